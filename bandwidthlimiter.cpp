@@ -0,0 +1,299 @@
+// bandwidthlimiter.cpp
+#include "bandwidthlimiter.h"
+#include <QDateTime>
+
+// Hur ofta väntande strömmar väcks; grovt, så att begränsningen inte
+// kostar något per paket
+const int TICK_INTERVAL_MS = 100;
+// Hur ofta schemat kontrolleras
+const int SCHEDULE_INTERVAL_MS = 60 * 1000;
+// Minsta hinkstorlek, så att låga gränser ändå släpper fram hela block
+const qint64 MIN_BUCKET_CAPACITY = 16 * 1024;
+
+const qint64 NSECS_PER_SEC = 1000000000;
+
+BandwidthLimiter::BandwidthLimiter(QObject *parent)
+    : QObject(parent)
+    , m_globalLimit(0)
+    , m_hostLimit(0)
+    , m_transferLimit(0)
+    , m_scheduledLimit(-1)
+    , m_nextStream(0)
+    , m_waiting(false)
+{
+    m_tickTimer.setInterval(TICK_INTERVAL_MS);
+    m_tickTimer.setTimerType(Qt::CoarseTimer);
+    connect(&m_tickTimer, &QTimer::timeout, this, &BandwidthLimiter::onTick);
+
+    m_scheduleTimer.setInterval(SCHEDULE_INTERVAL_MS);
+    m_scheduleTimer.setTimerType(Qt::VeryCoarseTimer);
+    connect(&m_scheduleTimer, &QTimer::timeout, this, &BandwidthLimiter::applySchedule);
+
+    m_lastRefill.start();
+}
+
+void BandwidthLimiter::setGlobalLimit(qint64 bytesPerSecond)
+{
+    m_globalLimit = qMax<qint64>(0, bytesPerSecond);
+    emit limitsChanged();
+    emit tokensAvailable();
+}
+
+qint64 BandwidthLimiter::globalLimit() const
+{
+    return m_globalLimit;
+}
+
+void BandwidthLimiter::setHostLimit(qint64 bytesPerSecond)
+{
+    m_hostLimit = qMax<qint64>(0, bytesPerSecond);
+    emit limitsChanged();
+    emit tokensAvailable();
+}
+
+qint64 BandwidthLimiter::hostLimit() const
+{
+    return m_hostLimit;
+}
+
+void BandwidthLimiter::setHostLimit(const QString &host, qint64 bytesPerSecond)
+{
+    if (bytesPerSecond < 0) {
+        m_hostOverrides.remove(host);
+    } else {
+        m_hostOverrides.insert(host, bytesPerSecond);
+    }
+    emit limitsChanged();
+    emit tokensAvailable();
+}
+
+void BandwidthLimiter::setTransferLimit(qint64 bytesPerSecond)
+{
+    m_transferLimit = qMax<qint64>(0, bytesPerSecond);
+    emit limitsChanged();
+    emit tokensAvailable();
+}
+
+qint64 BandwidthLimiter::transferLimit() const
+{
+    return m_transferLimit;
+}
+
+void BandwidthLimiter::setSchedule(const QList<ScheduleRule> &rules)
+{
+    m_schedule = rules;
+    if (rules.isEmpty()) {
+        m_scheduleTimer.stop();
+    } else {
+        m_scheduleTimer.start();
+    }
+    m_scheduledLimit = -2; // Tvinga fram en ny utvärdering
+    applySchedule();
+}
+
+QList<BandwidthLimiter::ScheduleRule> BandwidthLimiter::schedule() const
+{
+    return m_schedule;
+}
+
+qint64 BandwidthLimiter::effectiveGlobalLimit() const
+{
+    return m_scheduledLimit >= 0 ? m_scheduledLimit : m_globalLimit;
+}
+
+int BandwidthLimiter::openStream(const QString &host)
+{
+    Stream stream;
+    stream.host = host;
+    const int id = ++m_nextStream;
+    m_streams.insert(id, stream);
+    if (!m_hosts.contains(host)) {
+        m_hosts.insert(host, Bucket());
+    }
+    return id;
+}
+
+void BandwidthLimiter::closeStream(int stream)
+{
+    m_streams.remove(stream);
+}
+
+qint64 BandwidthLimiter::acquire(int stream, qint64 wanted)
+{
+    auto it = m_streams.find(stream);
+    if (it == m_streams.end() || wanted <= 0 || !isLimited()) {
+        return wanted;
+    }
+
+    refill();
+
+    Bucket &host = m_hosts[it->host];
+    const bool globalLimited = effectiveGlobalLimit() > 0;
+    const bool hostLimited = limitForHost(it->host) > 0;
+    const bool transferLimited = m_transferLimit > 0;
+
+    qint64 allowed = wanted;
+    if (globalLimited) {
+        allowed = qMin(allowed, m_global.tokens);
+    }
+    if (hostLimited) {
+        allowed = qMin(allowed, host.tokens);
+    }
+    if (transferLimited) {
+        allowed = qMin(allowed, it->bucket.tokens);
+    }
+
+    if (allowed <= 0) {
+        m_waiting = true;
+        if (!m_tickTimer.isActive()) {
+            m_tickTimer.start();
+        }
+        return 0;
+    }
+
+    if (globalLimited) {
+        m_global.tokens -= allowed;
+    }
+    if (hostLimited) {
+        host.tokens -= allowed;
+    }
+    if (transferLimited) {
+        it->bucket.tokens -= allowed;
+    }
+    return allowed;
+}
+
+void BandwidthLimiter::release(int stream, qint64 bytes)
+{
+    consume(stream, -bytes);
+}
+
+void BandwidthLimiter::consume(int stream, qint64 bytes)
+{
+    auto it = m_streams.find(stream);
+    if (it == m_streams.end() || bytes == 0 || !isLimited()) {
+        return;
+    }
+
+    refill();
+    if (effectiveGlobalLimit() > 0) {
+        m_global.tokens -= bytes;
+    }
+    if (limitForHost(it->host) > 0) {
+        m_hosts[it->host].tokens -= bytes;
+    }
+    if (m_transferLimit > 0) {
+        it->bucket.tokens -= bytes;
+    }
+}
+
+bool BandwidthLimiter::isOverBudget(int stream)
+{
+    auto it = m_streams.find(stream);
+    if (it == m_streams.end() || !isLimited()) {
+        return false;
+    }
+
+    refill();
+    const bool over = (effectiveGlobalLimit() > 0 && m_global.tokens <= 0)
+                      || (limitForHost(it->host) > 0 && m_hosts.value(it->host).tokens <= 0);
+    if (over) {
+        m_waiting = true;
+        if (!m_tickTimer.isActive()) {
+            m_tickTimer.start();
+        }
+    }
+    return over;
+}
+
+bool BandwidthLimiter::isLimited() const
+{
+    if (effectiveGlobalLimit() > 0 || m_hostLimit > 0 || m_transferLimit > 0) {
+        return true;
+    }
+    for (qint64 limit : m_hostOverrides) {
+        if (limit > 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void BandwidthLimiter::refill()
+{
+    // Mer än en sekund behövs aldrig, hinkarna är mindre än så
+    const qint64 elapsed = qMin(m_lastRefill.nsecsElapsed(), NSECS_PER_SEC);
+    m_lastRefill.restart();
+    if (elapsed <= 0) {
+        return;
+    }
+
+    refillBucket(m_global, effectiveGlobalLimit(), elapsed);
+    for (auto it = m_hosts.begin(); it != m_hosts.end(); ++it) {
+        refillBucket(it.value(), limitForHost(it.key()), elapsed);
+    }
+    for (auto it = m_streams.begin(); it != m_streams.end(); ++it) {
+        refillBucket(it->bucket, m_transferLimit, elapsed);
+    }
+}
+
+void BandwidthLimiter::refillBucket(Bucket &bucket, qint64 rate, qint64 elapsedNs)
+{
+    if (rate <= 0) {
+        bucket.tokens = 0;
+        bucket.remainder = 0;
+        return;
+    }
+
+    // Resten under en byte sparas, så att täta anrop inte tappar takt
+    const qint64 scaled = rate * elapsedNs + bucket.remainder;
+    bucket.tokens = qMin(capacity(rate), bucket.tokens + scaled / NSECS_PER_SEC);
+    bucket.remainder = scaled % NSECS_PER_SEC;
+}
+
+qint64 BandwidthLimiter::capacity(qint64 rate)
+{
+    return qMax(MIN_BUCKET_CAPACITY, rate * 2 * TICK_INTERVAL_MS / 1000);
+}
+
+qint64 BandwidthLimiter::limitForHost(const QString &host) const
+{
+    return m_hostOverrides.value(host, m_hostLimit);
+}
+
+void BandwidthLimiter::applySchedule()
+{
+    const QDateTime now = QDateTime::currentDateTime();
+    const QTime time = now.time();
+    const int day = 1 << (now.date().dayOfWeek() - 1);
+
+    qint64 limit = -1;
+    for (const ScheduleRule &rule : qAsConst(m_schedule)) {
+        if (!(rule.days & day) || !rule.start.isValid() || !rule.end.isValid()) {
+            continue;
+        }
+        const bool inside = rule.start <= rule.end
+            ? (time >= rule.start && time < rule.end)
+            : (time >= rule.start || time < rule.end);
+        if (inside) {
+            limit = rule.bytesPerSecond;
+            break;
+        }
+    }
+
+    if (limit != m_scheduledLimit) {
+        m_scheduledLimit = limit;
+        emit limitsChanged();
+        emit tokensAvailable();
+    }
+}
+
+void BandwidthLimiter::onTick()
+{
+    refill();
+    m_tickTimer.stop();
+    if (m_waiting) {
+        m_waiting = false;
+        emit tokensAvailable();
+    }
+}
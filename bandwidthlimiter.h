@@ -0,0 +1,156 @@
+// bandwidthlimiter.h
+#ifndef BANDWIDTHLIMITER_H
+#define BANDWIDTHLIMITER_H
+
+#include <QObject>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QList>
+#include <QString>
+#include <QTime>
+#include <QTimer>
+
+/**
+ * @brief Begränsar bandbredden med tokenhinkar på tre nivåer
+ *
+ * Varje överföringsström har en egen hink, varje värd en och hela
+ * programmet en. En ström får skicka eller läsa så många byte som finns i
+ * alla tre hinkarna; är någon tom får den vänta på tokensAvailable().
+ *
+ * Hinkarna fylls på i efterhand utifrån hur lång tid som gått, så ingen
+ * timer behövs medan det finns utrymme. En grov timer går bara medan
+ * någon ström väntar. En hink rymmer som mest två timerintervall av sin
+ * takt, så en ström som står still sparar inte ihop budget som sedan går
+ * ut i en skur.
+ *
+ * Den globala gränsen kan ersättas av ett schema, t.ex. en lägre gräns
+ * under kontorstid.
+ */
+class BandwidthLimiter : public QObject
+{
+    Q_OBJECT
+
+public:
+    // Dagar för ScheduleRule::days
+    enum {
+        Weekdays = 0x1f,
+        AllDays = 0x7f
+    };
+
+    // En regel i schemat; gäller från start till slut (slut före start
+    // betyder över midnatt) de dagar som är satta i days
+    struct ScheduleRule {
+        int days = AllDays;         // Bit (1 << (Qt::DayOfWeek - 1)) per dag
+        QTime start;
+        QTime end;
+        qint64 bytesPerSecond = 0;  // 0 = obegränsat
+    };
+
+    explicit BandwidthLimiter(QObject *parent = nullptr);
+
+    // Gränser i byte per sekund; 0 betyder obegränsat
+    void setGlobalLimit(qint64 bytesPerSecond);
+    qint64 globalLimit() const;
+    void setHostLimit(qint64 bytesPerSecond);
+    qint64 hostLimit() const;
+    void setTransferLimit(qint64 bytesPerSecond);
+    qint64 transferLimit() const;
+
+    /**
+     * @brief Gräns för en enskild värd i stället för setHostLimit()
+     * @param bytesPerSecond Gränsen, eller -1 för att ta bort undantaget
+     */
+    void setHostLimit(const QString &host, qint64 bytesPerSecond);
+
+    /**
+     * @brief Ersätt schemat; den första regeln som gäller just nu används
+     *
+     * Utanför alla regler gäller setGlobalLimit().
+     */
+    void setSchedule(const QList<ScheduleRule> &rules);
+    QList<ScheduleRule> schedule() const;
+
+    /**
+     * @brief Den globala gräns som gäller just nu, med schemat inräknat
+     */
+    qint64 effectiveGlobalLimit() const;
+
+    /**
+     * @brief Registrera en överföringsström
+     * @param host Värden strömmen går till
+     * @return Id för acquire(), consume() och closeStream()
+     */
+    int openStream(const QString &host);
+    void closeStream(int stream);
+
+    /**
+     * @brief Ta så många byte som får skickas nu, högst wanted
+     * @return 0 om strömmen ska vänta på tokensAvailable()
+     */
+    qint64 acquire(int stream, qint64 wanted);
+
+    /**
+     * @brief Lämna tillbaka byte som togs med acquire() men inte användes
+     */
+    void release(int stream, qint64 bytes);
+
+    /**
+     * @brief Dra byte som redan har skickats; hinkarna kan hamna på minus
+     *
+     * För överföringar som inte går att hålla igen byte för byte, se
+     * SftpManager. Skulden betalas av innan något nytt släpps fram.
+     */
+    void consume(int stream, qint64 bytes);
+
+    /**
+     * @brief Om värdens eller den globala hinken är tom
+     */
+    bool isOverBudget(int stream);
+
+    bool isLimited() const;
+
+signals:
+    /**
+     * @brief Hinkarna har fyllts på; väntande strömmar kan försöka igen
+     */
+    void tokensAvailable();
+
+    void limitsChanged();
+
+private:
+    struct Bucket {
+        qint64 tokens = 0;      // Kan bli negativt efter consume()
+        qint64 remainder = 0;   // Påfyllning under en byte, i byte * ns / s
+    };
+
+    struct Stream {
+        QString host;
+        Bucket bucket;
+    };
+
+    void refill();
+    static void refillBucket(Bucket &bucket, qint64 rate, qint64 elapsedNs);
+    static qint64 capacity(qint64 rate);
+    qint64 limitForHost(const QString &host) const;
+    void applySchedule();
+    void onTick();
+
+    qint64 m_globalLimit;
+    qint64 m_hostLimit;
+    qint64 m_transferLimit;
+    QHash<QString, qint64> m_hostOverrides;
+    QList<ScheduleRule> m_schedule;
+    qint64 m_scheduledLimit;    // Gränsen från schemat, -1 om ingen regel gäller
+
+    Bucket m_global;
+    QHash<QString, Bucket> m_hosts;
+    QHash<int, Stream> m_streams;
+    int m_nextStream;
+    bool m_waiting;             // Någon ström fick 0 och väntar på påfyllning
+
+    QElapsedTimer m_lastRefill;
+    QTimer m_tickTimer;
+    QTimer m_scheduleTimer;
+};
+
+#endif // BANDWIDTHLIMITER_H
@@ -0,0 +1,233 @@
+// bench_filemodel.cpp
+#include "filemodel.h"
+
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QQuickItem>
+#include <QQuickView>
+#include <QSignalSpy>
+#include <QTemporaryDir>
+#include <QtTest>
+
+namespace {
+
+const int ROW_COUNT = 100000;
+const int DIRECTORY_ROW_COUNT = 20000;
+const int LISTING_TIMEOUT_MS = 120000;
+const int FRAME_TIMEOUT_MS = 5000;
+
+// Samma blockstorlek som en fjärrlistning levererar
+const int CHUNK_SIZE = 1000;
+
+// Hopp genom listan; varje hopp skapar en ny skärmfull delegater
+const int SCROLL_JUMPS = 200;
+
+// Enkel delegat med samma roller som FileListView.qml, utan tema och menyer
+const char LIST_VIEW_QML[] =
+    "import QtQuick 2.15\n"
+    "ListView {\n"
+    "    id: list\n"
+    "    clip: true\n"
+    "    delegate: Row {\n"
+    "        width: list.width\n"
+    "        height: 24\n"
+    "        spacing: 8\n"
+    "        Text { width: list.width / 2; elide: Text.ElideRight; text: model.fileName }\n"
+    "        Text { width: 100; text: model.isDirectory ? \"\" : model.fileSize }\n"
+    "        Text { text: model.fileDate }\n"
+    "    }\n"
+    "}\n";
+
+QVector<FileInfo> generateEntries(int count)
+{
+    QVector<FileInfo> entries;
+    entries.reserve(count);
+    const QDateTime modified = QDateTime::currentDateTime();
+    for (int i = 0; i < count; ++i) {
+        FileInfo info;
+        info.isDirectory = i % 10 == 0;
+        info.fileName = (info.isDirectory ? QStringLiteral("katalog_%1") : QStringLiteral("fil_%1.dat")).arg(i);
+        info.filePath = QStringLiteral("/bench/") + info.fileName;
+        info.fileSize = info.isDirectory ? 0 : qint64(i) * 7919 % 100000000;
+        info.fileDate = modified;
+        entries.append(info);
+    }
+    return entries;
+}
+
+// Väntar tills vyn har ritat en bildruta, så att delegaterna verkligen skapats
+bool waitForFrame(QQuickView *view)
+{
+    QSignalSpy swapped(view, &QQuickWindow::frameSwapped);
+    view->update();
+    return swapped.wait(FRAME_TIMEOUT_MS);
+}
+
+// QBENCHMARK mäter tiden per varv; rader/s skrivs ut separat för jämförelser
+void reportRate(const char *what, int rows, qint64 nanoseconds)
+{
+    qInfo("%s: %d rader på %.2f ms, %.0f rader/s", what, rows, nanoseconds / 1e6,
+          rows * 1e9 / qMax<qint64>(1, nanoseconds));
+}
+
+} // namespace
+
+class BenchFileModel : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void appendEntries();
+    void listDirectory();
+    void listViewAppend();
+    void listViewScroll();
+
+private:
+    bool createView(QQuickView *view);
+
+    QVector<FileInfo> m_entries;
+    QTemporaryDir m_directory;
+    QTemporaryDir m_qmlDirectory;
+};
+
+void BenchFileModel::initTestCase()
+{
+    m_entries = generateEntries(ROW_COUNT);
+
+    QVERIFY(m_directory.isValid());
+    const QDir dir(m_directory.path());
+    for (int i = 0; i < DIRECTORY_ROW_COUNT; ++i) {
+        if (i % 10 == 0) {
+            QVERIFY(dir.mkdir(QStringLiteral("katalog_%1").arg(i)));
+        } else {
+            QFile file(dir.filePath(QStringLiteral("fil_%1.dat").arg(i)));
+            QVERIFY(file.open(QIODevice::WriteOnly));
+        }
+    }
+}
+
+void BenchFileModel::appendEntries()
+{
+    qint64 best = -1;
+    QBENCHMARK {
+        FileModel model(true);
+        QElapsedTimer timer;
+        timer.start();
+        for (int i = 0; i < m_entries.size(); i += CHUNK_SIZE) {
+            model.appendEntries(m_entries.mid(i, CHUNK_SIZE));
+        }
+        const qint64 elapsed = timer.nsecsElapsed();
+        best = best < 0 ? elapsed : qMin(best, elapsed);
+        QCOMPARE(model.rowCount(), ROW_COUNT);
+    }
+    reportRate("appendEntries", ROW_COUNT, best);
+}
+
+void BenchFileModel::listDirectory()
+{
+    // Utan cache listas katalogen från disken varje varv, inklusive
+    // insättningen en del per bildruta
+    FileModel model;
+    model.setCacheSize(0);
+
+    qint64 best = -1;
+    QBENCHMARK {
+        QSignalSpy loading(&model, &FileModel::loadingChanged);
+        QElapsedTimer timer;
+        timer.start();
+        model.navigate(m_directory.path());
+        while (model.isLoading()) {
+            QVERIFY(loading.wait(LISTING_TIMEOUT_MS));
+        }
+        const qint64 elapsed = timer.nsecsElapsed();
+        best = best < 0 ? elapsed : qMin(best, elapsed);
+    }
+    // ".." kommer till eftersom den tillfälliga katalogen inte är roten
+    QCOMPARE(model.rowCount(), DIRECTORY_ROW_COUNT + 1);
+    reportRate("Listning", DIRECTORY_ROW_COUNT, best);
+}
+
+bool BenchFileModel::createView(QQuickView *view)
+{
+    const QString path = m_qmlDirectory.filePath(QStringLiteral("BenchListView.qml"));
+    QFile file(path);
+    if (!m_qmlDirectory.isValid() || !file.open(QIODevice::WriteOnly)
+        || file.write(LIST_VIEW_QML) != qint64(sizeof(LIST_VIEW_QML) - 1)) {
+        return false;
+    }
+    file.close();
+
+    view->setResizeMode(QQuickView::SizeRootObjectToView);
+    view->resize(800, 600);
+    view->setSource(QUrl::fromLocalFile(path));
+    if (view->status() != QQuickView::Ready) {
+        return false;
+    }
+    view->show();
+    return QTest::qWaitForWindowExposed(view);
+}
+
+void BenchFileModel::listViewAppend()
+{
+    // Vyn ritar en bildruta per block, som när en fjärrlistning tas emot;
+    // tiden inkluderar därför väntan på skärmens uppdatering
+    QQuickView view;
+    if (!createView(&view)) {
+        QSKIP("Ingen Qt Quick-vy kunde visas");
+    }
+
+    qint64 best = -1;
+    QBENCHMARK {
+        FileModel model(true);
+        view.rootObject()->setProperty("model", QVariant::fromValue<QObject *>(&model));
+        QElapsedTimer timer;
+        timer.start();
+        for (int i = 0; i < m_entries.size(); i += CHUNK_SIZE) {
+            model.appendEntries(m_entries.mid(i, CHUNK_SIZE));
+            QVERIFY(waitForFrame(&view));
+        }
+        const qint64 elapsed = timer.nsecsElapsed();
+        best = best < 0 ? elapsed : qMin(best, elapsed);
+        QCOMPARE(view.rootObject()->property("count").toInt(), ROW_COUNT);
+        view.rootObject()->setProperty("model", QVariant());
+    }
+    reportRate("ListView, appendEntries", ROW_COUNT, best);
+}
+
+void BenchFileModel::listViewScroll()
+{
+    QQuickView view;
+    if (!createView(&view)) {
+        QSKIP("Ingen Qt Quick-vy kunde visas");
+    }
+    FileModel model(true);
+    for (int i = 0; i < m_entries.size(); i += CHUNK_SIZE) {
+        model.appendEntries(m_entries.mid(i, CHUNK_SIZE));
+    }
+    QObject *list = view.rootObject();
+    list->setProperty("model", QVariant::fromValue<QObject *>(&model));
+    QVERIFY(waitForFrame(&view));
+
+    // Hoppen sprids över hela listan så att inga delegater kan återanvändas
+    const int step = ROW_COUNT / SCROLL_JUMPS;
+    qint64 best = -1;
+    QBENCHMARK {
+        QElapsedTimer timer;
+        timer.start();
+        for (int i = 0; i < SCROLL_JUMPS; ++i) {
+            QMetaObject::invokeMethod(list, "positionViewAtIndex", Q_ARG(int, i * step),
+                                      Q_ARG(int, 1)); // ListView.Beginning
+            QVERIFY(waitForFrame(&view));
+        }
+        const qint64 elapsed = timer.nsecsElapsed();
+        best = best < 0 ? elapsed : qMin(best, elapsed);
+    }
+    const int visibleRows = view.height() / 24;
+    reportRate("ListView, rader som ritats vid hopp", SCROLL_JUMPS * visibleRows, best);
+}
+
+QTEST_MAIN(BenchFileModel)
+
+#include "bench_filemodel.moc"
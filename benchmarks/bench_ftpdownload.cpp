@@ -0,0 +1,285 @@
+// bench_ftpdownload.cpp
+#include "ftpmanager.h"
+
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QHostAddress>
+#include <QSignalSpy>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QTemporaryDir>
+#include <QTimer>
+#include <QtTest>
+
+namespace {
+
+const qint64 FILE_SIZE = 32 * 1024 * 1024;
+const QString REMOTE_PATH = QStringLiteral("/bench.dat");
+
+// Takt för en begränsad dataanslutning, som en enda TCP-ström över en
+// länk med lång rundresa; på loopback finns ingen sådan gräns annars
+const qint64 STREAM_RATE = 16 * 1024 * 1024;
+const int PACER_INTERVAL_MS = 5;
+
+const qint64 SEND_CHUNK_SIZE = 64 * 1024;
+const qint64 SEND_BUFFER_SIZE = 1024 * 1024;
+const int DOWNLOAD_TIMEOUT_MS = 120000;
+
+/**
+ * En session mot LoopbackFtpServer; kan precis det FtpClient skickar för
+ * inloggning, listning och nedladdning med REST.
+ */
+class LoopbackFtpSession : public QObject
+{
+public:
+    LoopbackFtpSession(QTcpSocket *control, const QByteArray &file, qint64 streamRate, QObject *parent)
+        : QObject(parent)
+        , m_control(control)
+        , m_file(file)
+        , m_streamRate(streamRate)
+    {
+        m_control->setParent(this);
+        m_pacer.setInterval(PACER_INTERVAL_MS);
+        m_pacer.setTimerType(Qt::PreciseTimer);
+        connect(&m_pacer, &QTimer::timeout, this, [this]() { pump(); });
+        connect(m_control, &QTcpSocket::readyRead, this, [this]() { onCommand(); });
+        connect(m_control, &QTcpSocket::disconnected, this, &QObject::deleteLater);
+        reply("220 DarkFTP bench");
+    }
+
+private:
+    enum Pending { None, Listing, File };
+
+    void reply(const QByteArray &line)
+    {
+        m_control->write(line + "\r\n");
+    }
+
+    void onCommand()
+    {
+        while (m_control->canReadLine()) {
+            const QByteArray line = m_control->readLine().trimmed();
+            const int space = line.indexOf(' ');
+            const QByteArray verb = (space < 0 ? line : line.left(space)).toUpper();
+            const QByteArray argument = space < 0 ? QByteArray() : line.mid(space + 1);
+
+            if (verb == "USER") {
+                reply("331 Lösenord krävs");
+            } else if (verb == "PASS") {
+                reply("230 Inloggad");
+            } else if (verb == "TYPE") {
+                reply("200 Binärt läge");
+            } else if (verb == "FEAT") {
+                reply("211-Features:\r\n SIZE\r\n REST STREAM\r\n211 End");
+            } else if (verb == "EPSV" || verb == "PASV") {
+                openPassive(verb == "EPSV");
+            } else if (verb == "SIZE") {
+                reply(argument == REMOTE_PATH.toUtf8() ? "213 " + QByteArray::number(m_file.size())
+                                                       : QByteArray("550 Filen finns inte"));
+            } else if (verb == "REST") {
+                m_offset = argument.toLongLong();
+                reply("350 Fortsätter från " + argument);
+            } else if (verb == "RETR" || verb == "LIST" || verb == "NLST") {
+                m_pending = verb == "RETR" ? File : Listing;
+                reply("150 Öppnar dataanslutning");
+                startData();
+            } else if (verb == "QUIT") {
+                reply("221 Hej då");
+                m_control->disconnectFromHost();
+            } else {
+                reply("502 Stöds inte");
+            }
+        }
+    }
+
+    void openPassive(bool extended)
+    {
+        delete m_passive;
+        m_passive = new QTcpServer(this);
+        m_passive->listen(QHostAddress::LocalHost, 0);
+        connect(m_passive, &QTcpServer::newConnection, this, [this]() {
+            m_data = m_passive->nextPendingConnection();
+            m_data->setParent(this);
+            m_passive->close();
+            connect(m_data, &QTcpSocket::bytesWritten, this, [this]() { pump(); });
+            connect(m_data, &QTcpSocket::disconnected, this, [this]() { onDataClosed(); });
+            startData();
+        });
+
+        const quint16 port = m_passive->serverPort();
+        if (extended) {
+            reply("229 Entering Extended Passive Mode (|||" + QByteArray::number(port) + "|)");
+        } else {
+            reply("227 Entering Passive Mode (127,0,0,1," + QByteArray::number(port / 256) + ','
+                  + QByteArray::number(port % 256) + ')');
+        }
+    }
+
+    // Börjar när både kommandot och dataanslutningen har kommit
+    void startData()
+    {
+        if (!m_data || m_pending == None) {
+            return;
+        }
+        if (m_pending == Listing) {
+            m_data->disconnectFromHost();
+            return;
+        }
+
+        m_position = qBound<qint64>(0, m_offset, m_file.size());
+        m_offset = 0;
+        m_sent = 0;
+        m_clock.start();
+        if (m_streamRate > 0) {
+            m_pacer.start();
+        }
+        pump();
+    }
+
+    void pump()
+    {
+        if (!m_data || m_pending != File) {
+            return;
+        }
+
+        while (m_position < m_file.size() && m_data->bytesToWrite() < SEND_BUFFER_SIZE) {
+            qint64 chunk = qMin(SEND_CHUNK_SIZE, m_file.size() - m_position);
+            if (m_streamRate > 0) {
+                chunk = qMin(chunk, m_streamRate * m_clock.nsecsElapsed() / 1000000000 - m_sent);
+                if (chunk <= 0) {
+                    return;
+                }
+            }
+            m_data->write(m_file.constData() + m_position, chunk);
+            m_position += chunk;
+            m_sent += chunk;
+        }
+
+        if (m_position >= m_file.size() && m_data->bytesToWrite() == 0) {
+            m_pacer.stop();
+            m_data->disconnectFromHost();
+        }
+    }
+
+    // En begränsad RETR stängs av klienten innan filen är slut
+    void onDataClosed()
+    {
+        m_pacer.stop();
+        m_pending = None;
+        m_data->deleteLater();
+        m_data = nullptr;
+        if (m_control->state() == QAbstractSocket::ConnectedState) {
+            reply("226 Överföringen klar");
+        }
+    }
+
+    QTcpSocket *m_control;
+    QTcpServer *m_passive = nullptr;
+    QTcpSocket *m_data = nullptr;
+    const QByteArray m_file;
+    const qint64 m_streamRate;
+    Pending m_pending = None;
+    qint64 m_offset = 0;
+    qint64 m_position = 0;
+    qint64 m_sent = 0;
+    QElapsedTimer m_clock;
+    QTimer m_pacer;
+};
+
+// QBENCHMARK mäter tiden per varv; MiB/s skrivs ut separat för jämförelser
+void reportRate(const char *what, qint64 bytes, qint64 nanoseconds)
+{
+    qInfo("%s: %.0f MiB på %.2f ms, %.1f MiB/s", what, bytes / 1048576.0, nanoseconds / 1e6,
+          bytes / 1048576.0 * 1e9 / qMax<qint64>(1, nanoseconds));
+}
+
+} // namespace
+
+/**
+ * Jämför segmenterad nedladdning med en enda ström mot en FTP-server på
+ * loopback. Med en takt per anslutning syns vinsten av parallella delar;
+ * utan den mäts vad det kostar att hämta och skriva delarna på plats.
+ * Servern körs i samma tråd som klienten.
+ */
+class BenchFtpDownload : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void download_data();
+    void download();
+
+private:
+    QByteArray m_file;
+    QTcpServer m_server;
+    qint64 m_streamRate = 0;
+    QTemporaryDir m_directory;
+};
+
+void BenchFtpDownload::initTestCase()
+{
+    m_file.resize(FILE_SIZE);
+    for (qint64 i = 0; i < FILE_SIZE; ++i) {
+        m_file[int(i)] = char(i * 7919 >> 8);
+    }
+
+    QVERIFY(m_directory.isValid());
+    QVERIFY(m_server.listen(QHostAddress::LocalHost, 0));
+    connect(&m_server, &QTcpServer::newConnection, this, [this]() {
+        while (QTcpSocket *socket = m_server.nextPendingConnection()) {
+            new LoopbackFtpSession(socket, m_file, m_streamRate, this);
+        }
+    });
+}
+
+void BenchFtpDownload::download_data()
+{
+    QTest::addColumn<int>("segments");
+    QTest::addColumn<qint64>("streamRate");
+
+    QTest::newRow("1 ström, 16 MiB/s per anslutning") << 1 << STREAM_RATE;
+    QTest::newRow("4 delar, 16 MiB/s per anslutning") << 4 << STREAM_RATE;
+    QTest::newRow("1 ström, obegränsad") << 1 << qint64(0);
+    QTest::newRow("4 delar, obegränsad") << 4 << qint64(0);
+}
+
+void BenchFtpDownload::download()
+{
+    QFETCH(int, segments);
+    QFETCH(qint64, streamRate);
+    m_streamRate = streamRate;
+
+    FtpManager manager;
+    manager.setResumeEnabled(false);
+    manager.setChecksumVerification(false);
+    manager.setSegmentedDownload(segments, 1);
+
+    QSignalSpy connected(&manager, &FtpManager::connected);
+    manager.connectToHost(QStringLiteral("127.0.0.1"), QStringLiteral("bench"), QStringLiteral("bench"),
+                          m_server.serverPort());
+    QVERIFY(connected.wait(DOWNLOAD_TIMEOUT_MS));
+
+    const QString localPath = m_directory.filePath(QStringLiteral("bench.dat"));
+    qint64 best = -1;
+    QBENCHMARK {
+        QFile::remove(localPath);
+        QSignalSpy finished(&manager, &FtpManager::downloadFinished);
+        QSignalSpy failed(&manager, &FtpManager::transferFailed);
+
+        QElapsedTimer timer;
+        timer.start();
+        manager.downloadFile(REMOTE_PATH, localPath);
+        QTRY_VERIFY_WITH_TIMEOUT(finished.count() + failed.count() > 0, DOWNLOAD_TIMEOUT_MS);
+        const qint64 elapsed = timer.nsecsElapsed();
+        best = best < 0 ? elapsed : qMin(best, elapsed);
+        QCOMPARE(failed.count(), 0);
+    }
+    QCOMPARE(QFileInfo(localPath).size(), FILE_SIZE);
+    reportRate(QTest::currentDataTag(), FILE_SIZE, best);
+}
+
+QTEST_GUILESS_MAIN(BenchFtpDownload)
+
+#include "bench_ftpdownload.moc"
@@ -0,0 +1,227 @@
+// bench_ftplistparser.cpp
+#include "ftplistparser.h"
+
+#include <QElapsedTimer>
+#include <QRegularExpression>
+#include <QtTest>
+
+namespace {
+
+const int ENTRY_COUNT = 100000;
+
+// En listning i samma form som vsftpd/ProFTPD skickar, var tionde post en katalog
+QByteArray generateList(int count)
+{
+    static const char *const months[] = {
+        "Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"
+    };
+
+    QByteArray data;
+    data.reserve(count * 64);
+    for (int i = 0; i < count; ++i) {
+        const bool directory = i % 10 == 0;
+        data += directory ? "drwxr-xr-x    2 owner    group        4096 " : "-rw-r--r--    1 owner    group    ";
+        if (!directory) {
+            data += QByteArray::number(qint64(i) * 7919 % 100000000).rightJustified(8, ' ');
+            data += ' ';
+        }
+        data += months[i % 12];
+        data += ' ';
+        data += QByteArray::number(i % 28 + 1).rightJustified(2, ' ');
+        data += i % 3 == 0 ? "  2023 " : " 12:34 ";
+        data += directory ? "katalog_" : "fil_";
+        data += QByteArray::number(i);
+        data += directory ? "" : ".dat";
+        data += "\r\n";
+    }
+    return data;
+}
+
+QByteArray generateMlsd(int count)
+{
+    QByteArray data;
+    data.reserve(count * 80);
+    for (int i = 0; i < count; ++i) {
+        const bool directory = i % 10 == 0;
+        data += directory ? "type=dir;" : "type=file;size=";
+        if (!directory) {
+            data += QByteArray::number(qint64(i) * 7919 % 100000000);
+            data += ';';
+        }
+        data += "modify=2024";
+        data += QByteArray::number(i % 12 + 1).rightJustified(2, '0');
+        data += QByteArray::number(i % 28 + 1).rightJustified(2, '0');
+        data += "123456;perm=adfrw;unique=801U";
+        data += QByteArray::number(i, 16);
+        data += "; ";
+        data += directory ? "katalog_" : "fil_";
+        data += QByteArray::number(i);
+        data += directory ? "" : ".dat";
+        data += "\r\n";
+    }
+    return data;
+}
+
+// Tolkningen som FtpManager::parseDirectoryListing() gjorde före
+// FtpListParser, oförändrad så att jämförelsen går att göra om
+QList<ServerFileItem> parseListWithRegex(const QByteArray &data)
+{
+    QList<ServerFileItem> items;
+
+    QString listing = QString::fromUtf8(data);
+    QStringList lines = listing.split('\n', Qt::SkipEmptyParts);
+
+    for (const QString &line : lines) {
+        if (line.startsWith("total ") || line.trimmed().isEmpty()) {
+            continue;
+        }
+
+        QRegularExpression re("^([\\-dbclps])([rwxsStT\\-]{9})\\s+"
+                             "(?:\\d+\\s+)?"
+                             "(?:[^\\s]+\\s+)?"
+                             "(?:[^\\s]+\\s+)?"
+                             "(\\d+)\\s+"
+                             "(?:(\\w{3})\\s+(\\d{1,2})\\s+"
+                             "(?:(\\d{4})|([0-9:]{4,5}))\\s+|"
+                             "(\\d{4})-(\\d{2})-(\\d{2})\\s+"
+                             "(\\d{2}):(\\d{2})\\s+)"
+                             "(.+)$");
+
+        QRegularExpressionMatch match = re.match(line);
+
+        if (match.hasMatch()) {
+            QString permissions = match.captured(1) + match.captured(2);
+            bool isDirectory = (permissions.at(0) == 'd');
+            qint64 size = match.captured(3).toLongLong();
+
+            QDateTime lastModified;
+            if (!match.captured(8).isEmpty()) {
+                int year = match.captured(8).toInt();
+                int month = match.captured(9).toInt();
+                int day = match.captured(10).toInt();
+                int hour = match.captured(11).toInt();
+                int minute = match.captured(12).toInt();
+                lastModified = QDateTime(QDate(year, month, day), QTime(hour, minute));
+            } else {
+                QDate date;
+                QTime time;
+
+                QStringList months = {"Jan", "Feb", "Mar", "Apr", "May", "Jun",
+                                    "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
+                int month = months.indexOf(match.captured(4)) + 1;
+                int day = match.captured(5).toInt();
+
+                if (!match.captured(6).isEmpty()) {
+                    int year = match.captured(6).toInt();
+                    date = QDate(year, month, day);
+                    time = QTime(0, 0);
+                } else {
+                    QStringList timeParts = match.captured(7).split(':');
+                    int hour = timeParts.at(0).toInt();
+                    int minute = timeParts.at(1).toInt();
+
+                    int year = QDate::currentDate().year();
+                    date = QDate(year, month, day);
+                    time = QTime(hour, minute);
+
+                    if (QDateTime(date, time) > QDateTime::currentDateTime().addDays(1)) {
+                        date = QDate(year - 1, month, day);
+                    }
+                }
+
+                lastModified = QDateTime(date, time);
+            }
+
+            QString name = match.captured(13);
+
+            ServerFileItem item(name, isDirectory, size, permissions, lastModified);
+            items.append(item);
+        }
+    }
+
+    return items;
+}
+
+// QBENCHMARK mäter tiden per varv; poster/s skrivs ut separat för jämförelser
+void reportRate(const char *format, int entries, qint64 nanoseconds)
+{
+    qInfo("%s: %d poster på %.2f ms, %.0f poster/s", format, entries, nanoseconds / 1e6,
+          entries * 1e9 / qMax<qint64>(1, nanoseconds));
+}
+
+} // namespace
+
+class BenchFtpListParser : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void parseListBaseline();
+    void parseList();
+    void parseMlsd();
+
+private:
+    QByteArray m_list;
+    QByteArray m_mlsd;
+};
+
+void BenchFtpListParser::initTestCase()
+{
+    m_list = generateList(ENTRY_COUNT);
+    m_mlsd = generateMlsd(ENTRY_COUNT);
+}
+
+void BenchFtpListParser::parseListBaseline()
+{
+    QCOMPARE(parseListWithRegex(m_list).size(), ENTRY_COUNT);
+
+    qint64 best = -1;
+    QBENCHMARK {
+        QElapsedTimer timer;
+        timer.start();
+        const QList<ServerFileItem> items = parseListWithRegex(m_list);
+        const qint64 elapsed = timer.nsecsElapsed();
+        best = best < 0 ? elapsed : qMin(best, elapsed);
+        Q_UNUSED(items);
+    }
+    reportRate("LIST, regex före FtpListParser", ENTRY_COUNT, best);
+}
+
+void BenchFtpListParser::parseList()
+{
+    const FtpListParser parser;
+    QCOMPARE(parser.parse(m_list).size(), ENTRY_COUNT);
+
+    qint64 best = -1;
+    QBENCHMARK {
+        QElapsedTimer timer;
+        timer.start();
+        const QList<ServerFileItem> items = parser.parse(m_list);
+        const qint64 elapsed = timer.nsecsElapsed();
+        best = best < 0 ? elapsed : qMin(best, elapsed);
+        Q_UNUSED(items);
+    }
+    reportRate("LIST", ENTRY_COUNT, best);
+}
+
+void BenchFtpListParser::parseMlsd()
+{
+    const FtpListParser parser;
+    QCOMPARE(parser.parseMlsd(m_mlsd).size(), ENTRY_COUNT);
+
+    qint64 best = -1;
+    QBENCHMARK {
+        QElapsedTimer timer;
+        timer.start();
+        const QList<ServerFileItem> items = parser.parseMlsd(m_mlsd);
+        const qint64 elapsed = timer.nsecsElapsed();
+        best = best < 0 ? elapsed : qMin(best, elapsed);
+        Q_UNUSED(items);
+    }
+    reportRate("MLSD", ENTRY_COUNT, best);
+}
+
+QTEST_GUILESS_MAIN(BenchFtpListParser)
+
+#include "bench_ftplistparser.moc"
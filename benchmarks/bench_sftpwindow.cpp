@@ -0,0 +1,132 @@
+// bench_sftpwindow.cpp
+#include "sftpmanager.h"
+
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QSignalSpy>
+#include <QTemporaryDir>
+#include <QtTest>
+
+namespace {
+
+const int FILE_COUNT = 32;
+const qint64 FILE_SIZE = 8 * 1024 * 1024;
+const int TRANSFER_TIMEOUT_MS = 600000;
+
+// QBENCHMARK mäter tiden per varv; MiB/s skrivs ut separat för jämförelser
+void reportRate(const char *what, qint64 bytes, qint64 nanoseconds, int window, qint64 roundTripTime)
+{
+    qInfo("%s: %.0f MiB på %.2f ms, %.1f MiB/s (fönster %d, RTT %lld ms)", what,
+          bytes / 1048576.0, nanoseconds / 1e6, bytes / 1048576.0 * 1e9 / qMax<qint64>(1, nanoseconds),
+          window, roundTripTime);
+}
+
+} // namespace
+
+/**
+ * Genomströmning mot överföringsfönstret för SFTP-uppladdningar.
+ *
+ * Behöver en riktig SSH-server, som anges med DARKFTP_BENCH_SFTP_HOST,
+ * DARKFTP_BENCH_SFTP_PORT, DARKFTP_BENCH_SFTP_USER,
+ * DARKFTP_BENCH_SFTP_PASSWORD och DARKFTP_BENCH_SFTP_DIR (en katalog där
+ * testfilerna får skrivas över). Fönstret spelar roll först när länken har
+ * en rundresa; mot localhost kan den läggas på med t.ex.
+ * "tc qdisc add dev lo root netem delay 25ms".
+ */
+class BenchSftpWindow : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void upload_data();
+    void upload();
+
+private:
+    QString m_host;
+    quint16 m_port = 22;
+    QString m_user;
+    QString m_password;
+    QString m_remoteDirectory;
+    QTemporaryDir m_directory;
+    QStringList m_files;
+};
+
+void BenchSftpWindow::initTestCase()
+{
+    m_host = qEnvironmentVariable("DARKFTP_BENCH_SFTP_HOST");
+    if (m_host.isEmpty()) {
+        QSKIP("DARKFTP_BENCH_SFTP_HOST är inte satt");
+    }
+    m_port = quint16(qEnvironmentVariableIntValue("DARKFTP_BENCH_SFTP_PORT"));
+    if (m_port == 0) {
+        m_port = 22;
+    }
+    m_user = qEnvironmentVariable("DARKFTP_BENCH_SFTP_USER");
+    m_password = qEnvironmentVariable("DARKFTP_BENCH_SFTP_PASSWORD");
+    m_remoteDirectory = qEnvironmentVariable("DARKFTP_BENCH_SFTP_DIR", QStringLiteral("/tmp"));
+
+    QVERIFY(m_directory.isValid());
+    QByteArray data(int(FILE_SIZE), Qt::Uninitialized);
+    for (qint64 i = 0; i < FILE_SIZE; ++i) {
+        data[int(i)] = char(i * 7919 >> 8);
+    }
+    for (int i = 0; i < FILE_COUNT; ++i) {
+        const QString path = m_directory.filePath(QStringLiteral("fil_%1.dat").arg(i));
+        QFile file(path);
+        QVERIFY(file.open(QIODevice::WriteOnly));
+        QCOMPARE(file.write(data), FILE_SIZE);
+        m_files.append(path);
+    }
+}
+
+void BenchSftpWindow::upload_data()
+{
+    QTest::addColumn<int>("window");
+    QTest::addColumn<bool>("autoTune");
+
+    for (int window = 1; window <= 64; window *= 2) {
+        QTest::newRow(qPrintable(QStringLiteral("fönster %1").arg(window))) << window << false;
+    }
+    QTest::newRow("automatiskt, högst 64") << 64 << true;
+}
+
+void BenchSftpWindow::upload()
+{
+    QFETCH(int, window);
+    QFETCH(bool, autoTune);
+
+    SftpManager manager;
+    manager.setChecksumVerification(false);
+    manager.setDeltaSync(false);
+    manager.setTransferWindow(window);
+    manager.setAutoTuneWindow(autoTune);
+
+    QSignalSpy connected(&manager, &SftpManager::connected);
+    manager.connectToHost(m_host, m_user, m_password, m_port);
+    QVERIFY(connected.wait(TRANSFER_TIMEOUT_MS));
+
+    qint64 best = -1;
+    QBENCHMARK {
+        QSignalSpy finished(&manager, &SftpManager::uploadFinished);
+        QSignalSpy failed(&manager, &SftpManager::transferFailed);
+
+        QElapsedTimer timer;
+        timer.start();
+        for (const QString &path : qAsConst(m_files)) {
+            manager.uploadFile(path, m_remoteDirectory + QLatin1Char('/') + QFileInfo(path).fileName());
+        }
+        QTRY_VERIFY_WITH_TIMEOUT(finished.count() + failed.count() == FILE_COUNT, TRANSFER_TIMEOUT_MS);
+        const qint64 elapsed = timer.nsecsElapsed();
+        best = best < 0 ? elapsed : qMin(best, elapsed);
+        QCOMPARE(failed.count(), 0);
+    }
+    reportRate(QTest::currentDataTag(), FILE_COUNT * FILE_SIZE, best,
+               manager.transferWindow(), manager.roundTripTime());
+    manager.disconnectFromHost();
+}
+
+QTEST_GUILESS_MAIN(BenchSftpWindow)
+
+#include "bench_sftpwindow.moc"
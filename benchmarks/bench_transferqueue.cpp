@@ -0,0 +1,111 @@
+// bench_transferqueue.cpp
+#include "transferqueue.h"
+
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QTimer>
+#include <QtTest>
+
+namespace {
+
+const int FILE_COUNT = 500;
+const qint64 SMALL_FILE_SIZE = 4 * 1024;
+const qint64 LARGE_FILE_SIZE = 100 * 1024 * 1024;
+
+// En liten SFTP-fil kostar open, write och close; tre rundresor på 3-4 ms
+const int SMALL_FILE_LATENCY_MS = 10;
+
+// Stora filer blir inte klara medan de små mäts
+const int LARGE_FILE_LATENCY_MS = 60000;
+
+const QString HOST = QStringLiteral("sftp://bench@localhost:22");
+const QString LARGE_FILE_PREFIX = QStringLiteral("/bench/stor_");
+
+// QBENCHMARK mäter tiden per varv; filer/s skrivs ut separat för jämförelser
+void reportRate(const char *what, int files, qint64 nanoseconds)
+{
+    qInfo("%s: %d filer på %.2f ms, %.0f filer/s", what, files, nanoseconds / 1e6,
+          files * 1e9 / qMax<qint64>(1, nanoseconds));
+}
+
+} // namespace
+
+/**
+ * Kön styr hur många överföringar som är ute samtidigt, och för små filer
+ * är det rundresorna som sätter takten. Ägaren här gör ingen överföring
+ * utan rapporterar varje jobb klart efter en fast fördröjning, så att
+ * filer/s bara beror på schemaläggningen.
+ */
+class BenchTransferQueue : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void smallFiles_data();
+    void smallFiles();
+};
+
+void BenchTransferQueue::smallFiles_data()
+{
+    QTest::addColumn<bool>("smallLane");
+    QTest::addColumn<int>("largeAhead");
+
+    QTest::newRow("utan småfilsplatser") << false << 0;
+    QTest::newRow("med småfilsplatser") << true << 0;
+    QTest::newRow("med småfilsplatser, bakom stora filer") << true << 4;
+}
+
+void BenchTransferQueue::smallFiles()
+{
+    QFETCH(bool, smallLane);
+    QFETCH(int, largeAhead);
+
+    QList<TransferRequest> requests;
+    for (int i = 0; i < largeAhead + FILE_COUNT; ++i) {
+        TransferRequest request;
+        request.host = HOST;
+        request.isUpload = true;
+        const bool large = i < largeAhead;
+        request.sourcePath = (large ? LARGE_FILE_PREFIX : QStringLiteral("/bench/fil_")) + QString::number(i);
+        request.targetPath = request.sourcePath;
+        request.size = large ? LARGE_FILE_SIZE : SMALL_FILE_SIZE;
+        requests.append(request);
+    }
+
+    qint64 best = -1;
+    QBENCHMARK {
+        TransferQueue queue;
+        if (!smallLane) {
+            queue.setSmallFileSize(0);
+        }
+        connect(&queue, &TransferQueue::startTransfer, &queue,
+                [&queue](int jobId, const QString &, bool, const QString &sourcePath, const QString &) {
+            const bool large = sourcePath.startsWith(LARGE_FILE_PREFIX);
+            QTimer::singleShot(large ? LARGE_FILE_LATENCY_MS : SMALL_FILE_LATENCY_MS,
+                               Qt::PreciseTimer, &queue, [&queue, jobId]() {
+                queue.reportFinished(jobId, false);
+            });
+        });
+
+        QEventLoop loop;
+        int finished = 0;
+        connect(&queue, &TransferQueue::transferFinished, &loop, [&loop, &finished]() {
+            if (++finished == FILE_COUNT) {
+                loop.quit();
+            }
+        });
+
+        QElapsedTimer timer;
+        timer.start();
+        queue.enqueueBatch(requests);
+        loop.exec();
+        const qint64 elapsed = timer.nsecsElapsed();
+        best = best < 0 ? elapsed : qMin(best, elapsed);
+        QCOMPARE(finished, FILE_COUNT);
+    }
+    reportRate(QTest::currentDataTag(), FILE_COUNT, best);
+}
+
+QTEST_GUILESS_MAIN(BenchTransferQueue)
+
+#include "bench_transferqueue.moc"
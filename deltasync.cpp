@@ -0,0 +1,391 @@
+// deltasync.cpp
+#include "deltasync.h"
+#include "shellquote.h"
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QHash>
+#include <QtEndian>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define DELTASYNC_SSE2
+#endif
+
+// Adler-32 räknar modulo största primtalet under 2^16
+const quint32 ADLER_MOD = 65521;
+
+// Blockstorlek: roten ur filstorleken, inom rimliga gränser
+const int MIN_BLOCK_SIZE = 2 * 1024;
+const int MAX_BLOCK_SIZE = 128 * 1024;
+
+// Signaturcachens filformat
+const quint32 SIGNATURE_MAGIC = 0x44465347; // "DFSG"
+const quint32 SIGNATURE_VERSION = 1;
+
+// Varje signaturpost från hjälparen: Adler-32, längd och MD5
+const int HELPER_RECORD_SIZE = 4 + 4 + 16;
+
+namespace {
+
+// Fjärrhjälparen; får inte innehålla enkla citattecken eftersom den
+// skickas inom sådana till skalet
+const char HELPER_SCRIPT[] =
+    "import sys,os,zlib,hashlib,struct,shutil\n"
+    "m,bs,p=sys.argv[1],int(sys.argv[2]),sys.argv[3]\n"
+    "if m==\"sig\":\n"
+    " f=open(p,\"rb\");o=sys.stdout.buffer\n"
+    " while True:\n"
+    "  b=f.read(bs)\n"
+    "  if not b: break\n"
+    "  o.write(struct.pack(\">II\",zlib.adler32(b)&0xffffffff,len(b))+hashlib.md5(b).digest())\n"
+    " sys.exit(0)\n"
+    "f=open(p,\"rb\");t=p+\".darkftp-delta\";g=open(t,\"wb\");i=sys.stdin.buffer;h=hashlib.md5()\n"
+    "def put(d):\n"
+    " g.write(d);h.update(d)\n"
+    "def fail(c):\n"
+    " g.close();os.unlink(t);sys.exit(c)\n"
+    "while True:\n"
+    " c=i.read(1)\n"
+    " if c==b\"C\":\n"
+    "  s,n=struct.unpack(\">QQ\",i.read(16));f.seek(s*bs);r=n*bs\n"
+    "  while r>0:\n"
+    "   d=f.read(min(r,1<<20))\n"
+    "   if not d: break\n"
+    "   put(d);r-=len(d)\n"
+    " elif c==b\"L\":\n"
+    "  (n,)=struct.unpack(\">Q\",i.read(8))\n"
+    "  while n>0:\n"
+    "   d=i.read(min(n,1<<20))\n"
+    "   if not d: fail(1)\n"
+    "   put(d);n-=len(d)\n"
+    " elif c==b\"E\":\n"
+    "  if i.read(16)!=h.digest(): fail(2)\n"
+    "  g.close();shutil.copymode(p,t);os.replace(t,p);st=os.stat(p)\n"
+    "  print(st.st_size,int(st.st_mtime));sys.exit(0)\n"
+    " else: fail(1)\n";
+
+void appendU64(QByteArray &out, quint64 value)
+{
+    uchar buffer[8];
+    qToBigEndian(value, buffer);
+    out.append(reinterpret_cast<const char *>(buffer), sizeof(buffer));
+}
+
+QByteArray md5(const uchar *data, qint64 length)
+{
+    // Hela filen kan vara större än vad en QByteArray rymmer
+    QCryptographicHash hash(QCryptographicHash::Md5);
+    while (length > 0) {
+        const int chunk = int(qMin<qint64>(length, 1 << 30));
+        hash.addData(reinterpret_cast<const char *>(data), chunk);
+        data += chunk;
+        length -= chunk;
+    }
+    return hash.result();
+}
+
+// Samlar på varandra följande kopieringar och data till instruktioner
+class DeltaWriter
+{
+public:
+    explicit DeltaWriter(QByteArray &out) : m_out(out) {}
+
+    void copy(qint64 block)
+    {
+        if (m_count > 0 && m_first + m_count == block) {
+            ++m_count;
+            return;
+        }
+        flushCopy();
+        m_first = block;
+        m_count = 1;
+    }
+
+    void literal(const uchar *data, qint64 length)
+    {
+        if (length <= 0) {
+            return;
+        }
+        flushCopy();
+        m_out.append('L');
+        appendU64(m_out, quint64(length));
+        m_out.append(reinterpret_cast<const char *>(data), int(length));
+    }
+
+    void finish(const QByteArray &fileHash)
+    {
+        flushCopy();
+        m_out.append('E');
+        m_out.append(fileHash);
+    }
+
+private:
+    void flushCopy()
+    {
+        if (m_count == 0) {
+            return;
+        }
+        m_out.append('C');
+        appendU64(m_out, quint64(m_first));
+        appendU64(m_out, quint64(m_count));
+        m_count = 0;
+    }
+
+    QByteArray &m_out;
+    qint64 m_first = 0;
+    qint64 m_count = 0;
+};
+
+} // namespace
+
+int DeltaSync::blockSizeFor(qint64 fileSize)
+{
+    // Jämn multipel av 64 så att SSE2-loopen sällan har en svans
+    int size = int(std::sqrt(double(qMax<qint64>(0, fileSize))));
+    size = (size + 63) & ~63;
+    return qBound(MIN_BLOCK_SIZE, size, MAX_BLOCK_SIZE);
+}
+
+quint32 DeltaSync::weakChecksum(const uchar *data, int length)
+{
+    // a = 1 + summan av alla byte, b = length + summan av (length - i) * x[i].
+    // Med MAX_BLOCK_SIZE ryms b i 64 bitar utan modulo inuti loopen.
+    quint64 a = 0;
+    quint64 b = 0;
+    int i = 0;
+
+#ifdef DELTASYNC_SSE2
+    // För 16 byte från position i: bidraget till b är
+    // (length - i) * summan - summan av t * x[i + t] för t = 0..15
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i weightsLow = _mm_setr_epi16(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m128i weightsHigh = _mm_setr_epi16(8, 9, 10, 11, 12, 13, 14, 15);
+    for (; i + 16 <= length; i += 16) {
+        const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+
+        const __m128i sad = _mm_sad_epu8(bytes, zero);
+        const quint32 sum = quint32(_mm_cvtsi128_si32(sad)) + quint32(_mm_extract_epi16(sad, 4));
+
+        const __m128i low = _mm_unpacklo_epi8(bytes, zero);
+        const __m128i high = _mm_unpackhi_epi8(bytes, zero);
+        __m128i weighted = _mm_add_epi32(_mm_madd_epi16(low, weightsLow), _mm_madd_epi16(high, weightsHigh));
+        weighted = _mm_add_epi32(weighted, _mm_shuffle_epi32(weighted, _MM_SHUFFLE(1, 0, 3, 2)));
+        weighted = _mm_add_epi32(weighted, _mm_shuffle_epi32(weighted, _MM_SHUFFLE(2, 3, 0, 1)));
+        const quint32 weightedSum = quint32(_mm_cvtsi128_si32(weighted));
+
+        a += sum;
+        b += quint64(length - i) * sum - weightedSum;
+    }
+#endif
+
+    for (; i < length; ++i) {
+        a += data[i];
+        b += quint64(length - i) * data[i];
+    }
+
+    const quint32 low = quint32((1 + a) % ADLER_MOD);
+    const quint32 high = quint32((quint64(length) + b) % ADLER_MOD);
+    return (high << 16) | low;
+}
+
+quint32 DeltaSync::rollChecksum(quint32 checksum, uchar out, uchar in, int length)
+{
+    // a' = a - out + in, b' = b - length * out + a' - 1 (allt modulo ADLER_MOD)
+    quint32 a = checksum & 0xffff;
+    quint32 b = checksum >> 16;
+
+    a = (a + ADLER_MOD - out + in) % ADLER_MOD;
+    const quint32 removed = quint32((quint64(length) * out) % ADLER_MOD);
+    b = (b + 2 * ADLER_MOD - removed + a - 1) % ADLER_MOD;
+    return (b << 16) | a;
+}
+
+DeltaSync::Signature DeltaSync::computeSignature(const uchar *data, qint64 size, int blockSize)
+{
+    Signature signature;
+    signature.blockSize = blockSize;
+    signature.fileSize = size;
+    signature.blocks.reserve(int((size + blockSize - 1) / blockSize));
+
+    for (qint64 offset = 0; offset < size; offset += blockSize) {
+        Block block;
+        block.length = int(qMin<qint64>(blockSize, size - offset));
+        block.weak = weakChecksum(data + offset, block.length);
+        block.strong = md5(data + offset, block.length);
+        signature.blocks.append(block);
+    }
+    return signature;
+}
+
+bool DeltaSync::computeDelta(const Signature &remote, const uchar *data, qint64 size,
+                             qint64 maxLiteral, Delta *delta)
+{
+    const int blockSize = remote.blockSize;
+
+    // Uppslag från svag summa till hela block; ett kortare sista block
+    // kan bara matcha i slutet av den lokala filen
+    QHash<quint32, QVector<int>> table;
+    table.reserve(remote.blocks.size());
+    int tailBlock = -1;
+    for (int index = 0; index < remote.blocks.size(); ++index) {
+        const Block &block = remote.blocks.at(index);
+        if (block.length == blockSize) {
+            table[block.weak].append(index);
+        } else {
+            tailBlock = index;
+        }
+    }
+
+    delta->payload.clear();
+    delta->literalBytes = 0;
+    delta->copiedBytes = 0;
+    DeltaWriter writer(delta->payload);
+
+    qint64 position = 0;
+    qint64 literalStart = 0;
+    quint32 weak = 0;
+    bool haveWeak = false;
+
+    while (position + blockSize <= size) {
+        if (!haveWeak) {
+            weak = weakChecksum(data + position, blockSize);
+            haveWeak = true;
+        }
+
+        int match = -1;
+        auto it = table.constFind(weak);
+        if (it != table.constEnd()) {
+            const QByteArray strong = md5(data + position, blockSize);
+            for (int index : it.value()) {
+                if (remote.blocks.at(index).strong == strong) {
+                    match = index;
+                    break;
+                }
+            }
+        }
+
+        if (match >= 0) {
+            delta->literalBytes += position - literalStart;
+            if (delta->literalBytes > maxLiteral) {
+                return false;
+            }
+            writer.literal(data + literalStart, position - literalStart);
+            writer.copy(match);
+            delta->copiedBytes += blockSize;
+
+            position += blockSize;
+            literalStart = position;
+            haveWeak = false;
+        } else {
+            if (position + blockSize < size) {
+                weak = rollChecksum(weak, data[position], data[position + blockSize], blockSize);
+            } else {
+                haveWeak = false;
+            }
+            ++position;
+
+            // Avbryt tidigt när det redan står klart att deltat inte lönar sig
+            if (position - literalStart + delta->literalBytes > maxLiteral) {
+                return false;
+            }
+        }
+    }
+
+    // Resten är kortare än ett block; kolla om den är fjärrfilens svans
+    if (tailBlock >= 0) {
+        const Block &tail = remote.blocks.at(tailBlock);
+        const qint64 tailStart = size - tail.length;
+        if (tailStart >= literalStart && weakChecksum(data + tailStart, tail.length) == tail.weak
+            && md5(data + tailStart, tail.length) == tail.strong) {
+            delta->literalBytes += tailStart - literalStart;
+            writer.literal(data + literalStart, tailStart - literalStart);
+            writer.copy(tailBlock);
+            delta->copiedBytes += tail.length;
+            literalStart = size;
+        }
+    }
+
+    delta->literalBytes += size - literalStart;
+    if (delta->literalBytes > maxLiteral) {
+        return false;
+    }
+    writer.literal(data + literalStart, size - literalStart);
+    writer.finish(md5(data, size));
+    return true;
+}
+
+DeltaSync::Signature DeltaSync::parseHelperSignature(const QByteArray &output, int blockSize)
+{
+    Signature signature;
+    if (output.size() % HELPER_RECORD_SIZE != 0) {
+        return signature;
+    }
+
+    const uchar *record = reinterpret_cast<const uchar *>(output.constData());
+    const int count = output.size() / HELPER_RECORD_SIZE;
+    signature.blocks.reserve(count);
+    for (int i = 0; i < count; ++i, record += HELPER_RECORD_SIZE) {
+        Block block;
+        block.weak = qFromBigEndian<quint32>(record);
+        block.length = int(qFromBigEndian<quint32>(record + 4));
+        block.strong = QByteArray(reinterpret_cast<const char *>(record + 8), 16);
+        if (block.length <= 0 || block.length > blockSize) {
+            return Signature();
+        }
+        signature.fileSize += block.length;
+        signature.blocks.append(block);
+    }
+
+    signature.blockSize = blockSize;
+    return signature;
+}
+
+QByteArray DeltaSync::serializeSignature(const Signature &signature)
+{
+    QByteArray data;
+    QDataStream stream(&data, QIODevice::WriteOnly);
+    stream << SIGNATURE_MAGIC << SIGNATURE_VERSION
+           << qint32(signature.blockSize) << signature.fileSize << signature.modified
+           << qint32(signature.blocks.size());
+    for (const Block &block : signature.blocks) {
+        stream << block.weak << qint32(block.length) << block.strong;
+    }
+    return data;
+}
+
+DeltaSync::Signature DeltaSync::deserializeSignature(const QByteArray &data)
+{
+    QDataStream stream(data);
+    quint32 magic = 0;
+    quint32 version = 0;
+    qint32 blockSize = 0;
+    qint32 count = 0;
+    Signature signature;
+
+    stream >> magic >> version >> blockSize >> signature.fileSize >> signature.modified >> count;
+    if (magic != SIGNATURE_MAGIC || version != SIGNATURE_VERSION || blockSize <= 0 || count < 0) {
+        return Signature();
+    }
+
+    signature.blocks.reserve(count);
+    for (qint32 i = 0; i < count; ++i) {
+        Block block;
+        qint32 length = 0;
+        stream >> block.weak >> length >> block.strong;
+        block.length = length;
+        signature.blocks.append(block);
+    }
+
+    if (stream.status() != QDataStream::Ok) {
+        return Signature();
+    }
+    signature.blockSize = blockSize;
+    return signature;
+}
+
+QByteArray DeltaSync::helperCommand(const QString &mode, int blockSize, const QString &remotePath)
+{
+    return "python3 -c " + shellQuote(QString::fromLatin1(HELPER_SCRIPT)) + ' '
+           + shellQuote(mode) + ' ' + QByteArray::number(blockSize) + ' ' + shellQuote(remotePath);
+}
@@ -0,0 +1,123 @@
+// deltasync.h
+#ifndef DELTASYNC_H
+#define DELTASYNC_H
+
+#include <QByteArray>
+#include <QString>
+#include <QVector>
+
+/**
+ * @brief Blockbaserad deltaöverföring i rsync-stil
+ *
+ * Fjärrfilen delas i block om blockSize byte. För varje block räknas en
+ * svag rullande kontrollsumma (Adler-32) och en stark (MD5). Den lokala
+ * filen gås sedan igenom byte för byte: där den svaga summan träffar ett
+ * block och den starka bekräftar det skickas bara blockets nummer, resten
+ * skickas som data.
+ *
+ * Adler-32 är valt för att fjärrhjälparen ska kunna räkna samma summa med
+ * zlib i stället för en långsam loop per byte. Summan för ett helt block
+ * räknas med SSE2 där det finns; när filerna mest är lika, som för
+ * VM-avbilder och databasdumpar, är det den vägen nästan all tid går.
+ *
+ * Protokoll till fjärrhjälparen (alla tal big endian):
+ * @code
+ * 'C' u64 första block, u64 antal   kopiera block från den gamla filen
+ * 'L' u64 längd, data               skriv ny data
+ * 'E' 16 byte MD5                   klar; MD5 för hela nya filen
+ * @endcode
+ */
+class DeltaSync
+{
+public:
+    /**
+     * @brief Kontrollsummor för ett block i fjärrfilen
+     */
+    struct Block {
+        quint32 weak = 0;
+        int length = 0;         ///< Sista blocket kan vara kortare
+        QByteArray strong;      ///< MD5, 16 byte
+    };
+
+    /**
+     * @brief Signatur för en hel fil
+     */
+    struct Signature {
+        int blockSize = 0;
+        qint64 fileSize = 0;
+        qint64 modified = 0;    ///< Fjärrfilens ändringstid (sekunder), för cachen
+        QVector<Block> blocks;
+
+        bool isValid() const { return blockSize > 0; }
+    };
+
+    /**
+     * @brief Resultatet av en deltaberäkning
+     */
+    struct Delta {
+        QByteArray payload;     ///< Kodade instruktioner till fjärrhjälparen
+        qint64 literalBytes = 0; ///< Byte som måste skickas som data
+        qint64 copiedBytes = 0; ///< Byte som återanvänds från fjärrfilen
+    };
+
+    /**
+     * @brief Välj blockstorlek efter filens storlek (ungefär roten ur storleken)
+     */
+    static int blockSizeFor(qint64 fileSize);
+
+    /**
+     * @brief Adler-32 för ett helt block
+     */
+    static quint32 weakChecksum(const uchar *data, int length);
+
+    /**
+     * @brief Flytta Adler-32-fönstret en byte framåt
+     * @param checksum Summan för fönstret som börjar med out
+     * @param out Byten som lämnar fönstret
+     * @param in Byten som kommer in i fönstret
+     * @param length Fönstrets längd
+     */
+    static quint32 rollChecksum(quint32 checksum, uchar out, uchar in, int length);
+
+    /**
+     * @brief Räkna signaturen för data i minnet, t.ex. en mappad fil
+     */
+    static Signature computeSignature(const uchar *data, qint64 size, int blockSize);
+
+    /**
+     * @brief Räkna delta mot en fjärrsignatur
+     * @param remote Fjärrfilens signatur
+     * @param data Den lokala filen
+     * @param size Den lokala filens storlek
+     * @param maxLiteral Avbryt och returnera false om mer data än så måste skickas
+     * @param delta Fylls i med resultatet
+     * @return false om deltat blev för stort för att löna sig
+     */
+    static bool computeDelta(const Signature &remote, const uchar *data, qint64 size,
+                             qint64 maxLiteral, Delta *delta);
+
+    /**
+     * @brief Tolka signaturen som fjärrhjälparen skriver i läget "sig"
+     * @return Ogiltig signatur om utdata är trasig
+     */
+    static Signature parseHelperSignature(const QByteArray &output, int blockSize);
+
+    // Signaturcachen på disk
+    static QByteArray serializeSignature(const Signature &signature);
+    static Signature deserializeSignature(const QByteArray &data);
+
+    /**
+     * @brief Kommandot som startar fjärrhjälparen över en exec-kanal
+     *
+     * Hjälparen är ett litet Python 3-skript. I läget "sig" skriver det
+     * fjärrfilens signatur, i läget "patch" läser det instruktioner från
+     * stdin, bygger den nya filen bredvid den gamla och byter namn när
+     * MD5 stämmer. Sist skriver det "<storlek> <ändringstid>".
+     * @param mode "sig" eller "patch"
+     * @param blockSize Blockstorlek
+     * @param remotePath Fjärrfilen
+     */
+    static QByteArray helperCommand(const QString &mode, int blockSize, const QString &remotePath);
+};
+
+#endif // DELTASYNC_H
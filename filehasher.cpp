@@ -0,0 +1,492 @@
+// filehasher.cpp
+#include "filehasher.h"
+#include "shellquote.h"
+#include <QCryptographicHash>
+#include <QtEndian>
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#include <cpuid.h>
+#include <immintrin.h>
+#define FILEHASHER_CLMUL
+#endif
+
+// Läsblock för hashFile()
+const qint64 HASH_READ_SIZE = 1024 * 1024;
+
+// Omvänt CRC-32-polynom, samma som zlib och FTP XCRC
+const quint32 CRC32_POLYNOMIAL = 0xedb88320;
+
+namespace {
+
+// Fjärrkommandot för CRC-32; får inte innehålla enkla citattecken
+const char REMOTE_CRC_SCRIPT[] =
+    "import sys,zlib\n"
+    "f=open(sys.argv[1],\"rb\");c=0\n"
+    "for b in iter(lambda:f.read(1<<20),b\"\"): c=zlib.crc32(b,c)\n"
+    "print(\"%08x\"%(c&0xffffffff))\n";
+
+// Tabeller för slicing-by-8: tabell k ger bidraget från en byte som
+// ligger k byte före slutet av ett 8-byteblock
+struct Crc32Tables {
+    quint32 table[8][256];
+
+    Crc32Tables()
+    {
+        for (quint32 n = 0; n < 256; ++n) {
+            quint32 c = n;
+            for (int bit = 0; bit < 8; ++bit) {
+                c = (c & 1) ? (c >> 1) ^ CRC32_POLYNOMIAL : c >> 1;
+            }
+            table[0][n] = c;
+        }
+        for (int k = 1; k < 8; ++k) {
+            for (int n = 0; n < 256; ++n) {
+                const quint32 previous = table[k - 1][n];
+                table[k][n] = (previous >> 8) ^ table[0][previous & 0xff];
+            }
+        }
+    }
+};
+
+const Crc32Tables &crcTables()
+{
+    static const Crc32Tables tables;
+    return tables;
+}
+
+// crc är det inverterade registret, som i zlib:s inre loop
+quint32 crc32Scalar(quint32 crc, const uchar *data, qint64 length)
+{
+    const Crc32Tables &t = crcTables();
+
+    while (length >= 8) {
+        crc ^= qFromLittleEndian<quint32>(data);
+        const quint32 high = qFromLittleEndian<quint32>(data + 4);
+        crc = t.table[7][crc & 0xff] ^ t.table[6][(crc >> 8) & 0xff]
+            ^ t.table[5][(crc >> 16) & 0xff] ^ t.table[4][crc >> 24]
+            ^ t.table[3][high & 0xff] ^ t.table[2][(high >> 8) & 0xff]
+            ^ t.table[1][(high >> 16) & 0xff] ^ t.table[0][high >> 24];
+        data += 8;
+        length -= 8;
+    }
+
+    while (length-- > 0) {
+        crc = t.table[0][(crc ^ *data++) & 0xff] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+#ifdef FILEHASHER_CLMUL
+bool hasCarrylessMultiply()
+{
+    static const bool supported = []() {
+        unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+        if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+            return false;
+        }
+        return (ecx & bit_PCLMUL) != 0 && (ecx & bit_SSE4_1) != 0;
+    }();
+    return supported;
+}
+
+// Vikning med PCLMULQDQ. Konstanterna är x^(k) mod P(x) i speglad form
+// för 4x128, 128 och 64 bitars avstånd samt Barrett-konstanterna, från
+// Intels artikel. length måste vara minst 64 och en multipel av 16.
+__attribute__((target("pclmul,sse4.1")))
+quint32 crc32Clmul(quint32 crc, const uchar *data, qint64 length)
+{
+    const __m128i k1k2 = _mm_set_epi64x(0x01c6e41596, 0x0154442bd4);
+    const __m128i k3k4 = _mm_set_epi64x(0x00ccaa009e, 0x01751997d0);
+    const __m128i k5k0 = _mm_set_epi64x(0x0000000000, 0x0163cd6124);
+    const __m128i poly = _mm_set_epi64x(0x01f7011641, 0x01db710641);
+    const __m128i mask32 = _mm_setr_epi32(~0, 0, ~0, 0);
+
+    // Fyra parallella ackumulatorer om 128 bitar, 64 byte per varv
+    __m128i x1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + 0x00));
+    __m128i x2 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + 0x10));
+    __m128i x3 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + 0x20));
+    __m128i x4 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + 0x30));
+    x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(int(crc)));
+    data += 64;
+    length -= 64;
+
+    while (length >= 64) {
+        const __m128i x5 = _mm_clmulepi64_si128(x1, k1k2, 0x00);
+        const __m128i x6 = _mm_clmulepi64_si128(x2, k1k2, 0x00);
+        const __m128i x7 = _mm_clmulepi64_si128(x3, k1k2, 0x00);
+        const __m128i x8 = _mm_clmulepi64_si128(x4, k1k2, 0x00);
+
+        x1 = _mm_clmulepi64_si128(x1, k1k2, 0x11);
+        x2 = _mm_clmulepi64_si128(x2, k1k2, 0x11);
+        x3 = _mm_clmulepi64_si128(x3, k1k2, 0x11);
+        x4 = _mm_clmulepi64_si128(x4, k1k2, 0x11);
+
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x5),
+                           _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + 0x00)));
+        x2 = _mm_xor_si128(_mm_xor_si128(x2, x6),
+                           _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + 0x10)));
+        x3 = _mm_xor_si128(_mm_xor_si128(x3, x7),
+                           _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + 0x20)));
+        x4 = _mm_xor_si128(_mm_xor_si128(x4, x8),
+                           _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + 0x30)));
+        data += 64;
+        length -= 64;
+    }
+
+    // Vik ihop de fyra till en
+    __m128i x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+
+    x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+
+    x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+    // Resterande 16-byteblock
+    while (length >= 16) {
+        x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x5),
+                           _mm_loadu_si128(reinterpret_cast<const __m128i *>(data)));
+        data += 16;
+        length -= 16;
+    }
+
+    // 128 till 64 bitar
+    __m128i x2r = _mm_clmulepi64_si128(x1, k3k4, 0x10);
+    x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2r);
+
+    x2r = _mm_srli_si128(x1, 4);
+    x1 = _mm_and_si128(x1, mask32);
+    x1 = _mm_clmulepi64_si128(x1, k5k0, 0x00);
+    x1 = _mm_xor_si128(x1, x2r);
+
+    // Barrett-reduktion till 32 bitar
+    x2r = _mm_and_si128(x1, mask32);
+    x2r = _mm_clmulepi64_si128(x2r, poly, 0x10);
+    x2r = _mm_and_si128(x2r, mask32);
+    x2r = _mm_clmulepi64_si128(x2r, poly, 0x00);
+    x1 = _mm_xor_si128(x1, x2r);
+
+    return quint32(_mm_extract_epi32(x1, 1));
+}
+#endif
+
+quint32 gf2MatrixTimes(const quint32 *matrix, quint32 vector)
+{
+    quint32 sum = 0;
+    while (vector) {
+        if (vector & 1) {
+            sum ^= *matrix;
+        }
+        vector >>= 1;
+        ++matrix;
+    }
+    return sum;
+}
+
+void gf2MatrixSquare(quint32 *square, const quint32 *matrix)
+{
+    for (int n = 0; n < 32; ++n) {
+        square[n] = gf2MatrixTimes(matrix, matrix[n]);
+    }
+}
+
+QCryptographicHash::Algorithm cryptographicAlgorithm(FileHasher::Algorithm algorithm)
+{
+    switch (algorithm) {
+    case FileHasher::Md5:
+        return QCryptographicHash::Md5;
+    case FileHasher::Sha1:
+        return QCryptographicHash::Sha1;
+    case FileHasher::Sha256:
+        return QCryptographicHash::Sha256;
+    default:
+        return QCryptographicHash::Sha512;
+    }
+}
+
+} // namespace
+
+FileHasher::FileHasher(Algorithm algorithm)
+    : m_algorithm(algorithm)
+    , m_crc(0)
+{
+    if (algorithm != Crc32) {
+        m_hash.reset(new QCryptographicHash(cryptographicAlgorithm(algorithm)));
+    }
+}
+
+FileHasher::~FileHasher()
+{
+}
+
+FileHasher::Algorithm FileHasher::algorithm() const
+{
+    return m_algorithm;
+}
+
+void FileHasher::reset()
+{
+    m_crc = 0;
+    if (m_hash) {
+        m_hash->reset();
+    }
+}
+
+void FileHasher::addData(const char *data, qint64 length)
+{
+    if (length <= 0) {
+        return;
+    }
+
+    if (m_hash) {
+        // addData tar int; dela upp mycket stora block
+        while (length > 0) {
+            const int chunk = int(qMin<qint64>(length, 1 << 30));
+            m_hash->addData(data, chunk);
+            data += chunk;
+            length -= chunk;
+        }
+    } else {
+        m_crc = crc32(m_crc, reinterpret_cast<const uchar *>(data), length);
+    }
+}
+
+QByteArray FileHasher::result() const
+{
+    if (m_hash) {
+        return m_hash->result();
+    }
+
+    uchar buffer[4];
+    qToBigEndian(m_crc, buffer);
+    return QByteArray(reinterpret_cast<const char *>(buffer), sizeof(buffer));
+}
+
+QString FileHasher::algorithmName(Algorithm algorithm)
+{
+    switch (algorithm) {
+    case Crc32:
+        return QStringLiteral("CRC32");
+    case Md5:
+        return QStringLiteral("MD5");
+    case Sha1:
+        return QStringLiteral("SHA-1");
+    case Sha256:
+        return QStringLiteral("SHA-256");
+    case Sha512:
+        return QStringLiteral("SHA-512");
+    }
+    return QString();
+}
+
+bool FileHasher::algorithmFromName(const QString &name, Algorithm *algorithm)
+{
+    // "SHA-256", "SHA256" och "sha256" betyder samma sak
+    const QString normalized = name.trimmed().toUpper().remove(QLatin1Char('-')).remove(QLatin1Char('*'));
+    if (normalized == QLatin1String("CRC32") || normalized == QLatin1String("CRC")) {
+        *algorithm = Crc32;
+    } else if (normalized == QLatin1String("MD5")) {
+        *algorithm = Md5;
+    } else if (normalized == QLatin1String("SHA1")) {
+        *algorithm = Sha1;
+    } else if (normalized == QLatin1String("SHA256")) {
+        *algorithm = Sha256;
+    } else if (normalized == QLatin1String("SHA512")) {
+        *algorithm = Sha512;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+QByteArray FileHasher::parseDigest(const QString &text, Algorithm algorithm)
+{
+    QString hex = text.trimmed();
+    if (hex.startsWith(QLatin1String("0x"), Qt::CaseInsensitive)) {
+        hex = hex.mid(2);
+    }
+
+    int expected = 0;
+    switch (algorithm) {
+    case Crc32:
+        expected = 8;
+        // Vissa servrar skriver XCRC utan inledande nollor
+        if (hex.size() < expected) {
+            hex = QString(expected - hex.size(), QLatin1Char('0')) + hex;
+        }
+        break;
+    case Md5:
+        expected = 32;
+        break;
+    case Sha1:
+        expected = 40;
+        break;
+    case Sha256:
+        expected = 64;
+        break;
+    case Sha512:
+        expected = 128;
+        break;
+    }
+
+    if (hex.size() != expected) {
+        return QByteArray();
+    }
+    for (const QChar c : hex) {
+        if (!c.isDigit() && !(c.toLower() >= QLatin1Char('a') && c.toLower() <= QLatin1Char('f'))) {
+            return QByteArray();
+        }
+    }
+    return QByteArray::fromHex(hex.toLatin1());
+}
+
+quint32 FileHasher::crc32(quint32 crc, const uchar *data, qint64 length)
+{
+    crc = ~crc;
+
+#ifdef FILEHASHER_CLMUL
+    if (length >= 64 && hasCarrylessMultiply()) {
+        const qint64 chunk = length & ~qint64(15);
+        crc = crc32Clmul(crc, data, chunk);
+        data += chunk;
+        length -= chunk;
+    }
+#endif
+
+    return ~crc32Scalar(crc, data, length);
+}
+
+quint32 FileHasher::crc32Combine(quint32 crc1, quint32 crc2, qint64 length2)
+{
+    // Som zlib:s crc32_combine: flytta crc1 fram length2 nollbyte genom att
+    // kvadrera operatorn för en nollbit, och lägg sedan till crc2
+    if (length2 <= 0) {
+        return crc1;
+    }
+
+    quint32 odd[32];
+    quint32 even[32];
+
+    odd[0] = CRC32_POLYNOMIAL;
+    quint32 row = 1;
+    for (int n = 1; n < 32; ++n) {
+        odd[n] = row;
+        row <<= 1;
+    }
+
+    gf2MatrixSquare(even, odd);   // två nollbitar
+    gf2MatrixSquare(odd, even);   // fyra nollbitar
+
+    do {
+        gf2MatrixSquare(even, odd);
+        if (length2 & 1) {
+            crc1 = gf2MatrixTimes(even, crc1);
+        }
+        length2 >>= 1;
+        if (length2 == 0) {
+            break;
+        }
+
+        gf2MatrixSquare(odd, even);
+        if (length2 & 1) {
+            crc1 = gf2MatrixTimes(odd, crc1);
+        }
+        length2 >>= 1;
+    } while (length2 != 0);
+
+    return crc1 ^ crc2;
+}
+
+QByteArray FileHasher::hashFile(const QString &path, Algorithm algorithm, qint64 length)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return QByteArray();
+    }
+
+    FileHasher hasher(algorithm);
+    QByteArray buffer(int(HASH_READ_SIZE), Qt::Uninitialized);
+    qint64 remaining = length >= 0 ? length : file.size();
+    while (remaining > 0) {
+        const qint64 n = file.read(buffer.data(), qMin(remaining, HASH_READ_SIZE));
+        if (n <= 0) {
+            return QByteArray();
+        }
+        hasher.addData(buffer.constData(), n);
+        remaining -= n;
+    }
+    return hasher.result();
+}
+
+QByteArray FileHasher::remoteCommand(const QString &remotePath)
+{
+    const QByteArray path = shellQuote(remotePath);
+    return "python3 -c " + shellQuote(QString::fromLatin1(REMOTE_CRC_SCRIPT)) + ' ' + path
+           + " 2>/dev/null || md5sum -b -- " + path + " 2>/dev/null || md5 -r -- " + path;
+}
+
+HashingFile::HashingFile(const QString &name, FileHasher::Algorithm algorithm, QObject *parent)
+    : QFile(name, parent)
+    , m_hasher(algorithm)
+{
+}
+
+bool HashingFile::hashExistingData(qint64 length)
+{
+    // Läses med ett eget handtag så att den här filens position inte påverkas
+    m_hasher.reset();
+    if (length <= 0) {
+        return true;
+    }
+
+    QFile existing(fileName());
+    if (!existing.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    QByteArray buffer(int(HASH_READ_SIZE), Qt::Uninitialized);
+    qint64 remaining = length;
+    while (remaining > 0) {
+        const qint64 n = existing.read(buffer.data(), qMin(remaining, HASH_READ_SIZE));
+        if (n <= 0) {
+            return false;
+        }
+        m_hasher.addData(buffer.constData(), n);
+        remaining -= n;
+    }
+    return true;
+}
+
+QByteArray HashingFile::digest() const
+{
+    return m_hasher.result();
+}
+
+FileHasher::Algorithm HashingFile::algorithm() const
+{
+    return m_hasher.algorithm();
+}
+
+qint64 HashingFile::readData(char *data, qint64 maxlen)
+{
+    const qint64 n = QFile::readData(data, maxlen);
+    if (n > 0) {
+        m_hasher.addData(data, n);
+    }
+    return n;
+}
+
+qint64 HashingFile::writeData(const char *data, qint64 len)
+{
+    const qint64 n = QFile::writeData(data, len);
+    if (n > 0) {
+        m_hasher.addData(data, n);
+    }
+    return n;
+}
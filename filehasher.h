@@ -0,0 +1,135 @@
+// filehasher.h
+#ifndef FILEHASHER_H
+#define FILEHASHER_H
+
+#include <QByteArray>
+#include <QFile>
+#include <QScopedPointer>
+#include <QString>
+
+class QCryptographicHash;
+
+/**
+ * @brief Kontrollsumma som räknas medan en fil strömmas
+ *
+ * Algoritmerna är de som servrarna själva kan räkna: FTP HASH/XCRC/XMD5/
+ * XSHA* och md5sum eller python3 över SSH. CRC32C, xxHash och BLAKE3 är
+ * snabbare men ingen server erbjuder dem, så de går inte att jämföra mot.
+ *
+ * CRC-32 är förstahandsvalet. Den räknas med PCLMULQDQ (vikning av 64 byte
+ * åt gången, se Intels "Fast CRC Computation Using PCLMULQDQ") där
+ * processorn har det och annars med slicing-by-8. Summor för olika delar
+ * av en fil kan slås ihop med crc32Combine(), så även segmenterade
+ * nedladdningar kan verifieras utan att filen läses igen.
+ */
+class FileHasher
+{
+public:
+    enum Algorithm {
+        Crc32,
+        Md5,
+        Sha1,
+        Sha256,
+        Sha512
+    };
+
+    explicit FileHasher(Algorithm algorithm = Crc32);
+    ~FileHasher();
+
+    Algorithm algorithm() const;
+    void reset();
+    void addData(const char *data, qint64 length);
+
+    /**
+     * @brief Summan för allt som lagts till hittills
+     * @return Rå byte; CRC-32 som fyra byte big endian
+     */
+    QByteArray result() const;
+
+    /**
+     * @brief Namnet som FTP HASH använder, t.ex. "CRC32" eller "SHA-256"
+     */
+    static QString algorithmName(Algorithm algorithm);
+
+    /**
+     * @brief Tolka ett algoritmnamn från HASH, FEAT eller X-kommandona
+     * @return false om algoritmen är okänd
+     */
+    static bool algorithmFromName(const QString &name, Algorithm *algorithm);
+
+    /**
+     * @brief Tolka en summa i hex från ett serversvar, med eller utan "0x"
+     * @return Tom om texten inte är hex eller har fel längd för algoritmen
+     */
+    static QByteArray parseDigest(const QString &text, Algorithm algorithm);
+
+    /**
+     * @brief Uppdatera en CRC-32 (samma som zlib) med mer data
+     */
+    static quint32 crc32(quint32 crc, const uchar *data, qint64 length);
+
+    /**
+     * @brief CRC-32 för två delar i följd, givet summan för varje del
+     * @param crc1 Summan för första delen
+     * @param crc2 Summan för andra delen
+     * @param length2 Längden på andra delen
+     */
+    static quint32 crc32Combine(quint32 crc1, quint32 crc2, qint64 length2);
+
+    /**
+     * @brief Läs och räkna summan för en fil; för bakgrundstrådar
+     * @param path Filen
+     * @param algorithm Algoritm
+     * @param length Antal byte från början, eller -1 för hela filen
+     * @return Tom om filen inte kunde läsas
+     */
+    static QByteArray hashFile(const QString &path, Algorithm algorithm, qint64 length = -1);
+
+    /**
+     * @brief Kommando som räknar en fjärrfils summa över en exec-kanal
+     *
+     * CRC-32 med python3/zlib om det finns, annars MD5 med md5sum eller
+     * md5. Utdata är summan i hex först på raden; längden avgör algoritmen.
+     */
+    static QByteArray remoteCommand(const QString &remotePath);
+
+private:
+    Algorithm m_algorithm;
+    quint32 m_crc;
+    QScopedPointer<QCryptographicHash> m_hash;
+};
+
+/**
+ * @brief QFile som räknar en kontrollsumma på allt som läses eller skrivs
+ *
+ * FtpClient läser och skriver överföringens data genom enheten, så summan
+ * är klar när överföringen är det och filen behöver inte läsas en gång
+ * till. Datat måste passera i ordning från filens början; vid
+ * återupptagning räknas den del som redan finns med hashExistingData()
+ * innan överföringen börjar.
+ */
+class HashingFile : public QFile
+{
+    Q_OBJECT
+
+public:
+    HashingFile(const QString &name, FileHasher::Algorithm algorithm, QObject *parent = nullptr);
+
+    /**
+     * @brief Räkna in de första length byten som redan finns i filen
+     * @return false om de inte gick att läsa
+     */
+    bool hashExistingData(qint64 length);
+
+    QByteArray digest() const;
+    FileHasher::Algorithm algorithm() const;
+
+protected:
+    qint64 readData(char *data, qint64 maxlen) override;
+    qint64 writeData(const char *data, qint64 len) override;
+
+private:
+    FileHasher m_hasher;
+};
+
+#endif // FILEHASHER_H
@@ -0,0 +1,1044 @@
+// ftpclient.cpp
+#include "ftpclient.h"
+#include "bandwidthlimiter.h"
+
+#include <QHostAddress>
+#include <QRegularExpression>
+#include <QDebug>
+
+// Storlek på varje block som skickas vid uppladdning
+const qint64 UPLOAD_CHUNK_SIZE = 64 * 1024;
+// Fyll inte på socketens skrivbuffert mer än så här
+const qint64 UPLOAD_HIGH_WATERMARK = 256 * 1024;
+
+// Datakanalens läsbuffert; när den är full slutar socketen läsa och
+// TCP-fönstret stängs så att servern bromsas in
+const qint64 DATA_READ_BUFFER_SIZE = 256 * 1024;
+// Storlek på varje block som skrivs till målenheten vid nedladdning
+const qint64 DOWNLOAD_CHUNK_SIZE = 64 * 1024;
+// Pausa läsningen om målenheten har mer än så här oskrivet
+const qint64 DEVICE_HIGH_WATERMARK = 1024 * 1024;
+
+// Äldre kommandon för kontrollsummor och algoritmen de räknar, i samma
+// namn som HASH använder
+struct ChecksumCommand {
+    const char *verb;
+    const char *algorithm;
+};
+const ChecksumCommand CHECKSUM_COMMANDS[] = {
+    { "XCRC", "CRC32" },
+    { "XMD5", "MD5" },
+    { "XSHA1", "SHA-1" },
+    { "XSHA256", "SHA-256" },
+    { "XSHA512", "SHA-512" }
+};
+
+FtpClient::FtpClient(QObject *parent)
+    : QObject(parent)
+    , m_control(new QTcpSocket(this))
+    , m_data(nullptr)
+    , m_state(Unconnected)
+    , m_port(21)
+    , m_busy(false)
+    , m_nextId(0)
+    , m_replyCode(0)
+    , m_inMultiLine(false)
+    , m_lastReplyCode(0)
+    , m_epsvEnabled(true)
+    , m_mlsdEnabled(true)
+    , m_readPaused(false)
+    , m_limiterStream(0)
+    , m_throttled(false)
+{
+    connect(m_control, &QTcpSocket::connected, this, &FtpClient::onControlConnected);
+    connect(m_control, &QTcpSocket::readyRead, this, &FtpClient::onControlReadyRead);
+    connect(m_control, &QTcpSocket::disconnected, this, &FtpClient::onControlDisconnected);
+    connect(m_control, &QAbstractSocket::errorOccurred, this, &FtpClient::onControlError);
+}
+
+FtpClient::~FtpClient()
+{
+    abort();
+}
+
+int FtpClient::connectToHost(const QString &host, quint16 port,
+                             const QString &username, const QString &password)
+{
+    abort();
+
+    m_host = host;
+    m_port = port;
+    m_username = username.isEmpty() ? QStringLiteral("anonymous") : username;
+    m_password = password;
+    m_epsvEnabled = true;
+    m_mlsdEnabled = true;
+    m_features.clear();
+    m_hashAlgorithm.clear();
+
+    // Inloggningen körs som en vanlig operation så att efterföljande
+    // kommandon köas bakom den
+    Operation op;
+    op.command = Login;
+    op.steps << QStringLiteral("USER ") + m_username
+             << QStringLiteral("PASS ") + m_password
+             << QStringLiteral("TYPE I")
+             << QStringLiteral("FEAT");
+    int id = ++m_nextId;
+    op.id = id;
+    m_pending.prepend(op);
+
+    setState(Connecting);
+    m_control->connectToHost(host, port);
+    return id;
+}
+
+void FtpClient::close()
+{
+    if (m_state == Unconnected) {
+        return;
+    }
+
+    m_pending.clear();
+    closeDataConnection();
+
+    if (m_state == LoggedIn && m_control->state() == QAbstractSocket::ConnectedState) {
+        setState(Closing);
+        sendLine(QStringLiteral("QUIT"));
+        m_control->disconnectFromHost();
+    } else {
+        abort();
+    }
+}
+
+void FtpClient::abort()
+{
+    m_pending.clear();
+    m_busy = false;
+    m_current = Operation();
+    m_currentStep.clear();
+    m_inMultiLine = false;
+    m_replyText.clear();
+
+    closeDataConnection();
+
+    if (m_control->state() != QAbstractSocket::UnconnectedState) {
+        m_control->abort();
+    }
+    setState(Unconnected);
+}
+
+bool FtpClient::abortOperation(int id)
+{
+    for (int i = 0; i < m_pending.size(); ++i) {
+        if (m_pending.at(i).id == id) {
+            m_pending.removeAt(i);
+            m_lastStep.clear();
+            emit commandFinished(id, true, tr("Operationen avbröts"));
+            return true;
+        }
+    }
+
+    if (!m_busy || m_current.id != id) {
+        return false;
+    }
+
+    // En sluten datakanal ger ett slutsvar på RETR/STOR (426, eller 226 för
+    // det som hann skickas), så ABOR och dess extra svar behövs inte
+    m_current.aborted = true;
+    m_current.steps.clear();
+    if (m_current.usesData) {
+        closeDataConnection();
+    }
+    if (isTransferStep(m_currentStep) && m_current.replyFinished) {
+        finishOperation(true, tr("Operationen avbröts"));
+    }
+    return true;
+}
+
+FtpClient::State FtpClient::state() const
+{
+    return m_state;
+}
+
+bool FtpClient::isLoggedIn() const
+{
+    return m_state == LoggedIn;
+}
+
+int FtpClient::list(const QString &path)
+{
+    // MLSD ger entydiga fakta och exakta tidsstämplar; välj det när det finns
+    const QString verb = (m_mlsdEnabled && hasFeature(QStringLiteral("MLST")))
+                         ? QStringLiteral("MLSD") : QStringLiteral("LIST");
+
+    Operation op;
+    op.command = List;
+    op.path = path;
+    op.usesData = true;
+    op.steps << QStringLiteral("PASV")
+             << (path.isEmpty() ? verb : verb + QLatin1Char(' ') + path);
+    return enqueue(op);
+}
+
+bool FtpClient::hasFeature(const QString &feature) const
+{
+    return m_features.contains(feature.toUpper());
+}
+
+QString FtpClient::featureParameters(const QString &feature) const
+{
+    return m_features.value(feature.toUpper());
+}
+
+void FtpClient::parseFeatures(const QString &text)
+{
+    // 211-Features:
+    //  MLST type*;size*;modify*;
+    //  UTF8
+    // 211 End
+    m_features.clear();
+    const QStringList lines = text.split(QLatin1Char('\n'));
+    for (const QString &line : lines) {
+        if (!line.startsWith(QLatin1Char(' '))) {
+            continue;
+        }
+        const QString feature = line.trimmed();
+        int space = feature.indexOf(QLatin1Char(' '));
+        if (space < 0) {
+            m_features.insert(feature.toUpper(), QString());
+        } else {
+            m_features.insert(feature.left(space).toUpper(), feature.mid(space + 1));
+        }
+    }
+
+    // HASH SHA-256;SHA-1*;MD5;CRC32 - stjärnan markerar vald algoritm
+    const QStringList hashes = featureParameters(QStringLiteral("HASH")).split(QLatin1Char(';'), Qt::SkipEmptyParts);
+    for (const QString &hash : hashes) {
+        if (hash.endsWith(QLatin1Char('*'))) {
+            m_hashAlgorithm = hash.left(hash.size() - 1).trimmed().toUpper();
+        }
+    }
+}
+
+QStringList FtpClient::checksumAlgorithms() const
+{
+    QStringList algorithms;
+    const QStringList hashes = featureParameters(QStringLiteral("HASH")).split(QLatin1Char(';'), Qt::SkipEmptyParts);
+    for (QString hash : hashes) {
+        hash = hash.trimmed().toUpper();
+        if (hash.endsWith(QLatin1Char('*'))) {
+            hash.chop(1);
+        }
+        algorithms.append(hash);
+    }
+
+    for (const ChecksumCommand &command : CHECKSUM_COMMANDS) {
+        const QString algorithm = QLatin1String(command.algorithm);
+        if (hasFeature(QLatin1String(command.verb)) && !algorithms.contains(algorithm)) {
+            algorithms.append(algorithm);
+        }
+    }
+    return algorithms;
+}
+
+int FtpClient::checksum(const QString &path, const QString &algorithm)
+{
+    const QString wanted = algorithm.toUpper();
+
+    Operation op;
+    op.command = Checksum;
+    op.path = path;
+
+    const QStringList hashes = featureParameters(QStringLiteral("HASH")).toUpper().remove(QLatin1Char('*'))
+                               .split(QLatin1Char(';'), Qt::SkipEmptyParts);
+    if (hashes.contains(wanted)) {
+        // Algoritmen gäller resten av sessionen, så OPTS behövs bara vid byte
+        if (m_hashAlgorithm != wanted) {
+            op.steps << QStringLiteral("OPTS HASH ") + wanted;
+            m_hashAlgorithm = wanted;
+        }
+        op.steps << QStringLiteral("HASH ") + path;
+        return enqueue(op);
+    }
+
+    for (const ChecksumCommand &command : CHECKSUM_COMMANDS) {
+        if (wanted == QLatin1String(command.algorithm) && hasFeature(QLatin1String(command.verb))) {
+            op.steps << QLatin1String(command.verb) + QLatin1Char(' ') + path;
+            return enqueue(op);
+        }
+    }
+    return 0;
+}
+
+void FtpClient::parseChecksumReply(const QString &step, const QString &text)
+{
+    const QStringList parts = text.trimmed().split(QLatin1Char(' '), Qt::SkipEmptyParts);
+
+    if (step.startsWith(QLatin1String("HASH "))) {
+        // 213 SHA-256 0-49 169cd22282da7f147cb491e559e9dd filnamn
+        if (parts.size() >= 3) {
+            m_current.checksumAlgorithm = parts.at(0).toUpper();
+            m_current.checksum = parts.at(2);
+            m_hashAlgorithm = m_current.checksumAlgorithm;
+        }
+        return;
+    }
+
+    // 250 B5E47C1A, ibland med text före eller 0x framför; ta sista hexordet
+    const QString verb = step.section(QLatin1Char(' '), 0, 0).toUpper();
+    for (const ChecksumCommand &command : CHECKSUM_COMMANDS) {
+        if (verb == QLatin1String(command.verb)) {
+            m_current.checksumAlgorithm = QLatin1String(command.algorithm);
+        }
+    }
+    static const QRegularExpression hexRe(QStringLiteral("^(0x)?[0-9A-Fa-f]+$"));
+    for (int i = parts.size() - 1; i >= 0; --i) {
+        if (hexRe.match(parts.at(i)).hasMatch()) {
+            m_current.checksum = parts.at(i);
+            break;
+        }
+    }
+}
+
+int FtpClient::get(const QString &path, QIODevice *device, qint64 offset, qint64 length)
+{
+    Operation op;
+    op.command = Get;
+    op.path = path;
+    op.device = device;
+    op.usesData = true;
+    op.done = offset;
+    op.end = length >= 0 ? offset + length : -1;
+    op.steps << QStringLiteral("PASV");
+    if (offset > 0) {
+        op.steps << QStringLiteral("REST %1").arg(offset);
+    }
+    op.steps << QStringLiteral("RETR ") + path;
+    return enqueue(op);
+}
+
+int FtpClient::put(QIODevice *device, const QString &path, qint64 offset, bool append)
+{
+    Operation op;
+    op.command = Put;
+    op.path = path;
+    op.device = device;
+    op.usesData = true;
+    op.done = offset;
+    op.total = (device && !device->isSequential()) ? device->size() : -1;
+    op.steps << QStringLiteral("PASV");
+    if (append) {
+        op.steps << QStringLiteral("APPE ") + path;
+    } else {
+        if (offset > 0) {
+            op.steps << QStringLiteral("REST %1").arg(offset);
+        }
+        op.steps << QStringLiteral("STOR ") + path;
+    }
+    return enqueue(op);
+}
+
+void FtpClient::setBandwidthLimiter(BandwidthLimiter *limiter)
+{
+    if (m_limiter) {
+        disconnect(m_limiter, nullptr, this, nullptr);
+        if (m_limiterStream) {
+            m_limiter->closeStream(m_limiterStream);
+        }
+    }
+    // En pågående överföring fortsätter obegränsad
+    m_limiterStream = 0;
+    m_limiter = limiter;
+    if (limiter) {
+        connect(limiter, &BandwidthLimiter::tokensAvailable, this, &FtpClient::onTokensAvailable);
+    }
+    onTokensAvailable();
+}
+
+int FtpClient::size(const QString &path)
+{
+    Operation op;
+    op.command = Size;
+    op.path = path;
+    op.steps << QStringLiteral("SIZE ") + path;
+    return enqueue(op);
+}
+
+int FtpClient::rawCommand(const QString &command)
+{
+    Operation op;
+    op.command = Raw;
+    op.steps << command;
+    return enqueue(op);
+}
+
+int FtpClient::rename(const QString &oldPath, const QString &newPath)
+{
+    Operation op;
+    op.command = Rename;
+    op.path = oldPath;
+    op.steps << QStringLiteral("RNFR ") + oldPath
+             << QStringLiteral("RNTO ") + newPath;
+    return enqueue(op);
+}
+
+int FtpClient::currentId() const
+{
+    return m_busy ? m_current.id : 0;
+}
+
+int FtpClient::lastReplyCode() const
+{
+    return m_lastReplyCode;
+}
+
+QString FtpClient::lastReplyText() const
+{
+    return m_lastReplyText;
+}
+
+QString FtpClient::lastStep() const
+{
+    return m_lastStep;
+}
+
+int FtpClient::enqueue(Operation op)
+{
+    op.id = ++m_nextId;
+    m_pending.enqueue(op);
+
+    // Starta direkt om kontrollanslutningen är ledig
+    if (m_state == LoggedIn && !m_busy) {
+        startNextOperation();
+    }
+    return op.id;
+}
+
+void FtpClient::startNextOperation()
+{
+    if (m_busy || m_pending.isEmpty()) {
+        return;
+    }
+
+    m_current = m_pending.dequeue();
+    m_busy = true;
+    emit commandStarted(m_current.id);
+
+    sendNextStep();
+}
+
+void FtpClient::sendNextStep()
+{
+    if (m_current.steps.isEmpty()) {
+        finishOperation(false);
+        return;
+    }
+
+    m_currentStep = m_current.steps.takeFirst();
+
+    // PASV är en platshållare för "öppna en datakanal"; välj EPSV när det går
+    if (m_currentStep == QLatin1String("PASV") && m_epsvEnabled) {
+        m_currentStep = QStringLiteral("EPSV");
+    }
+
+    sendLine(m_currentStep);
+}
+
+void FtpClient::sendLine(const QString &line)
+{
+    if (line.startsWith(QLatin1String("PASS "))) {
+        emit commandSent(QStringLiteral("PASS ****"));
+    } else {
+        emit commandSent(line);
+    }
+
+    m_control->write(line.toUtf8() + "\r\n");
+}
+
+void FtpClient::onControlConnected()
+{
+    // Vänta på serverns hälsning innan något skickas
+}
+
+void FtpClient::onControlReadyRead()
+{
+    while (m_control->canReadLine()) {
+        QByteArray raw = m_control->readLine();
+        while (raw.endsWith('\n') || raw.endsWith('\r')) {
+            raw.chop(1);
+        }
+        const QString line = QString::fromUtf8(raw);
+
+        if (line.size() < 3) {
+            continue;
+        }
+
+        bool ok = false;
+        int code = line.left(3).toInt(&ok);
+        QChar separator = line.size() > 3 ? line.at(3) : QChar(' ');
+
+        if (!m_inMultiLine) {
+            if (!ok) {
+                continue;
+            }
+            m_replyCode = code;
+            m_replyText = line.mid(4);
+            if (separator == QLatin1Char('-')) {
+                m_inMultiLine = true;
+                continue;
+            }
+        } else {
+            // Flerradigt svar avslutas av en rad med samma kod följd av mellanslag
+            if (ok && code == m_replyCode && separator == QLatin1Char(' ')) {
+                m_replyText += QLatin1Char('\n') + line.mid(4);
+                m_inMultiLine = false;
+            } else {
+                m_replyText += QLatin1Char('\n') + line;
+                continue;
+            }
+        }
+
+        m_lastReplyCode = m_replyCode;
+        m_lastReplyText = m_replyText;
+        emit replyReceived(m_replyCode, m_replyText);
+        handleReply(m_replyCode, m_replyText);
+    }
+}
+
+void FtpClient::handleReply(int code, const QString &text)
+{
+    // Hälsningen från servern; inloggningen ligger först i kön och startar här
+    if (m_state == Connecting && !m_busy) {
+        if (code == 120) {
+            return; // Servern är inte redo än
+        }
+        if (code != 220) {
+            failAll(tr("Servern vägrade anslutning: %1").arg(text));
+            abort();
+            return;
+        }
+        startNextOperation();
+        return;
+    }
+
+    if (!m_busy) {
+        return; // Oväntat svar, t.ex. 421 efter timeout hanteras vid frånkoppling
+    }
+
+    const QString step = m_currentStep;
+
+    // Svaret på det sista steget som skickades före abortOperation()
+    if (m_current.aborted) {
+        if (code >= 200) {
+            finishOperation(true, tr("Operationen avbröts"));
+        }
+        return;
+    }
+
+    // Preliminära svar
+    if (code >= 100 && code < 200) {
+        if (isTransferStep(step)) {
+            m_current.transferStarted = true;
+            if (m_current.command == Put) {
+                writeUploadData();
+            }
+        }
+        return;
+    }
+
+    // FEAT och OPTS är frivilliga; äldre servrar svarar 500 och det är inget fel
+    if (step == QLatin1String("FEAT")) {
+        if (code == 211) {
+            parseFeatures(text);
+            if (hasFeature(QStringLiteral("UTF8"))) {
+                m_current.steps.prepend(QStringLiteral("OPTS UTF8 ON"));
+            }
+        }
+        sendNextStep();
+        return;
+    }
+    if (step.startsWith(QLatin1String("OPTS "))) {
+        sendNextStep();
+        return;
+    }
+
+    // MLSD som inte stöds trots FEAT: gör om listningen med LIST
+    if (step.startsWith(QLatin1String("MLSD")) && (code == 500 || code == 502 || code == 504)) {
+        m_mlsdEnabled = false;
+        closeDataConnection();
+        m_current.listing.clear();
+        m_current.done = 0;
+        m_current.transferStarted = false;
+        m_current.replyFinished = false;
+        m_current.dataFinished = false;
+        m_current.steps.prepend(m_current.path.isEmpty() ? QStringLiteral("LIST")
+                                                         : QStringLiteral("LIST ") + m_current.path);
+        m_current.steps.prepend(QStringLiteral("PASV"));
+        sendNextStep();
+        return;
+    }
+
+    // Öppna datakanal
+    if (step == QLatin1String("EPSV") || step == QLatin1String("PASV")) {
+        if (code >= 200 && code < 300) {
+            if (!openDataConnection(code, text)) {
+                finishOperation(true, tr("Kunde inte tolka svar på %1: %2").arg(step, text));
+                return;
+            }
+            sendNextStep();
+            return;
+        }
+        if (step == QLatin1String("EPSV") && code >= 500) {
+            // Servern saknar EPSV, försök igen med PASV
+            m_epsvEnabled = false;
+            m_current.steps.prepend(QStringLiteral("PASV"));
+            sendNextStep();
+            return;
+        }
+        finishOperation(true, text);
+        return;
+    }
+
+    // USER kan ge 230 direkt om lösenord inte krävs
+    if (step.startsWith(QLatin1String("USER "))) {
+        if (code == 230) {
+            if (!m_current.steps.isEmpty() && m_current.steps.first().startsWith(QLatin1String("PASS "))) {
+                m_current.steps.removeFirst();
+            }
+            sendNextStep();
+            return;
+        }
+        if (code == 331) {
+            sendNextStep();
+            return;
+        }
+        finishOperation(true, tr("Inloggningen misslyckades: %1").arg(text));
+        return;
+    }
+
+    // Positiva mellansvar (RNFR, REST)
+    if (code >= 300 && code < 400) {
+        sendNextStep();
+        return;
+    }
+
+    if (code >= 400) {
+        finishOperation(true, text);
+        return;
+    }
+
+    // Positivt slutsvar
+    if (code == 213 && m_current.command == Size) {
+        bool ok = false;
+        qint64 value = text.trimmed().toLongLong(&ok);
+        if (!ok) {
+            finishOperation(true, tr("Ogiltigt svar på SIZE: %1").arg(text));
+            return;
+        }
+        m_current.total = value;
+    }
+
+    if (m_current.command == Checksum) {
+        parseChecksumReply(step, text);
+        if (m_current.checksum.isEmpty()) {
+            finishOperation(true, tr("Ogiltigt svar på %1: %2").arg(step.section(QLatin1Char(' '), 0, 0), text));
+            return;
+        }
+    }
+
+    if (isTransferStep(step)) {
+        m_current.replyFinished = true;
+        checkTransferFinished();
+        return;
+    }
+
+    sendNextStep();
+}
+
+bool FtpClient::openDataConnection(int code, const QString &text)
+{
+    quint16 port = 0;
+
+    if (code == 229) {
+        // 229 Entering Extended Passive Mode (|||6446|)
+        static const QRegularExpression epsvRe(QStringLiteral("\\((.)\\1\\1(\\d+)\\1\\)"));
+        QRegularExpressionMatch match = epsvRe.match(text);
+        if (!match.hasMatch()) {
+            return false;
+        }
+        port = match.captured(2).toUShort();
+    } else {
+        // 227 Entering Passive Mode (h1,h2,h3,h4,p1,p2)
+        static const QRegularExpression pasvRe(
+            QStringLiteral("(\\d+),(\\d+),(\\d+),(\\d+),(\\d+),(\\d+)"));
+        QRegularExpressionMatch match = pasvRe.match(text);
+        if (!match.hasMatch()) {
+            return false;
+        }
+        port = quint16(match.captured(5).toUInt() * 256 + match.captured(6).toUInt());
+    }
+
+    if (port == 0) {
+        return false;
+    }
+
+    closeDataConnection();
+
+    // Anslut alltid till kontrollanslutningens motpart; adressen i 227-svaret
+    // är ofta en intern adress bakom NAT
+    m_data = new QTcpSocket(this);
+    m_data->setReadBufferSize(DATA_READ_BUFFER_SIZE);
+    connect(m_data, &QTcpSocket::connected, this, &FtpClient::onDataConnected);
+    connect(m_data, &QTcpSocket::readyRead, this, &FtpClient::onDataReadyRead);
+    connect(m_data, &QTcpSocket::bytesWritten, this, &FtpClient::onDataBytesWritten);
+    connect(m_data, &QTcpSocket::disconnected, this, &FtpClient::onDataDisconnected);
+    connect(m_data, &QAbstractSocket::errorOccurred, this, &FtpClient::onDataError);
+    m_data->connectToHost(m_control->peerAddress(), port);
+
+    if (m_limiter && (m_current.command == Get || m_current.command == Put)) {
+        m_limiterStream = m_limiter->openStream(m_host);
+    }
+    return true;
+}
+
+void FtpClient::closeDataConnection()
+{
+    if (m_readPaused && m_current.device) {
+        disconnect(m_current.device, &QIODevice::bytesWritten, this, &FtpClient::onDeviceBytesWritten);
+    }
+    m_readPaused = false;
+
+    if (m_limiterStream) {
+        if (m_limiter) {
+            m_limiter->closeStream(m_limiterStream);
+        }
+        m_limiterStream = 0;
+    }
+    m_throttled = false;
+
+    if (!m_data) {
+        return;
+    }
+
+    disconnect(m_data, nullptr, this, nullptr);
+    m_data->abort();
+    m_data->deleteLater();
+    m_data = nullptr;
+}
+
+void FtpClient::onDataConnected()
+{
+    if (m_busy && m_current.command == Put && m_current.transferStarted) {
+        writeUploadData();
+    }
+}
+
+void FtpClient::onDataReadyRead()
+{
+    if (!m_data || !m_busy || m_readPaused || m_throttled) {
+        return;
+    }
+
+    if (m_readBuffer.size() != DOWNLOAD_CHUNK_SIZE) {
+        m_readBuffer.resize(DOWNLOAD_CHUNK_SIZE);
+    }
+
+    qint64 received = 0;
+    while (m_data && m_data->bytesAvailable() > 0) {
+        QIODevice *device = m_current.device;
+
+        // Mottryck: låt socketens buffert fyllas i stället för minnet om
+        // målenheten inte hinner skriva
+        if (device && device->bytesToWrite() > DEVICE_HIGH_WATERMARK) {
+            m_readPaused = true;
+            connect(device, &QIODevice::bytesWritten,
+                    this, &FtpClient::onDeviceBytesWritten, Qt::UniqueConnection);
+            break;
+        }
+
+        qint64 want = DOWNLOAD_CHUNK_SIZE;
+        if (m_current.end >= 0) {
+            want = qMin(want, m_current.end - m_current.done);
+        }
+
+        // Bandbredd: det som inte läses blir kvar i socketen, och när dess
+        // buffert är full stänger TCP-fönstret och servern bromsas
+        if (want > 0 && m_limiterStream && m_limiter) {
+            want = m_limiter->acquire(m_limiterStream, qMin(want, m_data->bytesAvailable()));
+            if (want == 0) {
+                m_throttled = true;
+                break;
+            }
+        }
+
+        qint64 n = want > 0 ? m_data->read(m_readBuffer.data(), want) : 0;
+        if (n <= 0) {
+            break;
+        }
+
+        if (m_current.command == List) {
+            m_current.listing.append(m_readBuffer.constData(), int(n));
+            emit listingData(m_current.id, QByteArray(m_readBuffer.constData(), int(n)),
+                             m_currentStep.startsWith(QLatin1String("MLSD")));
+        } else if (device) {
+            if (device->write(m_readBuffer.constData(), n) != n) {
+                finishOperation(true, tr("Kunde inte skriva data: %1").arg(device->errorString()));
+                return;
+            }
+        }
+
+        m_current.done += n;
+        received += n;
+    }
+
+    if (received > 0) {
+        emit dataTransferProgress(m_current.id, m_current.done, m_current.total);
+    }
+
+    // Begränsad RETR: allt som begärdes har kommit. Servern skickar resten
+    // av filen tills datakanalen stängs, så avsluta operationen och sessionen
+    if (m_busy && m_current.end >= 0 && m_current.done >= m_current.end) {
+        finishOperation(false);
+        abort();
+        return;
+    }
+
+    // Kanalen kan ha stängts medan läsningen var pausad
+    if (!m_readPaused && m_current.dataFinished) {
+        checkTransferFinished();
+    }
+}
+
+void FtpClient::onDeviceBytesWritten(qint64 bytes)
+{
+    Q_UNUSED(bytes);
+
+    QIODevice *device = m_current.device;
+    if (!m_readPaused || (device && device->bytesToWrite() > DEVICE_HIGH_WATERMARK / 2)) {
+        return;
+    }
+
+    if (device) {
+        disconnect(device, &QIODevice::bytesWritten, this, &FtpClient::onDeviceBytesWritten);
+    }
+    m_readPaused = false;
+    onDataReadyRead();
+}
+
+void FtpClient::onTokensAvailable()
+{
+    if (!m_throttled) {
+        return;
+    }
+
+    m_throttled = false;
+    if (m_current.command == Put) {
+        writeUploadData();
+    } else {
+        onDataReadyRead();
+    }
+}
+
+void FtpClient::writeUploadData()
+{
+    if (!m_data || m_data->state() != QAbstractSocket::ConnectedState || !m_current.device) {
+        return;
+    }
+
+    while (m_data->bytesToWrite() < UPLOAD_HIGH_WATERMARK) {
+        qint64 size = UPLOAD_CHUNK_SIZE;
+        if (m_limiterStream && m_limiter && !m_current.device->atEnd()) {
+            size = m_limiter->acquire(m_limiterStream, size);
+            if (size == 0) {
+                m_throttled = true;
+                return;
+            }
+        }
+
+        QByteArray chunk = m_current.device->read(size);
+        if (m_limiterStream && m_limiter && chunk.size() < size) {
+            m_limiter->release(m_limiterStream, size - chunk.size());
+        }
+        if (chunk.isEmpty()) {
+            // Allt är skickat när enheten är slut och bufferten tömd
+            if (m_current.device->atEnd() && m_data->bytesToWrite() == 0) {
+                m_data->disconnectFromHost();
+            }
+            return;
+        }
+        m_data->write(chunk);
+    }
+}
+
+void FtpClient::onDataBytesWritten(qint64 bytes)
+{
+    if (!m_busy || m_current.command != Put) {
+        return;
+    }
+
+    m_current.done += bytes;
+    emit dataTransferProgress(m_current.id, m_current.done, m_current.total);
+    writeUploadData();
+}
+
+void FtpClient::onDataDisconnected()
+{
+    if (!m_busy) {
+        return;
+    }
+
+    // Läs det som finns kvar innan kanalen räknas som stängd; är läsningen
+    // pausad avslutas överföringen när målenheten har hunnit ikapp
+    m_current.dataFinished = true;
+    if (m_data && m_data->bytesAvailable() > 0) {
+        onDataReadyRead();
+        return;
+    }
+
+    checkTransferFinished();
+}
+
+void FtpClient::onDataError(QAbstractSocket::SocketError socketError)
+{
+    // Servern stänger datakanalen när överföringen är klar
+    if (socketError == QAbstractSocket::RemoteHostClosedError) {
+        return;
+    }
+
+    if (m_busy && m_current.usesData) {
+        QString message = m_data ? m_data->errorString() : tr("Datakanalen bröts");
+        closeDataConnection();
+        finishOperation(true, tr("Fel på datakanalen: %1").arg(message));
+    }
+}
+
+void FtpClient::checkTransferFinished()
+{
+    if (!m_current.replyFinished || !m_current.dataFinished || m_readPaused) {
+        return;
+    }
+    if (m_data && m_data->bytesAvailable() > 0) {
+        return;
+    }
+
+    closeDataConnection();
+    sendNextStep();
+}
+
+void FtpClient::finishOperation(bool error, const QString &errorString)
+{
+    if (!m_busy) {
+        return;
+    }
+
+    Operation op = m_current;
+    const bool machineReadable = m_currentStep.startsWith(QLatin1String("MLSD"));
+    m_lastStep = m_currentStep;
+    m_current = Operation();
+    m_currentStep.clear();
+    m_busy = false;
+
+    if (op.usesData) {
+        closeDataConnection();
+    }
+
+    if (op.command == Login) {
+        if (error) {
+            emit commandFinished(op.id, true, errorString);
+            failAll(errorString);
+            abort();
+            return;
+        }
+        setState(LoggedIn);
+        emit loggedIn();
+    }
+
+    if (op.command == List && !error) {
+        emit listingReceived(op.id, op.listing, machineReadable);
+    }
+
+    if (op.command == Size && !error) {
+        emit sizeReceived(op.id, op.total);
+    }
+
+    if (op.command == Checksum && !error) {
+        emit checksumReceived(op.id, op.checksumAlgorithm, op.checksum);
+    }
+
+    emit commandFinished(op.id, error, errorString);
+
+    if (m_state == LoggedIn) {
+        startNextOperation();
+    }
+}
+
+void FtpClient::failAll(const QString &errorString)
+{
+    m_lastStep.clear();
+    if (m_busy) {
+        int id = m_current.id;
+        m_busy = false;
+        m_current = Operation();
+        m_currentStep.clear();
+        emit commandFinished(id, true, errorString);
+    }
+
+    while (!m_pending.isEmpty()) {
+        Operation op = m_pending.dequeue();
+        emit commandFinished(op.id, true, errorString);
+    }
+}
+
+void FtpClient::onControlDisconnected()
+{
+    closeDataConnection();
+
+    if (m_state == Closing) {
+        setState(Unconnected);
+        emit closed();
+        return;
+    }
+
+    // Tillståndet sätts först, så att den som får operationerna som
+    // misslyckade ser att anslutningen är borta och inte köar nya
+    if (m_state != Unconnected) {
+        setState(Unconnected);
+        failAll(tr("Anslutningen stängdes av servern"));
+        emit closed();
+    }
+}
+
+void FtpClient::onControlError(QAbstractSocket::SocketError socketError)
+{
+    if (socketError == QAbstractSocket::RemoteHostClosedError) {
+        return; // Hanteras i onControlDisconnected
+    }
+
+    if (m_state == Unconnected || m_state == Closing) {
+        return;
+    }
+
+    QString message = m_control->errorString();
+    setState(Unconnected);
+    failAll(message);
+    abort();
+    emit connectionError(message);
+}
+
+void FtpClient::setState(State state)
+{
+    if (m_state == state) {
+        return;
+    }
+    m_state = state;
+    emit stateChanged(state);
+}
+
+bool FtpClient::isTransferStep(const QString &step)
+{
+    return step.startsWith(QLatin1String("LIST"))
+        || step.startsWith(QLatin1String("MLSD"))
+        || step.startsWith(QLatin1String("RETR "))
+        || step.startsWith(QLatin1String("STOR "))
+        || step.startsWith(QLatin1String("APPE "));
+}
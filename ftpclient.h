@@ -0,0 +1,396 @@
+// ftpclient.h
+#ifndef FTPCLIENT_H
+#define FTPCLIENT_H
+
+#include <QObject>
+#include <QTcpSocket>
+#include <QPointer>
+#include <QQueue>
+#include <QHash>
+#include <QByteArray>
+#include <QStringList>
+
+class BandwidthLimiter;
+
+/**
+ * @brief FtpClient är en asynkron FTP-motor byggd direkt på QTcpSocket
+ *
+ * Klienten håller en autentiserad kontrollanslutning per session och öppnar
+ * själv datakanaler med EPSV (med reserv till PASV). Operationer köas och
+ * identifieras med ett id som återkommer i commandStarted() och
+ * commandFinished(), på samma sätt som i Qt 4:s QFtp.
+ */
+class FtpClient : public QObject
+{
+    Q_OBJECT
+
+public:
+    /**
+     * @brief Anslutningens tillstånd
+     */
+    enum State {
+        Unconnected,
+        Connecting,
+        LoggedIn,
+        Closing
+    };
+    Q_ENUM(State)
+
+    /**
+     * @brief Typ av köad operation
+     */
+    enum Command {
+        None,
+        Login,
+        List,
+        Get,
+        Put,
+        Raw,
+        Rename,
+        Size,
+        Checksum,
+        Quit
+    };
+    Q_ENUM(Command)
+
+    /**
+     * @brief Standardkonstruktor
+     * @param parent Förälderobjekt
+     */
+    explicit FtpClient(QObject *parent = nullptr);
+    ~FtpClient();
+
+    /**
+     * @brief Öppna kontrollanslutningen och logga in
+     * @param host Värdnamn eller IP-adress
+     * @param port Port
+     * @param username Användarnamn
+     * @param password Lösenord
+     * @return Id för inloggningsoperationen
+     */
+    int connectToHost(const QString &host, quint16 port,
+                      const QString &username, const QString &password);
+
+    /**
+     * @brief Avsluta sessionen med QUIT och stäng alla socketar
+     */
+    void close();
+
+    /**
+     * @brief Avbryt alla operationer och stäng anslutningen direkt
+     */
+    void abort();
+
+    /**
+     * @brief Avbryt en enskild operation och behåll sessionen
+     *
+     * En köad operation tas bort direkt. För en pågående överföring stängs
+     * datakanalen och inga fler steg skickas; operationen avslutas med fel
+     * när servern har svarat på det kommando som redan skickats, så att
+     * kontrollanslutningen är i takt när nästa operation startar.
+     * @param id Operationens id
+     * @return false om operationen inte finns
+     */
+    bool abortOperation(int id);
+
+    State state() const;
+    bool isLoggedIn() const;
+
+    /**
+     * @brief Lista en katalog
+     *
+     * MLSD används om servern annonserade MLST i FEAT, annars LIST. Svarar
+     * servern att MLSD inte stöds görs listningen om med LIST automatiskt.
+     * @param path Katalog att lista
+     * @return Operationens id
+     */
+    int list(const QString &path);
+
+    /**
+     * @brief Kontrollera om servern annonserade en funktion i FEAT
+     * @param feature Funktionens namn, t.ex. "MLST" eller "UTF8"
+     * @return true om funktionen stöds
+     */
+    bool hasFeature(const QString &feature) const;
+
+    /**
+     * @brief Hämta parametrarna för en funktion från FEAT
+     * @param feature Funktionens namn
+     * @return Resten av FEAT-raden, t.ex. "type*;size*;modify*;" för MLST
+     */
+    QString featureParameters(const QString &feature) const;
+
+    /**
+     * @brief Hämta en fil med RETR
+     * @param path Fjärrsökväg
+     * @param device Enhet som tar emot datat (måste vara öppen för skrivning)
+     *
+     * Datat skrivs till enheten i block om 64 KiB allteftersom det kommer in.
+     * Läsbufferten är begränsad och läsningen pausas om enheten inte hinner
+     * med, så minnesanvändningen är konstant oavsett filstorlek.
+     * @param offset Startposition i fjärrfilen (skickas som REST om > 0)
+     * @param length Antal byte att hämta, eller -1 för resten av filen.
+     *               FTP saknar ett sätt att avsluta RETR i förtid, så när
+     *               gränsen nås stängs hela sessionen; använd det bara som
+     *               sista operation i en egen session.
+     * @return Operationens id
+     */
+    int get(const QString &path, QIODevice *device, qint64 offset = 0, qint64 length = -1);
+
+    /**
+     * @brief Skicka en fil med STOR eller APPE
+     * @param device Enhet att läsa från (måste vara öppen för läsning och
+     *               stå på rätt position)
+     * @param path Fjärrsökväg
+     * @param offset Position i fjärrfilen där datat börjar
+     * @param append true för att använda APPE, annars REST + STOR när offset > 0
+     * @return Operationens id
+     */
+    int put(QIODevice *device, const QString &path, qint64 offset = 0, bool append = false);
+
+    /**
+     * @brief Begränsa get() och put() med en gemensam BandwidthLimiter
+     *
+     * Varje överföring får en egen ström i limitern, knuten till värden.
+     * Är hinkarna tomma slutar klienten läsa från datakanalen (så att
+     * TCP-fönstret stängs) respektive skriva till den tills de fyllts på.
+     * @param limiter Limitern, eller nullptr för obegränsat
+     */
+    void setBandwidthLimiter(BandwidthLimiter *limiter);
+
+    /**
+     * @brief Fråga efter en fils storlek med SIZE
+     * @param path Fjärrsökväg
+     * @return Operationens id; storleken skickas med sizeReceived()
+     */
+    int size(const QString &path);
+
+    /**
+     * @brief Kontrollsummor som servern kan räkna, enligt FEAT
+     *
+     * Både HASH och de äldre XCRC, XMD5, XSHA1, XSHA256 och XSHA512 räknas.
+     * @return Namn som HASH använder, t.ex. "CRC32", "MD5", "SHA-256"
+     */
+    QStringList checksumAlgorithms() const;
+
+    /**
+     * @brief Be servern räkna en kontrollsumma för en fil
+     *
+     * HASH används om servern har algoritmen där, och väljs då med
+     * OPTS HASH; annars motsvarande X-kommando.
+     * @param path Fjärrsökväg
+     * @param algorithm Ett namn från checksumAlgorithms()
+     * @return Operationens id, eller 0 om servern saknar algoritmen;
+     *         summan skickas med checksumReceived()
+     */
+    int checksum(const QString &path, const QString &algorithm);
+
+    /**
+     * @brief Skicka ett enkelt kontrollkommando, t.ex. "MKD /a"
+     * @param command Kommandorad utan CRLF
+     * @return Operationens id
+     */
+    int rawCommand(const QString &command);
+
+    /**
+     * @brief Byt namn med RNFR/RNTO
+     * @param oldPath Gammal sökväg
+     * @param newPath Ny sökväg
+     * @return Operationens id
+     */
+    int rename(const QString &oldPath, const QString &newPath);
+
+    /**
+     * @brief Hämta id för operationen som körs just nu
+     * @return Id, eller 0 om ingen operation körs
+     */
+    int currentId() const;
+
+    /**
+     * @brief Senaste svaret från servern (kod och text)
+     */
+    int lastReplyCode() const;
+    QString lastReplyText() const;
+
+    /**
+     * @brief Det sista kommandot som fick svar i den senast avslutade operationen
+     *
+     * Gäller under commandFinished(); visar t.ex. om ett namnbyte föll på
+     * RNFR eller RNTO. Tom om operationen avslutades utan svar från servern.
+     */
+    QString lastStep() const;
+
+signals:
+    void stateChanged(FtpClient::State state);
+    void loggedIn();
+    void closed();
+
+    /**
+     * @brief Signal som skickas när en köad operation börjar köras
+     * @param id Operationens id
+     */
+    void commandStarted(int id);
+
+    /**
+     * @brief Signal som skickas när en operation är klar
+     * @param id Operationens id
+     * @param error true om operationen misslyckades
+     * @param errorString Felbeskrivning (tom om inget fel)
+     */
+    void commandFinished(int id, bool error, const QString &errorString);
+
+    /**
+     * @brief Signal som skickas för varje rad som skickas på kontrollanslutningen
+     * @param command Kommandoraden (lösenord maskeras)
+     */
+    void commandSent(const QString &command);
+
+    /**
+     * @brief Signal som skickas för varje fullständigt serversvar
+     * @param code Svarskod
+     * @param text Svarstext
+     */
+    void replyReceived(int code, const QString &text);
+
+    /**
+     * @brief Signal som skickas när en listning har tagit emot all data
+     * @param id Operationens id
+     * @param data Rå listningsdata
+     * @param machineReadable true om datat kommer från MLSD, false för LIST
+     */
+    void listingReceived(int id, const QByteArray &data, bool machineReadable);
+
+    /**
+     * @brief Signal som skickas för varje block listningsdata som tas emot
+     *
+     * Blocken följer inte radgränser; mottagaren ansvarar för att spara en
+     * ofullständig sista rad till nästa block.
+     * @param id Operationens id
+     * @param data Nytt block rådata
+     * @param machineReadable true om datat kommer från MLSD, false för LIST
+     */
+    void listingData(int id, const QByteArray &data, bool machineReadable);
+
+    /**
+     * @brief Signal som skickas när ett SIZE-kommando har besvarats
+     * @param id Operationens id
+     * @param size Filens storlek i byte
+     */
+    void sizeReceived(int id, qint64 size);
+
+    /**
+     * @brief Signal som skickas när ett checksum() har besvarats
+     * @param id Operationens id
+     * @param algorithm Algoritmen som servern faktiskt använde
+     * @param digest Summan i hex, som servern skrev den
+     */
+    void checksumReceived(int id, const QString &algorithm, const QString &digest);
+
+    /**
+     * @brief Signal som skickas under överföring på datakanalen
+     * @param id Operationens id
+     * @param done Antal överförda byte
+     * @param total Totalt antal byte (-1 om okänt)
+     */
+    void dataTransferProgress(int id, qint64 done, qint64 total);
+
+    /**
+     * @brief Signal som skickas när kontrollanslutningen bryts oväntat
+     * @param errorString Felbeskrivning
+     */
+    void connectionError(const QString &errorString);
+
+private slots:
+    void onControlConnected();
+    void onControlReadyRead();
+    void onControlDisconnected();
+    void onControlError(QAbstractSocket::SocketError socketError);
+
+    void onDataConnected();
+    void onDataReadyRead();
+    void onDataBytesWritten(qint64 bytes);
+    void onDataDisconnected();
+    void onDataError(QAbstractSocket::SocketError socketError);
+    void onDeviceBytesWritten(qint64 bytes);
+    void onTokensAvailable();
+
+private:
+    /**
+     * @brief En köad operation och dess kontrollkommandon
+     */
+    struct Operation {
+        int id = 0;
+        Command command = None;
+        QStringList steps;          ///< Kontrollkommandon som skickas i tur och ordning
+        QString path;
+        QPointer<QIODevice> device;
+        QByteArray listing;
+        qint64 done = 0;
+        qint64 total = -1;
+        qint64 end = -1;            ///< Sista position + 1 för begränsad RETR
+        QString checksumAlgorithm;  ///< Svar på HASH/XCRC/XMD5/XSHA*
+        QString checksum;
+        bool usesData = false;      ///< Operationen öppnar en datakanal
+        bool transferStarted = false; ///< 125/150 mottaget
+        bool replyFinished = false; ///< 226/250 mottaget på kontrollanslutningen
+        bool dataFinished = false;  ///< Datakanalen är stängd
+        bool aborted = false;       ///< abortOperation(); avslutas vid nästa slutsvar
+    };
+
+    int enqueue(Operation op);
+    void startNextOperation();
+    void sendNextStep();
+    void sendLine(const QString &line);
+    void handleReply(int code, const QString &text);
+    bool openDataConnection(int code, const QString &text);
+    void closeDataConnection();
+    void writeUploadData();
+    void checkTransferFinished();
+    void finishOperation(bool error, const QString &errorString = QString());
+    void failAll(const QString &errorString);
+    void setState(State state);
+    void parseFeatures(const QString &text);
+    void parseChecksumReply(const QString &step, const QString &text);
+    static bool isTransferStep(const QString &step);
+
+    QTcpSocket *m_control;
+    QTcpSocket *m_data;
+
+    State m_state;
+    QString m_host;
+    quint16 m_port;
+    QString m_username;
+    QString m_password;
+
+    QQueue<Operation> m_pending;
+    Operation m_current;
+    QString m_currentStep;
+    bool m_busy;
+    int m_nextId;
+
+    // Tolkning av flerradiga svar ("123-" ... "123 ")
+    int m_replyCode;
+    QString m_replyText;
+    bool m_inMultiLine;
+    int m_lastReplyCode;
+    QString m_lastReplyText;
+    QString m_lastStep;
+
+    bool m_epsvEnabled;
+    bool m_mlsdEnabled;
+
+    // Funktioner från FEAT, nycklade på namn i versaler
+    QHash<QString, QString> m_features;
+    QString m_hashAlgorithm;    // Vald algoritm för HASH, se OPTS HASH
+
+    // Återanvänd läsbuffert för datakanalen och mottrycksflagga
+    QByteArray m_readBuffer;
+    bool m_readPaused;
+
+    // Bandbreddsbegränsning; strömmen finns bara medan en get()/put() har datakanal
+    QPointer<BandwidthLimiter> m_limiter;
+    int m_limiterStream;
+    bool m_throttled;           // Väntar på tokensAvailable()
+};
+
+#endif // FTPCLIENT_H
@@ -0,0 +1,468 @@
+// ftplistparser.cpp
+#include "ftplistparser.h"
+
+#include <QDateTime>
+#include <cstring>
+
+namespace {
+
+// Max antal fält som behövs före filnamnet: länkar, ägare, grupp, storlek
+// och tre datumfält
+const int MAX_TOKENS = 8;
+
+struct Token {
+    const char *begin;
+    const char *end;
+
+    int length() const { return int(end - begin); }
+};
+
+inline bool isSpace(char c)
+{
+    return c == ' ' || c == '\t';
+}
+
+inline bool isDigit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+inline bool isTypeChar(char c)
+{
+    return c == '-' || c == 'd' || c == 'b' || c == 'c' || c == 'l' || c == 'p' || c == 's';
+}
+
+inline bool isPermissionChar(char c)
+{
+    return c == '-' || c == 'r' || c == 'w' || c == 'x'
+        || c == 's' || c == 'S' || c == 't' || c == 'T';
+}
+
+// Läs ett heltal som består av enbart siffror
+bool parseNumber(const char *p, const char *end, qint64 *value)
+{
+    if (p == end) {
+        return false;
+    }
+
+    qint64 result = 0;
+    for (; p != end; ++p) {
+        if (!isDigit(*p)) {
+            return false;
+        }
+        result = result * 10 + (*p - '0');
+    }
+
+    *value = result;
+    return true;
+}
+
+bool parseNumber(const Token &token, int maxDigits, int *value)
+{
+    if (token.length() == 0 || token.length() > maxDigits) {
+        return false;
+    }
+
+    qint64 result = 0;
+    if (!parseNumber(token.begin, token.end, &result)) {
+        return false;
+    }
+
+    *value = int(result);
+    return true;
+}
+
+// "Jan" .. "Dec" till 1 .. 12, 0 om okänd
+int monthFromName(const Token &token)
+{
+    if (token.length() != 3) {
+        return 0;
+    }
+
+    const char *p = token.begin;
+    switch (p[0]) {
+    case 'J':
+        if (p[1] == 'a' && p[2] == 'n') return 1;
+        if (p[1] == 'u' && p[2] == 'n') return 6;
+        if (p[1] == 'u' && p[2] == 'l') return 7;
+        return 0;
+    case 'F':
+        return (p[1] == 'e' && p[2] == 'b') ? 2 : 0;
+    case 'M':
+        if (p[1] == 'a' && p[2] == 'r') return 3;
+        if (p[1] == 'a' && p[2] == 'y') return 5;
+        return 0;
+    case 'A':
+        if (p[1] == 'p' && p[2] == 'r') return 4;
+        if (p[1] == 'u' && p[2] == 'g') return 8;
+        return 0;
+    case 'S':
+        return (p[1] == 'e' && p[2] == 'p') ? 9 : 0;
+    case 'O':
+        return (p[1] == 'c' && p[2] == 't') ? 10 : 0;
+    case 'N':
+        return (p[1] == 'o' && p[2] == 'v') ? 11 : 0;
+    case 'D':
+        return (p[1] == 'e' && p[2] == 'c') ? 12 : 0;
+    default:
+        return 0;
+    }
+}
+
+// "H:MM" eller "HH:MM"
+bool parseTime(const Token &token, int *hour, int *minute)
+{
+    int len = token.length();
+    if (len < 4 || len > 5 || token.begin[len - 3] != ':') {
+        return false;
+    }
+
+    Token h = { token.begin, token.begin + len - 3 };
+    Token m = { token.begin + len - 2, token.end };
+    return parseNumber(h, 2, hour) && parseNumber(m, 2, minute);
+}
+
+// "YYYY-MM-DD"
+bool parseIsoDate(const Token &token, int *year, int *month, int *day)
+{
+    if (token.length() != 10 || token.begin[4] != '-' || token.begin[7] != '-') {
+        return false;
+    }
+
+    const char *p = token.begin;
+    return parseNumber(Token{ p, p + 4 }, 4, year)
+        && parseNumber(Token{ p + 5, p + 7 }, 2, month)
+        && parseNumber(Token{ p + 8, p + 10 }, 2, day);
+}
+
+// Jämför ett faktanamn skiftlägesokänsligt med ett namn i gemener
+bool factIs(const char *begin, const char *end, const char *name)
+{
+    for (; begin != end && *name; ++begin, ++name) {
+        char c = *begin;
+        if (c >= 'A' && c <= 'Z') {
+            c = char(c - 'A' + 'a');
+        }
+        if (c != *name) {
+            return false;
+        }
+    }
+    return begin == end && *name == 0;
+}
+
+// "YYYYMMDDHHMMSS[.sss]" i UTC
+QDateTime parseMlsdTime(const char *p, const char *end)
+{
+    if (end - p < 14) {
+        return QDateTime();
+    }
+
+    int year = 0, month = 0, day = 0, hour = 0, minute = 0, second = 0, msec = 0;
+    if (!parseNumber(Token{ p, p + 4 }, 4, &year)
+        || !parseNumber(Token{ p + 4, p + 6 }, 2, &month)
+        || !parseNumber(Token{ p + 6, p + 8 }, 2, &day)
+        || !parseNumber(Token{ p + 8, p + 10 }, 2, &hour)
+        || !parseNumber(Token{ p + 10, p + 12 }, 2, &minute)
+        || !parseNumber(Token{ p + 12, p + 14 }, 2, &second)) {
+        return QDateTime();
+    }
+
+    if (end - p > 15 && p[14] == '.') {
+        const char *fraction = p + 15;
+        int digits = 0;
+        for (; fraction != end && isDigit(*fraction) && digits < 3; ++fraction, ++digits) {
+            msec = msec * 10 + (*fraction - '0');
+        }
+        for (; digits < 3; ++digits) {
+            msec *= 10;
+        }
+    }
+
+    // Visa i lokal tid precis som LIST-tiderna
+    return QDateTime(QDate(year, month, day), QTime(hour, minute, second, msec), Qt::UTC).toLocalTime();
+}
+
+// Oktalt UNIX.mode ("0755") till "rwxr-xr-x"
+QString unixModeToString(const char *p, const char *end)
+{
+    qint64 mode = 0;
+    for (; p != end; ++p) {
+        if (*p < '0' || *p > '7') {
+            return QString();
+        }
+        mode = mode * 8 + (*p - '0');
+    }
+
+    static const char flags[] = "rwxrwxrwx";
+    QString result(9, QLatin1Char('-'));
+    for (int i = 0; i < 9; ++i) {
+        if (mode & (0400 >> i)) {
+            result[i] = QLatin1Char(flags[i]);
+        }
+    }
+    return result;
+}
+
+} // namespace
+
+FtpListParser::FtpListParser()
+{
+    // Läs klockan en gång per listning i stället för en gång per rad
+    const QDateTime cutoff = QDateTime::currentDateTime().addDays(1);
+    m_today = QDate::currentDate();
+    m_cutoffDate = cutoff.date();
+    m_cutoffTime = cutoff.time();
+}
+
+QList<ServerFileItem> FtpListParser::parse(const QByteArray &data) const
+{
+    QList<ServerFileItem> items;
+    items.reserve(int(data.count('\n')) + 1);
+
+    const char *p = data.constData();
+    const char *end = p + data.size();
+
+    while (p < end) {
+        const char *lineEnd = static_cast<const char *>(std::memchr(p, '\n', size_t(end - p)));
+        if (!lineEnd) {
+            lineEnd = end;
+        }
+
+        ServerFileItem item;
+        if (parseLine(p, lineEnd, &item)) {
+            items.append(item);
+        }
+
+        p = lineEnd + 1;
+    }
+
+    return items;
+}
+
+bool FtpListParser::parseLine(const char *begin, const char *end, ServerFileItem *item) const
+{
+    // Ta bort CR från CRLF-radslut
+    while (end > begin && (end[-1] == '\r')) {
+        --end;
+    }
+
+    // Rättigheter: typtecken följt av nio rättighetstecken
+    if (end - begin < 11 || !isTypeChar(begin[0])) {
+        return false;
+    }
+    for (int i = 1; i < 10; ++i) {
+        if (!isPermissionChar(begin[i])) {
+            return false;
+        }
+    }
+
+    const char *p = begin + 10;
+    // Vissa servrar markerar ACL:er eller SELinux-kontext direkt efter rättigheterna
+    if (*p == '+' || *p == '@' || *p == '.') {
+        ++p;
+    }
+    if (p == end || !isSpace(*p)) {
+        return false;
+    }
+
+    // Dela upp fälten fram till och med datumet
+    Token tokens[MAX_TOKENS];
+    int tokenCount = 0;
+    while (tokenCount < MAX_TOKENS) {
+        while (p != end && isSpace(*p)) {
+            ++p;
+        }
+        if (p == end) {
+            break;
+        }
+        const char *tokenBegin = p;
+        while (p != end && !isSpace(*p)) {
+            ++p;
+        }
+        tokens[tokenCount++] = Token{ tokenBegin, p };
+    }
+
+    // Storleken står efter 0-3 valfria fält (länkar, ägare, grupp). Pröva
+    // flest valfria fält först, precis som det giriga uttrycket gjorde tidigare
+    for (int sizeIndex = 3; sizeIndex >= 0; --sizeIndex) {
+        if (sizeIndex + 2 >= tokenCount) {
+            continue;
+        }
+
+        qint64 size = 0;
+        if (!parseNumber(tokens[sizeIndex].begin, tokens[sizeIndex].end, &size)) {
+            continue;
+        }
+
+        QDate date;
+        QTime time;
+        int lastDateToken = -1;
+
+        int year = 0, month = 0, day = 0, hour = 0, minute = 0;
+        const Token &first = tokens[sizeIndex + 1];
+        const Token &second = tokens[sizeIndex + 2];
+
+        if (parseIsoDate(first, &year, &month, &day)) {
+            // ISO-format: 2024-01-01 12:34
+            if (!parseTime(second, &hour, &minute)) {
+                continue;
+            }
+            date = QDate(year, month, day);
+            time = QTime(hour, minute);
+            lastDateToken = sizeIndex + 2;
+        } else if ((month = monthFromName(first)) != 0) {
+            // Unix-format: Jan 01 12:34 eller Jan 01 2023
+            if (sizeIndex + 3 >= tokenCount || !parseNumber(second, 2, &day)) {
+                continue;
+            }
+
+            const Token &third = tokens[sizeIndex + 3];
+            if (third.length() == 4 && parseNumber(third, 4, &year)) {
+                date = QDate(year, month, day);
+                time = QTime(0, 0);
+            } else if (parseTime(third, &hour, &minute)) {
+                // Tid angiven, året är innevarande år om datumet inte är i framtiden
+                year = m_today.year();
+                date = QDate(year, month, day);
+                time = QTime(hour, minute);
+                if (date > m_cutoffDate || (date == m_cutoffDate && time > m_cutoffTime)) {
+                    date = QDate(year - 1, month, day);
+                }
+            } else {
+                continue;
+            }
+            lastDateToken = sizeIndex + 3;
+        } else {
+            continue;
+        }
+
+        // Filnamnet är resten av raden efter datumet
+        const char *name = tokens[lastDateToken].end;
+        while (name != end && isSpace(*name)) {
+            ++name;
+        }
+        if (name == end) {
+            continue;
+        }
+
+        item->setName(QString::fromUtf8(name, int(end - name)));
+        item->setIsDirectory(begin[0] == 'd');
+        item->setSize(size);
+        item->setPermissions(QString::fromLatin1(begin, 10));
+        item->setLastModified(QDateTime(date, time));
+        return true;
+    }
+
+    return false;
+}
+
+QList<ServerFileItem> FtpListParser::parseMlsd(const QByteArray &data) const
+{
+    QList<ServerFileItem> items;
+    items.reserve(int(data.count('\n')) + 1);
+
+    const char *p = data.constData();
+    const char *end = p + data.size();
+
+    while (p < end) {
+        const char *lineEnd = static_cast<const char *>(std::memchr(p, '\n', size_t(end - p)));
+        if (!lineEnd) {
+            lineEnd = end;
+        }
+
+        ServerFileItem item;
+        if (parseMlsdLine(p, lineEnd, &item)) {
+            items.append(item);
+        }
+
+        p = lineEnd + 1;
+    }
+
+    return items;
+}
+
+bool FtpListParser::parseMlsdLine(const char *begin, const char *end, ServerFileItem *item) const
+{
+    while (end > begin && (end[-1] == '\r')) {
+        --end;
+    }
+
+    // Fakta och namn skiljs åt av exakt ett mellanslag; namnet kan alltså
+    // börja med mellanslag
+    const char *space = static_cast<const char *>(std::memchr(begin, ' ', size_t(end - begin)));
+    if (!space || space + 1 >= end) {
+        return false;
+    }
+
+    bool typeFound = false;
+    bool isDirectory = false;
+    bool isLink = false;
+    qint64 size = 0;
+    QDateTime modified;
+    QString mode;
+    const char *permBegin = nullptr;
+    const char *permEnd = nullptr;
+    const char *uniqueBegin = nullptr;
+    const char *uniqueEnd = nullptr;
+
+    const char *fact = begin;
+    while (fact < space) {
+        const char *factEnd = static_cast<const char *>(std::memchr(fact, ';', size_t(space - fact)));
+        if (!factEnd) {
+            factEnd = space;
+        }
+
+        const char *equals = static_cast<const char *>(std::memchr(fact, '=', size_t(factEnd - fact)));
+        if (equals) {
+            const char *value = equals + 1;
+
+            if (factIs(fact, equals, "type")) {
+                typeFound = true;
+                if (factIs(value, factEnd, "cdir") || factIs(value, factEnd, "pdir")) {
+                    return false;
+                }
+                isDirectory = factIs(value, factEnd, "dir");
+                // "OS.unix=slink" eller "OS.unix=slink:/mål"
+                isLink = factEnd - value >= 13 && factIs(value, value + 13, "os.unix=slink");
+            } else if (factIs(fact, equals, "size") || factIs(fact, equals, "sizd")) {
+                parseNumber(value, factEnd, &size);
+            } else if (factIs(fact, equals, "modify")) {
+                modified = parseMlsdTime(value, factEnd);
+            } else if (factIs(fact, equals, "perm")) {
+                permBegin = value;
+                permEnd = factEnd;
+            } else if (factIs(fact, equals, "unique")) {
+                uniqueBegin = value;
+                uniqueEnd = factEnd;
+            } else if (factIs(fact, equals, "unix.mode")) {
+                mode = unixModeToString(value, factEnd);
+            }
+        }
+
+        fact = factEnd + 1;
+    }
+
+    if (!typeFound) {
+        return false;
+    }
+
+    // Rättighetssträngen följer LIST-formatet när servern skickar UNIX.mode,
+    // annars visas MLSD-faktumet "perm" som det är (t.ex. "adfrw")
+    QString permissions;
+    if (!mode.isEmpty()) {
+        permissions = QLatin1Char(isDirectory ? 'd' : (isLink ? 'l' : '-')) + mode;
+    } else if (permBegin) {
+        permissions = QString::fromLatin1(permBegin, int(permEnd - permBegin));
+    }
+
+    const char *name = space + 1;
+    item->setName(QString::fromUtf8(name, int(end - name)));
+    item->setIsDirectory(isDirectory);
+    item->setSize(isDirectory ? 0 : size);
+    item->setPermissions(permissions);
+    item->setLastModified(modified);
+    if (uniqueBegin) {
+        item->setUniqueId(QString::fromLatin1(uniqueBegin, int(uniqueEnd - uniqueBegin)));
+    }
+    return true;
+}
@@ -0,0 +1,77 @@
+// ftplistparser.h
+#ifndef FTPLISTPARSER_H
+#define FTPLISTPARSER_H
+
+#include <QByteArray>
+#include <QDate>
+#include <QTime>
+#include <QList>
+#include "serverfileitem.h"
+
+/**
+ * @brief Tolkar LIST-svar i Unix-stil direkt från rådatan
+ *
+ * Tolkningen går i ett enda pass över QByteArray utan reguljära uttryck och
+ * utan att dela upp listningen i strängar först. De enda allokeringarna är
+ * namn- och rättighetssträngarna i varje ServerFileItem.
+ *
+ * Format som stöds:
+ * @code
+ * -rw-r--r-- 1 owner group    12345 Jan 01 12:34 filename.txt
+ * drwxr-xr-x 2 owner group     4096 Jan 01  2023 directory
+ * -rw-r--r-- 1 owner group    12345 2024-01-01 12:34 filename.txt
+ * @endcode
+ * Länkräknare, ägare och grupp är valfria.
+ *
+ * MLSD-svar (RFC 3659) tolkas med parseMlsd():
+ * @code
+ * type=file;size=12345;modify=20240101123456;perm=adfrw;unique=801U1A; filename.txt
+ * @endcode
+ */
+class FtpListParser
+{
+public:
+    /**
+     * @brief Skapa en tolkare; aktuellt datum läses en gång här
+     */
+    FtpListParser();
+
+    /**
+     * @brief Tolka en hel listning
+     * @param data Rå listningsdata
+     * @return Alla rader som kunde tolkas
+     */
+    QList<ServerFileItem> parse(const QByteArray &data) const;
+
+    /**
+     * @brief Tolka en enskild rad (utan radslut)
+     * @param begin Pekare till radens början
+     * @param end Pekare till radens slut
+     * @param item Fylls i om raden kunde tolkas
+     * @return true om raden var en giltig post
+     */
+    bool parseLine(const char *begin, const char *end, ServerFileItem *item) const;
+
+    /**
+     * @brief Tolka ett helt MLSD-svar
+     * @param data Rå listningsdata
+     * @return Alla poster utom "." och ".." (type=cdir/pdir)
+     */
+    QList<ServerFileItem> parseMlsd(const QByteArray &data) const;
+
+    /**
+     * @brief Tolka en enskild MLSD-rad (utan radslut)
+     * @param begin Pekare till radens början
+     * @param end Pekare till radens slut
+     * @param item Fylls i om raden kunde tolkas
+     * @return true om raden var en fil, katalog eller länk
+     */
+    bool parseMlsdLine(const char *begin, const char *end, ServerFileItem *item) const;
+
+private:
+    QDate m_today;
+    QDate m_cutoffDate;
+    QTime m_cutoffTime;
+};
+
+#endif // FTPLISTPARSER_H
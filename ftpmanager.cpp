@@ -1,24 +1,49 @@
 // ftpmanager.cpp
 #include "ftpmanager.h"
+#include "ftplistparser.h"
 
-#include <QUrl>
 #include <QDateTime>
-#include <QRegularExpression>
 #include <QFileInfo>
 #include <QDir>
+#include <QDebug>
+#include <QLoggingCategory>
+#include <QtEndian>
+
+// Genomströmning per nedladdning; slås på med QT_LOGGING_RULES="darkftp.ftp.throughput.debug=true"
+Q_LOGGING_CATEGORY(lcThroughput, "darkftp.ftp.throughput", QtWarningMsg)
+
+// Kontrollsummor som inte kunde jämföras; överföringen godkänns ändå
+Q_LOGGING_CATEGORY(lcChecksum, "darkftp.ftp.checksum", QtWarningMsg)
+
+// Ändelse för filer som håller på att laddas ner eller upp
+const QString PARTIAL_SUFFIX = QStringLiteral(".part");
+
+// Antal poster per listningsblock efter det första; större block ger färre
+// signaler och färre modelluppdateringar i vyn
+const int LISTING_CHUNK_ITEMS = 256;
 
 FtpManager::FtpManager(QObject *parent)
     : QObject(parent),
-    m_manager(new QNetworkAccessManager(this)),
+    m_client(new FtpClient(this)),
     m_port(21),
     m_connected(false),
+    m_resumeEnabled(true),
+    m_verifyChecksums(true),
     m_currentDirectory("/"),
-    m_currentListReply(nullptr),
-    m_currentUploadReply(nullptr),
-    m_currentDownloadReply(nullptr)
+    m_listingId(0),
+    m_segmentCount(1),
+    m_segmentThreshold(64 * 1024 * 1024),
+    m_limiter(nullptr)
 {
-    connect(m_manager, &QNetworkAccessManager::authenticationRequired,
-            this, &FtpManager::onAuthenticationRequired);
+    connect(m_client, &FtpClient::loggedIn, this, &FtpManager::onLoggedIn);
+    connect(m_client, &FtpClient::commandFinished, this, &FtpManager::onCommandFinished);
+    connect(m_client, &FtpClient::listingData, this, &FtpManager::onListingData);
+    connect(m_client, &FtpClient::sizeReceived, this, &FtpManager::onSizeReceived);
+    connect(m_client, &FtpClient::checksumReceived, this, &FtpManager::onChecksumReceived);
+    connect(m_client, &FtpClient::dataTransferProgress, this, &FtpManager::onDataTransferProgress);
+    connect(m_client, &FtpClient::commandSent, this, &FtpManager::commandSent);
+    connect(m_client, &FtpClient::closed, this, &FtpManager::onConnectionClosed);
+    connect(m_client, &FtpClient::connectionError, this, &FtpManager::onConnectionError);
 }
 
 FtpManager::~FtpManager()
@@ -29,38 +54,34 @@ FtpManager::~FtpManager()
 void FtpManager::connectToHost(const QString &host, const QString &username, 
                               const QString &password, quint16 port)
 {
+    if (m_connected || m_client->state() != FtpClient::Unconnected) {
+        disconnectFromHost();
+    }
+
     // Spara anslutningsinformationen
     m_host = host;
     m_username = username;
     m_password = password;
     m_port = port;
     
-    // Lista roten för att testa anslutningen
-    listDirectory("/");
+    // Öppna kontrollanslutningen; connected() skickas när inloggningen lyckats
+    m_client->connectToHost(host, port, username, password);
 }
 
 void FtpManager::disconnectFromHost()
 {
-    if (m_connected) {
-        // Avbryt pågående överföringar
-        if (m_currentListReply) {
-            m_currentListReply->abort();
-            m_currentListReply->deleteLater();
-            m_currentListReply = nullptr;
-        }
-        
-        if (m_currentUploadReply) {
-            m_currentUploadReply->abort();
-            m_currentUploadReply->deleteLater();
-            m_currentUploadReply = nullptr;
+    // Avbryt pågående överföringar och städa upp deras filer
+    for (auto it = m_operations.begin(); it != m_operations.end(); ++it) {
+        if (it->device) {
+            it->device->deleteLater();
         }
-        
-        if (m_currentDownloadReply) {
-            m_currentDownloadReply->abort();
-            m_currentDownloadReply->deleteLater();
-            m_currentDownloadReply = nullptr;
-        }
-        
+    }
+    m_operations.clear();
+    abortSegmentedDownloads();
+
+    m_client->close();
+
+    if (m_connected) {
         m_connected = false;
         emit disconnected();
     }
@@ -68,7 +89,9 @@ void FtpManager::disconnectFromHost()
 
 bool FtpManager::isConnected() const
 {
-    return m_connected;
+    // Klienten släpper inloggningen innan den rapporterar de operationer
+    // som bröts, medan disconnected() kommer efter dem
+    return m_connected && m_client->isLoggedIn();
 }
 
 QString FtpManager::currentDirectory() const
@@ -82,55 +105,75 @@ void FtpManager::listDirectory(const QString &path)
     if (dirPath.isEmpty()) {
         dirPath = m_currentDirectory;
     }
+    dirPath = resolvePath(dirPath);
     
-    QUrl url = createUrl(dirPath);
-    
-    QNetworkRequest request(url);
-    m_currentListReply = m_manager->get(request);
-    
-    connect(m_currentListReply, &QNetworkReply::finished, this, &FtpManager::onListFinished);
-    connect(m_currentListReply, QOverload<QNetworkReply::NetworkError>::of(&QNetworkReply::error),
-            this, &FtpManager::onNetworkError);
+    PendingOperation op;
+    op.type = PendingOperation::List;
+    op.remotePath = dirPath;
+    op.listingId = ++m_listingId;
+    m_operations.insert(m_client->list(dirPath), op);
+}
+
+void FtpManager::scanDirectory(const QString &path)
+{
+    PendingOperation op;
+    op.type = PendingOperation::Scan;
+    op.remotePath = resolvePath(path);
+    m_operations.insert(m_client->list(op.remotePath), op);
 }
 
 void FtpManager::uploadFile(const QString &localFilePath, const QString &remoteFilePath)
 {
-    QFile *file = new QFile(localFilePath, this);
+    QFileInfo localInfo(localFilePath);
+    if (!localInfo.isFile() || !localInfo.isReadable()) {
+        failTransfer(resolvePath(remoteFilePath), tr("Kunde inte öppna lokal fil: %1").arg(localFilePath));
+        return;
+    }
+    
+    // Datat skickas till en .part-fil bredvid målet. Bara en sådan fil kan
+    // vara en avbruten uppladdning härifrån; en äldre fil med målets namn
+    // får aldrig datat tillagt
+    PendingOperation op;
+    op.type = PendingOperation::UploadSize;
+    op.remotePath = resolvePath(remoteFilePath);
+    op.localPath = localFilePath;
+    m_operations.insert(m_client->size(op.remotePath + PARTIAL_SUFFIX), op);
+}
+
+void FtpManager::startUpload(PendingOperation op)
+{
+    // Kontrollsumman räknas på datat som FtpClient läser ur filen
+    op.verifyChecksum = m_verifyChecksums && chooseChecksumAlgorithm(&op.checksumAlgorithm);
+    HashingFile *file = new HashingFile(op.localPath, op.checksumAlgorithm, this);
     if (!file->open(QIODevice::ReadOnly)) {
-        emit error(tr("Kunde inte öppna lokal fil: %1").arg(file->errorString()));
+        failTransfer(op.remotePath, tr("Kunde inte öppna lokal fil: %1").arg(file->errorString()));
         file->deleteLater();
         return;
     }
     
-    QUrl url = createUrl(remoteFilePath);
-    QNetworkRequest request(url);
+    qint64 localSize = file->size();
+    bool resume = m_resumeEnabled && op.remoteSize > 0 && op.remoteSize < localSize
+                  && file->seek(op.remoteSize);
     
-    m_currentLocalUploadPath = localFilePath;
-    m_currentUploadPath = remoteFilePath;
-    
-    m_currentUploadReply = m_manager->put(request, file);
+    // Delen som redan finns på servern skickas inte och måste räknas för sig
+    if (resume && op.verifyChecksum && !file->hashExistingData(op.remoteSize)) {
+        op.verifyChecksum = false;
+    }
     
-    connect(m_currentUploadReply, &QNetworkReply::uploadProgress, 
-            this, &FtpManager::onUploadProgress);
-            
-    connect(m_currentUploadReply, &QNetworkReply::finished,
-            this, &FtpManager::onUploadFinished);
-            
-    connect(m_currentUploadReply, QOverload<QNetworkReply::NetworkError>::of(&QNetworkReply::error),
-            this, &FtpManager::onNetworkError);
+    op.type = PendingOperation::Upload;
+    op.device = file;
+    op.offset = resume ? op.remoteSize : 0;
+    op.expectedSize = localSize;
     
-    // Filobjektet raderas automatiskt när svaret är klart
-    file->setParent(m_currentUploadReply);
+    // Filobjektet raderas i onUploadFinished
+    const QString partPath = op.remotePath + PARTIAL_SUFFIX;
+    int id = resume ? m_client->put(file, partPath, op.offset, true)
+                    : m_client->put(file, partPath);
+    m_operations.insert(id, op);
 }
 
 void FtpManager::downloadFile(const QString &remoteFilePath, const QString &localFilePath)
 {
-    QUrl url = createUrl(remoteFilePath);
-    QNetworkRequest request(url);
-    
-    m_currentDownloadPath = remoteFilePath;
-    m_currentLocalDownloadPath = localFilePath;
-    
     // Skapa katalogstruktur om den inte finns
     QFileInfo fileInfo(localFilePath);
     QDir dir = fileInfo.dir();
@@ -138,321 +181,874 @@ void FtpManager::downloadFile(const QString &remoteFilePath, const QString &loca
         dir.mkpath(".");
     }
     
-    m_currentDownloadReply = m_manager->get(request);
-    
-    connect(m_currentDownloadReply, &QNetworkReply::downloadProgress,
-            this, &FtpManager::onDownloadProgress);
-            
-    connect(m_currentDownloadReply, &QNetworkReply::finished,
-            this, &FtpManager::onDownloadFinished);
-            
-    connect(m_currentDownloadReply, QOverload<QNetworkReply::NetworkError>::of(&QNetworkReply::error),
-            this, &FtpManager::onNetworkError);
+    // Storleken behövs både för att återuppta och för att verifiera
+    PendingOperation op;
+    op.type = PendingOperation::DownloadSize;
+    op.remotePath = resolvePath(remoteFilePath);
+    op.localPath = localFilePath;
+    m_operations.insert(m_client->size(op.remotePath), op);
 }
 
-void FtpManager::createDirectory(const QString &dirPath)
+void FtpManager::startDownload(PendingOperation op)
 {
-    QUrl url = createUrl(dirPath);
-    QNetworkRequest request(url);
+    // Stora filer hämtas i flera delar parallellt om det är påslaget
+    if (m_segmentCount > 1 && op.remoteSize >= m_segmentThreshold
+        && op.remoteSize >= m_segmentCount) {
+        startSegmentedDownload(op);
+        return;
+    }
     
-    // För att skapa en katalog med FTP, gör en PUT med en tom fil
-    // och lägg till parametern "mkdir"
-    url.setQuery("mkdir");
-    request.setUrl(url);
+    // Datat strömmas direkt till en .part-fil block för block, så hela filen
+    // behöver aldrig ligga i minnet och en avbruten överföring kan fortsätta
+    const QString partPath = op.localPath + PARTIAL_SUFFIX;
+    QFileInfo partInfo(partPath);
+    qint64 partSize = partInfo.exists() ? partInfo.size() : 0;
     
-    QNetworkReply *reply = m_manager->put(request, QByteArray());
+    bool resume = m_resumeEnabled && op.remoteSize > 0
+                  && partSize > 0 && partSize < op.remoteSize;
     
-    connect(reply, &QNetworkReply::finished, [=]() {
-        reply->deleteLater();
-        
-        if (reply->error() == QNetworkReply::NoError) {
-            emit directoryCreated(dirPath);
-        } else {
-            emit error(tr("Kunde inte skapa katalog: %1").arg(reply->errorString()));
-        }
-    });
+    op.verifyChecksum = m_verifyChecksums && chooseChecksumAlgorithm(&op.checksumAlgorithm);
+    HashingFile *file = new HashingFile(partPath, op.checksumAlgorithm, this);
+    if (resume && op.verifyChecksum && !file->hashExistingData(partSize)) {
+        op.verifyChecksum = false;
+    }
+    QIODevice::OpenMode mode = resume ? (QIODevice::WriteOnly | QIODevice::Append)
+                                      : (QIODevice::WriteOnly | QIODevice::Truncate);
+    if (!file->open(mode)) {
+        failTransfer(op.remotePath, tr("Kunde inte öppna lokal fil för skrivning: %1").arg(file->errorString()));
+        file->deleteLater();
+        return;
+    }
+    
+    op.type = PendingOperation::Download;
+    op.device = file;
+    op.offset = resume ? partSize : 0;
+    op.expectedSize = op.remoteSize;
+    op.timer.start();
     
-    connect(reply, QOverload<QNetworkReply::NetworkError>::of(&QNetworkReply::error),
-            this, &FtpManager::onNetworkError);
+    // Filobjektet raderas i onDownloadFinished
+    m_operations.insert(m_client->get(op.remotePath, file, op.offset), op);
 }
 
-void FtpManager::deleteFile(const QString &filePath)
+void FtpManager::abortTransfer(const QString &remotePath)
 {
-    QUrl url = createUrl(filePath);
-    QNetworkRequest request(url);
+    const QString path = resolvePath(remotePath);
     
-    QNetworkReply *reply = m_manager->deleteResource(request);
+    // abortOperation() kan svara direkt, så id:na samlas först
+    QList<int> ids;
+    for (auto it = m_operations.begin(); it != m_operations.end(); ++it) {
+        const PendingOperation::Type type = it->type;
+        const bool transfer = type == PendingOperation::UploadSize || type == PendingOperation::Upload
+                              || type == PendingOperation::UploadVerify || type == PendingOperation::UploadChecksum
+                              || type == PendingOperation::UploadRename || type == PendingOperation::DownloadSize
+                              || type == PendingOperation::Download || type == PendingOperation::DownloadChecksum;
+        if (transfer && it->remotePath == path) {
+            it->aborted = true;
+            ids.append(it.key());
+        }
+    }
+    for (int id : qAsConst(ids)) {
+        m_client->abortOperation(id);
+    }
     
-    connect(reply, &QNetworkReply::finished, [=]() {
-        reply->deleteLater();
-        
-        if (reply->error() == QNetworkReply::NoError) {
-            emit fileDeleted(filePath);
-        } else {
-            emit error(tr("Kunde inte radera fil: %1").arg(reply->errorString()));
+    // Segmenterade nedladdningar har egna sessioner som stängs
+    const QList<SegmentedDownload*> downloads = m_segmentedDownloads;
+    for (SegmentedDownload *download : downloads) {
+        if (download->remotePath != path) {
+            continue;
         }
-    });
+        // Den sista delen som avslutas tar bort download
+        QList<int> running;
+        for (int index = 0; index < download->segments.size(); ++index) {
+            if (download->segments.at(index).client) {
+                running.append(index);
+            }
+        }
+        for (int index : qAsConst(running)) {
+            onSegmentFinished(download, index, true, tr("Överföringen avbröts"));
+        }
+    }
+}
+
+void FtpManager::remoteChecksum(const QString &remotePath)
+{
+    PendingOperation op;
+    op.type = PendingOperation::RemoteChecksum;
+    op.remotePath = remotePath;
     
-    connect(reply, QOverload<QNetworkReply::NetworkError>::of(&QNetworkReply::error),
-            this, &FtpManager::onNetworkError);
+    int id = 0;
+    if (m_client->isLoggedIn() && chooseChecksumAlgorithm(&op.checksumAlgorithm)) {
+        id = m_client->checksum(resolvePath(remotePath), FileHasher::algorithmName(op.checksumAlgorithm));
+    }
+    if (id == 0) {
+        emit remoteChecksumReady(remotePath, op.checksumAlgorithm, QByteArray());
+        return;
+    }
+    m_operations.insert(id, op);
 }
 
-void FtpManager::deleteDirectory(const QString &dirPath)
+void FtpManager::setChecksumVerification(bool enabled)
+{
+    m_verifyChecksums = enabled;
+}
+
+bool FtpManager::checksumVerification() const
 {
-    QUrl url = createUrl(dirPath);
-    url.setQuery("rmdir");
-    QNetworkRequest request(url);
+    return m_verifyChecksums;
+}
+
+void FtpManager::setBandwidthLimiter(BandwidthLimiter *limiter)
+{
+    m_limiter = limiter;
+    m_client->setBandwidthLimiter(limiter);
+    for (SegmentedDownload *download : qAsConst(m_segmentedDownloads)) {
+        for (SegmentedDownload::Segment &segment : download->segments) {
+            if (segment.client) {
+                segment.client->setBandwidthLimiter(limiter);
+            }
+        }
+    }
+}
+
+void FtpManager::setResumeEnabled(bool enabled)
+{
+    m_resumeEnabled = enabled;
+}
+
+bool FtpManager::resumeEnabled() const
+{
+    return m_resumeEnabled;
+}
+
+void FtpManager::setSegmentedDownload(int segments, qint64 minimumSize)
+{
+    m_segmentCount = qMax(1, segments);
+    m_segmentThreshold = qMax<qint64>(0, minimumSize);
+}
+
+int FtpManager::segmentCount() const
+{
+    return m_segmentCount;
+}
+
+void FtpManager::startSegmentedDownload(const PendingOperation &op)
+{
+    const QString partPath = op.localPath + PARTIAL_SUFFIX;
+    
+    // Förallokera hela filen så att varje del kan skrivas på sin position
+    QFile partFile(partPath);
+    if (!partFile.open(QIODevice::WriteOnly | QIODevice::Truncate)
+        || !partFile.resize(op.remoteSize)) {
+        failTransfer(op.remotePath, tr("Kunde inte öppna lokal fil för skrivning: %1").arg(partFile.errorString()));
+        return;
+    }
+    partFile.close();
+    
+    // Delarnas CRC-32 kan slås ihop till hela filens; andra summor går inte att dela upp
+    FileHasher::Algorithm algorithm = FileHasher::Crc32;
+    
+    SegmentedDownload *download = new SegmentedDownload;
+    download->verifyChecksum = m_verifyChecksums && chooseChecksumAlgorithm(&algorithm)
+                              && algorithm == FileHasher::Crc32;
+    download->remotePath = op.remotePath;
+    download->localPath = op.localPath;
+    download->totalSize = op.remoteSize;
+    download->timer.start();
+    m_segmentedDownloads.append(download);
     
-    QNetworkReply *reply = m_manager->deleteResource(request);
+    const qint64 segmentSize = op.remoteSize / m_segmentCount;
     
-    connect(reply, &QNetworkReply::finished, [=]() {
-        reply->deleteLater();
+    for (int i = 0; i < m_segmentCount; ++i) {
+        SegmentedDownload::Segment segment;
+        segment.offset = i * segmentSize;
+        segment.length = (i == m_segmentCount - 1) ? op.remoteSize - segment.offset : segmentSize;
         
-        if (reply->error() == QNetworkReply::NoError) {
-            emit directoryDeleted(dirPath);
-        } else {
-            emit error(tr("Kunde inte radera katalog: %1").arg(reply->errorString()));
+        // Varje del har en egen fil-handle som står på delens startposition
+        segment.file = new HashingFile(partPath, FileHasher::Crc32, this);
+        if (!segment.file->open(QIODevice::ReadWrite) || !segment.file->seek(segment.offset)) {
+            download->failed = true;
+            download->errorString = segment.file->errorString();
+            delete segment.file;
+            break;
         }
-    });
+        
+        // Varje del får en egen session; FTP kan bara köra en RETR per kontrollanslutning
+        segment.client = new FtpClient(this);
+        segment.client->setBandwidthLimiter(m_limiter);
+        connect(segment.client, &FtpClient::commandSent, this, &FtpManager::commandSent);
+        connect(segment.client, &FtpClient::dataTransferProgress, this,
+                [this, download, i](int, qint64 position, qint64) {
+            onSegmentProgress(download, i, position);
+        });
+        connect(segment.client, &FtpClient::commandFinished, this,
+                [this, download, i](int id, bool failed, const QString &errorString) {
+            if (id == download->segments.at(i).getId) {
+                onSegmentFinished(download, i, failed, errorString);
+            }
+        });
+        
+        segment.client->connectToHost(m_host, m_port, m_username, m_password);
+        // Sista delen läser till filens slut och behöver ingen gräns
+        qint64 limit = (i == m_segmentCount - 1) ? -1 : segment.length;
+        segment.getId = segment.client->get(op.remotePath, segment.file, segment.offset, limit);
+        
+        download->segments.append(segment);
+        download->remaining++;
+    }
     
-    connect(reply, QOverload<QNetworkReply::NetworkError>::of(&QNetworkReply::error),
-            this, &FtpManager::onNetworkError);
+    if (download->remaining == 0) {
+        finishSegmentedDownload(download);
+    }
 }
 
-void FtpManager::rename(const QString &oldPath, const QString &newPath)
+void FtpManager::onSegmentProgress(SegmentedDownload *download, int index, qint64 position)
+{
+    download->segments[index].done = position - download->segments.at(index).offset;
+    
+    qint64 done = 0;
+    for (const SegmentedDownload::Segment &segment : download->segments) {
+        done += segment.done;
+    }
+    
+    emit transferProgress(done, download->totalSize, download->remotePath);
+}
+
+void FtpManager::onSegmentFinished(SegmentedDownload *download, int index, bool failed,
+                                   const QString &errorString)
+{
+    SegmentedDownload::Segment &segment = download->segments[index];
+    
+    if (failed && !download->failed) {
+        download->failed = true;
+        download->errorString = errorString;
+    }
+    
+    if (segment.file) {
+        segment.file->close();
+        segment.digest = segment.file->digest();
+        segment.file->deleteLater();
+        segment.file = nullptr;
+    }
+    if (segment.client) {
+        disconnect(segment.client, nullptr, this, nullptr);
+        segment.client->close();
+        segment.client->deleteLater();
+        segment.client = nullptr;
+    }
+    
+    if (--download->remaining == 0) {
+        finishSegmentedDownload(download);
+    }
+}
+
+void FtpManager::finishSegmentedDownload(SegmentedDownload *download)
 {
-    // För att byta namn med FTP, använd kommandot "rename"
-    QUrl url = createUrl(oldPath);
-    url.setQuery("rename=" + QUrl::toPercentEncoding(newPath));
-    QNetworkRequest request(url);
+    m_segmentedDownloads.removeOne(download);
     
-    QNetworkReply *reply = m_manager->put(request, QByteArray());
+    const QString partPath = download->localPath + PARTIAL_SUFFIX;
+    qint64 received = 0;
+    for (const SegmentedDownload::Segment &segment : download->segments) {
+        received += segment.done;
+    }
     
-    connect(reply, &QNetworkReply::finished, [=]() {
-        reply->deleteLater();
+    if (download->failed) {
+        failTransfer(download->remotePath, tr("Fel vid nedladdning av fil: %1").arg(download->errorString));
+        // Delarna kan inte återupptas var för sig, så den förallokerade filen tas bort
+        QFile::remove(partPath);
+    } else if (received != download->totalSize) {
+        failTransfer(download->remotePath,
+                     tr("Verifiering misslyckades för %1: %2 av %3 byte mottagna")
+                     .arg(download->remotePath).arg(received).arg(download->totalSize));
+        QFile::remove(partPath);
+    } else if (download->verifyChecksum) {
+        // Delarna skrevs i ordning från sina startpositioner, så deras
+        // summor kan läggas ihop till hela filens
+        quint32 crc = 0;
+        for (const SegmentedDownload::Segment &segment : download->segments) {
+            crc = FileHasher::crc32Combine(crc, qFromBigEndian<quint32>(segment.digest.constData()),
+                                           segment.done);
+        }
         
-        if (reply->error() == QNetworkReply::NoError) {
-            emit renamed(oldPath, newPath);
+        PendingOperation op;
+        op.remotePath = download->remotePath;
+        op.localPath = download->localPath;
+        op.expectedSize = download->totalSize;
+        op.timer = download->timer;
+        op.verifyChecksum = true;
+        op.checksumAlgorithm = FileHasher::Crc32;
+        op.localDigest.resize(4);
+        qToBigEndian(crc, op.localDigest.data());
+        requestChecksum(op, PendingOperation::DownloadChecksum);
+    } else {
+        if (QFile::exists(download->localPath)) {
+            QFile::remove(download->localPath);
+        }
+        if (QFile::rename(partPath, download->localPath)) {
+            // Genomströmning för jämförelse med en enda ström
+            qint64 elapsed = qMax<qint64>(1, download->timer.elapsed());
+            qCDebug(lcThroughput) << "Segmenterad nedladdning:" << download->remotePath
+                                  << download->segments.size() << "delar,"
+                                  << (download->totalSize / 1048576.0) / (elapsed / 1000.0) << "MB/s";
+            emit downloadFinished(download->remotePath);
         } else {
-            emit error(tr("Kunde inte byta namn: %1").arg(reply->errorString()));
+            failTransfer(download->remotePath, tr("Kunde inte spara fil: %1").arg(download->localPath));
         }
-    });
+    }
     
-    connect(reply, QOverload<QNetworkReply::NetworkError>::of(&QNetworkReply::error),
-            this, &FtpManager::onNetworkError);
+    delete download;
+}
+
+void FtpManager::abortSegmentedDownloads()
+{
+    const QList<SegmentedDownload*> downloads = m_segmentedDownloads;
+    for (SegmentedDownload *download : downloads) {
+        for (SegmentedDownload::Segment &segment : download->segments) {
+            if (segment.client) {
+                disconnect(segment.client, nullptr, this, nullptr);
+                segment.client->abort();
+                segment.client->deleteLater();
+            }
+            if (segment.file) {
+                segment.file->close();
+                segment.file->deleteLater();
+            }
+        }
+        delete download;
+    }
+    m_segmentedDownloads.clear();
+}
+
+void FtpManager::createDirectory(const QString &dirPath)
+{
+    PendingOperation op;
+    op.type = PendingOperation::Mkdir;
+    op.remotePath = dirPath;
+    m_operations.insert(m_client->rawCommand("MKD " + resolvePath(dirPath)), op);
+}
+
+void FtpManager::ensureDirectory(const QString &dirPath)
+{
+    PendingOperation op;
+    op.type = PendingOperation::EnsureDir;
+    op.remotePath = dirPath;
+    m_operations.insert(m_client->rawCommand("MKD " + resolvePath(dirPath)), op);
+}
+
+void FtpManager::deleteFile(const QString &filePath)
+{
+    PendingOperation op;
+    op.type = PendingOperation::RemoveFile;
+    op.remotePath = filePath;
+    m_operations.insert(m_client->rawCommand("DELE " + resolvePath(filePath)), op);
+}
+
+void FtpManager::deleteDirectory(const QString &dirPath)
+{
+    PendingOperation op;
+    op.type = PendingOperation::RemoveDir;
+    op.remotePath = dirPath;
+    m_operations.insert(m_client->rawCommand("RMD " + resolvePath(dirPath)), op);
+}
+
+void FtpManager::rename(const QString &oldPath, const QString &newPath)
+{
+    PendingOperation op;
+    op.type = PendingOperation::Rename;
+    op.remotePath = oldPath;
+    op.newPath = newPath;
+    m_operations.insert(m_client->rename(resolvePath(oldPath), resolvePath(newPath)), op);
 }
 
-void FtpManager::onAuthenticationRequired(QNetworkReply *reply, QAuthenticator *authenticator)
+void FtpManager::onLoggedIn()
 {
-    Q_UNUSED(reply);
+    m_connected = true;
+    emit connected();
     
-    authenticator->setUser(m_username);
-    authenticator->setPassword(m_password);
+    // Lista roten som första åtgärd, precis som SftpManager
+    listDirectory("/");
 }
 
-void FtpManager::onNetworkError(QNetworkReply::NetworkError error)
+void FtpManager::onConnectionClosed()
 {
-    QNetworkReply *reply = qobject_cast<QNetworkReply*>(sender());
-    if (reply) {
-        emit this->error(reply->errorString());
-    } else {
-        emit this->error(tr("Nätverksfel: %1").arg(error));
+    if (m_connected) {
+        m_connected = false;
+        emit disconnected();
     }
 }
 
-void FtpManager::onUploadProgress(qint64 bytesSent, qint64 bytesTotal)
+void FtpManager::onConnectionError(const QString &errorString)
 {
-    emit transferProgress(bytesSent, bytesTotal, m_currentUploadPath);
+    // Fel under inloggningen rapporteras redan via onCommandFinished
+    if (m_connected) {
+        emit error(tr("Nätverksfel: %1").arg(errorString));
+    }
+    onConnectionClosed();
 }
 
-void FtpManager::onDownloadProgress(qint64 bytesReceived, qint64 bytesTotal)
+void FtpManager::onListingData(int id, const QByteArray &data, bool machineReadable)
 {
-    emit transferProgress(bytesReceived, bytesTotal, m_currentDownloadPath);
+    auto it = m_operations.find(id);
+    if (it == m_operations.end()) {
+        return;
+    }
+
+    // Tolka bara hela rader; resten sparas till nästa block
+    it->listing.append(data);
+    it->machineReadable = machineReadable;
+    int lastNewline = it->listing.lastIndexOf('\n');
+    if (lastNewline < 0) {
+        return;
+    }
+
+    it->items += parseDirectoryListing(QByteArray::fromRawData(it->listing.constData(), lastNewline + 1),
+                                       machineReadable);
+    it->listing.remove(0, lastNewline + 1);
+    emitListingChunk(*it, false);
 }
 
-void FtpManager::onListFinished()
+void FtpManager::emitListingChunk(PendingOperation &op, bool force)
 {
-    if (m_currentListReply->error() != QNetworkReply::NoError) {
-        emit error(tr("Fel vid listning av katalog: %1").arg(m_currentListReply->errorString()));
-        m_currentListReply->deleteLater();
-        m_currentListReply = nullptr;
+    const int pending = op.items.size() - op.emittedItems;
+    if (pending == 0) {
+        return;
+    }
+
+    // Första blocket skickas direkt, därefter samlas poster ihop
+    if (!force && op.emittedItems > 0 && pending < LISTING_CHUNK_ITEMS) {
+        return;
+    }
+
+    if (op.type == PendingOperation::Scan) {
+        emit directoryScanChunk(op.remotePath, op.items.mid(op.emittedItems));
+    } else if (op.listingId == m_listingId) {
+        emit directoryListingChunk(op.listingId, op.remotePath, op.items.mid(op.emittedItems));
+    }
+    op.emittedItems = op.items.size();
+}
+
+void FtpManager::onSizeReceived(int id, qint64 size)
+{
+    auto it = m_operations.find(id);
+    if (it != m_operations.end()) {
+        it->remoteSize = size;
+    }
+}
+
+void FtpManager::onChecksumReceived(int id, const QString &algorithm, const QString &digest)
+{
+    auto it = m_operations.find(id);
+    if (it != m_operations.end()) {
+        it->remoteAlgorithm = algorithm;
+        it->remoteDigest = digest;
+    }
+}
+
+void FtpManager::onDataTransferProgress(int id, qint64 done, qint64 total)
+{
+    auto it = m_operations.constFind(id);
+    if (it == m_operations.constEnd()) {
         return;
     }
     
-    // Uppdatera anslutningsstatus
-    if (!m_connected) {
-        m_connected = true;
-        emit connected();
+    if (total < 0) {
+        total = it->expectedSize;
     }
     
-    // Uppdatera aktuell katalog
-    QUrl url = m_currentListReply->url();
-    m_currentDirectory = url.path();
+    if (it->type == PendingOperation::Upload || it->type == PendingOperation::Download) {
+        emit transferProgress(done, total, it->remotePath);
+    }
+}
+
+void FtpManager::onCommandFinished(int id, bool failed, const QString &errorString)
+{
+    auto it = m_operations.find(id);
+    if (it == m_operations.end()) {
+        // Inloggningen och okända operationer
+        if (failed && !m_connected) {
+            emit error(tr("Kunde inte ansluta: %1").arg(errorString));
+        }
+        return;
+    }
     
-    // Läs och tolka svaret
-    QByteArray data = m_currentListReply->readAll();
-    QList<ServerFileItem> items = parseDirectoryListing(data);
+    PendingOperation op = it.value();
+    m_operations.erase(it);
     
-    // Skicka signal
-    emit directoryListed(m_currentDirectory, items);
+    // Avbruten överföring: .part-filen sparas, men inget fler steg körs
+    if (op.aborted) {
+        if (op.device) {
+            op.device->close();
+            op.device->deleteLater();
+        }
+        failTransfer(op.remotePath, tr("Överföringen avbröts"));
+        return;
+    }
     
-    // Städa upp
-    m_currentListReply->deleteLater();
-    m_currentListReply = nullptr;
+    switch (op.type) {
+    case PendingOperation::List:
+        onListFinished(op, failed, errorString);
+        break;
+    case PendingOperation::Scan:
+        if (!failed) {
+            if (!op.listing.isEmpty()) {
+                op.items += parseDirectoryListing(op.listing, op.machineReadable);
+            }
+            emitListingChunk(op, true);
+        }
+        emit directoryScanFinished(op.remotePath, failed, errorString);
+        break;
+    case PendingOperation::UploadSize:
+        if (failed && !m_client->isLoggedIn()) {
+            failTransfer(op.remotePath, tr("Fel vid uppladdning av fil: %1").arg(errorString));
+            break;
+        }
+        // 550 betyder att .part-filen inte finns; börja då från början
+        startUpload(op);
+        break;
+    case PendingOperation::Upload:
+        onUploadFinished(op, failed, errorString);
+        break;
+    case PendingOperation::UploadVerify:
+        onUploadVerified(op, failed);
+        break;
+    case PendingOperation::UploadReplace:
+    case PendingOperation::RemovePartial:
+        // Fel ignoreras; filen fanns kanske inte
+        break;
+    case PendingOperation::UploadRename:
+        onUploadRenamed(op, failed, errorString);
+        break;
+    case PendingOperation::UploadChecksum:
+    case PendingOperation::DownloadChecksum:
+        onChecksumVerified(op, failed);
+        break;
+    case PendingOperation::RemoteChecksum: {
+        FileHasher::Algorithm algorithm = op.checksumAlgorithm;
+        QByteArray digest;
+        if (!failed && FileHasher::algorithmFromName(op.remoteAlgorithm, &algorithm)) {
+            digest = FileHasher::parseDigest(op.remoteDigest, algorithm);
+        }
+        emit remoteChecksumReady(op.remotePath, algorithm, digest);
+        break;
+    }
+    case PendingOperation::DownloadSize:
+        if (failed && !m_client->isLoggedIn()) {
+            failTransfer(op.remotePath, tr("Fel vid nedladdning av fil: %1").arg(errorString));
+            break;
+        }
+        // Servrar utan SIZE ger ett fel här; ladda då ner utan verifiering
+        startDownload(op);
+        break;
+    case PendingOperation::Download:
+        onDownloadFinished(op, failed, errorString);
+        break;
+    case PendingOperation::Mkdir:
+        if (failed) {
+            emit error(tr("Kunde inte skapa katalog: %1").arg(errorString));
+        } else {
+            emit directoryCreated(op.remotePath);
+        }
+        break;
+    case PendingOperation::EnsureDir:
+        emit directoryEnsured(op.remotePath);
+        break;
+    case PendingOperation::RemoveFile:
+        if (failed) {
+            emit error(tr("Kunde inte radera fil: %1").arg(errorString));
+        } else {
+            emit fileDeleted(op.remotePath);
+        }
+        break;
+    case PendingOperation::RemoveDir:
+        if (failed) {
+            emit error(tr("Kunde inte radera katalog: %1").arg(errorString));
+        } else {
+            emit directoryDeleted(op.remotePath);
+        }
+        break;
+    case PendingOperation::Rename:
+        if (failed) {
+            emit error(tr("Kunde inte byta namn: %1").arg(errorString));
+        } else {
+            emit renamed(op.remotePath, op.newPath);
+        }
+        break;
+    }
 }
 
-void FtpManager::onUploadFinished()
+void FtpManager::onListFinished(PendingOperation op, bool failed, const QString &errorString)
 {
-    if (m_currentUploadReply->error() != QNetworkReply::NoError) {
-        emit error(tr("Fel vid uppladdning av fil: %1").arg(m_currentUploadReply->errorString()));
-    } else {
-        emit uploadFinished(m_currentUploadPath);
+    if (failed) {
+        emit error(tr("Fel vid listning av katalog: %1").arg(errorString));
+        emit directoryListingFailed(op.listingId, op.remotePath, errorString);
+        return;
     }
     
-    // Städa upp
-    m_currentUploadReply->deleteLater();
-    m_currentUploadReply = nullptr;
-    m_currentUploadPath.clear();
-    m_currentLocalUploadPath.clear();
+    // En nyare listning har startat; den här visas inte
+    if (op.listingId != m_listingId) {
+        return;
+    }
+    
+    // Uppdatera aktuell katalog
+    m_currentDirectory = op.remotePath;
+    
+    // Sista raden saknar ibland radslut
+    if (!op.listing.isEmpty()) {
+        op.items += parseDirectoryListing(op.listing, op.machineReadable);
+    }
+    emitListingChunk(op, true);
+
+    emit directoryListingFinished(op.listingId, m_currentDirectory, op.items.size());
+    emit directoryListed(m_currentDirectory, op.items);
 }
 
-void FtpManager::onDownloadFinished()
+void FtpManager::onUploadFinished(const PendingOperation &op, bool failed, const QString &errorString)
 {
-    if (m_currentDownloadReply->error() != QNetworkReply::NoError) {
-        emit error(tr("Fel vid nedladdning av fil: %1").arg(m_currentDownloadReply->errorString()));
-    } else {
-        // Spara data till fil
-        QByteArray data = m_currentDownloadReply->readAll();
-        QFile file(m_currentLocalDownloadPath);
-        if (file.open(QIODevice::WriteOnly)) {
-            file.write(data);
-            file.close();
-            emit downloadFinished(m_currentDownloadPath);
-        } else {
-            emit error(tr("Kunde inte spara fil: %1").arg(file.errorString()));
+    // Summan för allt som lästes ur filen sparas innan den städas upp
+    PendingOperation verify = op;
+    if (HashingFile *file = qobject_cast<HashingFile*>(op.device)) {
+        verify.localDigest = file->digest();
+    }
+    if (op.device) {
+        op.device->deleteLater();
+    }
+    
+    if (failed) {
+        failTransfer(op.remotePath, tr("Fel vid uppladdning av fil: %1").arg(errorString));
+        // Behåll .part-filen så att uppladdningen kan återupptas
+        if (!m_resumeEnabled) {
+            removePartialUpload(op);
         }
+        return;
     }
     
-    // Städa upp
-    m_currentDownloadReply->deleteLater();
-    m_currentDownloadReply = nullptr;
-    m_currentDownloadPath.clear();
-    m_currentLocalDownloadPath.clear();
+    // Verifiera att filen på servern har samma storlek som den lokala
+    verify.type = PendingOperation::UploadVerify;
+    verify.device = nullptr;
+    verify.remoteSize = -1;
+    m_operations.insert(m_client->size(op.remotePath + PARTIAL_SUFFIX), verify);
 }
 
-QUrl FtpManager::createUrl(const QString &path) const
+void FtpManager::onUploadVerified(const PendingOperation &op, bool failed)
 {
-    QUrl url;
-    url.setScheme("ftp");
-    url.setHost(m_host);
+    // Servrar utan SIZE kan inte verifieras; lita då på 226-svaret
+    if (!failed && op.remoteSize != op.expectedSize) {
+        // En .part-fil med fel storlek går inte att fortsätta på
+        removePartialUpload(op);
+        failTransfer(op.remotePath,
+                     tr("Verifiering misslyckades för %1: %2 av %3 byte på servern")
+                     .arg(op.remotePath).arg(op.remoteSize).arg(op.expectedSize));
+        return;
+    }
     
-    if (m_port != 21) {
-        url.setPort(m_port);
+    if (op.verifyChecksum) {
+        requestChecksum(op, PendingOperation::UploadChecksum);
+        return;
     }
     
-    QString urlPath = path;
-    if (!urlPath.startsWith('/')) {
-        urlPath = m_currentDirectory;
-        if (!urlPath.endsWith('/')) {
-            urlPath += '/';
-        }
-        urlPath += path;
+    completeUpload(op);
+}
+
+void FtpManager::completeUpload(PendingOperation op)
+{
+    // Målet rörs först nu, när .part-filen är kontrollerad
+    op.type = PendingOperation::UploadRename;
+    m_operations.insert(m_client->rename(op.remotePath + PARTIAL_SUFFIX, op.remotePath), op);
+}
+
+void FtpManager::onUploadRenamed(PendingOperation op, bool failed, const QString &errorString)
+{
+    if (!failed) {
+        emit uploadFinished(op.remotePath);
+        return;
     }
     
-    url.setPath(urlPath);
+    // Många servrar byter inte namn till en fil som redan finns; ta bort
+    // den äldre versionen och försök en gång till. Bara när RNFR gick
+    // igenom och det var RNTO som nekades, annars finns inget som ersätter
+    // den fil som skulle tas bort
+    const bool targetRefused = m_client->isLoggedIn()
+            && m_client->lastStep().startsWith(QLatin1String("RNTO "));
+    if (!op.replaceTarget && targetRefused) {
+        op.replaceTarget = true;
+        PendingOperation replace;
+        replace.type = PendingOperation::UploadReplace;
+        replace.remotePath = op.remotePath;
+        m_operations.insert(m_client->rawCommand("DELE " + op.remotePath), replace);
+        m_operations.insert(m_client->rename(op.remotePath + PARTIAL_SUFFIX, op.remotePath), op);
+        return;
+    }
+    
+    failTransfer(op.remotePath, tr("Kunde inte byta namn på %1: %2")
+                 .arg(op.remotePath + PARTIAL_SUFFIX, errorString));
+}
+
+void FtpManager::removePartialUpload(const PendingOperation &op)
+{
+    PendingOperation remove;
+    remove.type = PendingOperation::RemovePartial;
+    remove.remotePath = op.remotePath + PARTIAL_SUFFIX;
+    m_operations.insert(m_client->rawCommand("DELE " + remove.remotePath), remove);
+}
+
+void FtpManager::onDownloadFinished(const PendingOperation &op, bool failed, const QString &errorString)
+{
+    HashingFile *file = qobject_cast<HashingFile*>(op.device);
+    
+    // Töm skrivbufferten innan resultatet rapporteras
+    bool flushed = !file || file->flush();
+    QString flushError = file ? file->errorString() : QString();
+    qint64 writtenSize = file ? file->size() : -1;
+    if (file) {
+        file->close();
+    }
     
-    // Lägg inte till användarinformation, den hanteras av QAuthenticator
+    if (failed) {
+        failTransfer(op.remotePath, tr("Fel vid nedladdning av fil: %1").arg(errorString));
+        // Behåll .part-filen så att nedladdningen kan återupptas
+        if (file && !m_resumeEnabled) {
+            file->remove();
+        }
+    } else if (!flushed) {
+        failTransfer(op.remotePath, tr("Kunde inte spara fil: %1").arg(flushError));
+    } else if (op.expectedSize >= 0 && writtenSize != op.expectedSize) {
+        failTransfer(op.remotePath,
+                     tr("Verifiering misslyckades för %1: %2 av %3 byte mottagna")
+                     .arg(op.remotePath).arg(writtenSize).arg(op.expectedSize));
+    } else if (file && op.verifyChecksum) {
+        // .part-filen döps om först när serverns summa stämmer
+        PendingOperation verify = op;
+        verify.device = nullptr;
+        verify.localDigest = file->digest();
+        verify.expectedSize = writtenSize;
+        requestChecksum(verify, PendingOperation::DownloadChecksum);
+    } else if (file) {
+        completeDownload(op, writtenSize);
+    }
     
-    return url;
+    // Städa upp
+    if (op.device) {
+        op.device->deleteLater();
+    }
 }
 
-QList<ServerFileItem> FtpManager::parseDirectoryListing(const QByteArray &data) const
+void FtpManager::completeDownload(const PendingOperation &op, qint64 receivedBytes)
 {
-    QList<ServerFileItem> items;
+    // Ersätt en eventuell äldre version och döp om .part-filen
+    const QString partPath = op.localPath + PARTIAL_SUFFIX;
+    if (QFile::exists(op.localPath)) {
+        QFile::remove(op.localPath);
+    }
+    if (!QFile::rename(partPath, op.localPath)) {
+        failTransfer(op.remotePath, tr("Kunde inte spara fil: %1").arg(op.localPath));
+        return;
+    }
     
-    // FTP-listning är vanligtvis i Unix-stil:
-    // -rw-r--r-- 1 owner group    12345 Jan 01 12:34 filename.txt
-    // drwxr-xr-x 2 owner group     4096 Jan 01 12:34 directory
+    // Genomströmning för jämförelse med segmenterad nedladdning
+    qint64 elapsed = qMax<qint64>(1, op.timer.elapsed());
+    qCDebug(lcThroughput) << "Nedladdning:" << op.remotePath
+                          << ((receivedBytes - op.offset) / 1048576.0) / (elapsed / 1000.0) << "MB/s";
+    emit downloadFinished(op.remotePath);
+}
+
+bool FtpManager::chooseChecksumAlgorithm(FileHasher::Algorithm *algorithm) const
+{
+    // CRC-32 först: den räknas med SIMD lokalt och är billigast för servern
+    static const FileHasher::Algorithm preferred[] = {
+        FileHasher::Crc32, FileHasher::Md5, FileHasher::Sha1, FileHasher::Sha256, FileHasher::Sha512
+    };
+    const QStringList available = m_client->checksumAlgorithms();
+    for (FileHasher::Algorithm candidate : preferred) {
+        if (available.contains(FileHasher::algorithmName(candidate))) {
+            *algorithm = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+void FtpManager::requestChecksum(PendingOperation op, PendingOperation::Type type)
+{
+    op.type = type;
+    op.device = nullptr;
+    
+    // En uppladdning ligger kvar i .part-filen tills summan stämmer
+    const QString path = type == PendingOperation::UploadChecksum ? op.remotePath + PARTIAL_SUFFIX
+                                                                  : op.remotePath;
+    const int id = m_client->checksum(path, FileHasher::algorithmName(op.checksumAlgorithm));
+    if (id == 0) {
+        onChecksumVerified(op, true);
+        return;
+    }
+    m_operations.insert(id, op);
+}
+
+void FtpManager::onChecksumVerified(const PendingOperation &op, bool failed)
+{
+    const bool upload = op.type == PendingOperation::UploadChecksum;
     
-    QString listing = QString::fromUtf8(data);
-    QStringList lines = listing.split('\n', Qt::SkipEmptyParts);
+    // Servern kunde inte räkna summan, t.ex. för att den tar för lång tid;
+    // storleken är redan kontrollerad så överföringen godkänns ändå
+    FileHasher::Algorithm algorithm = op.checksumAlgorithm;
+    QByteArray remoteDigest;
+    if (!failed && FileHasher::algorithmFromName(op.remoteAlgorithm, &algorithm)
+        && algorithm == op.checksumAlgorithm) {
+        remoteDigest = FileHasher::parseDigest(op.remoteDigest, algorithm);
+    }
     
-    for (const QString &line : lines) {
-        // Ignorera icke-listningsrader (t.ex. "total 123")
-        if (line.startsWith("total ") || line.trimmed().isEmpty()) {
-            continue;
+    if (remoteDigest.isEmpty()) {
+        qCWarning(lcChecksum) << "Kontrollsumman kunde inte jämföras för" << op.remotePath
+                              << op.remoteAlgorithm << op.remoteDigest;
+    } else if (remoteDigest != op.localDigest) {
+        // En felaktig .part-fil får inte återupptas, den börjar om från noll
+        if (upload) {
+            removePartialUpload(op);
+        } else {
+            QFile::remove(op.localPath + PARTIAL_SUFFIX);
         }
-        
-        // Tolka listningsraden
-        QRegularExpression re("^([\\-dbclps])([rwxsStT\\-]{9})\\s+"    // Permissions
-                             "(?:\\d+\\s+)?"                          // Link count (optional)
-                             "(?:[^\\s]+\\s+)?"                       // Owner (optional)
-                             "(?:[^\\s]+\\s+)?"                       // Group (optional)
-                             "(\\d+)\\s+"                            // Size
-                             "(?:(\\w{3})\\s+(\\d{1,2})\\s+"          // Month, Day
-                             "(?:(\\d{4})|([0-9:]{4,5}))\\s+|"        // Year or Time
-                             "(\\d{4})-(\\d{2})-(\\d{2})\\s+"         // ISO Date
-                             "(\\d{2}):(\\d{2})\\s+)"                 // ISO Time
-                             "(.+)$");                               // Filename
-        
-        QRegularExpressionMatch match = re.match(line);
-        
-        if (match.hasMatch()) {
-            QString permissions = match.captured(1) + match.captured(2);
-            bool isDirectory = (permissions.at(0) == 'd');
-            qint64 size = match.captured(3).toLongLong();
-            
-            QDateTime lastModified;
-            if (!match.captured(8).isEmpty()) {
-                // ISO format
-                int year = match.captured(8).toInt();
-                int month = match.captured(9).toInt();
-                int day = match.captured(10).toInt();
-                int hour = match.captured(11).toInt();
-                int minute = match.captured(12).toInt();
-                lastModified = QDateTime(QDate(year, month, day), QTime(hour, minute));
-            } else {
-                // Unix format
-                QDate date;
-                QTime time;
-                
-                QStringList months = {"Jan", "Feb", "Mar", "Apr", "May", "Jun", 
-                                    "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
-                int month = months.indexOf(match.captured(4)) + 1;
-                int day = match.captured(5).toInt();
-                
-                if (!match.captured(6).isEmpty()) {
-                    // År specificerat
-                    int year = match.captured(6).toInt();
-                    date = QDate(year, month, day);
-                    time = QTime(0, 0);
-                } else {
-                    // Tid specificerad, år är nuvarande
-                    QStringList timeParts = match.captured(7).split(':');
-                    int hour = timeParts.at(0).toInt();
-                    int minute = timeParts.at(1).toInt();
-                    
-                    int year = QDate::currentDate().year();
-                    date = QDate(year, month, day);
-                    time = QTime(hour, minute);
-                    
-                    // Om datumet är i framtiden, anta förra året
-                    if (QDateTime(date, time) > QDateTime::currentDateTime().addDays(1)) {
-                        date = QDate(year - 1, month, day);
-                    }
-                }
-                
-                lastModified = QDateTime(date, time);
-            }
-            
-            QString name = match.captured(13);
-            
-            // Lägg till objektet i listan
-            ServerFileItem item(name, isDirectory, size, permissions, lastModified);
-            items.append(item);
+        failTransfer(op.remotePath,
+                     tr("Kontrollsumman stämmer inte för %1: %2 lokalt, %3 på servern")
+                     .arg(op.remotePath, QString::fromLatin1(op.localDigest.toHex()),
+                          QString::fromLatin1(remoteDigest.toHex())));
+        return;
+    }
+    
+    if (upload) {
+        completeUpload(op);
+    } else {
+        completeDownload(op, op.expectedSize);
+    }
+}
+
+QString FtpManager::resolvePath(const QString &path) const
+{
+    QString resolved = path;
+    if (!resolved.startsWith('/')) {
+        resolved = m_currentDirectory;
+        if (!resolved.endsWith('/')) {
+            resolved += '/';
         }
+        resolved += path;
     }
     
-    return items;
+    return resolved;
 }
 
+void FtpManager::failTransfer(const QString &remotePath, const QString &errorString)
+{
+    emit error(errorString);
+    emit transferFailed(remotePath, errorString);
+}
+
+QList<ServerFileItem> FtpManager::parseDirectoryListing(const QByteArray &data, bool machineReadable) const
+{
+    // MLSD har ett standardiserat format med UTC-tider och exakta storlekar:
+    // type=file;size=12345;modify=20240101123456; filename.txt
+    if (machineReadable) {
+        return FtpListParser().parseMlsd(data);
+    }
+
+    // LIST är vanligtvis i Unix-stil:
+    // -rw-r--r-- 1 owner group    12345 Jan 01 12:34 filename.txt
+    // drwxr-xr-x 2 owner group     4096 Jan 01 12:34 directory
+    return FtpListParser().parse(data);
+}
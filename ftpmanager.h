@@ -3,19 +3,23 @@
 #define FTPMANAGER_H
 
 #include <QObject>
-#include <QNetworkAccessManager>
-#include <QNetworkReply>
-#include <QUrl>
-#include <QAuthenticator>
 #include <QFile>
 #include <QFileInfo>
 #include <QDir>
-#include <QFileSystemModel>
+#include <QHash>
 #include <QList>
+#include <QVector>
+#include <QElapsedTimer>
+#include "ftpclient.h"
+#include "filehasher.h"
 #include "serverfileitem.h"
 
 /**
  * @brief FtpManager hanterar anslutningar och filöverföringar med FTP
+ *
+ * All trafik går genom en FtpClient som håller en inloggad kontrollanslutning
+ * per session, så listningar och överföringar slipper ny TCP- och
+ * inloggningshandskakning för varje anrop.
  */
 class FtpManager : public QObject
 {
@@ -47,8 +51,25 @@ public:
      */
     void listDirectory(const QString &path = QString());
 
+    /**
+     * @brief Lista en katalog i bakgrunden, t.ex. vid rekursiv nedladdning
+     *
+     * Till skillnad från listDirectory() ändras inte aktuell katalog och
+     * resultatet skickas med directoryScanChunk()/directoryScanFinished(),
+     * så vyn påverkas inte. Flera genomsökningar kan köas samtidigt.
+     * @param path Absolut sökväg att lista
+     */
+    void scanDirectory(const QString &path);
+
     /**
      * @brief Ladda upp en fil
+     *
+     * Datat skickas till "<remoteFilePath>.part" som döps om till målet med
+     * RNFR/RNTO först när storleken på servern (och kontrollsumman, om
+     * servern kan räkna den) stämmer; se setChecksumVerification(). Finns
+     * en .part-fil som är kortare än den lokala filen fortsätter
+     * uppladdningen med APPE från dess storlek. En befintlig fil med målets
+     * namn ersätts bara, den fylls aldrig på.
      * @param localFilePath Lokal filsökväg
      * @param remoteFilePath Fjärrfilsökväg
      */
@@ -56,17 +77,93 @@ public:
 
     /**
      * @brief Ladda ner en fil
+     *
+     * Datat skrivs till "<localFilePath>.part" som döps om när filen är
+     * komplett och storleken (och kontrollsumman, om servern kan räkna
+     * den) stämmer. Finns en ofullständig
+     * .part-fil fortsätter nedladdningen med REST från dess storlek.
      * @param remoteFilePath Fjärrfilsökväg
      * @param localFilePath Lokal filsökväg
      */
     void downloadFile(const QString &remoteFilePath, const QString &localFilePath);
 
+    /**
+     * @brief Avbryt en upp- eller nedladdning och behåll sessionen
+     *
+     * Datakanalen stängs och transferFailed() skickas när servern har
+     * svarat, så att anroparen vet när överföringen verkligen har slutat.
+     * .part-filen sparas så att överföringen kan återupptas.
+     * @param remotePath Fjärrsökvägen som gavs till uploadFile()/downloadFile()
+     */
+    void abortTransfer(const QString &remotePath);
+
+    /**
+     * @brief Slå på eller av återupptagning av avbrutna överföringar
+     * @param enabled true för att återuppta (standard), false för att alltid börja om
+     */
+    void setResumeEnabled(bool enabled);
+    bool resumeEnabled() const;
+
+    /**
+     * @brief Ladda ner stora filer i flera delar över parallella dataanslutningar
+     *
+     * Filen delas i lika stora byteintervall som hämtas samtidigt med REST i
+     * egna sessioner och skrivs direkt på rätt position i en förallokerad fil.
+     * @param segments Antal samtidiga anslutningar (1 stänger av)
+     * @param minimumSize Filer mindre än så här hämtas med en enda ström
+     */
+    void setSegmentedDownload(int segments, qint64 minimumSize = 64 * 1024 * 1024);
+    int segmentCount() const;
+
+    /**
+     * @brief Jämför kontrollsummor efter varje överföring
+     *
+     * Servern räknar sin summa med HASH eller XCRC/XMD5/XSHA*, och den
+     * lokala räknas medan datat strömmas, så ingen sida behöver läsa om
+     * filen över nätet. CRC-32 väljs helst eftersom den räknas med SIMD
+     * lokalt. Servrar utan något av kommandona verifieras bara på storlek.
+     * Segmenterade nedladdningar verifieras bara med CRC-32, vars delsummor
+     * kan slås ihop.
+     * @param enabled true för att verifiera (standard)
+     */
+    void setChecksumVerification(bool enabled);
+    bool checksumVerification() const;
+
+    /**
+     * @brief Räkna en fjärrfils kontrollsumma med HASH eller XCRC/XMD5/XSHA*
+     *
+     * Används av synkroniseringen för att jämföra filer med samma storlek.
+     * Svaret kommer med remoteChecksumReady(), med tom summa om servern
+     * saknar kommandona eller inte kunde räkna den.
+     * @param remotePath Absolut fjärrsökväg
+     */
+    void remoteChecksum(const QString &remotePath);
+
+    /**
+     * @brief Begränsa bandbredden för alla överföringar, även segmenterade
+     *
+     * Varje överföring och varje del av en segmenterad nedladdning räknas
+     * som en egen ström, se FtpClient::setBandwidthLimiter().
+     * @param limiter Limitern (ägs av anroparen), eller nullptr för obegränsat
+     */
+    void setBandwidthLimiter(BandwidthLimiter *limiter);
+
     /**
      * @brief Skapa en katalog
      * @param dirPath Sökväg till katalogen att skapa
      */
     void createDirectory(const QString &dirPath);
 
+    /**
+     * @brief Se till att en katalog finns, t.ex. vid rekursiv uppladdning
+     *
+     * Ett misslyckat MKD rapporteras inte som fel eftersom katalogen oftast
+     * redan finns; directoryEnsured() skickas i båda fallen och eventuella
+     * problem syns när filerna laddas upp.
+     * @param dirPath Sökväg till katalogen
+     */
+    void ensureDirectory(const QString &dirPath);
+
     /**
      * @brief Radera en fil
      * @param filePath Sökväg till filen att radera
@@ -108,6 +205,61 @@ signals:
      */
     void directoryListed(const QString &path, const QList<ServerFileItem> &items);
 
+    /**
+     * @brief Signal som skickas medan en listning fortfarande tas emot
+     *
+     * Första blocket skickas så snart den första hela raden har tolkats, så
+     * att vyn kan börja visa poster innan hela listningen har kommit. Bara
+     * den senast startade listningen skickar block; en äldre som ersatts
+     * tystnar.
+     * @param listingId Listningens id; ökar för varje ny listning
+     * @param path Katalogen som listas
+     * @param items Nya poster sedan föregående block
+     */
+    void directoryListingChunk(int listingId, const QString &path, const QList<ServerFileItem> &items);
+
+    /**
+     * @brief Signal som skickas när en listning är klar
+     *
+     * Skickas efter det sista directoryListingChunk() och före directoryListed().
+     * @param listingId Listningens id
+     * @param path Katalogen som listades
+     * @param count Totalt antal poster
+     */
+    void directoryListingFinished(int listingId, const QString &path, int count);
+
+    /**
+     * @brief Signal som skickas när en listning misslyckas
+     *
+     * Block som redan skickats för listningen är ofullständiga. Skickas
+     * efter error().
+     * @param listingId Listningens id
+     * @param path Katalogen som listades
+     * @param errorString Felbeskrivning
+     */
+    void directoryListingFailed(int listingId, const QString &path, const QString &errorString);
+
+    /**
+     * @brief Signal som skickas medan en scanDirectory() tas emot
+     * @param path Katalogen som genomsöks
+     * @param items Nya poster sedan föregående block
+     */
+    void directoryScanChunk(const QString &path, const QList<ServerFileItem> &items);
+
+    /**
+     * @brief Signal som skickas när en scanDirectory() är klar
+     * @param path Katalogen som genomsöktes
+     * @param error true om listningen misslyckades
+     * @param errorString Felbeskrivning
+     */
+    void directoryScanFinished(const QString &path, bool error, const QString &errorString);
+
+    /**
+     * @brief Signal som skickas när en ensureDirectory() är klar
+     * @param dirPath Sökväg till katalogen
+     */
+    void directoryEnsured(const QString &dirPath);
+
     /**
      * @brief Signal som skickas under filöverföring
      * @param bytesSent Antal byte skickade
@@ -128,6 +280,24 @@ signals:
      */
     void downloadFinished(const QString &filePath);
 
+    /**
+     * @brief Signal som skickas när en uppladdning eller nedladdning misslyckas
+     *
+     * Skickas efter error() så att en överföringskö kan knyta felet till rätt jobb.
+     * @param remotePath Fjärrsökvägen för överföringen
+     * @param errorString Felbeskrivning
+     */
+    void transferFailed(const QString &remotePath, const QString &errorString);
+
+    /**
+     * @brief Signal som skickas när remoteChecksum() är klar
+     * @param remotePath Fjärrsökvägen som gavs till remoteChecksum()
+     * @param algorithm Algoritmen servern använde
+     * @param digest Summan, tom om den inte kunde räknas
+     */
+    void remoteChecksumReady(const QString &remotePath, FileHasher::Algorithm algorithm,
+                             const QByteArray &digest);
+    
     /**
      * @brief Signal som skickas när en katalog har skapats
      * @param dirPath Sökväg till den skapade katalogen
@@ -153,36 +323,133 @@ signals:
      */
     void renamed(const QString &oldPath, const QString &newPath);
 
+private slots:
+    void onLoggedIn();
+    void onCommandFinished(int id, bool error, const QString &errorString);
+    void onListingData(int id, const QByteArray &data, bool machineReadable);
+    void onSizeReceived(int id, qint64 size);
+    void onChecksumReceived(int id, const QString &algorithm, const QString &digest);
+    void onDataTransferProgress(int id, qint64 done, qint64 total);
+    void onConnectionClosed();
+    void onConnectionError(const QString &errorString);
+
 private:
-    QNetworkAccessManager *m_networkManager;
+    /**
+     * @brief En operation som väntar på svar från FtpClient
+     */
+    struct PendingOperation {
+        enum Type {
+            List,
+            Scan,           ///< Listning i bakgrunden, se scanDirectory()
+            UploadSize,     ///< SIZE före uppladdning, för att hitta en ofullständig fjärrfil
+            Upload,
+            UploadVerify,   ///< SIZE efter uppladdning, för verifiering
+            UploadChecksum, ///< Serverns kontrollsumma efter uppladdning
+            UploadRename,   ///< RNFR/RNTO från .part-filen till målet
+            UploadReplace,  ///< DELE av en äldre målfil när RNTO inte får ersätta den
+            RemovePartial,  ///< DELE av en .part-fil som inte ska återupptas
+            DownloadSize,   ///< SIZE före nedladdning
+            Download,
+            DownloadChecksum, ///< Serverns kontrollsumma innan .part-filen döps om
+            RemoteChecksum, ///< Serverns kontrollsumma för remoteChecksum()
+            Mkdir,
+            EnsureDir,      ///< MKD där fel ignoreras, se ensureDirectory()
+            RemoveFile,
+            RemoveDir,
+            Rename
+        };
+
+        Type type = List;
+        QString remotePath;
+        QString localPath;
+        QString newPath;
+        QIODevice *device = nullptr;
+        QByteArray listing;         ///< Ofullständig sista rad i listningen
+        bool machineReadable = false; ///< Listningen kommer från MLSD
+        QList<ServerFileItem> items; ///< Tolkade poster hittills
+        int emittedItems = 0;       ///< Antal poster som redan skickats som block
+        int listingId = 0;          ///< Se directoryListingChunk()
+        qint64 offset = 0;          ///< Position där överföringen återupptogs
+        qint64 expectedSize = -1;   ///< Förväntad slutstorlek för verifiering
+        qint64 remoteSize = -1;     ///< Svar från SIZE
+        bool verifyChecksum = false; ///< Jämför kontrollsummor efter överföringen
+        FileHasher::Algorithm checksumAlgorithm = FileHasher::Crc32;
+        QByteArray localDigest;     ///< Räknad medan datat strömmades
+        QString remoteAlgorithm;    ///< Svar från HASH/XCRC/...
+        QString remoteDigest;
+        QElapsedTimer timer;        ///< Startas när datat börjar överföras
+        bool replaceTarget = false; ///< Målet har tagits bort för ett nytt RNTO
+        bool aborted = false;       ///< abortTransfer(); avslutas som misslyckad
+    };
+
+    /**
+     * @brief En nedladdning som delats i flera parallella byteintervall
+     */
+    struct SegmentedDownload {
+        struct Segment {
+            FtpClient *client = nullptr;
+            HashingFile *file = nullptr;
+            QByteArray digest;      ///< CRC-32 för delen, när den är klar
+            int getId = 0;
+            qint64 offset = 0;
+            qint64 length = 0;
+            qint64 done = 0;
+        };
+
+        QString remotePath;
+        QString localPath;
+        qint64 totalSize = 0;
+        QVector<Segment> segments;
+        int remaining = 0;
+        bool verifyChecksum = false;
+        bool failed = false;
+        QString errorString;
+        QElapsedTimer timer;
+    };
+
+    QString resolvePath(const QString &path) const;
+    QList<ServerFileItem> parseDirectoryListing(const QByteArray &data, bool machineReadable) const;
+    void failTransfer(const QString &remotePath, const QString &errorString);
+    void emitListingChunk(PendingOperation &op, bool force);
+
+    void onListFinished(PendingOperation op, bool error, const QString &errorString);
+    void startUpload(PendingOperation op);
+    void startDownload(PendingOperation op);
+    void startSegmentedDownload(const PendingOperation &op);
+    void onSegmentProgress(SegmentedDownload *download, int index, qint64 position);
+    void onSegmentFinished(SegmentedDownload *download, int index, bool error, const QString &errorString);
+    void finishSegmentedDownload(SegmentedDownload *download);
+    void abortSegmentedDownloads();
+    void onUploadFinished(const PendingOperation &op, bool error, const QString &errorString);
+    void onUploadVerified(const PendingOperation &op, bool error);
+    void completeUpload(PendingOperation op);
+    void onUploadRenamed(PendingOperation op, bool error, const QString &errorString);
+    void removePartialUpload(const PendingOperation &op);
+    void onDownloadFinished(const PendingOperation &op, bool error, const QString &errorString);
+    void completeDownload(const PendingOperation &op, qint64 receivedBytes);
+    bool chooseChecksumAlgorithm(FileHasher::Algorithm *algorithm) const;
+    void requestChecksum(PendingOperation op, PendingOperation::Type type);
+    void onChecksumVerified(const PendingOperation &op, bool error);
+
+    FtpClient *m_client;
     QString m_host;
     quint16 m_port;
     QString m_username;
     QString m_password;
     bool m_connected;
+    bool m_resumeEnabled;
+    bool m_verifyChecksums;
     QString m_currentDirectory;
+    int m_listingId;            ///< Senast startade listning
 
-    QNetworkReply *m_currentReply;
-    QFile *m_currentFile;
-
-    QNetworkReply *m_currentListReply;
-    QNetworkReply *m_currentUploadReply;
-    QNetworkReply *m_currentDownloadReply;
+    // Operationer som väntar på svar, nycklade på FtpClient-id
+    QHash<int, PendingOperation> m_operations;
 
-    QString m_currentUploadPath;
-    QString m_currentDownloadPath;
-    QString m_currentLocalUploadPath;
-    QString m_currentLocalDownloadPath;
-
-private slots:
-    void onAuthenticationRequired(QNetworkReply *reply, QAuthenticator *authenticator);
-    void onFinished(QNetworkReply *reply);
-    void onNetworkError(QNetworkReply::NetworkError error);
-    void onUploadProgress(qint64 bytesSent, qint64 bytesTotal);
-    void onDownloadProgress(qint64 bytesReceived, qint64 bytesTotal);
-    void onListFinished();
-    void onUploadFinished();
-    void onDownloadFinished();
+    // Segmenterade nedladdningar med egna sessioner
+    int m_segmentCount;
+    qint64 m_segmentThreshold;
+    BandwidthLimiter *m_limiter;
+    QList<SegmentedDownload*> m_segmentedDownloads;
 };
 
 #endif // FTPMANAGER_H
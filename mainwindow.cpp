@@ -30,12 +30,20 @@
 #include <QMimeType>
 #include <QMimeDatabase>
 #include <QCryptographicHash> // Lägg till för hashning
+#include <QStandardPaths>
 
 MainWindow::MainWindow(QWidget *parent)
     : QMainWindow(parent)
     , m_ftpManager(new FtpManager(this))
     , m_sftpManager(new SftpManager(this))
+    , m_transferQueue(new TransferQueue(this))
+    , m_transferJournal(nullptr)
+    , m_bandwidthLimiter(new BandwidthLimiter(this))
+    , m_syncDryRun(false)
+    , m_syncDeleteExtraneous(false)
+    , m_syncCompareChecksums(false)
     , m_connected(false)
+    , m_listingId(0)
     , m_tabWidget(nullptr)
     , m_currentTabIndex(-1)
     , m_currentTheme(ThemeDark)
@@ -58,25 +66,109 @@ MainWindow::MainWindow(QWidget *parent)
     connect(m_ftpManager, &FtpManager::disconnected, this, &MainWindow::onFtpDisconnected); // Använd onFtpDisconnected
     connect(m_ftpManager, &FtpManager::error, this, &MainWindow::onFtpError); // Korrigera signalnamn tillbaka till 'error'
     connect(m_ftpManager, &FtpManager::commandSent, this, &MainWindow::onFtpCommandSent);
-    connect(m_ftpManager, &FtpManager::directoryListed, this, &MainWindow::onDirectoryListed);
+    connect(m_ftpManager, &FtpManager::directoryListingChunk, this, &MainWindow::onDirectoryListingChunk);
+    connect(m_ftpManager, &FtpManager::directoryListingFinished, this, &MainWindow::onDirectoryListingFinished);
+    connect(m_ftpManager, &FtpManager::directoryListingFailed, this, &MainWindow::onDirectoryListingFailed);
     connect(m_ftpManager, &FtpManager::transferProgress, this, &MainWindow::onTransferProgress);
     
     // Koppla SFTP-hanterarens signaler (använd befintliga slots)
     connect(m_sftpManager, &SftpManager::connected, this, &MainWindow::onFtpConnected); // Använd onFtpConnected
     connect(m_sftpManager, &SftpManager::disconnected, this, &MainWindow::onFtpDisconnected); // Använd onFtpDisconnected
     connect(m_sftpManager, &SftpManager::error, this, &MainWindow::onFtpError); // Korrigera signalnamn tillbaka till 'error'
-    connect(m_sftpManager, &SftpManager::directoryListed, this, &MainWindow::onDirectoryListed);
+    connect(m_sftpManager, &SftpManager::directoryListingChunk, this, &MainWindow::onDirectoryListingChunk);
+    connect(m_sftpManager, &SftpManager::directoryListingFinished, this, &MainWindow::onDirectoryListingFinished);
+    connect(m_sftpManager, &SftpManager::directoryListingFailed, this, &MainWindow::onDirectoryListingFailed);
     connect(m_sftpManager, &SftpManager::transferProgress, this, &MainWindow::onTransferProgress);
     
+    // Överföringskön startar jobben; resultaten knyts tillbaka via fjärrsökvägen
+    connect(m_transferQueue, &TransferQueue::startTransfer, this, &MainWindow::onStartTransfer);
+    connect(m_transferQueue, &TransferQueue::progressUpdated, this, &MainWindow::onTransferQueueProgress);
+    // Kopplingen ligger kvar tills hanteraren rapporterar att överföringen
+    // slutat, så att kön inte ger platsen till ett nytt jobb för tidigt
+    connect(m_transferQueue, &TransferQueue::abortTransfer, this, [this](int jobId) {
+        const QString remotePath = m_transferJobs.key(jobId);
+        if (remotePath.isEmpty()) {
+            return;
+        }
+        if (m_activeConnectionType == ConnectionType::SFTP) {
+            m_sftpManager->abortTransfer(remotePath);
+        } else {
+            m_ftpManager->abortTransfer(remotePath);
+        }
+    });
+    connect(m_ftpManager, &FtpManager::uploadFinished, this, &MainWindow::onTransferCompleted);
+    connect(m_ftpManager, &FtpManager::downloadFinished, this, &MainWindow::onTransferCompleted);
+    connect(m_ftpManager, &FtpManager::transferFailed, this, &MainWindow::onTransferFailed);
+    connect(m_sftpManager, &SftpManager::uploadFinished, this, &MainWindow::onTransferCompleted);
+    connect(m_sftpManager, &SftpManager::downloadFinished, this, &MainWindow::onTransferCompleted);
+    connect(m_sftpManager, &SftpManager::transferFailed, this, &MainWindow::onTransferFailed);
+    
+    // Genomsökningar för katalogöverföringar skickas vidare till alla
+    // pågående träd; varje träd ignorerar sökvägar det inte väntar på
+    auto forwardScanChunk = [this](const QString &path, const QList<ServerFileItem> &items) {
+        const QList<TreeTransfer*> trees = m_treeTransfers;
+        for (TreeTransfer *tree : trees) {
+            tree->onRemoteListingChunk(path, items);
+        }
+        const QList<SyncEngine*> syncs = m_syncEngines;
+        for (SyncEngine *sync : syncs) {
+            sync->onRemoteListingChunk(path, items);
+        }
+    };
+    auto forwardScanFinished = [this](const QString &path, bool error, const QString &errorString) {
+        const QList<TreeTransfer*> trees = m_treeTransfers;
+        for (TreeTransfer *tree : trees) {
+            tree->onRemoteListingFinished(path, error, errorString);
+        }
+        const QList<SyncEngine*> syncs = m_syncEngines;
+        for (SyncEngine *sync : syncs) {
+            sync->onRemoteListingFinished(path, error, errorString);
+        }
+    };
+    auto forwardDirectoryEnsured = [this](const QString &path) {
+        const QList<TreeTransfer*> trees = m_treeTransfers;
+        for (TreeTransfer *tree : trees) {
+            tree->onRemoteDirectoryReady(path);
+        }
+        const QList<SyncEngine*> syncs = m_syncEngines;
+        for (SyncEngine *sync : syncs) {
+            sync->onRemoteDirectoryReady(path);
+        }
+    };
+    connect(m_ftpManager, &FtpManager::directoryScanChunk, this, forwardScanChunk);
+    connect(m_ftpManager, &FtpManager::directoryScanFinished, this, forwardScanFinished);
+    connect(m_ftpManager, &FtpManager::directoryEnsured, this, forwardDirectoryEnsured);
+    connect(m_sftpManager, &SftpManager::directoryScanChunk, this, forwardScanChunk);
+    connect(m_sftpManager, &SftpManager::directoryScanFinished, this, forwardScanFinished);
+    connect(m_sftpManager, &SftpManager::directoryEnsured, this, forwardDirectoryEnsured);
+    
+    m_ftpManager->setBandwidthLimiter(m_bandwidthLimiter);
+    m_sftpManager->setBandwidthLimiter(m_bandwidthLimiter);
+    
     // Ladda inställningar
     loadSettings();
     
     // Skapa användargränssnitt
     setupUi();
+    
+    // Överföringar som inte blev klara förra gången, t.ex. efter en krasch,
+    // väntar pausade tills samma session är ansluten igen
+    const QString journalDir = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation);
+    QDir().mkpath(journalDir);
+    m_transferJournal = new TransferJournal(journalDir + "/transfers.journal", this);
+    const int restored = m_transferQueue->setJournal(m_transferJournal);
+    if (restored > 0) {
+        appendToLog(tr("%1 överföringar från förra körningen väntar på anslutning").arg(restored));
+    }
 }
 
 MainWindow::~MainWindow()
 {
+    // Normal avslutning: journalen skrivs om med bara det som återstår och
+    // kopplas loss innan nedkopplingen hinner markera jobben som misslyckade
+    m_transferQueue->compactJournal();
+    m_transferQueue->setJournal(nullptr);
+    
     if (m_ftpManager->isConnected()) {
         m_ftpManager->disconnectFromServer();
     }
@@ -954,13 +1046,17 @@ void MainWindow::setupConnections()
     connect(m_ftpManager, &FtpManager::connected, this, &MainWindow::onFtpConnected);
     connect(m_ftpManager, &FtpManager::disconnected, this, &MainWindow::onFtpDisconnected);
     connect(m_ftpManager, &FtpManager::error, this, &MainWindow::onFtpError);
-    connect(m_ftpManager, &FtpManager::directoryListed, this, &MainWindow::onDirectoryListed);
+    connect(m_ftpManager, &FtpManager::directoryListingChunk, this, &MainWindow::onDirectoryListingChunk);
+    connect(m_ftpManager, &FtpManager::directoryListingFinished, this, &MainWindow::onDirectoryListingFinished);
+    connect(m_ftpManager, &FtpManager::directoryListingFailed, this, &MainWindow::onDirectoryListingFailed);
     
     // SFTP Manager-signaler
     connect(m_sftpManager, &SftpManager::connected, this, &MainWindow::onFtpConnected);
     connect(m_sftpManager, &SftpManager::disconnected, this, &MainWindow::onFtpDisconnected);
     connect(m_sftpManager, &SftpManager::error, this, &MainWindow::onFtpError);
-    connect(m_sftpManager, &SftpManager::directoryListed, this, &MainWindow::onDirectoryListed);
+    connect(m_sftpManager, &SftpManager::directoryListingChunk, this, &MainWindow::onDirectoryListingChunk);
+    connect(m_sftpManager, &SftpManager::directoryListingFinished, this, &MainWindow::onDirectoryListingFinished);
+    connect(m_sftpManager, &SftpManager::directoryListingFailed, this, &MainWindow::onDirectoryListingFailed);
     
     // Anpassa anslutningar för att hantera filsökvägar i signalerna
     connect(m_sftpManager, &SftpManager::downloadProgress, 
@@ -1101,7 +1197,8 @@ void MainWindow::uploadFile()
         return;
     }
     
-    // För varje vald fil
+    // Lägg alla valda filer i överföringskön på en gång
+    QList<TransferRequest> requests;
     for (const QModelIndex &index : fileIndexes) {
         QString localFilePath = currentTab.localFileModel->filePath(index);
         QFileInfo fileInfo(localFilePath);
@@ -1113,25 +1210,28 @@ void MainWindow::uploadFile()
         }
         remoteFilePath += fileInfo.fileName();
         
-        // Logga operationen
-        m_logTextEdit->append(tr("Laddar upp: %1 -> %2").arg(localFilePath, remoteFilePath));
-        
-        // Ställ in visuella indikatorer
-        m_progressBar->setValue(0);
-        m_statusLabel->setText(tr("Laddar upp %1...").arg(fileInfo.fileName()));
-        m_currentDragAction = DragUpload;
-        
-        // Ladda upp med rätt protokoll
-        if (m_currentConnection.isUseSSH) {
-            m_sftpManager->uploadFile(localFilePath, remoteFilePath);
-        } else {
-            m_ftpManager->uploadFile(localFilePath, remoteFilePath);
+        // Kataloger laddas upp rekursivt medan trädet läses
+        if (fileInfo.isDir()) {
+            startTreeTransfer(true, localFilePath, remoteFilePath);
+            continue;
         }
         
-        // För demo-syften, ladda bara upp en fil åt gången
-        // I en mer avancerad implementation skulle man hantera flera samtidiga överföringar
-        break;
+        TransferRequest request;
+        request.host = transferHostKey();
+        request.isUpload = true;
+        request.sourcePath = localFilePath;
+        request.targetPath = remoteFilePath;
+        request.size = fileInfo.size();
+        requests.append(request);
+    }
+    
+    m_currentDragAction = DragUpload;
+    if (requests.isEmpty()) {
+        return;
     }
+    
+    appendToLog(tr("Lägger %1 filer i kö för uppladdning").arg(requests.size()));
+    m_transferQueue->enqueueBatch(requests);
 }
 
 void MainWindow::downloadFile()
@@ -1159,26 +1259,14 @@ void MainWindow::downloadFile()
         return;
     }
     
-    // För varje vald fil
+    // Lägg alla valda filer i överföringskön på en gång
+    QList<TransferRequest> requests;
     for (const QModelIndex &index : fileIndexes) {
         // Hämta filnamn och filtyp
         QString fileName = currentTab.remoteFileModel->data(index).toString();
         QString fileType = currentTab.remoteFileModel->data(
             currentTab.remoteFileModel->index(index.row(), 2)).toString();
         
-        // Om det är en katalog, hantera separat
-        if (fileType == tr("Katalog")) {
-            // För enkelhets skull, bara navigera till katalogen istället för att ladda ner
-            QString newPath = currentTab.currentRemotePath;
-            if (!newPath.endsWith('/')) {
-                newPath += '/';
-            }
-            newPath += fileName;
-            
-            updateRemoteDirectory(newPath);
-            return;
-        }
-        
         // Skapa sökvägar
         QString remoteFilePath = currentTab.currentRemotePath;
         if (!remoteFilePath.endsWith('/')) {
@@ -1192,26 +1280,284 @@ void MainWindow::downloadFile()
         }
         localFilePath += fileName;
         
-        // Logga operationen
-        m_logTextEdit->append(tr("Laddar ner: %1 -> %2").arg(remoteFilePath, localFilePath));
-        
-        // Ställ in visuella indikatorer
-        m_progressBar->setValue(0);
-        m_statusLabel->setText(tr("Laddar ner %1...").arg(fileName));
-        m_currentDragAction = DragDownload;
+        // Kataloger laddas ner rekursivt medan trädet listas
+        if (fileType == tr("Katalog")) {
+            if (fileName != "..") {
+                startTreeTransfer(false, remoteFilePath, localFilePath);
+            }
+            continue;
+        }
         
-        // Ladda ner med rätt protokoll
-        if (m_currentConnection.isUseSSH) {
-            m_sftpManager->downloadFile(remoteFilePath, localFilePath);
+        TransferRequest request;
+        request.host = transferHostKey();
+        request.isUpload = false;
+        request.sourcePath = remoteFilePath;
+        request.targetPath = localFilePath;
+        requests.append(request);
+    }
+    
+    m_currentDragAction = DragDownload;
+    if (requests.isEmpty()) {
+        return;
+    }
+    
+    appendToLog(tr("Lägger %1 filer i kö för nedladdning").arg(requests.size()));
+    m_transferQueue->enqueueBatch(requests);
+}
+
+QString MainWindow::transferHostKey() const
+{
+    // Kön begränsar samtidighet per session, så nyckeln ska skilja på
+    // protokoll, användare och port
+    const bool sftp = m_activeConnectionType == ConnectionType::SFTP;
+    return QString("%1://%2@%3:%4")
+        .arg(sftp ? "sftp" : "ftp", m_currentConnection.username, m_currentConnection.host)
+        .arg(m_currentConnection.port);
+}
+
+void MainWindow::startTreeTransfer(bool isUpload, const QString &sourcePath, const QString &targetPath)
+{
+    TreeTransfer *tree = new TreeTransfer(m_transferQueue, transferHostKey(), this);
+    const bool sftp = m_activeConnectionType == ConnectionType::SFTP;
+    
+    connect(tree, &TreeTransfer::listRemoteDirectory, this, [this, sftp](const QString &path) {
+        if (sftp) {
+            m_sftpManager->scanDirectory(path);
+        } else {
+            m_ftpManager->scanDirectory(path);
+        }
+    });
+    connect(tree, &TreeTransfer::createRemoteDirectory, this, [this, sftp](const QString &path) {
+        if (sftp) {
+            m_sftpManager->ensureDirectory(path);
         } else {
-            m_ftpManager->downloadFile(remoteFilePath, localFilePath);
+            m_ftpManager->ensureDirectory(path);
+        }
+    });
+    connect(tree, &TreeTransfer::walkError, this, [this](const QString &path, const QString &errorString) {
+        appendToLog(tr("Kunde inte läsa %1: %2").arg(path, errorString));
+    });
+    connect(tree, &TreeTransfer::finished, this, [this, tree, sourcePath](int files, int directories) {
+        appendToLog(tr("%1: %2 filer i %3 kataloger lagda i kö")
+                    .arg(sourcePath).arg(files).arg(directories));
+        m_treeTransfers.removeOne(tree);
+        tree->deleteLater();
+    });
+    
+    m_treeTransfers.append(tree);
+    appendToLog(isUpload ? tr("Laddar upp katalog: %1 -> %2").arg(sourcePath, targetPath)
+                          : tr("Laddar ner katalog: %1 -> %2").arg(sourcePath, targetPath));
+    
+    if (isUpload) {
+        tree->startUpload(sourcePath, targetPath);
+    } else {
+        tree->startDownload(sourcePath, targetPath);
+    }
+}
+
+void MainWindow::cancelTreeTransfers()
+{
+    // cancel() skickar finished() som tar bort trädet ur listan
+    const QList<TreeTransfer*> trees = m_treeTransfers;
+    for (TreeTransfer *tree : trees) {
+        tree->cancel();
+    }
+}
+
+void MainWindow::startSync(SyncEngine::Direction direction)
+{
+    if (!m_connected || m_currentTabIndex < 0 || m_currentTabIndex >= m_tabs.size()) {
+        return;
+    }
+    
+    // Aktuell lokal katalog synkas mot aktuell fjärrkatalog
+    const TabInfo &currentTab = m_tabs[m_currentTabIndex];
+    const QString localPath = currentTab.localPathEdit->text();
+    const QString remotePath = currentTab.currentRemotePath;
+    const bool sftp = m_activeConnectionType == ConnectionType::SFTP;
+    
+    SyncEngine *sync = new SyncEngine(m_transferQueue, transferHostKey(), this);
+    sync->setDirection(direction);
+    sync->setDryRun(m_syncDryRun);
+    sync->setDeleteExtraneous(m_syncDeleteExtraneous);
+    sync->setCompareChecksums(m_syncCompareChecksums);
+    if (!sftp) {
+        sync->setTimeTolerance(60); // LIST visar bara minuter
+    }
+    
+    connect(sync, &SyncEngine::listRemoteDirectory, this, [this, sftp](const QString &path) {
+        if (sftp) {
+            m_sftpManager->scanDirectory(path);
+        } else {
+            m_ftpManager->scanDirectory(path);
+        }
+    });
+    connect(sync, &SyncEngine::createRemoteDirectory, this, [this, sftp](const QString &path) {
+        if (sftp) {
+            m_sftpManager->ensureDirectory(path);
+        } else {
+            m_ftpManager->ensureDirectory(path);
+        }
+    });
+    connect(sync, &SyncEngine::deleteRemotePath, this, [this, sftp](const QString &path, bool isDirectory) {
+        if (sftp) {
+            isDirectory ? m_sftpManager->deleteDirectory(path) : m_sftpManager->deleteFile(path);
+        } else {
+            isDirectory ? m_ftpManager->deleteDirectory(path) : m_ftpManager->deleteFile(path);
+        }
+    });
+    connect(sync, &SyncEngine::requestRemoteChecksum, this, [this, sftp](const QString &path) {
+        if (sftp) {
+            m_sftpManager->remoteChecksum(path);
+        } else {
+            m_ftpManager->remoteChecksum(path);
+        }
+    });
+    if (sftp) {
+        connect(m_sftpManager, &SftpManager::remoteChecksumReady, sync, &SyncEngine::onRemoteChecksum);
+    } else {
+        connect(m_ftpManager, &FtpManager::remoteChecksumReady, sync, &SyncEngine::onRemoteChecksum);
+    }
+    connect(sync, &SyncEngine::walkError, this, [this](const QString &path, const QString &errorString) {
+        appendToLog(tr("Kunde inte läsa %1, hoppar över: %2").arg(path, errorString));
+    });
+    connect(sync, &SyncEngine::conflict, this, [this](const QString &path, const QString &reason) {
+        appendToLog(tr("Konflikt, hoppar över %1: %2").arg(path, reason));
+    });
+    const bool dryRun = m_syncDryRun;
+    connect(sync, &SyncEngine::planReady, this, [this, dryRun](const QList<SyncAction> &plan) {
+        if (plan.isEmpty()) {
+            appendToLog(tr("Synkronisering: katalogerna är redan lika"));
+            return;
         }
         
-        // För demo-syften, ladda bara ner en fil åt gången
-        break;
+        // Hela planen skrivs ut vid torrkörning, loggfönstret får bara början
+        const int maxLogLines = 500;
+        appendToLog(tr("Synkroniseringsplan: %1 åtgärder").arg(plan.size()));
+        for (int i = 0; i < plan.size(); ++i) {
+            const QString line = SyncEngine::describe(plan.at(i));
+            if (dryRun) {
+                qInfo().noquote() << line;
+            }
+            if (i < maxLogLines) {
+                appendToLog(line);
+            }
+        }
+        if (plan.size() > maxLogLines) {
+            appendToLog(tr("... och %1 åtgärder till").arg(plan.size() - maxLogLines));
+        }
+    });
+    connect(sync, &SyncEngine::finished, this, [this, sync, dryRun](int transfers, int deletes) {
+        if (dryRun) {
+            appendToLog(tr("Torrkörning klar, ingenting ändrades"));
+        } else {
+            appendToLog(tr("Synkronisering: %1 överföringar lagda i kö, %2 borttagningar")
+                        .arg(transfers).arg(deletes));
+        }
+        m_syncEngines.removeOne(sync);
+        sync->deleteLater();
+    });
+    
+    m_syncEngines.append(sync);
+    appendToLog(tr("Jämför %1 med %2").arg(localPath, remotePath));
+    sync->start(localPath, remotePath);
+}
+
+void MainWindow::cancelSyncs()
+{
+    // cancel() skickar finished() som tar bort synkroniseringen ur listan
+    const QList<SyncEngine*> syncs = m_syncEngines;
+    for (SyncEngine *sync : syncs) {
+        sync->cancel();
+    }
+}
+
+void MainWindow::onStartTransfer(int jobId, const QString &host, bool isUpload,
+                                 const QString &sourcePath, const QString &targetPath)
+{
+    // Sessionen kan ha bytts sedan jobbet köades; värdens jobb väntar då
+    // tills den är ansluten igen, se onFtpConnected()
+    if (!m_connected || host != transferHostKey()) {
+        m_transferQueue->holdHost(host);
+        m_transferQueue->requeue(jobId);
+        return;
+    }
+    
+    const QString remotePath = isUpload ? targetPath : sourcePath;
+    m_transferJobs.insert(remotePath, jobId);
+    
+    appendToLog(isUpload ? tr("Laddar upp: %1 -> %2").arg(sourcePath, targetPath)
+                          : tr("Laddar ner: %1 -> %2").arg(sourcePath, targetPath));
+    
+    m_progressBar->setValue(0);
+    m_statusLabel->setText(isUpload ? tr("Laddar upp %1...").arg(QFileInfo(sourcePath).fileName())
+                                    : tr("Laddar ner %1...").arg(QFileInfo(sourcePath).fileName()));
+    
+    const bool sftp = m_activeConnectionType == ConnectionType::SFTP;
+    if (isUpload) {
+        if (sftp) {
+            m_sftpManager->uploadFile(sourcePath, targetPath);
+        } else {
+            m_ftpManager->uploadFile(sourcePath, targetPath);
+        }
+    } else {
+        if (sftp) {
+            m_sftpManager->downloadFile(sourcePath, targetPath);
+        } else {
+            m_ftpManager->downloadFile(sourcePath, targetPath);
+        }
+    }
+}
+
+void MainWindow::onTransferProgress(qint64 bytesSent, qint64 bytesTotal, const QString &file)
+{
+    // Anropas för varje block; köade jobb ritas om av kön i jämn takt,
+    // se onTransferQueueProgress()
+    int jobId = m_transferJobs.value(file);
+    if (jobId > 0) {
+        m_transferQueue->reportProgress(jobId, bytesSent, bytesTotal);
+    } else if (bytesTotal > 0) {
+        m_progressBar->setValue(static_cast<int>((bytesSent * 100) / bytesTotal));
     }
 }
 
+void MainWindow::onTransferQueueProgress()
+{
+    if (m_transferQueue->activeCount() > 0) {
+        m_progressBar->setValue(qRound(m_transferQueue->overallProgress() * 100));
+    }
+}
+
+void MainWindow::onTransferCompleted(const QString &remotePath)
+{
+    int jobId = m_transferJobs.take(remotePath);
+    if (jobId > 0) {
+        m_transferQueue->reportFinished(jobId, false);
+        if (m_transferQueue->activeCount() == 0) {
+            m_progressBar->setValue(100);
+        }
+    }
+}
+
+void MainWindow::onTransferFailed(const QString &remotePath, const QString &errorString)
+{
+    int jobId = m_transferJobs.take(remotePath);
+    if (jobId <= 0) {
+        return;
+    }
+    
+    // Överföringar som bryts av att anslutningen försvinner är inte fel;
+    // de körs om när sessionen är tillbaka
+    const bool connected = m_activeConnectionType == ConnectionType::SFTP
+                           ? m_sftpManager->isConnected() : m_ftpManager->isConnected();
+    if (!connected) {
+        m_transferQueue->holdHost(transferHostKey());
+        m_transferQueue->requeue(jobId);
+        return;
+    }
+    m_transferQueue->reportFinished(jobId, true, errorString);
+}
+
 void MainWindow::onFtpConnected()
 {
     // Uppdatera både QLabel och Q_PROPERTY
@@ -1219,6 +1565,7 @@ void MainWindow::onFtpConnected()
     appendToLog(tr("Ansluten till %1").arg(m_currentConnection.host));
 
     m_connected = true; // Uppdatera anslutningsstatus
+    m_listingId = 0;    // Hanteraren numrerar sina listningar från början
 
     // Aktivera UI-element (exempel från befintlig kod, kan behöva anpassas till flikar)
     if (m_currentTabIndex >= 0 && m_currentTabIndex < m_tabs.size()) {
@@ -1230,6 +1577,11 @@ void MainWindow::onFtpConnected()
 
     updateRemoteDirectory("/"); // Hämta rotkatalogen
     updateUIState(); // Uppdatera generell UI-status
+    
+    // Fortsätt överföringar som väntade på den här sessionen, både från en
+    // tidigare anslutning och från journalen
+    m_transferQueue->releaseHost(transferHostKey());
+    m_transferQueue->resumeRestored(transferHostKey());
 }
 
 void MainWindow::onFtpDisconnected()
@@ -1239,6 +1591,17 @@ void MainWindow::onFtpDisconnected()
     appendToLog(tr("Frånkopplad från servern"));
 
     m_connected = false; // Uppdatera anslutningsstatus
+    cancelTreeTransfers(); // Svaren på väntande listningar kommer aldrig
+    cancelSyncs();
+
+    // Överföringar som pågick rapporteras aldrig klara; de läggs tillbaka i
+    // kön och väntar med resten av sessionens jobb tills den ansluts igen
+    m_transferQueue->holdHost(transferHostKey());
+    const QList<int> jobIds = m_transferJobs.values();
+    m_transferJobs.clear();
+    for (int jobId : jobIds) {
+        m_transferQueue->requeue(jobId);
+    }
 
     // Inaktivera UI-element och rensa vyer (exempel från befintlig kod)
     if (m_currentTabIndex >= 0 && m_currentTabIndex < m_tabs.size()) {
@@ -1321,6 +1684,138 @@ void MainWindow::onDirectoryListed(const QStringList &entries)
     }
 }
 
+void MainWindow::onDirectoryListingChunk(int listingId, const QString &path, const QList<ServerFileItem> &items)
+{
+    Q_UNUSED(path)
+    
+    // Block från en listning som redan ersatts av en nyare
+    if (!m_connected || listingId < m_listingId
+        || m_currentTabIndex < 0 || m_currentTabIndex >= m_tabs.size()) {
+        return;
+    }
+    
+    TabInfo &currentTab = m_tabs[m_currentTabIndex];
+    
+    // Första blocket för en ny listning: töm vyn och stäng av sorteringen
+    // så att varje block bara läggs till sist i stället för att sorteras om
+    if (listingId != m_listingId) {
+        m_listingId = listingId;
+        beginRemoteListing(currentTab);
+    }
+    
+    for (const ServerFileItem &item : items) {
+        appendRemoteItem(currentTab, item);
+    }
+}
+
+void MainWindow::onDirectoryListingFinished(int listingId, const QString &path, int count)
+{
+    Q_UNUSED(path)
+    
+    if (!m_connected || listingId < m_listingId
+        || m_currentTabIndex < 0 || m_currentTabIndex >= m_tabs.size()) {
+        return;
+    }
+    
+    TabInfo &currentTab = m_tabs[m_currentTabIndex];
+    
+    // Tom katalog: inget block har kommit
+    if (listingId != m_listingId) {
+        m_listingId = listingId;
+        beginRemoteListing(currentTab);
+    }
+    endRemoteListing(currentTab);
+    
+    m_logTextEdit->append(tr("Mottog fillista med %1 poster").arg(count));
+}
+
+void MainWindow::onDirectoryListingFailed(int listingId, const QString &path, const QString &errorString)
+{
+    Q_UNUSED(errorString) // Visas redan via error()
+    
+    if (!m_connected || listingId < m_listingId
+        || m_currentTabIndex < 0 || m_currentTabIndex >= m_tabs.size()) {
+        return;
+    }
+    
+    // Listningen är avslutad; ett nytt försök får ett nytt id och börjar
+    // med en tom vy i stället för att fylla på de ofullständiga raderna
+    m_listingId = listingId;
+    endRemoteListing(m_tabs[m_currentTabIndex]);
+    m_logTextEdit->append(tr("Listningen av %1 avbröts").arg(path));
+}
+
+void MainWindow::beginRemoteListing(TabInfo &tab)
+{
+    if (tab.remoteView) {
+        tab.remoteView->setSortingEnabled(false);
+    }
+    
+    tab.remoteFileModel->clear();
+    QStringList headers;
+    headers << tr("Namn") << tr("Storlek") << tr("Typ") << tr("Ändrad") << tr("Rättigheter");
+    tab.remoteFileModel->setHorizontalHeaderLabels(headers);
+    
+    // Lägg till katalogen ".." (föräldrakatalog) om vi inte är i rootkatalogen
+    if (tab.currentRemotePath != "/" && !tab.currentRemotePath.isEmpty()) {
+        QList<QStandardItem*> parentRow;
+        parentRow.append(new QStandardItem(QApplication::style()->standardIcon(QStyle::SP_DirIcon), ".."));
+        parentRow.append(new QStandardItem(""));
+        parentRow.append(new QStandardItem(tr("Katalog")));
+        parentRow.append(new QStandardItem(""));
+        parentRow.append(new QStandardItem(""));
+        tab.remoteFileModel->appendRow(parentRow);
+    }
+}
+
+void MainWindow::endRemoteListing(TabInfo &tab)
+{
+    if (tab.remoteView) {
+        tab.remoteView->setSortingEnabled(true);
+    }
+}
+
+void MainWindow::appendRemoteItem(TabInfo &tab, const ServerFileItem &item)
+{
+    QIcon icon;
+    QString fileType;
+    
+    if (item.isDirectory()) {
+        icon = m_fileTypeIcons["folder"];
+        fileType = tr("Katalog");
+    } else {
+        QString iconType = getFileIconName(item.name(), false);
+        icon = m_fileTypeIcons.contains(iconType) ? m_fileTypeIcons[iconType] : m_fileTypeIcons["default"];
+        
+        fileType = QFileInfo(item.name()).suffix().toUpper();
+        if (fileType.isEmpty()) {
+            fileType = tr("Fil");
+        }
+    }
+    
+    const qint64 fileSize = item.size();
+    QString sizeStr;
+    if (item.isDirectory()) {
+        sizeStr = "--";
+    } else if (fileSize < 1024) {
+        sizeStr = QString("%1 B").arg(fileSize);
+    } else if (fileSize < 1024 * 1024) {
+        sizeStr = QString("%1 KB").arg(fileSize / 1024.0, 0, 'f', 1);
+    } else if (fileSize < 1024 * 1024 * 1024) {
+        sizeStr = QString("%1 MB").arg(fileSize / (1024.0 * 1024.0), 0, 'f', 1);
+    } else {
+        sizeStr = QString("%1 GB").arg(fileSize / (1024.0 * 1024.0 * 1024.0), 0, 'f', 1);
+    }
+    
+    QList<QStandardItem*> row;
+    row.append(new QStandardItem(icon, item.name()));
+    row.append(new QStandardItem(sizeStr));
+    row.append(new QStandardItem(fileType));
+    row.append(new QStandardItem(item.lastModified().toString("yyyy-MM-dd hh:mm")));
+    row.append(new QStandardItem(item.permissions()));
+    tab.remoteFileModel->appendRow(row);
+}
+
 void MainWindow::onDownloadFinished(bool success)
 {
     m_uploadButton->setEnabled(true);
@@ -1521,6 +2016,61 @@ void MainWindow::createMenus()
     });
     fileMenu->addAction(manageConnectionsAction);
     
+    // Synkronisera aktuell lokal katalog med aktuell fjärrkatalog
+    QMenu *syncMenu = fileMenu->addMenu(tr("Synkronisera"));
+    syncMenu->setIcon(QApplication::style()->standardIcon(QStyle::SP_BrowserReload));
+    
+    QAction *mirrorToRemoteAction = syncMenu->addAction(tr("Spegla lokalt till servern"));
+    connect(mirrorToRemoteAction, &QAction::triggered, this, [this]() {
+        startSync(SyncEngine::MirrorToRemote);
+    });
+    QAction *mirrorToLocalAction = syncMenu->addAction(tr("Spegla servern till lokalt"));
+    connect(mirrorToLocalAction, &QAction::triggered, this, [this]() {
+        startSync(SyncEngine::MirrorToLocal);
+    });
+    QAction *twoWayAction = syncMenu->addAction(tr("Synkronisera åt båda hållen"));
+    connect(twoWayAction, &QAction::triggered, this, [this]() {
+        startSync(SyncEngine::TwoWay);
+    });
+    
+    syncMenu->addSeparator();
+    
+    QAction *dryRunAction = syncMenu->addAction(tr("Torrkörning (visa bara planen)"));
+    dryRunAction->setCheckable(true);
+    dryRunAction->setChecked(m_syncDryRun);
+    connect(dryRunAction, &QAction::toggled, this, [this](bool checked) {
+        m_syncDryRun = checked;
+    });
+    QAction *deleteExtraneousAction = syncMenu->addAction(tr("Ta bort filer som saknas i källan"));
+    deleteExtraneousAction->setCheckable(true);
+    deleteExtraneousAction->setChecked(m_syncDeleteExtraneous);
+    connect(deleteExtraneousAction, &QAction::toggled, this, [this](bool checked) {
+        m_syncDeleteExtraneous = checked;
+    });
+    QAction *compareChecksumsAction = syncMenu->addAction(tr("Jämför kontrollsummor för filer med samma storlek"));
+    compareChecksumsAction->setCheckable(true);
+    compareChecksumsAction->setChecked(m_syncCompareChecksums);
+    connect(compareChecksumsAction, &QAction::toggled, this, [this](bool checked) {
+        m_syncCompareChecksums = checked;
+    });
+    
+    // Bandbreddsgränser i KiB/s; 0 betyder obegränsat
+    QMenu *bandwidthMenu = fileMenu->addMenu(tr("Bandbredd"));
+    
+    QAction *globalLimitAction = bandwidthMenu->addAction(tr("Total gräns..."));
+    connect(globalLimitAction, &QAction::triggered, this, [this]() {
+        askBandwidthLimit(tr("Total gräns"), "bandwidth/global", &BandwidthLimiter::setGlobalLimit);
+    });
+    QAction *hostLimitAction = bandwidthMenu->addAction(tr("Gräns per server..."));
+    connect(hostLimitAction, &QAction::triggered, this, [this]() {
+        askBandwidthLimit(tr("Gräns per server"), "bandwidth/perHost",
+                          static_cast<void (BandwidthLimiter::*)(qint64)>(&BandwidthLimiter::setHostLimit));
+    });
+    QAction *transferLimitAction = bandwidthMenu->addAction(tr("Gräns per överföring (FTP)..."));
+    connect(transferLimitAction, &QAction::triggered, this, [this]() {
+        askBandwidthLimit(tr("Gräns per överföring"), "bandwidth/perTransfer", &BandwidthLimiter::setTransferLimit);
+    });
+    
     fileMenu->addSeparator();
     
     // Avsluta-åtgärd
@@ -2386,6 +2936,8 @@ void MainWindow::loadSettings()
         m_currentTheme = (ThemeType)m_settings.value("theme").toInt();
     }
     
+    loadBandwidthSettings();
+    
     // Läs senaste lokala katalog
     if (m_settings.contains("lastLocalDirectory")) {
         QString lastLocalDir = m_settings.value("lastLocalDirectory").toString();
@@ -2398,6 +2950,46 @@ void MainWindow::loadSettings()
     }
 }
 
+// Bandbreddsgränser och schema, lagrade i KiB/s
+void MainWindow::loadBandwidthSettings()
+{
+    m_bandwidthLimiter->setGlobalLimit(m_settings.value("bandwidth/global", 0).toLongLong() * 1024);
+    m_bandwidthLimiter->setHostLimit(m_settings.value("bandwidth/perHost", 0).toLongLong() * 1024);
+    m_bandwidthLimiter->setTransferLimit(m_settings.value("bandwidth/perTransfer", 0).toLongLong() * 1024);
+    
+    // Schemat redigeras i inställningsfilen, t.ex. en lägre gräns vardagar 08:00-17:00
+    QList<BandwidthLimiter::ScheduleRule> rules;
+    const int count = m_settings.beginReadArray("bandwidth/schedule");
+    for (int i = 0; i < count; ++i) {
+        m_settings.setArrayIndex(i);
+        BandwidthLimiter::ScheduleRule rule;
+        rule.days = m_settings.value("days", int(BandwidthLimiter::AllDays)).toInt();
+        rule.start = QTime::fromString(m_settings.value("start").toString(), "HH:mm");
+        rule.end = QTime::fromString(m_settings.value("end").toString(), "HH:mm");
+        rule.bytesPerSecond = m_settings.value("limit", 0).toLongLong() * 1024;
+        if (rule.start.isValid() && rule.end.isValid()) {
+            rules.append(rule);
+        }
+    }
+    m_settings.endArray();
+    m_bandwidthLimiter->setSchedule(rules);
+}
+
+void MainWindow::askBandwidthLimit(const QString &title, const QString &key,
+                                   void (BandwidthLimiter::*setter)(qint64))
+{
+    bool ok = false;
+    const int limit = QInputDialog::getInt(this, title, tr("KiB/s (0 = obegränsat):"),
+                                           m_settings.value(key, 0).toInt(), 0, 1024 * 1024, 64, &ok);
+    if (!ok) {
+        return;
+    }
+    m_settings.setValue(key, limit);
+    (m_bandwidthLimiter->*setter)(qint64(limit) * 1024);
+    appendToLog(limit > 0 ? tr("%1: %2 KiB/s").arg(title).arg(limit)
+                          : tr("%1: obegränsat").arg(title));
+}
+
 // Implementera sparande av inställningar
 void MainWindow::saveSettings()
 {
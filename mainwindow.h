@@ -31,7 +31,12 @@
 
 #include "ftpmanager.h"
 #include "sftpmanager.h"
+#include "bandwidthlimiter.h"
 #include "connection.h"
+#include "src/transferqueue.h"
+#include "src/transferjournal.h"
+#include "src/treetransfer.h"
+#include "src/syncengine.h"
 #include "connectiondialog.h"
 #include "serverfileitem.h"
 
@@ -99,6 +104,9 @@ private slots:
     void uploadFile();
     void downloadFile();
     void onDirectoryListed(const QStringList &entries);
+    void onDirectoryListingChunk(int listingId, const QString &path, const QList<ServerFileItem> &items);
+    void onDirectoryListingFinished(int listingId, const QString &path, int count);
+    void onDirectoryListingFailed(int listingId, const QString &path, const QString &errorString);
     void onFtpCommandSent(const QString &command);
     void clearLog();
     void showPreferences();
@@ -112,6 +120,11 @@ private slots:
     void initializeFileIcons();
     void updateTabTitle(int index, const QString &title);
     void onTransferProgress(qint64 bytesSent, qint64 bytesTotal, const QString &file);
+    void onTransferQueueProgress();
+    void onStartTransfer(int jobId, const QString &host, bool isUpload,
+                         const QString &sourcePath, const QString &targetPath);
+    void onTransferCompleted(const QString &remotePath);
+    void onTransferFailed(const QString &remotePath, const QString &errorString);
     void onConnected();
     void onDisconnected();
     void onError(const QString &errorMessage);
@@ -128,9 +141,20 @@ private:
     void createMenus();
     void setupTab(TabInfo &tab);
     void loadSettings();
+    void loadBandwidthSettings();
+    void askBandwidthLimit(const QString &title, const QString &key,
+                           void (BandwidthLimiter::*setter)(qint64));
     QString getFileIconName(const QString &fileName, bool isDir);
     void processFtpEntry(const QString &entry);
     void processSftpEntry(const QString &entry);
+    void beginRemoteListing(TabInfo &tab);
+    void endRemoteListing(TabInfo &tab);
+    QString transferHostKey() const;
+    void startTreeTransfer(bool isUpload, const QString &sourcePath, const QString &targetPath);
+    void cancelTreeTransfers();
+    void startSync(SyncEngine::Direction direction);
+    void cancelSyncs();
+    void appendRemoteItem(TabInfo &tab, const ServerFileItem &item);
     
     // Flikhanteringsvariabler
     QTabWidget* m_tabWidget;
@@ -147,6 +171,18 @@ private:
     SftpManager *m_sftpManager;
     bool m_connected;
     Connection m_currentConnection;
+    int m_listingId;        // Senaste listningen som visas; äldre block ignoreras
+    
+    // Överföringskö och pågående jobb per fjärrsökväg
+    TransferQueue *m_transferQueue;
+    TransferJournal *m_transferJournal;     // Kön på disk, återställs vid nästa start
+    BandwidthLimiter *m_bandwidthLimiter;   // Delas av FTP och SFTP
+    QHash<QString, int> m_transferJobs;
+    QList<TreeTransfer*> m_treeTransfers;   // Rekursiva katalogöverföringar som fortfarande läser trädet
+    QList<SyncEngine*> m_syncEngines;       // Synkroniseringar som jämför eller utför sin plan
+    bool m_syncDryRun;                      // Synkronisering visar bara planen
+    bool m_syncDeleteExtraneous;            // Spegling tar bort filer som saknas i källan
+    bool m_syncCompareChecksums;            // Filer med samma storlek jämförs även på kontrollsumma
     
     // Inställningar
     QSettings m_settings;
@@ -9,59 +9,6 @@ Rectangle {
     // Tillgång till tema från applikationsfönstret
     property var theme: mainWindow.theme
     
-    // Exempelmodell för överföringar
-    ListModel {
-        id: transferModel
-        
-        ListElement {
-            fileName: "dokument.pdf"
-            sourceFile: "/home/user/dokument.pdf"
-            targetFile: "C:/Users/david/Downloads/dokument.pdf"
-            fileSize: "2.5 MB"
-            transferProgress: 0.75
-            transferSpeed: "1.2 MB/s"
-            timeRemaining: "5s"
-            isUpload: false
-            status: "Pågår"
-        }
-        
-        ListElement {
-            fileName: "bilder.zip"
-            sourceFile: "C:/Users/david/Documents/bilder.zip"
-            targetFile: "/home/user/uploads/bilder.zip"
-            fileSize: "15.8 MB"
-            transferProgress: 0.35
-            transferSpeed: "850 KB/s"
-            timeRemaining: "25s"
-            isUpload: true
-            status: "Pågår"
-        }
-        
-        ListElement {
-            fileName: "config.json"
-            sourceFile: "/home/user/config.json"
-            targetFile: "C:/Users/david/Downloads/config.json"
-            fileSize: "12 KB"
-            transferProgress: 1.0
-            transferSpeed: "0 KB/s"
-            timeRemaining: "0s"
-            isUpload: false
-            status: "Klar"
-        }
-        
-        ListElement {
-            fileName: "backup.sql"
-            sourceFile: "C:/Users/david/Documents/backup.sql"
-            targetFile: "/home/user/uploads/backup.sql"
-            fileSize: "4.3 MB"
-            transferProgress: 0.0
-            transferSpeed: "0 KB/s"
-            timeRemaining: "Väntar"
-            isUpload: true
-            status: "I kö"
-        }
-    }
-    
     ColumnLayout {
         anchors.fill: parent
         spacing: 0
@@ -86,8 +33,19 @@ Rectangle {
                     Layout.fillWidth: true
                 }
                 
+                // Sammanlagd hastighet, uppdateras i takt med progressInterval
+                Text {
+                    text: transferQueue.totalTimeRemaining.length > 0
+                          ? transferQueue.totalSpeed + " · " + transferQueue.totalTimeRemaining
+                          : transferQueue.totalSpeed
+                    font.pixelSize: 12
+                    color: theme.text
+                    visible: transferQueue.activeCount > 0
+                    Layout.rightMargin: 8
+                }
+                
                 Text {
-                    text: transferModel.count + " filer"
+                    text: transferQueue.count + " filer"
                     font.pixelSize: 12
                     color: theme.text
                 }
@@ -99,7 +57,7 @@ Rectangle {
             Layout.fillWidth: true
             Layout.fillHeight: true
             clip: true
-            model: transferModel
+            model: transferQueue
             
             ScrollBar.vertical: ScrollBar {
                 active: true
@@ -160,7 +118,7 @@ Rectangle {
                             radius: height / 2
                             color: status === "Klar" ? "#4CAF50" : 
                                   status === "Pågår" ? "#2196F3" : 
-                                  status === "I kö" ? "#FFC107" : "#F44336"
+                                  status === "I kö" || status === "Pausad" ? "#FFC107" : "#F44336"
                             opacity: 0.7
                             
                             Text {
@@ -246,11 +204,48 @@ Rectangle {
                             }
                         }
                         
+                        // Hastighet den senaste minuten
+                        Canvas {
+                            id: speedSparkline
+                            width: 60
+                            height: 14
+                            visible: status === "Pågår" && speedHistory.length > 1
+                            
+                            property var history: speedHistory
+                            onHistoryChanged: requestPaint()
+                            
+                            onPaint: {
+                                var ctx = getContext("2d")
+                                ctx.reset()
+                                if (history.length < 2) {
+                                    return
+                                }
+                                var peak = 1
+                                for (var i = 0; i < history.length; ++i) {
+                                    peak = Math.max(peak, history[i])
+                                }
+                                ctx.strokeStyle = isUpload ? "#4CAF50" : "#2196F3"
+                                ctx.lineWidth = 1
+                                ctx.beginPath()
+                                for (var j = 0; j < history.length; ++j) {
+                                    var x = j * (width - 1) / (history.length - 1)
+                                    var y = height - 1 - history[j] / peak * (height - 2)
+                                    if (j === 0) {
+                                        ctx.moveTo(x, y)
+                                    } else {
+                                        ctx.lineTo(x, y)
+                                    }
+                                }
+                                ctx.stroke()
+                            }
+                        }
+                        
                         // Överföringshastighet och återstående tid
                         Text {
-                            text: transferSpeed + " · " + timeRemaining
+                            text: timeRemaining.length > 0 ? transferSpeed + " · " + timeRemaining
+                                                           : transferSpeed
                             font.pixelSize: 10
-                            color: theme.text
+                            color: stalled ? "#FFC107" : theme.text
                             visible: status === "Pågår"
                         }
                     }
@@ -262,7 +257,7 @@ Rectangle {
                     anchors.top: parent.top
                     anchors.margins: 4
                     spacing: 3
-                    visible: status === "Pågår" || status === "I kö"
+                    visible: status === "Pågår" || status === "I kö" || status === "Pausad"
                     
                     // Pausa/Fortsätta-knapp
                     Rectangle {
@@ -273,7 +268,7 @@ Rectangle {
                         
                         Text {
                             anchors.centerIn: parent
-                            text: status === "Pågår" ? "⏸" : "▶"
+                            text: status === "Pausad" ? "▶" : "⏸"
                             color: theme.text
                             font.pixelSize: 12
                         }
@@ -281,8 +276,11 @@ Rectangle {
                         MouseArea {
                             anchors.fill: parent
                             onClicked: {
-                                console.log(status === "Pågår" ? "Pausar överföring: " : "Fortsätter överföring: " + fileName)
-                                // Här kan vi implementera paus/fortsätt-logik
+                                if (status === "Pausad") {
+                                    transferQueue.resume(jobId)
+                                } else {
+                                    transferQueue.pause(jobId)
+                                }
                             }
                         }
                     }
@@ -304,8 +302,7 @@ Rectangle {
                         MouseArea {
                             anchors.fill: parent
                             onClicked: {
-                                console.log("Avbryter överföring: " + fileName)
-                                // Här kan vi implementera avbryt-logik
+                                transferQueue.cancel(jobId)
                             }
                         }
                     }
@@ -348,8 +345,7 @@ Rectangle {
                     }
                     
                     onClicked: {
-                        console.log("Rensar slutförda överföringar")
-                        // Här kan vi ta bort slutförda överföringar från modellen
+                        transferQueue.clearFinished()
                     }
                 }
                 
@@ -380,8 +376,7 @@ Rectangle {
                     }
                     
                     onClicked: {
-                        console.log("Avbryter alla överföringar")
-                        // Här kan vi avbryta alla pågående överföringar
+                        transferQueue.cancelAll()
                     }
                 }
             }
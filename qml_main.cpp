@@ -8,6 +8,7 @@
 #include <exception>
 #include <QDir>
 #include "src/filemodel.h" // Inkludera FileModel header
+#include "src/transferqueue.h"
 
 int main(int argc, char *argv[])
 {
@@ -43,6 +44,10 @@ int main(int argc, char *argv[])
         // Gör modellerna tillgängliga i QML-kontexten
         engine.rootContext()->setContextProperty("localFileModel", &localFileModel);
         engine.rootContext()->setContextProperty("remoteFileModel", &remoteFileModel);
+
+        // Gemensam överföringskö för alla flikar
+        TransferQueue transferQueue;
+        engine.rootContext()->setContextProperty("transferQueue", &transferQueue);
         
         // Ladda QML-huvudfilen från lokal sökväg
         const QUrl url(QStringLiteral("qml/main.qml"));
@@ -93,6 +93,18 @@ public:
      */
     void setLastModified(const QDateTime &lastModified) { m_lastModified = lastModified; }
     
+    /**
+     * @brief Hämta serverns unika id för objektet
+     * @return Värdet av MLSD-faktumet "unique", eller tom sträng om det saknas
+     */
+    QString uniqueId() const { return m_uniqueId; }
+    
+    /**
+     * @brief Sätt serverns unika id för objektet
+     * @param uniqueId Värdet av MLSD-faktumet "unique"
+     */
+    void setUniqueId(const QString &uniqueId) { m_uniqueId = uniqueId; }
+    
     /**
      * @brief Hämta filändelsen
      * @return Filändelsen utan punkt (t.ex. "txt" för fil.txt)
@@ -140,6 +152,7 @@ private:
     qint64 m_size;
     QString m_permissions;
     QDateTime m_lastModified;
+    QString m_uniqueId;
 };
 
 #endif // SERVERFILEITEM_H 
\ No newline at end of file
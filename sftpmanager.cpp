@@ -1,36 +1,208 @@
-#include "mainwindow.h"
+#include "sftpmanager.h"
+#include "bandwidthlimiter.h"
 #include <QDebug>
 #include <QThread>
 #include <QTimer>
 #include <QDir>
+#include <QFileInfo>
 #include <QDateTime>
+#include <QLoggingCategory>
 #include <QRandomGenerator>
 #include <QJsonDocument>
 #include <QJsonObject>
 #include <QSsh>
+#include <QCryptographicHash>
+#include <QMutexLocker>
+#include <QRunnable>
+#include <QStandardPaths>
+#include <QThreadPool>
+#include <cstring>
+#include <functional>
+
+// Statistik per deltaöverföring; slås på med QT_LOGGING_RULES="darkftp.sftp.delta.debug=true"
+Q_LOGGING_CATEGORY(lcDelta, "darkftp.sftp.delta", QtWarningMsg)
+
+// Kontrollsummor som inte kunde jämföras; överföringen godkänns ändå
+Q_LOGGING_CATEGORY(lcChecksum, "darkftp.sftp.checksum", QtWarningMsg)
 
 // SftpManager-implementation
 // Detta är en simulerad implementation av SFTP-funktionalitet
 // I en riktig implementation skulle vi använda ett bibliotek som libssh2
 
+// QSsh håller upp till 10 förfrågningar om 32 KiB ute per fil, så en
+// överföring kan som mest ha ~320 KiB i luften
+const qint64 BYTES_IN_FLIGHT_PER_TRANSFER = 10 * 32 * 1024;
+
+// Bandbredd som fönstret dimensioneras för vid automatisk justering; ungefär
+// vad en gigabitlänk ger efter SSH:s kryptering
+const qint64 TARGET_BYTES_PER_SECOND = 100 * 1024 * 1024;
+
+// Innan RTT är uppmätt: 4 x 320 KiB fyller målbandbredden upp till ~12 ms
+// RTT, dvs. lokalt nät och närliggande servrar. Taket 64 ger 20 MiB i
+// luften, vilket räcker till ~200 ms RTT. Mät med benchmarks/bench_sftpwindow
+const int DEFAULT_TRANSFER_WINDOW = 4;
+const int MAX_TRANSFER_WINDOW = 64;
+
+// Hur ofta RTT mäts om medan överföringar pågår
+const qint64 PROBE_INTERVAL_MS = 10000;
+
+// Standardpool: metadatakanal plus två överföringskanaler på samma anslutning
+const int DEFAULT_TRANSFER_CHANNELS = 2;
+const int MAX_TRANSFER_CHANNELS = 16;
+const int MAX_CONNECTIONS = 8;
+
+// Snabbväg för små filer: upp till två skrivförfrågningar per fil, så
+// många filer kan ligga ute samtidigt utan att fylla länken
+const qint64 SMALL_FILE_MAX_SIZE = 64 * 1024;
+const int SMALL_FILE_WINDOW = 64;
+
+// Tar-arkiv för små filer: storlek per arkiv och hur länge filer samlas ihop
+const int ARCHIVE_MAX_FILES = 1000;
+const int ARCHIVE_MAX_BYTES = 8 * 1024 * 1024;
+const int ARCHIVE_FLUSH_DELAY_MS = 20;
+const int MAX_ARCHIVE_UPLOADS = 2;
+
+// Deltaöverföring: lönar sig inte om mer än hälften av filen ändrats,
+// och deltat hålls i minnet så det får inte bli hur stort som helst
+const qint64 DELTA_MAX_LITERAL_BYTES = 256 * 1024 * 1024;
+
+// Fjärrkommandot skriver summan i hex först på raden; längden avgör algoritmen
+const int CRC32_HEX_LENGTH = 8;
+const int MD5_HEX_LENGTH = 32;
+
+// tar läser i poster om 20 block; ett arkiv utfyllt till hel post avslutas
+// utan att fjärrsidan behöver EOF på stdin
+const int TAR_BLOCK_SIZE = 512;
+const int TAR_RECORD_SIZE = 20 * TAR_BLOCK_SIZE;
+
+namespace {
+
+void writeTarOctal(char *field, int width, qint64 value)
+{
+    // Fältet är width-1 oktala siffror följda av NUL
+    QByteArray digits = QByteArray::number(value, 8).rightJustified(width - 1, '0');
+    memcpy(field, digits.constData(), width - 1);
+    field[width - 1] = '\0';
+}
+
+/**
+ * @brief Lägg till en vanlig fil i ett ustar-arkiv
+ * @return false om sökvägen inte ryms i huvudet
+ */
+bool appendTarEntry(QByteArray &archive, const QByteArray &path, const QByteArray &data,
+                    qint64 mtime, int mode)
+{
+    // ustar delar långa sökvägar i prefix (155 byte) och namn (100 byte)
+    QByteArray prefix;
+    QByteArray name = path;
+    if (name.size() > 100) {
+        int split = path.lastIndexOf('/', 155);
+        if (split <= 0 || path.size() - split - 1 > 100) {
+            return false;
+        }
+        prefix = path.left(split);
+        name = path.mid(split + 1);
+    }
+
+    char header[TAR_BLOCK_SIZE];
+    memset(header, 0, sizeof(header));
+    memcpy(header, name.constData(), name.size());
+    writeTarOctal(header + 100, 8, mode);
+    writeTarOctal(header + 108, 8, 0);
+    writeTarOctal(header + 116, 8, 0);
+    writeTarOctal(header + 124, 12, data.size());
+    writeTarOctal(header + 136, 12, mtime);
+    header[156] = '0';
+    memcpy(header + 257, "ustar", 6);
+    memcpy(header + 263, "00", 2);
+    memcpy(header + 345, prefix.constData(), prefix.size());
+
+    // Kontrollsumman räknas med checksummefältet fyllt med blanksteg
+    memset(header + 148, ' ', 8);
+    unsigned int checksum = 0;
+    for (unsigned char byte : header) {
+        checksum += byte;
+    }
+    writeTarOctal(header + 148, 7, checksum);
+    header[155] = ' ';
+
+    archive.append(header, sizeof(header));
+    archive.append(data);
+    const int padding = (TAR_BLOCK_SIZE - data.size() % TAR_BLOCK_SIZE) % TAR_BLOCK_SIZE;
+    archive.append(padding, '\0');
+    return true;
+}
+
+// QRunnable som kör en funktion; QRunnable::create() finns inte i äldre Qt5
+class FunctionTask : public QRunnable
+{
+public:
+    explicit FunctionTask(std::function<void()> function)
+        : m_function(std::move(function))
+    {
+    }
+
+    void run() override
+    {
+        m_function();
+    }
+
+private:
+    std::function<void()> m_function;
+};
+
+void finishTarArchive(QByteArray &archive)
+{
+    // Två tomma block markerar slutet; fyll sedan ut till hel post
+    archive.append(2 * TAR_BLOCK_SIZE, '\0');
+    const int padding = (TAR_RECORD_SIZE - archive.size() % TAR_RECORD_SIZE) % TAR_RECORD_SIZE;
+    archive.append(padding, '\0');
+}
+
+} // namespace
+
 SftpManager::SftpManager(QObject *parent)
     : QObject(parent)
     , m_sshConnection(nullptr)
     , m_port(22)
-    , m_connected(false)
     , m_currentDirectory("")
-    , m_currentListJob(0)
-    , m_currentUploadJob(0)
-    , m_currentDownloadJob(0)
-    , m_currentMkdirJob(0)
-    , m_currentRemoveFileJob(0)
-    , m_currentRemoveDirJob(0)
-    , m_currentRenameJob(0)
+    , m_connected(false)
+    , m_listingId(0)
+    , m_transferChannelCount(DEFAULT_TRANSFER_CHANNELS)
+    , m_connectionCount(1)
+    , m_activeTransfers(0)
+    , m_transferWindow(DEFAULT_TRANSFER_WINDOW)
+    , m_maxTransferWindow(MAX_TRANSFER_WINDOW)
+    , m_autoTuneWindow(true)
+    , m_activeSmallTransfers(0)
+    , m_smallFileBatching(true)
+    , m_useArchive(false)
+    , m_archiveUnavailable(false)
+    , m_archiveFlushScheduled(false)
+    , m_deltaSync(false)
+    , m_deltaMinimumSize(16 * 1024 * 1024)
+    , m_deltaUnavailable(false)
+    , m_nextDeltaId(0)
+    , m_workerGuard(new WorkerGuard)
+    , m_verifyChecksums(true)
+    , m_checksumMinimumSize(1024 * 1024)
+    , m_checksumUnavailable(false)
+    , m_remoteChecksumAlgorithm(FileHasher::Crc32)
+    , m_nextChecksumId(0)
+    , m_limiter(nullptr)
+    , m_limiterStream(0)
+    , m_roundTripTime(-1)
+    , m_probePending(false)
 {
+    m_workerGuard->owner = this;
 }
 
 SftpManager::~SftpManager()
 {
+    {
+        QMutexLocker locker(&m_workerGuard->mutex);
+        m_workerGuard->owner = nullptr;
+    }
     disconnectFromHost();
 }
 
@@ -137,11 +309,74 @@ bool SftpManager::connectToHostWithKey(const QString &host, const QString &usern
 
 void SftpManager::disconnectFromHost()
 {
+    // Släpp lokala filer för jobb som aldrig blev klara
+    for (auto it = m_jobs.constBegin(); it != m_jobs.constEnd(); ++it) {
+        if (it->file) {
+            it->file->close();
+            it->file->deleteLater();
+        }
+    }
+    m_jobs.clear();
+    m_queuedTransfers.clear();
+    m_activeTransfers = 0;
+    m_queuedSmallTransfers.clear();
+    m_activeSmallTransfers = 0;
+    m_pendingArchiveFiles.clear();
+    m_archiveUnavailable = false;
+    
+    for (ArchiveUpload *upload : m_archiveUploads) {
+        disconnect(upload->process.data(), nullptr, this, nullptr);
+        upload->process->close();
+        delete upload;
+    }
+    m_archiveUploads.clear();
+    
+    for (DeltaUpload *upload : m_deltaUploads) {
+        if (upload->process) {
+            disconnect(upload->process.data(), nullptr, this, nullptr);
+            upload->process->close();
+        }
+        delete upload;
+    }
+    m_deltaUploads.clear();
+    m_deltaUnavailable = false;
+    
+    for (ChecksumVerification *verification : m_checksumVerifications) {
+        if (verification->process) {
+            disconnect(verification->process.data(), nullptr, this, nullptr);
+            verification->process->close();
+        }
+        delete verification;
+    }
+    m_checksumVerifications.clear();
+    m_checksumUnavailable = false;
+    m_remoteChecksumAlgorithm = FileHasher::Crc32;
+    
+    if (m_limiter && m_limiterStream) {
+        m_limiter->closeStream(m_limiterStream);
+    }
+    m_limiterStream = 0;
+    m_probePending = false;
+    
+    for (TransferChannel &transfer : m_transferChannels) {
+        disconnect(transfer.channel.data(), nullptr, this, nullptr);
+        transfer.channel->closeChannel();
+    }
+    m_transferChannels.clear();
+    
     if (m_sftpChannel) {
+        disconnect(m_sftpChannel.data(), nullptr, this, nullptr);
         m_sftpChannel->closeChannel();
         m_sftpChannel.clear();
     }
     
+    for (QSsh::SshConnection *connection : m_extraConnections) {
+        disconnect(connection, nullptr, this, nullptr);
+        connection->disconnectFromHost();
+        connection->deleteLater();
+    }
+    m_extraConnections.clear();
+    
     if (m_sshConnection) {
         m_sshConnection->disconnectFromHost();
         disconnect(m_sshConnection, nullptr, this, nullptr);
@@ -163,6 +398,500 @@ QString SftpManager::currentDirectory() const
     return m_currentDirectory;
 }
 
+int SftpManager::pendingJobCount() const
+{
+    int archived = 0;
+    for (const ArchiveUpload *upload : m_archiveUploads) {
+        archived += upload->jobs.size();
+    }
+    return m_jobs.size() + m_queuedTransfers.size() + m_queuedSmallTransfers.size()
+           + m_pendingArchiveFiles.size() + archived + m_deltaUploads.size();
+}
+
+void SftpManager::setTransferWindow(int window)
+{
+    m_maxTransferWindow = qBound(1, window, MAX_TRANSFER_WINDOW);
+    if (m_autoTuneWindow) {
+        updateTransferWindow();
+    } else {
+        m_transferWindow = m_maxTransferWindow;
+    }
+    startQueuedTransfers();
+}
+
+int SftpManager::transferWindow() const
+{
+    return m_transferWindow;
+}
+
+void SftpManager::setAutoTuneWindow(bool enabled)
+{
+    m_autoTuneWindow = enabled;
+    if (enabled) {
+        updateTransferWindow();
+    } else {
+        m_transferWindow = m_maxTransferWindow;
+    }
+    startQueuedTransfers();
+}
+
+qint64 SftpManager::roundTripTime() const
+{
+    return m_roundTripTime;
+}
+
+void SftpManager::setChannelPool(int transferChannels, int connections)
+{
+    m_transferChannelCount = qBound(0, transferChannels, MAX_TRANSFER_CHANNELS);
+    m_connectionCount = qBound(1, connections, MAX_CONNECTIONS);
+}
+
+void SftpManager::setSmallFileBatching(bool enabled, bool useArchive)
+{
+    m_smallFileBatching = enabled;
+    m_useArchive = enabled && useArchive;
+    
+    // Filer som väntar på ett arkiv skickas med SFTP i stället
+    if (!m_useArchive) {
+        for (const SftpJob &job : qAsConst(m_pendingArchiveFiles)) {
+            m_queuedSmallTransfers.enqueue(job);
+        }
+        m_pendingArchiveFiles.clear();
+        startQueuedTransfers();
+    }
+}
+
+bool SftpManager::smallFileBatching() const
+{
+    return m_smallFileBatching;
+}
+
+void SftpManager::setDeltaSync(bool enabled, qint64 minimumSize)
+{
+    m_deltaSync = enabled;
+    m_deltaMinimumSize = qMax<qint64>(0, minimumSize);
+}
+
+bool SftpManager::deltaSync() const
+{
+    return m_deltaSync;
+}
+
+void SftpManager::setChecksumVerification(bool enabled, qint64 minimumSize)
+{
+    m_verifyChecksums = enabled;
+    m_checksumMinimumSize = qMax<qint64>(0, minimumSize);
+}
+
+bool SftpManager::checksumVerification() const
+{
+    return m_verifyChecksums;
+}
+
+void SftpManager::setBandwidthLimiter(BandwidthLimiter *limiter)
+{
+    if (m_limiter) {
+        disconnect(m_limiter, nullptr, this, nullptr);
+        if (m_limiterStream) {
+            m_limiter->closeStream(m_limiterStream);
+        }
+    }
+    m_limiterStream = 0;
+    m_limiter = limiter;
+    if (limiter) {
+        connect(limiter, &BandwidthLimiter::tokensAvailable, this, &SftpManager::startQueuedTransfers);
+        if (m_connected) {
+            m_limiterStream = limiter->openStream(m_host);
+        }
+    }
+}
+
+int SftpManager::readyTransferChannelCount() const
+{
+    int count = 0;
+    for (const TransferChannel &transfer : m_transferChannels) {
+        if (transfer.ready) {
+            ++count;
+        }
+    }
+    return count;
+}
+
+void SftpManager::connectJobSignals(QSsh::SftpChannel *channel)
+{
+    // Jobbsignalerna kopplas en gång per kanal; jobbtabellen avgör vem
+    // ett svar hör till
+    connect(channel, &QSsh::SftpChannel::finished, this,
+            [this, channel](QSsh::SftpJobId job, const QString &error) {
+                onJobFinished(channel, job, error);
+            });
+    connect(channel, &QSsh::SftpChannel::fileInfoAvailable, this,
+            [this, channel](QSsh::SftpJobId job, const QList<QSsh::SftpFileInfo> &dirContent) {
+                onListDirFileInfoAvailable(channel, job, dirContent);
+            });
+    connect(channel, &QSsh::SftpChannel::transferProgress, this,
+            [this, channel](QSsh::SftpJobId job, quint64 bytesSent, quint64 bytesTotal) {
+                onTransferProgress(channel, job, bytesSent, bytesTotal);
+            });
+}
+
+void SftpManager::openTransferChannels(QSsh::SshConnection *connection, int count)
+{
+    for (int i = 0; i < count; ++i) {
+        QSsh::SftpChannel::Ptr channel = connection->createSftpChannel();
+        if (!channel) {
+            continue;
+        }
+        
+        TransferChannel transfer;
+        transfer.channel = channel;
+        transfer.connection = connection;
+        m_transferChannels.append(transfer);
+        
+        QSsh::SftpChannel *raw = channel.data();
+        connect(raw, &QSsh::SftpChannel::initialized, this, [this, raw]() {
+            for (TransferChannel &transfer : m_transferChannels) {
+                if (transfer.channel.data() == raw) {
+                    transfer.ready = true;
+                }
+            }
+            startQueuedTransfers();
+        });
+        connect(raw, &QSsh::SftpChannel::channelError, this, [this, raw](const QString &errorMessage) {
+            qDebug() << "SFTP-överföringskanal misslyckades:" << errorMessage;
+            for (TransferChannel &transfer : m_transferChannels) {
+                if (transfer.channel.data() == raw) {
+                    transfer.ready = false;
+                    transfer.failed = true;
+                }
+            }
+            // Köade överföringar går vidare på övriga kanaler
+            startQueuedTransfers();
+        });
+        connectJobSignals(raw);
+        
+        channel->initialize();
+    }
+}
+
+void SftpManager::openExtraConnections()
+{
+    // Fördela överföringskanalerna jämnt; huvudanslutningen har redan fått sin andel
+    for (int i = 1; i < m_connectionCount; ++i) {
+        const int share = m_transferChannelCount / m_connectionCount
+                          + (i < m_transferChannelCount % m_connectionCount ? 1 : 0);
+        if (share == 0) {
+            continue;
+        }
+        
+        QSsh::SshConnection *connection = new QSsh::SshConnection(m_connectionParams, this);
+        m_extraConnections.append(connection);
+        
+        connect(connection, &QSsh::SshConnection::connected, this, [this, connection, share]() {
+            openTransferChannels(connection, share);
+        });
+        connect(connection, &QSsh::SshConnection::error, this, [this, connection](QSsh::SshError error) {
+            // En extra anslutning som faller bort påverkar inte sessionen;
+            // dess kanaler markeras som trasiga och kön går vidare på resten
+            qDebug() << "Extra SSH-anslutning misslyckades:" << error;
+            for (TransferChannel &transfer : m_transferChannels) {
+                if (transfer.connection == connection) {
+                    transfer.ready = false;
+                    transfer.failed = true;
+                }
+            }
+            startQueuedTransfers();
+        });
+        
+        connection->connectToHost();
+    }
+}
+
+int SftpManager::pickTransferChannel() const
+{
+    int best = -1;
+    bool opening = false;
+    for (int i = 0; i < m_transferChannels.size(); ++i) {
+        const TransferChannel &transfer = m_transferChannels.at(i);
+        if (transfer.failed) {
+            continue;
+        }
+        if (!transfer.ready) {
+            opening = true;
+            continue;
+        }
+        if (best < 0 || transfer.activeTransfers < m_transferChannels.at(best).activeTransfers) {
+            best = i;
+        }
+    }
+    
+    if (best >= 0) {
+        return best;
+    }
+    
+    // Vänta hellre på poolen än att belasta metadatakanalen
+    return opening ? -2 : -1;
+}
+
+void SftpManager::updateTransferWindow()
+{
+    if (m_roundTripTime < 0) {
+        m_transferWindow = qMin(DEFAULT_TRANSFER_WINDOW, m_maxTransferWindow);
+        return;
+    }
+    
+    // Bandbredd-fördröjningsprodukt: så många överföringar behövs för att
+    // fylla länken när varje överföring har en begränsad mängd data i luften
+    const qint64 rtt = qMax<qint64>(1, m_roundTripTime);
+    const qint64 bytesInFlight = TARGET_BYTES_PER_SECOND * rtt / 1000;
+    const qint64 window = (bytesInFlight + BYTES_IN_FLIGHT_PER_TRANSFER - 1) / BYTES_IN_FLIGHT_PER_TRANSFER;
+    m_transferWindow = int(qBound<qint64>(1, window, m_maxTransferWindow));
+}
+
+void SftpManager::probeRoundTripTime()
+{
+    if (!m_sftpChannel || m_probePending) {
+        return;
+    }
+    if (m_lastProbe.isValid() && m_lastProbe.elapsed() < PROBE_INTERVAL_MS) {
+        return;
+    }
+    
+    // STAT är billigt på servern, så svarstiden är i stort sett ren RTT
+    SftpJob job;
+    job.type = SftpJob::Probe;
+    job.remotePath = m_currentDirectory.isEmpty() ? QStringLiteral("/") : m_currentDirectory;
+    QSsh::SftpJobId jobId = m_sftpChannel->statFile(job.remotePath);
+    if (jobId == QSsh::SftpInvalidJob) {
+        return;
+    }
+    
+    job.channel = m_sftpChannel.data();
+    job.timer.start();
+    m_jobs.insert(JobKey(job.channel, jobId), job);
+    m_probePending = true;
+    m_lastProbe.start();
+}
+
+void SftpManager::startQueuedTransfers()
+{
+    // Pågående överföringar kan inte hållas igen, så skulden betalas av
+    // genom att nya inte startas förrän hinkarna fyllts på igen
+    if (m_limiter && m_limiterStream && m_limiter->isOverBudget(m_limiterStream)) {
+        return;
+    }
+    
+    // Små filer har ett eget fönster; de håller lite data i luften och
+    // begränsas av rundresorna för open/write/close
+    while (m_sftpChannel && m_activeSmallTransfers < SMALL_FILE_WINDOW && !m_queuedSmallTransfers.isEmpty()) {
+        const int index = pickTransferChannel();
+        if (index == -2) {
+            break;
+        }
+        startTransferJob(m_queuedSmallTransfers.dequeue(), index);
+    }
+    
+    while (m_sftpChannel && m_activeTransfers < m_transferWindow && !m_queuedTransfers.isEmpty()) {
+        const int index = pickTransferChannel();
+        if (index == -2) {
+            break;
+        }
+        startTransferJob(m_queuedTransfers.dequeue(), index);
+    }
+}
+
+void SftpManager::startTransferJob(SftpJob job, int index)
+{
+    QSsh::SftpChannel *channel = index >= 0 ? m_transferChannels.at(index).channel.data()
+                                            : m_sftpChannel.data();
+    
+    // Filen öppnas först när överföringen startar, så att en lång kö
+    // inte håller tusentals filhandtag öppna
+    QFile *file = new QFile(job.localPath, this);
+    QSsh::SftpJobId jobId = QSsh::SftpInvalidJob;
+    if (job.type == SftpJob::Upload) {
+        if (!file->open(QIODevice::ReadOnly)) {
+            failTransfer(job.remotePath, tr("Kunde inte öppna lokal fil: %1").arg(file->errorString()));
+            file->deleteLater();
+            return;
+        }
+        job.bytesTotal = quint64(file->size());
+        jobId = channel->uploadFile(file->handle(), job.remotePath, file->size());
+    } else {
+        if (!file->open(QIODevice::WriteOnly)) {
+            failTransfer(job.remotePath, tr("Kunde inte öppna lokal fil för skrivning: %1").arg(file->errorString()));
+            file->deleteLater();
+            return;
+        }
+        jobId = channel->downloadFile(job.remotePath, file->handle());
+    }
+    
+    // Filobjektet raderas när jobbet är klart
+    job.file = file;
+    const bool smallFile = job.smallFile;
+    if (addJob(channel, jobId, job)) {
+        if (smallFile) {
+            ++m_activeSmallTransfers;
+        } else {
+            ++m_activeTransfers;
+        }
+        if (index >= 0) {
+            ++m_transferChannels[index].activeTransfers;
+        }
+    }
+}
+
+void SftpManager::flushArchiveBatch()
+{
+    if (m_pendingArchiveFiles.isEmpty() || !m_connected || !m_sshConnection) {
+        return;
+    }
+    
+    if (m_archiveUnavailable) {
+        for (const SftpJob &job : qAsConst(m_pendingArchiveFiles)) {
+            m_queuedSmallTransfers.enqueue(job);
+        }
+        m_pendingArchiveFiles.clear();
+        startQueuedTransfers();
+        return;
+    }
+    
+    if (m_archiveUploads.size() >= MAX_ARCHIVE_UPLOADS) {
+        return; // Nästa arkiv packas när ett pågående är klart
+    }
+    
+    ArchiveUpload *upload = new ArchiveUpload;
+    while (!m_pendingArchiveFiles.isEmpty() && upload->jobs.size() < ARCHIVE_MAX_FILES
+           && upload->archive.size() < ARCHIVE_MAX_BYTES) {
+        SftpJob job = m_pendingArchiveFiles.takeFirst();
+        
+        // Arkivet packas upp med -C /, så bara absoluta sökvägar fungerar
+        const QByteArray path = job.remotePath.mid(1).toUtf8();
+        if (!job.remotePath.startsWith('/') || path.isEmpty()) {
+            m_queuedSmallTransfers.enqueue(job);
+            continue;
+        }
+        
+        QFile file(job.localPath);
+        if (!file.open(QIODevice::ReadOnly)) {
+            failTransfer(job.remotePath, tr("Kunde inte öppna lokal fil: %1").arg(file.errorString()));
+            continue;
+        }
+        const QByteArray data = file.readAll();
+        const QFileInfo info(file);
+        const int mode = (info.permissions() & QFileDevice::ExeOwner) ? 0755 : 0644;
+        
+        if (!appendTarEntry(upload->archive, path, data, info.lastModified().toSecsSinceEpoch(), mode)) {
+            // Sökvägen ryms inte i ett ustar-huvud
+            m_queuedSmallTransfers.enqueue(job);
+            continue;
+        }
+        job.bytesTotal = quint64(data.size());
+        upload->jobs.append(job);
+    }
+    
+    if (upload->jobs.isEmpty()) {
+        delete upload;
+        startQueuedTransfers();
+        return;
+    }
+    
+    finishTarArchive(upload->archive);
+    
+    // QSsh kan bara skicka EOF tillsammans med CLOSE, och då före data som
+    // väntar på fönstret. head stänger i stället tars stdin efter sista
+    // blocket; saknas head svarar kommandot 127 som när tar saknas
+    const QByteArray command = "command -v head >/dev/null || exit 127; head -c "
+                               + QByteArray::number(upload->archive.size()) + " | tar -xf - -C /";
+    upload->process = m_sshConnection->createRemoteProcess(command);
+    if (!upload->process) {
+        m_archiveUnavailable = true;
+        for (const SftpJob &job : qAsConst(upload->jobs)) {
+            m_queuedSmallTransfers.enqueue(job);
+        }
+        delete upload;
+        startQueuedTransfers();
+        return;
+    }
+    
+    connect(upload->process.data(), &QSsh::SshRemoteProcess::started, this, [upload]() {
+        upload->started = true;
+        upload->process->write(upload->archive);
+    });
+    connect(upload->process.data(), &QSsh::SshRemoteProcess::closed, this, [this, upload](int exitStatus) {
+        onArchiveFinished(upload, exitStatus);
+    });
+    
+    m_archiveUploads.append(upload);
+    upload->process->start();
+    
+    if (!m_pendingArchiveFiles.isEmpty()) {
+        QTimer::singleShot(0, this, &SftpManager::flushArchiveBatch);
+    }
+    startQueuedTransfers();
+}
+
+void SftpManager::onArchiveFinished(ArchiveUpload *upload, int exitStatus)
+{
+    if (!m_archiveUploads.removeOne(upload)) {
+        return;
+    }
+    disconnect(upload->process.data(), nullptr, this, nullptr);
+    
+    const int exitCode = upload->process->exitCode();
+    if (exitStatus == QSsh::SshRemoteProcess::NormalExit && exitCode == 0) {
+        for (const SftpJob &job : qAsConst(upload->jobs)) {
+            emit transferProgress(job.bytesTotal, job.bytesTotal, job.remotePath);
+            emit uploadFinished(job.remotePath);
+        }
+        if (m_limiter && m_limiterStream) {
+            m_limiter->consume(m_limiterStream, upload->archive.size());
+        }
+    } else {
+        // Exec nekad eller tar saknas (127): använd SFTP resten av sessionen.
+        // Andra fel, t.ex. rättigheter, får SFTP rapportera per fil.
+        if (!upload->started || exitCode == 127) {
+            m_archiveUnavailable = true;
+        }
+        qDebug() << "Tar-arkiv misslyckades, skickar filerna med SFTP:"
+                 << upload->process->readAllStandardError();
+        
+        for (const SftpJob &job : qAsConst(upload->jobs)) {
+            m_queuedSmallTransfers.enqueue(job);
+        }
+    }
+    
+    // Processen skickade signalen och får inte raderas förrän den är hanterad
+    QTimer::singleShot(0, this, [upload]() {
+        delete upload;
+    });
+    
+    flushArchiveBatch();
+    startQueuedTransfers();
+}
+
+bool SftpManager::addJob(QSsh::SftpChannel *channel, QSsh::SftpJobId jobId, SftpJob job)
+{
+    if (jobId == QSsh::SftpInvalidJob) {
+        if (job.file) {
+            job.file->close();
+            job.file->deleteLater();
+        }
+        const QString message = tr("Kunde inte starta SFTP-jobb för %1").arg(job.remotePath);
+        if (job.type == SftpJob::Upload || job.type == SftpJob::Download) {
+            failTransfer(job.remotePath, message);
+        } else {
+            emit error(message);
+        }
+        return false;
+    }
+    
+    job.channel = channel;
+    job.timer.start();
+    m_jobs.insert(JobKey(channel, jobId), job);
+    return true;
+}
+
 void SftpManager::listDirectory(const QString &path)
 {
     if (!m_connected || !m_sftpChannel) {
@@ -175,11 +904,28 @@ void SftpManager::listDirectory(const QString &path)
         dirPath = m_currentDirectory.isEmpty() ? "/" : m_currentDirectory;
     }
     
-    m_currentListPath = dirPath;
-    m_currentListJob = m_sftpChannel->listDirectory(dirPath);
+    SftpJob job;
+    job.type = SftpJob::List;
+    job.remotePath = dirPath;
+    job.listingId = ++m_listingId;
+    if (!addJob(m_sftpChannel.data(), m_sftpChannel->listDirectory(dirPath), job)) {
+        emit directoryListingFailed(job.listingId, dirPath, tr("Kunde inte lista katalog: %1").arg(dirPath));
+    }
+}
+
+void SftpManager::scanDirectory(const QString &path)
+{
+    if (!m_connected || !m_sftpChannel) {
+        emit directoryScanFinished(path, true, tr("Inte ansluten till SFTP-server"));
+        return;
+    }
     
-    connect(m_sftpChannel.data(), &QSsh::SftpChannel::fileInfoAvailable, 
-            this, &SftpManager::onListDirJobFinished);
+    SftpJob job;
+    job.type = SftpJob::Scan;
+    job.remotePath = path;
+    if (!addJob(m_sftpChannel.data(), m_sftpChannel->listDirectory(path), job)) {
+        emit directoryScanFinished(path, true, tr("Kunde inte lista katalog: %1").arg(path));
+    }
 }
 
 void SftpManager::uploadFile(const QString &localFilePath, const QString &remoteFilePath)
@@ -189,25 +935,42 @@ void SftpManager::uploadFile(const QString &localFilePath, const QString &remote
         return;
     }
     
-    QFile *file = new QFile(localFilePath, this);
-    if (!file->open(QIODevice::ReadOnly)) {
-        emit error(tr("Kunde inte öppna lokal fil: %1").arg(file->errorString()));
-        file->deleteLater();
+    SftpJob job;
+    job.type = SftpJob::Upload;
+    job.remotePath = remoteFilePath;
+    job.localPath = localFilePath;
+    
+    const qint64 localSize = QFileInfo(localFilePath).size();
+    if (m_deltaSync && !m_deltaUnavailable && localSize >= m_deltaMinimumSize
+        && !m_deltaUploads.contains(remoteFilePath)) {
+        startDeltaUpload(job);
         return;
     }
     
-    m_currentLocalUploadPath = localFilePath;
-    m_currentUploadPath = remoteFilePath;
-    m_currentUploadJob = m_sftpChannel->uploadFile(file->handle(), remoteFilePath, file->size());
+    if (!m_smallFileBatching || localSize > SMALL_FILE_MAX_SIZE) {
+        m_queuedTransfers.enqueue(job);
+        startQueuedTransfers();
+        return;
+    }
     
-    connect(m_sftpChannel.data(), &QSsh::SftpChannel::finished, 
-            this, &SftpManager::onFileUploadJobFinished);
-            
-    connect(m_sftpChannel.data(), &QSsh::SftpChannel::transferProgress, 
-            this, &SftpManager::onTransferProgress);
+    job.smallFile = true;
+    if (!m_useArchive || m_archiveUnavailable) {
+        m_queuedSmallTransfers.enqueue(job);
+        startQueuedTransfers();
+        return;
+    }
     
-    // Filobjektet kommer att raderas i onFileUploadJobFinished
-    file->setParent(this);
+    // Samla små filer en kort stund så att de hamnar i samma arkiv
+    m_pendingArchiveFiles.append(job);
+    if (m_pendingArchiveFiles.size() >= ARCHIVE_MAX_FILES) {
+        flushArchiveBatch();
+    } else if (!m_archiveFlushScheduled) {
+        m_archiveFlushScheduled = true;
+        QTimer::singleShot(ARCHIVE_FLUSH_DELAY_MS, this, [this]() {
+            m_archiveFlushScheduled = false;
+            flushArchiveBatch();
+        });
+    }
 }
 
 void SftpManager::downloadFile(const QString &remoteFilePath, const QString &localFilePath)
@@ -224,25 +987,105 @@ void SftpManager::downloadFile(const QString &remoteFilePath, const QString &loc
         dir.mkpath(".");
     }
     
-    QFile *file = new QFile(localFilePath, this);
-    if (!file->open(QIODevice::WriteOnly)) {
-        emit error(tr("Kunde inte öppna lokal fil för skrivning: %1").arg(file->errorString()));
-        file->deleteLater();
+    SftpJob job;
+    job.type = SftpJob::Download;
+    job.remotePath = remoteFilePath;
+    job.localPath = localFilePath;
+    m_queuedTransfers.enqueue(job);
+    startQueuedTransfers();
+}
+
+void SftpManager::abortTransfer(const QString &remotePath)
+{
+    const QString message = tr("Överföringen avbröts");
+    
+    // Överföringar som inte har startat tas bara bort ur köerna
+    bool queued = false;
+    auto removeQueued = [&](QList<SftpJob> &jobs) {
+        for (int i = jobs.size() - 1; i >= 0; --i) {
+            if (jobs.at(i).remotePath == remotePath) {
+                jobs.removeAt(i);
+                queued = true;
+            }
+        }
+    };
+    removeQueued(m_queuedTransfers);
+    removeQueued(m_queuedSmallTransfers);
+    removeQueued(m_pendingArchiveFiles);
+    if (queued) {
+        failTransfer(remotePath, message);
+        return;
+    }
+    
+    if (DeltaUpload *upload = m_deltaUploads.value(remotePath)) {
+        QSsh::SshRemoteProcess::Ptr process = upload->process;
+        finishDeltaUpload(upload);
+        if (process) {
+            process->close();
+        }
+        failTransfer(remotePath, message);
         return;
     }
     
-    m_currentDownloadPath = remoteFilePath;
-    m_currentLocalDownloadPath = localFilePath;
-    m_currentDownloadJob = m_sftpChannel->downloadFile(remoteFilePath, file->handle());
+    for (ChecksumVerification *verification : qAsConst(m_checksumVerifications)) {
+        if (verification->remoteOnly || verification->job.remotePath != remotePath) {
+            continue;
+        }
+        m_checksumVerifications.remove(verification->id);
+        if (verification->process) {
+            disconnect(verification->process.data(), nullptr, this, nullptr);
+            verification->process->close();
+        }
+        delete verification;
+        failTransfer(remotePath, message);
+        return;
+    }
     
-    connect(m_sftpChannel.data(), &QSsh::SftpChannel::finished, 
-            this, &SftpManager::onFileDownloadJobFinished);
-            
-    connect(m_sftpChannel.data(), &QSsh::SftpChannel::transferProgress, 
-            this, &SftpManager::onTransferProgress);
+    QList<JobKey> running;
+    for (auto it = m_jobs.constBegin(); it != m_jobs.constEnd(); ++it) {
+        if ((it->type == SftpJob::Upload || it->type == SftpJob::Download)
+            && it->remotePath == remotePath && !it->aborted) {
+            running.append(it.key());
+        }
+    }
     
-    // Filobjektet kommer att raderas i onFileDownloadJobFinished
-    file->setParent(this);
+    for (const JobKey &key : qAsConst(running)) {
+        int index = -1;
+        for (int i = 0; i < m_transferChannels.size(); ++i) {
+            if (m_transferChannels.at(i).channel.data() == key.first
+                && m_transferChannels.at(i).activeTransfers == 1) {
+                index = i;
+            }
+        }
+        
+        if (index < 0) {
+            // SFTP saknar avbrott per jobb; på en delad kanal får jobbet köra klart
+            m_jobs[key].aborted = true;
+            continue;
+        }
+        
+        // Kanalen bär bara det här jobbet, så den stängs och ersätts med en ny
+        const TransferChannel transfer = m_transferChannels.takeAt(index);
+        disconnect(transfer.channel.data(), nullptr, this, nullptr);
+        transfer.channel->closeChannel();
+        
+        const SftpJob job = m_jobs.take(key);
+        if (job.file) {
+            job.file->close();
+            job.file->deleteLater();
+        }
+        if (job.smallFile) {
+            --m_activeSmallTransfers;
+        } else {
+            --m_activeTransfers;
+        }
+        failTransfer(remotePath, message);
+        
+        if (transfer.connection) {
+            openTransferChannels(transfer.connection, 1);
+        }
+    }
+    startQueuedTransfers();
 }
 
 void SftpManager::createDirectory(const QString &dirPath)
@@ -252,11 +1095,22 @@ void SftpManager::createDirectory(const QString &dirPath)
         return;
     }
     
-    m_currentMkdirPath = dirPath;
-    m_currentMkdirJob = m_sftpChannel->createDirectory(dirPath);
-    
-    connect(m_sftpChannel.data(), &QSsh::SftpChannel::finished, 
-            this, &SftpManager::onMkdirJobFinished);
+    SftpJob job;
+    job.type = SftpJob::Mkdir;
+    job.remotePath = dirPath;
+    addJob(m_sftpChannel.data(), m_sftpChannel->createDirectory(dirPath), job);
+}
+
+void SftpManager::ensureDirectory(const QString &dirPath)
+{
+    SftpJob job;
+    job.type = SftpJob::EnsureDir;
+    job.remotePath = dirPath;
+    if (!m_connected || !m_sftpChannel
+        || !addJob(m_sftpChannel.data(), m_sftpChannel->createDirectory(dirPath), job)) {
+        // Överföringarna i katalogen får rapportera det egentliga felet
+        emit directoryEnsured(dirPath);
+    }
 }
 
 void SftpManager::deleteFile(const QString &filePath)
@@ -266,11 +1120,10 @@ void SftpManager::deleteFile(const QString &filePath)
         return;
     }
     
-    m_currentRemoveFilePath = filePath;
-    m_currentRemoveFileJob = m_sftpChannel->removeFile(filePath);
-    
-    connect(m_sftpChannel.data(), &QSsh::SftpChannel::finished, 
-            this, &SftpManager::onRemoveFileJobFinished);
+    SftpJob job;
+    job.type = SftpJob::RemoveFile;
+    job.remotePath = filePath;
+    addJob(m_sftpChannel.data(), m_sftpChannel->removeFile(filePath), job);
 }
 
 void SftpManager::deleteDirectory(const QString &dirPath)
@@ -280,11 +1133,10 @@ void SftpManager::deleteDirectory(const QString &dirPath)
         return;
     }
     
-    m_currentRemoveDirPath = dirPath;
-    m_currentRemoveDirJob = m_sftpChannel->removeDirectory(dirPath);
-    
-    connect(m_sftpChannel.data(), &QSsh::SftpChannel::finished, 
-            this, &SftpManager::onRemoveDirJobFinished);
+    SftpJob job;
+    job.type = SftpJob::RemoveDir;
+    job.remotePath = dirPath;
+    addJob(m_sftpChannel.data(), m_sftpChannel->removeDirectory(dirPath), job);
 }
 
 void SftpManager::rename(const QString &oldPath, const QString &newPath)
@@ -294,12 +1146,11 @@ void SftpManager::rename(const QString &oldPath, const QString &newPath)
         return;
     }
     
-    m_currentRenameSrcPath = oldPath;
-    m_currentRenameDstPath = newPath;
-    m_currentRenameJob = m_sftpChannel->renameFile(oldPath, newPath);
-    
-    connect(m_sftpChannel.data(), &QSsh::SftpChannel::finished, 
-            this, &SftpManager::onRenameJobFinished);
+    SftpJob job;
+    job.type = SftpJob::Rename;
+    job.remotePath = oldPath;
+    job.newPath = newPath;
+    addJob(m_sftpChannel.data(), m_sftpChannel->renameFile(oldPath, newPath), job);
 }
 
 void SftpManager::onSshConnectionEstablished()
@@ -319,7 +1170,13 @@ void SftpManager::onSshConnectionEstablished()
     connect(m_sftpChannel.data(), &QSsh::SftpChannel::channelError, 
             this, &SftpManager::onSftpChannelError);
     
+    connectJobSignals(m_sftpChannel.data());
+    
     m_sftpChannel->initialize();
+    
+    // Huvudanslutningens andel av överföringskanalerna
+    openTransferChannels(m_sshConnection, m_transferChannelCount / m_connectionCount
+                                          + (m_transferChannelCount % m_connectionCount > 0 ? 1 : 0));
 }
 
 void SftpManager::onSshConnectionError(QSsh::SshError error)
@@ -356,10 +1213,19 @@ void SftpManager::onSshConnectionError(QSsh::SshError error)
 void SftpManager::onSftpChannelInitialized()
 {
     m_connected = true;
+    if (m_limiter && !m_limiterStream) {
+        m_limiterStream = m_limiter->openStream(m_host);
+    }
     emit connected();
     
     // Lista roten som första åtgärd för att hämta hemkatalogen
     listDirectory("/");
+    
+    // Första RTT-mätningen, så att fönstret är anpassat före första överföringen
+    probeRoundTripTime();
+    
+    // Extra anslutningar öppnas först när inloggningen bevisats fungera
+    openExtraConnections();
 }
 
 void SftpManager::onSftpChannelError(const QString &errorMessage)
@@ -367,25 +1233,28 @@ void SftpManager::onSftpChannelError(const QString &errorMessage)
     emit error(tr("SFTP-fel: %1").arg(errorMessage));
 }
 
-void SftpManager::onListDirJobFinished(QSsh::SftpJobId job, const QList<QSsh::SftpFileInfo> &dirContent, const QString &error)
+void SftpManager::onListDirFileInfoAvailable(QSsh::SftpChannel *channel, QSsh::SftpJobId job,
+                                             const QList<QSsh::SftpFileInfo> &dirContent)
 {
-    if (job != m_currentListJob) {
+    auto it = m_jobs.find(JobKey(channel, job));
+    if (it == m_jobs.end()) {
         return;
     }
     
-    disconnect(m_sftpChannel.data(), &QSsh::SftpChannel::fileInfoAvailable, 
-              this, &SftpManager::onListDirJobFinished);
-    
-    if (!error.isEmpty()) {
-        emit this->error(tr("Kunde inte lista katalog: %1").arg(error));
+    // STAT före en deltaöverföring ger en enda post för fjärrfilen
+    if (it->type == SftpJob::DeltaStat) {
+        for (const QSsh::SftpFileInfo &fileInfo : dirContent) {
+            it->items.append(convertSftpFileInfo(fileInfo));
+        }
+        return;
+    }
+    if (it->type != SftpJob::List && it->type != SftpJob::Scan) {
         return;
     }
-    
-    // Uppdatera aktuell katalog
-    m_currentDirectory = m_currentListPath;
     
     // Konvertera SFTP-filinformation till ServerFileItem
     QList<ServerFileItem> items;
+    items.reserve(dirContent.size());
     for (const QSsh::SftpFileInfo &fileInfo : dirContent) {
         // Ignorera "." och ".." för att hålla konsekvent med FTP
         if (fileInfo.name == "." || fileInfo.name == "..") {
@@ -395,145 +1264,581 @@ void SftpManager::onListDirJobFinished(QSsh::SftpJobId job, const QList<QSsh::Sf
         items.append(convertSftpFileInfo(fileInfo));
     }
     
-    emit directoryListed(m_currentListPath, items);
+    if (items.isEmpty()) {
+        return;
+    }
+    
+    it->items += items;
+    if (it->type == SftpJob::Scan) {
+        emit directoryScanChunk(it->remotePath, items);
+    } else if (it->listingId == m_listingId) {
+        emit directoryListingChunk(it->listingId, it->remotePath, items);
+    }
 }
 
-void SftpManager::onFileUploadJobFinished(QSsh::SftpJobId job, const QString &error)
+void SftpManager::onJobFinished(QSsh::SftpChannel *channel, QSsh::SftpJobId jobId, const QString &error)
 {
-    if (job != m_currentUploadJob) {
+    auto it = m_jobs.find(JobKey(channel, jobId));
+    if (it == m_jobs.end()) {
         return;
     }
     
-    disconnect(m_sftpChannel.data(), &QSsh::SftpChannel::finished, 
-              this, &SftpManager::onFileUploadJobFinished);
+    SftpJob job = it.value();
+    m_jobs.erase(it);
+    
+    if (job.file) {
+        job.file->close();
+        job.file->deleteLater();
+    }
     
-    disconnect(m_sftpChannel.data(), &QSsh::SftpChannel::transferProgress, 
-              this, &SftpManager::onTransferProgress);
+    const bool failed = !error.isEmpty();
     
-    if (!error.isEmpty()) {
-        emit this->error(tr("Kunde inte ladda upp fil: %1").arg(error));
-    } else {
-        emit uploadFinished(m_currentUploadPath);
+    if (job.type == SftpJob::Upload || job.type == SftpJob::Download) {
+        if (job.smallFile) {
+            --m_activeSmallTransfers;
+        } else {
+            --m_activeTransfers;
+        }
+        for (TransferChannel &transfer : m_transferChannels) {
+            if (transfer.channel.data() == channel) {
+                --transfer.activeTransfers;
+            }
+        }
     }
     
-    m_currentUploadJob = 0;
-    m_currentUploadPath.clear();
-    m_currentLocalUploadPath.clear();
+    switch (job.type) {
+    case SftpJob::List:
+        if (failed) {
+            emit this->error(tr("Kunde inte lista katalog: %1").arg(error));
+            emit directoryListingFailed(job.listingId, job.remotePath, error);
+            break;
+        }
+        // En nyare listning har startat; den här visas inte
+        if (job.listingId != m_listingId) {
+            break;
+        }
+        m_currentDirectory = job.remotePath;
+        emit directoryListingFinished(job.listingId, job.remotePath, job.items.size());
+        emit directoryListed(job.remotePath, job.items);
+        break;
+        
+    case SftpJob::Scan:
+        emit directoryScanFinished(job.remotePath, failed, error);
+        break;
+        
+    case SftpJob::Upload:
+        if (job.aborted) {
+            failTransfer(job.remotePath, tr("Överföringen avbröts"));
+        } else if (failed) {
+            failTransfer(job.remotePath, tr("Kunde inte ladda upp fil: %1").arg(error));
+        } else if (!startChecksumVerification(job)) {
+            emit uploadFinished(job.remotePath);
+        }
+        break;
+        
+    case SftpJob::Download:
+        if (job.aborted) {
+            failTransfer(job.remotePath, tr("Överföringen avbröts"));
+        } else if (failed) {
+            failTransfer(job.remotePath, tr("Kunde inte ladda ner fil: %1").arg(error));
+        } else if (!startChecksumVerification(job)) {
+            emit downloadFinished(job.remotePath);
+        }
+        break;
+        
+    case SftpJob::Mkdir:
+        if (failed) {
+            emit this->error(tr("Kunde inte skapa katalog: %1").arg(error));
+        } else {
+            emit directoryCreated(job.remotePath);
+        }
+        break;
+        
+    case SftpJob::EnsureDir:
+        emit directoryEnsured(job.remotePath);
+        break;
+        
+    case SftpJob::RemoveFile:
+        if (failed) {
+            emit this->error(tr("Kunde inte radera fil: %1").arg(error));
+        } else {
+            emit fileDeleted(job.remotePath);
+        }
+        break;
+        
+    case SftpJob::RemoveDir:
+        if (failed) {
+            emit this->error(tr("Kunde inte radera katalog: %1").arg(error));
+        } else {
+            emit directoryDeleted(job.remotePath);
+        }
+        break;
+        
+    case SftpJob::Rename:
+        if (failed) {
+            emit this->error(tr("Kunde inte byta namn: %1").arg(error));
+        } else {
+            emit renamed(job.remotePath, job.newPath);
+        }
+        break;
+        
+    case SftpJob::DeltaStat:
+        onDeltaStat(job, failed);
+        break;
+        
+    case SftpJob::Probe:
+        m_probePending = false;
+        if (!failed) {
+            // Utjämna som TCP:s SRTT (1/8 av ny mätning)
+            const qint64 sample = job.timer.elapsed();
+            m_roundTripTime = m_roundTripTime < 0 ? sample : (7 * m_roundTripTime + sample) / 8;
+            if (m_autoTuneWindow) {
+                updateTransferWindow();
+            }
+        }
+        break;
+    }
+    
+    if (!m_queuedTransfers.isEmpty()) {
+        probeRoundTripTime();
+    }
+    startQueuedTransfers();
 }
 
-void SftpManager::onFileDownloadJobFinished(QSsh::SftpJobId job, const QString &error)
+void SftpManager::startDeltaUpload(const SftpJob &job)
 {
-    if (job != m_currentDownloadJob) {
+    DeltaUpload *upload = new DeltaUpload;
+    upload->id = ++m_nextDeltaId;
+    upload->job = job;
+    upload->timer.start();
+    m_deltaUploads.insert(job.remotePath, upload);
+    
+    // Storlek och ändringstid avgör om en cachad signatur fortfarande gäller
+    SftpJob stat;
+    stat.type = SftpJob::DeltaStat;
+    stat.remotePath = job.remotePath;
+    if (!addJob(m_sftpChannel.data(), m_sftpChannel->statFile(job.remotePath), stat)) {
+        fallBackToFullUpload(upload);
+    }
+}
+
+void SftpManager::onDeltaStat(const SftpJob &job, bool failed)
+{
+    DeltaUpload *upload = m_deltaUploads.value(job.remotePath);
+    if (!upload || upload->stage != DeltaUpload::Stat) {
         return;
     }
     
-    disconnect(m_sftpChannel.data(), &QSsh::SftpChannel::finished, 
-              this, &SftpManager::onFileDownloadJobFinished);
+    // Finns inte fjärrfilen finns inget att jämföra med
+    if (failed || job.items.isEmpty() || job.items.first().isDirectory()) {
+        fallBackToFullUpload(upload);
+        return;
+    }
     
-    disconnect(m_sftpChannel.data(), &QSsh::SftpChannel::transferProgress, 
-              this, &SftpManager::onTransferProgress);
+    upload->remoteSize = job.items.first().size();
+    upload->remoteModified = job.items.first().lastModified().toSecsSinceEpoch();
     
-    if (!error.isEmpty()) {
-        emit this->error(tr("Kunde inte ladda ner fil: %1").arg(error));
-    } else {
-        emit downloadFinished(m_currentDownloadPath);
+    const DeltaSync::Signature cached = loadCachedSignature(job.remotePath);
+    if (cached.isValid() && cached.fileSize == upload->remoteSize
+        && cached.modified == upload->remoteModified) {
+        upload->blockSize = cached.blockSize;
+        startDeltaComputation(upload, cached);
+        return;
     }
     
-    m_currentDownloadJob = 0;
-    m_currentDownloadPath.clear();
-    m_currentLocalDownloadPath.clear();
+    upload->blockSize = DeltaSync::blockSizeFor(upload->remoteSize);
+    runDeltaHelper(upload, DeltaUpload::Signature);
 }
 
-void SftpManager::onTransferProgress(QSsh::SftpJobId job, quint64 bytesSent, quint64 bytesTotal)
+void SftpManager::runDeltaHelper(DeltaUpload *upload, DeltaUpload::Stage stage)
 {
-    QString filePath;
-    
-    if (job == m_currentUploadJob) {
-        filePath = m_currentUploadPath;
-    } else if (job == m_currentDownloadJob) {
-        filePath = m_currentDownloadPath;
-    } else {
+    upload->stage = stage;
+    upload->started = false;
+    upload->output.clear();
+    
+    const QString mode = stage == DeltaUpload::Patch ? QStringLiteral("patch") : QStringLiteral("sig");
+    upload->process = m_sshConnection
+        ? m_sshConnection->createRemoteProcess(DeltaSync::helperCommand(mode, upload->blockSize,
+                                                                        upload->job.remotePath))
+        : QSsh::SshRemoteProcess::Ptr();
+    if (!upload->process) {
+        m_deltaUnavailable = true;
+        fallBackToFullUpload(upload);
         return;
     }
     
-    emit transferProgress(bytesSent, bytesTotal, filePath);
+    QSsh::SshRemoteProcess *process = upload->process.data();
+    connect(process, &QSsh::SshRemoteProcess::started, this, [upload]() {
+        upload->started = true;
+        if (upload->stage == DeltaUpload::Patch) {
+            upload->process->write(upload->payload);
+        }
+    });
+    connect(process, &QSsh::SshRemoteProcess::readyReadStandardOutput, this, [upload]() {
+        upload->output += upload->process->readAllStandardOutput();
+    });
+    connect(process, &QSsh::SshRemoteProcess::closed, this, [this, upload](int exitStatus) {
+        onDeltaHelperFinished(upload, exitStatus);
+    });
+    process->start();
 }
 
-void SftpManager::onMkdirJobFinished(QSsh::SftpJobId job, const QString &error)
+void SftpManager::onDeltaHelperFinished(DeltaUpload *upload, int exitStatus)
 {
-    if (job != m_currentMkdirJob) {
+    disconnect(upload->process.data(), nullptr, this, nullptr);
+    upload->output += upload->process->readAllStandardOutput();
+    
+    const int exitCode = upload->process->exitCode();
+    if (exitStatus != QSsh::SshRemoteProcess::NormalExit || exitCode != 0) {
+        // Exec nekad eller python3 saknas (127): ladda upp hela filer resten av sessionen
+        if (!upload->started || exitCode == 127) {
+            m_deltaUnavailable = true;
+        }
+        qDebug() << "Deltahjälparen misslyckades, laddar upp hela filen:"
+                 << upload->process->readAllStandardError();
+        fallBackToFullUpload(upload);
         return;
     }
     
-    disconnect(m_sftpChannel.data(), &QSsh::SftpChannel::finished, 
-              this, &SftpManager::onMkdirJobFinished);
+    if (upload->stage == DeltaUpload::Signature) {
+        DeltaSync::Signature signature = DeltaSync::parseHelperSignature(upload->output, upload->blockSize);
+        if (!signature.isValid()) {
+            fallBackToFullUpload(upload);
+            return;
+        }
+        signature.modified = upload->remoteModified;
+        startDeltaComputation(upload, signature);
+        return;
+    }
     
-    if (!error.isEmpty()) {
-        emit this->error(tr("Kunde inte skapa katalog: %1").arg(error));
-    } else {
-        emit directoryCreated(m_currentMkdirPath);
+    // Hjälparen skriver "<storlek> <ändringstid>" för den nya filen
+    const QList<QByteArray> fields = upload->output.trimmed().split(' ');
+    if (fields.size() == 2 && fields.at(0).toLongLong() == upload->newSignature.fileSize) {
+        upload->newSignature.modified = fields.at(1).toLongLong();
+        saveCachedSignature(upload->job.remotePath, upload->newSignature);
     }
     
-    m_currentMkdirJob = 0;
-    m_currentMkdirPath.clear();
+    const qint64 total = upload->newSignature.fileSize;
+    qCDebug(lcDelta) << "Deltaöverföring klar:" << upload->job.remotePath << "skickade"
+                     << upload->payload.size() << "av" << total << "byte på" << upload->timer.elapsed() << "ms";
+    
+    emit transferProgress(total, total, upload->job.remotePath);
+    emit uploadFinished(upload->job.remotePath);
+    finishDeltaUpload(upload);
+}
+
+void SftpManager::startDeltaComputation(DeltaUpload *upload, const DeltaSync::Signature &signature)
+{
+    upload->stage = DeltaUpload::Compute;
+    
+    const QString remotePath = upload->job.remotePath;
+    const QString localPath = upload->job.localPath;
+    const int id = upload->id;
+    const qint64 maxLiteral = qMin(QFileInfo(localPath).size() / 2, DELTA_MAX_LITERAL_BYTES);
+    QSharedPointer<WorkerGuard> guard = m_workerGuard;
+    
+    // Filen mappas och gås igenom i en bakgrundstråd; för en stor
+    // VM-avbild tar det flera sekunder
+    QThreadPool::globalInstance()->start(new FunctionTask([=]() {
+        DeltaSync::Delta delta;
+        DeltaSync::Signature newSignature;
+        bool worthwhile = false;
+        
+        QFile file(localPath);
+        if (file.open(QIODevice::ReadOnly) && file.size() > 0) {
+            const qint64 size = file.size();
+            uchar *data = file.map(0, size);
+            if (data) {
+                worthwhile = DeltaSync::computeDelta(signature, data, size, maxLiteral, &delta);
+                if (worthwhile) {
+                    newSignature = DeltaSync::computeSignature(data, size, signature.blockSize);
+                }
+                file.unmap(data);
+            }
+        }
+        
+        QMutexLocker locker(&guard->mutex);
+        SftpManager *owner = guard->owner;
+        if (owner) {
+            QMetaObject::invokeMethod(owner, [=]() {
+                owner->onDeltaComputed(remotePath, id, worthwhile, delta, newSignature);
+            }, Qt::QueuedConnection);
+        }
+    }));
 }
 
-void SftpManager::onRemoveFileJobFinished(QSsh::SftpJobId job, const QString &error)
+void SftpManager::onDeltaComputed(const QString &remotePath, int id, bool worthwhile,
+                                  const DeltaSync::Delta &delta, const DeltaSync::Signature &newSignature)
 {
-    if (job != m_currentRemoveFileJob) {
+    DeltaUpload *upload = m_deltaUploads.value(remotePath);
+    if (!upload || upload->id != id) {
+        return;
+    }
+    
+    if (!worthwhile) {
+        qDebug() << "Deltaöverföring lönar sig inte för" << remotePath << ", laddar upp hela filen";
+        fallBackToFullUpload(upload);
         return;
     }
     
-    disconnect(m_sftpChannel.data(), &QSsh::SftpChannel::finished, 
-              this, &SftpManager::onRemoveFileJobFinished);
+    upload->payload = delta.payload;
+    upload->literalBytes = delta.literalBytes;
+    upload->newSignature = newSignature;
+    runDeltaHelper(upload, DeltaUpload::Patch);
+}
+
+void SftpManager::fallBackToFullUpload(DeltaUpload *upload)
+{
+    m_queuedTransfers.enqueue(upload->job);
+    finishDeltaUpload(upload);
+    startQueuedTransfers();
+}
+
+void SftpManager::finishDeltaUpload(DeltaUpload *upload)
+{
+    m_deltaUploads.remove(upload->job.remotePath);
+    if (upload->process) {
+        disconnect(upload->process.data(), nullptr, this, nullptr);
+    }
     
-    if (!error.isEmpty()) {
-        emit this->error(tr("Kunde inte radera fil: %1").arg(error));
-    } else {
-        emit fileDeleted(m_currentRemoveFilePath);
+    // Processen kan vara den som skickade signalen vi hanterar just nu
+    QTimer::singleShot(0, this, [upload]() {
+        delete upload;
+    });
+}
+
+bool SftpManager::startChecksumVerification(const SftpJob &job)
+{
+    if (!m_verifyChecksums || QFileInfo(job.localPath).size() < m_checksumMinimumSize) {
+        return false;
     }
     
-    m_currentRemoveFileJob = 0;
-    m_currentRemoveFilePath.clear();
+    ChecksumVerification *verification = new ChecksumVerification;
+    verification->job = job;
+    if (!startRemoteChecksum(verification)) {
+        delete verification;
+        return false;
+    }
+    
+    // Gissa att servern svarar med samma algoritm som förra gången, så att
+    // båda summorna räknas samtidigt
+    hashLocalFile(verification, m_remoteChecksumAlgorithm);
+    return true;
 }
 
-void SftpManager::onRemoveDirJobFinished(QSsh::SftpJobId job, const QString &error)
+void SftpManager::remoteChecksum(const QString &remotePath)
 {
-    if (job != m_currentRemoveDirJob) {
-        return;
+    ChecksumVerification *verification = new ChecksumVerification;
+    verification->job.remotePath = remotePath;
+    verification->remoteOnly = true;
+    verification->localDone = true;
+    if (!startRemoteChecksum(verification)) {
+        delete verification;
+        emit remoteChecksumReady(remotePath, m_remoteChecksumAlgorithm, QByteArray());
+    }
+}
+
+bool SftpManager::startRemoteChecksum(ChecksumVerification *verification)
+{
+    if (m_checksumUnavailable || !m_sshConnection) {
+        return false;
     }
     
-    disconnect(m_sftpChannel.data(), &QSsh::SftpChannel::finished, 
-              this, &SftpManager::onRemoveDirJobFinished);
+    QSsh::SshRemoteProcess::Ptr process =
+        m_sshConnection->createRemoteProcess(FileHasher::remoteCommand(verification->job.remotePath));
+    if (!process) {
+        m_checksumUnavailable = true;
+        return false;
+    }
     
-    if (!error.isEmpty()) {
-        emit this->error(tr("Kunde inte radera katalog: %1").arg(error));
+    verification->id = ++m_nextChecksumId;
+    verification->process = process;
+    m_checksumVerifications.insert(verification->id, verification);
+    
+    connect(process.data(), &QSsh::SshRemoteProcess::started, this, [verification]() {
+        verification->started = true;
+    });
+    connect(process.data(), &QSsh::SshRemoteProcess::readyReadStandardOutput, this, [verification]() {
+        verification->output += verification->process->readAllStandardOutput();
+    });
+    connect(process.data(), &QSsh::SshRemoteProcess::closed, this, [this, verification](int exitStatus) {
+        onRemoteChecksumFinished(verification, exitStatus);
+    });
+    process->start();
+    return true;
+}
+
+void SftpManager::hashLocalFile(ChecksumVerification *verification, FileHasher::Algorithm algorithm)
+{
+    verification->localDone = false;
+    
+    const QString localPath = verification->job.localPath;
+    const int id = verification->id;
+    QSharedPointer<WorkerGuard> guard = m_workerGuard;
+    
+    QThreadPool::globalInstance()->start(new FunctionTask([=]() {
+        const QByteArray digest = FileHasher::hashFile(localPath, algorithm);
+        
+        QMutexLocker locker(&guard->mutex);
+        SftpManager *owner = guard->owner;
+        if (owner) {
+            QMetaObject::invokeMethod(owner, [=]() {
+                owner->onLocalChecksumComputed(id, algorithm, digest);
+            }, Qt::QueuedConnection);
+        }
+    }));
+}
+
+void SftpManager::onLocalChecksumComputed(int id, FileHasher::Algorithm algorithm, const QByteArray &digest)
+{
+    ChecksumVerification *verification = m_checksumVerifications.value(id);
+    if (!verification) {
+        return;
+    }
+    
+    verification->localDone = true;
+    verification->localAlgorithm = algorithm;
+    verification->localDigest = digest;
+    checkChecksumVerification(verification);
+}
+
+void SftpManager::onRemoteChecksumFinished(ChecksumVerification *verification, int exitStatus)
+{
+    if (!m_checksumVerifications.contains(verification->id)) {
+        return;
+    }
+    disconnect(verification->process.data(), nullptr, this, nullptr);
+    verification->output += verification->process->readAllStandardOutput();
+    verification->remoteDone = true;
+    
+    const int exitCode = verification->process->exitCode();
+    if (exitStatus != QSsh::SshRemoteProcess::NormalExit || exitCode != 0) {
+        // Exec nekad eller inget av verktygen finns (127): sluta försöka resten av sessionen
+        if (!verification->started || exitCode == 127) {
+            m_checksumUnavailable = true;
+        }
+        qDebug() << "Kontrollsumman kunde inte räknas på servern för" << verification->job.remotePath
+                 << verification->process->readAllStandardError();
     } else {
-        emit directoryDeleted(m_currentRemoveDirPath);
+        // md5sum sätter ett bakstreck före summan om filnamnet innehåller specialtecken
+        QString text = QString::fromLatin1(verification->output.trimmed());
+        text = text.section(QLatin1Char(' '), 0, 0);
+        if (text.startsWith(QLatin1Char('\\'))) {
+            text.remove(0, 1);
+        }
+        
+        if (text.size() == CRC32_HEX_LENGTH || text.size() == MD5_HEX_LENGTH) {
+            verification->remoteAlgorithm = text.size() == CRC32_HEX_LENGTH ? FileHasher::Crc32
+                                                                            : FileHasher::Md5;
+            verification->remoteDigest = FileHasher::parseDigest(text, verification->remoteAlgorithm);
+            m_remoteChecksumAlgorithm = verification->remoteAlgorithm;
+        }
     }
     
-    m_currentRemoveDirJob = 0;
-    m_currentRemoveDirPath.clear();
+    checkChecksumVerification(verification);
 }
 
-void SftpManager::onRenameJobFinished(QSsh::SftpJobId job, const QString &error)
+void SftpManager::checkChecksumVerification(ChecksumVerification *verification)
 {
-    if (job != m_currentRenameJob) {
+    if (!verification->remoteDone || !verification->localDone) {
         return;
     }
     
-    disconnect(m_sftpChannel.data(), &QSsh::SftpChannel::finished, 
-              this, &SftpManager::onRenameJobFinished);
+    // Servern svarade med en annan algoritm än den gissade
+    if (!verification->remoteDigest.isEmpty() && !verification->localDigest.isEmpty()
+        && verification->localAlgorithm != verification->remoteAlgorithm) {
+        hashLocalFile(verification, verification->remoteAlgorithm);
+        return;
+    }
+    
+    m_checksumVerifications.remove(verification->id);
+    const SftpJob job = verification->job;
+    const bool upload = job.type == SftpJob::Upload;
+    
+    // Verifieringen äger processen, som kan vara den som skickade signalen
+    // vi hanterar just nu; båda raderas när händelsen är klar
+    QTimer::singleShot(0, this, [verification]() {
+        delete verification;
+    });
+    
+    if (verification->remoteOnly) {
+        emit remoteChecksumReady(job.remotePath, verification->remoteAlgorithm, verification->remoteDigest);
+        return;
+    }
     
-    if (!error.isEmpty()) {
-        emit this->error(tr("Kunde inte byta namn: %1").arg(error));
+    if (verification->remoteDigest.isEmpty() || verification->localDigest.isEmpty()) {
+        // Överföringen rapporterade inget fel, så den godkänns utan jämförelse
+        qCWarning(lcChecksum) << "Kontrollsumman kunde inte jämföras för" << job.remotePath;
+    } else if (verification->remoteDigest != verification->localDigest) {
+        // En felaktig nedladdning får inte ligga kvar som om den vore hel
+        if (!upload) {
+            QFile::remove(job.localPath);
+        }
+        failTransfer(job.remotePath,
+                     tr("Kontrollsumman stämmer inte för %1: %2 lokalt, %3 på servern")
+                     .arg(job.remotePath, QString::fromLatin1(verification->localDigest.toHex()),
+                          QString::fromLatin1(verification->remoteDigest.toHex())));
+        return;
+    }
+    
+    if (upload) {
+        emit uploadFinished(job.remotePath);
     } else {
-        emit renamed(m_currentRenameSrcPath, m_currentRenameDstPath);
+        emit downloadFinished(job.remotePath);
+    }
+}
+
+QString SftpManager::signatureCachePath(const QString &remotePath) const
+{
+    const QByteArray key = QString("%1@%2:%3%4").arg(m_username, m_host).arg(m_port).arg(remotePath).toUtf8();
+    return QStandardPaths::writableLocation(QStandardPaths::CacheLocation)
+           + "/delta-signatures/"
+           + QCryptographicHash::hash(key, QCryptographicHash::Md5).toHex() + ".sig";
+}
+
+DeltaSync::Signature SftpManager::loadCachedSignature(const QString &remotePath) const
+{
+    QFile file(signatureCachePath(remotePath));
+    if (!file.open(QIODevice::ReadOnly)) {
+        return DeltaSync::Signature();
     }
+    return DeltaSync::deserializeSignature(file.readAll());
+}
+
+void SftpManager::saveCachedSignature(const QString &remotePath, const DeltaSync::Signature &signature) const
+{
+    const QString path = signatureCachePath(remotePath);
+    QDir().mkpath(QFileInfo(path).path());
     
-    m_currentRenameJob = 0;
-    m_currentRenameSrcPath.clear();
-    m_currentRenameDstPath.clear();
+    QFile file(path);
+    if (file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        file.write(DeltaSync::serializeSignature(signature));
+    }
+}
+
+void SftpManager::onTransferProgress(QSsh::SftpChannel *channel, QSsh::SftpJobId job,
+                                     quint64 bytesSent, quint64 bytesTotal)
+{
+    auto it = m_jobs.find(JobKey(channel, job));
+    if (it == m_jobs.end()) {
+        return;
+    }
+    
+    if (m_limiter && m_limiterStream && bytesSent > it->bytesDone) {
+        m_limiter->consume(m_limiterStream, qint64(bytesSent - it->bytesDone));
+    }
+    it->bytesDone = bytesSent;
+    if (bytesTotal > 0) {
+        it->bytesTotal = bytesTotal;
+    }
+    
+    emit transferProgress(bytesSent, it->bytesTotal, it->remotePath);
+}
+
+void SftpManager::failTransfer(const QString &remotePath, const QString &errorString)
+{
+    emit error(errorString);
+    emit transferFailed(remotePath, errorString);
 }
 
 ServerFileItem SftpManager::convertSftpFileInfo(const QSsh::SftpFileInfo &fileInfo) const
@@ -4,8 +4,21 @@
 #include <QObject>
 #include <QSsh/sshconnection.h>
 #include <QSsh/sftpchannel.h>
+#include <QSsh/sshremoteprocess.h>
 #include <QList>
+#include <QHash>
+#include <QQueue>
+#include <QPair>
+#include <QVector>
+#include <QFile>
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QSharedPointer>
 #include "serverfileitem.h"
+#include "deltasync.h"
+#include "filehasher.h"
+
+class BandwidthLimiter;
 
 /**
  * @brief SftpManager hanterar anslutningar och filöverföringar med SFTP
@@ -60,6 +73,16 @@ public:
      */
     void listDirectory(const QString &path = QString());
     
+    /**
+     * @brief Lista en katalog i bakgrunden, t.ex. vid rekursiv nedladdning
+     *
+     * Till skillnad från listDirectory() ändras inte aktuell katalog och
+     * resultatet skickas med directoryScanChunk()/directoryScanFinished(),
+     * så vyn påverkas inte. Flera genomsökningar kan pågå samtidigt.
+     * @param path Absolut sökväg att lista
+     */
+    void scanDirectory(const QString &path);
+    
     /**
      * @brief Ladda upp en fil
      * @param localFilePath Lokal filsökväg
@@ -74,12 +97,34 @@ public:
      */
     void downloadFile(const QString &remoteFilePath, const QString &localFilePath);
     
+    /**
+     * @brief Avbryt en upp- eller nedladdning och behåll sessionen
+     *
+     * Köade överföringar tas bort direkt. En överföring som ensam kör på en
+     * kanal i poolen avbryts genom att kanalen stängs och ersätts; delar den
+     * kanal med andra får den köra klart men rapporteras som misslyckad.
+     * Filer som redan packats i ett tar-arkiv kan inte plockas ut och
+     * rapporteras när arkivet är klart. transferFailed() skickas när
+     * överföringen verkligen har slutat.
+     * @param remotePath Fjärrsökvägen som gavs till uploadFile()/downloadFile()
+     */
+    void abortTransfer(const QString &remotePath);
+    
     /**
      * @brief Skapa en katalog
      * @param dirPath Sökväg till katalogen att skapa
      */
     void createDirectory(const QString &dirPath);
     
+    /**
+     * @brief Se till att en katalog finns, t.ex. vid rekursiv uppladdning
+     *
+     * Ett misslyckat MKDIR rapporteras inte som fel eftersom katalogen oftast
+     * redan finns; directoryEnsured() skickas i båda fallen.
+     * @param dirPath Sökväg till katalogen
+     */
+    void ensureDirectory(const QString &dirPath);
+    
     /**
      * @brief Radera en fil
      * @param filePath Sökväg till filen att radera
@@ -110,6 +155,133 @@ public:
      * @return Aktuell katalog
      */
     QString currentDirectory() const;
+    
+    /**
+     * @brief Antal jobb som pågår på SFTP-kanalen
+     * @return Antal listningar, överföringar och filåtgärder som inte är klara
+     */
+    int pendingJobCount() const;
+    
+    /**
+     * @brief Sätt hur många filöverföringar som får pågå samtidigt på kanalen
+     *
+     * QSsh håller själv ett fast antal läs-/skrivförfrågningar ute per fil.
+     * Den totala mängden data i luften styrs därför med antalet parallella
+     * överföringar; övriga köas tills en plats blir ledig. Fönstret är 4
+     * tills RTT har mätts och högst 64, vilket räcker för 100 MiB/s upp
+     * till ~200 ms RTT; benchmarks/bench_sftpwindow mäter MiB/s per fönster.
+     * @param window Antal samtidiga överföringar (1-64). Vid automatisk
+     *               justering är detta den övre gränsen.
+     */
+    void setTransferWindow(int window);
+    
+    /**
+     * @brief Hämta aktuellt överföringsfönster
+     * @return Antal överföringar som får pågå samtidigt just nu
+     */
+    int transferWindow() const;
+    
+    /**
+     * @brief Slå på eller av automatisk justering av fönstret efter uppmätt RTT
+     * @param enabled true för att räkna fram fönstret från RTT (standard)
+     */
+    void setAutoTuneWindow(bool enabled);
+    
+    /**
+     * @brief Senast uppmätta tur-och-retur-tid för en SFTP-förfrågan
+     * @return Utjämnad RTT i millisekunder, eller -1 om ingen mätning finns
+     */
+    qint64 roundTripTime() const;
+    
+    /**
+     * @brief Ställ in kanalpoolen som används vid nästa anslutning
+     *
+     * Listningar och filåtgärder går alltid på en egen metadatakanal så att
+     * bläddring inte hamnar i kö bakom stora överföringar. Överföringarna
+     * sprids över transferChannels kanaler, fördelade på connections
+     * SSH-anslutningar (varje anslutning har en egen TCP-ström och därmed
+     * ett eget överbelastningsfönster).
+     * @param transferChannels Antal kanaler för överföringar (0 = använd metadatakanalen)
+     * @param connections Antal SSH-anslutningar att fördela kanalerna på (minst 1)
+     */
+    void setChannelPool(int transferChannels, int connections = 1);
+    
+    /**
+     * @brief Antal överföringskanaler som är öppna och redo
+     * @return Antal initierade kanaler i poolen
+     */
+    int readyTransferChannelCount() const;
+    
+    /**
+     * @brief Slå på eller av snabbvägen för små filer vid uppladdning
+     *
+     * Små filer begränsas av rundresorna för open/write/close snarare än av
+     * bandbredden. Med snabbvägen räknas de mot ett eget, större fönster så
+     * att många sådana sekvenser ligger ute samtidigt. Med useArchive
+     * packas de i stället i tar-arkiv som strömmas över en exec-kanal och
+     * packas upp av tar på servern; tillåter servern inte exec faller de
+     * tillbaka till SFTP.
+     * @param enabled true för att använda snabbvägen (standard)
+     * @param useArchive true för att skicka små filer som tar-arkiv
+     */
+    void setSmallFileBatching(bool enabled, bool useArchive = false);
+    bool smallFileBatching() const;
+    
+    /**
+     * @brief Slå på eller av deltaöverföring för stora uppladdningar
+     *
+     * Finns fjärrfilen redan skickas bara de block som har ändrats, se
+     * DeltaSync. Fjärrfilens signatur hämtas från cachen om fjärrfilen inte
+     * ändrats sedan förra uppladdningen, annars räknas den av en hjälpare
+     * över en exec-kanal. QSsh kan inte skriva mitt i en fil över SFTP, så
+     * även ändringarna appliceras av hjälparen; saknar servern exec eller
+     * python3 laddas filen upp i sin helhet.
+     * @param enabled true för att använda deltaöverföring
+     * @param minimumSize Mindre filer laddas alltid upp i sin helhet
+     */
+    void setDeltaSync(bool enabled, qint64 minimumSize = 16 * 1024 * 1024);
+    bool deltaSync() const;
+    
+    /**
+     * @brief Jämför kontrollsummor efter uppladdningar och nedladdningar
+     *
+     * QSsh saknar SFTP-tillägget check-file, så fjärrfilens summa räknas
+     * över en exec-kanal: CRC-32 med python3 om det finns, annars MD5.
+     * QSsh läser och skriver den lokala filen själv via filhandtaget, så
+     * till skillnad från FTP kan summan inte räknas medan datat passerar;
+     * filen läses en gång till i en bakgrundstråd, samtidigt som servern
+     * räknar sin summa. Saknar servern exec godkänns överföringarna utan
+     * jämförelse resten av sessionen. Tar-arkiv och deltaöverföringar
+     * verifieras inte.
+     * @param enabled true för att verifiera (standard)
+     * @param minimumSize Mindre filer verifieras inte; en exec-kanal per
+     *                    fil kostar mer än själva överföringen
+     */
+    void setChecksumVerification(bool enabled, qint64 minimumSize = 1024 * 1024);
+    bool checksumVerification() const;
+    
+    /**
+     * @brief Räkna en fjärrfils kontrollsumma över en exec-kanal
+     *
+     * Används av synkroniseringen för att jämföra filer med samma storlek.
+     * Samma kommando som vid verifiering används, så algoritmen är CRC-32
+     * eller MD5 beroende på servern. Svaret kommer med remoteChecksumReady(),
+     * med tom summa om servern inte tillåter exec eller saknar verktygen.
+     * @param remotePath Absolut fjärrsökväg
+     */
+    void remoteChecksum(const QString &remotePath);
+    
+    /**
+     * @brief Begränsa bandbredden med en gemensam BandwidthLimiter
+     *
+     * QSsh läser och skriver filerna själv via filhandtaget, så en SFTP-
+     * överföring kan inte hållas igen medan den pågår. Överförda byte dras
+     * i stället från värdens och den globala hinken efterhand, och nya
+     * överföringar startar bara när hinkarna inte är tomma. Gränsen per
+     * överföring gäller därför bara FTP.
+     * @param limiter Limitern (ägs av anroparen), eller nullptr för obegränsat
+     */
+    void setBandwidthLimiter(BandwidthLimiter *limiter);
 
 signals:
     /**
@@ -135,6 +307,53 @@ signals:
      */
     void directoryListed(const QString &path, const QList<ServerFileItem> &items);
     
+    /**
+     * @brief Signal som skickas för varje grupp poster medan en listning pågår
+     *
+     * Bara den senast startade listningen skickar grupper.
+     * @param listingId Listningens id; ökar för varje ny listning
+     * @param path Katalogen som listas
+     * @param items Nya poster sedan föregående grupp
+     */
+    void directoryListingChunk(int listingId, const QString &path, const QList<ServerFileItem> &items);
+    
+    /**
+     * @brief Signal som skickas när en listning är klar
+     * @param listingId Listningens id
+     * @param path Katalogen som listades
+     * @param count Totalt antal poster
+     */
+    void directoryListingFinished(int listingId, const QString &path, int count);
+    
+    /**
+     * @brief Signal som skickas när en listning misslyckas, efter error()
+     * @param listingId Listningens id
+     * @param path Katalogen som listades
+     * @param errorString Felbeskrivning
+     */
+    void directoryListingFailed(int listingId, const QString &path, const QString &errorString);
+    
+    /**
+     * @brief Signal som skickas för varje grupp poster under en scanDirectory()
+     * @param path Katalogen som genomsöks
+     * @param items Nya poster sedan föregående grupp
+     */
+    void directoryScanChunk(const QString &path, const QList<ServerFileItem> &items);
+    
+    /**
+     * @brief Signal som skickas när en scanDirectory() är klar
+     * @param path Katalogen som genomsöktes
+     * @param error true om listningen misslyckades
+     * @param errorString Felbeskrivning
+     */
+    void directoryScanFinished(const QString &path, bool error, const QString &errorString);
+    
+    /**
+     * @brief Signal som skickas när en ensureDirectory() är klar
+     * @param dirPath Sökväg till katalogen
+     */
+    void directoryEnsured(const QString &dirPath);
+    
     /**
      * @brief Signal som skickas under filöverföring
      * @param bytesSent Antal byte skickade
@@ -155,6 +374,24 @@ signals:
      */
     void downloadFinished(const QString &filePath);
     
+    /**
+     * @brief Signal som skickas när en uppladdning eller nedladdning misslyckas
+     *
+     * Skickas efter error() så att en överföringskö kan knyta felet till rätt jobb.
+     * @param remotePath Fjärrsökvägen för överföringen
+     * @param errorString Felbeskrivning
+     */
+    void transferFailed(const QString &remotePath, const QString &errorString);
+    
+    /**
+     * @brief Signal som skickas när remoteChecksum() är klar
+     * @param remotePath Fjärrsökvägen som gavs till remoteChecksum()
+     * @param algorithm Algoritmen servern använde
+     * @param digest Summan, tom om den inte kunde räknas
+     */
+    void remoteChecksumReady(const QString &remotePath, FileHasher::Algorithm algorithm,
+                             const QByteArray &digest);
+    
     /**
      * @brief Signal som skickas när en katalog har skapats
      * @param dirPath Sökväg till den skapade katalogen
@@ -203,65 +440,286 @@ private slots:
      */
     void onSftpChannelError(const QString &errorMessage);
     
+private:
+    /**
+     * @brief En kanal i poolen för överföringar
+     */
+    struct TransferChannel {
+        QSsh::SftpChannel::Ptr channel;
+        QSsh::SshConnection *connection = nullptr;
+        bool ready = false;         ///< initialized() mottagen
+        bool failed = false;        ///< Kanalen gick inte att öppna eller har stängts
+        int activeTransfers = 0;
+    };
+    
+    // Jobb-id är bara unika per kanal
+    typedef QPair<QSsh::SftpChannel *, QSsh::SftpJobId> JobKey;
+    
+    /**
+     * @brief Sammanhang för ett pågående jobb på SFTP-kanalen
+     */
+    struct SftpJob {
+        enum Type {
+            List,
+            Scan,       ///< Listning i bakgrunden, se scanDirectory()
+            Upload,
+            Download,
+            Mkdir,
+            EnsureDir,  ///< MKDIR där fel ignoreras, se ensureDirectory()
+            RemoveFile,
+            RemoveDir,
+            Rename,
+            Probe,      ///< STAT som bara används för att mäta RTT
+            DeltaStat   ///< STAT av fjärrfilen före en deltaöverföring
+        };
+        
+        Type type = List;
+        QSsh::SftpChannel *channel = nullptr; ///< Kanalen jobbet körs på
+        QString remotePath;
+        QString localPath;
+        QString newPath;                ///< Målsökväg vid namnbyte
+        QFile *file = nullptr;          ///< Lokal fil vid överföring
+        bool smallFile = false;         ///< Uppladdning i fönstret för små filer
+        bool aborted = false;           ///< abortTransfer(); rapporteras som misslyckad
+        QList<ServerFileItem> items;    ///< Poster hittills vid listning
+        int listingId = 0;              ///< Se directoryListingChunk()
+        quint64 bytesDone = 0;
+        quint64 bytesTotal = 0;
+        QElapsedTimer timer;            ///< Startas när jobbet skapas
+    };
+    
+    /**
+     * @brief Ett tar-arkiv med små filer som strömmas över en exec-kanal
+     */
+    struct ArchiveUpload {
+        QSsh::SshRemoteProcess::Ptr process;
+        QList<SftpJob> jobs;            ///< Filerna i arkivet
+        QByteArray archive;
+        bool started = false;           ///< Servern accepterade exec
+    };
+    
+    /**
+     * @brief En uppladdning som bara skickar ändrade block
+     */
+    struct DeltaUpload {
+        enum Stage {
+            Stat,       ///< Väntar på fjärrfilens storlek och ändringstid
+            Signature,  ///< Hjälparen räknar fjärrfilens signatur
+            Compute,    ///< Deltat räknas i en bakgrundstråd
+            Patch       ///< Hjälparen bygger den nya filen
+        };
+        
+        int id = 0;
+        Stage stage = Stat;
+        SftpJob job;
+        int blockSize = 0;
+        qint64 remoteSize = 0;
+        qint64 remoteModified = 0;
+        QSsh::SshRemoteProcess::Ptr process;
+        bool started = false;           ///< Servern accepterade exec
+        QByteArray output;              ///< Hjälparens stdout
+        QByteArray payload;             ///< Kodat delta till hjälparen
+        qint64 literalBytes = 0;
+        DeltaSync::Signature newSignature; ///< Den lokala filens signatur, för cachen
+        QElapsedTimer timer;
+    };
+    
     /**
-     * @brief Hantera när kataloglistning är klar
-     * @param job Listningsjobbet
-     * @param dirContent Kataloginnehåll
-     * @param error Eventuellt fel
+     * @brief En avslutad överföring vars kontrollsummor jämförs
      */
-    void onListDirJobFinished(QSsh::SftpJobId job, const QList<QSsh::SftpFileInfo> &dirContent, const QString &error);
+    struct ChecksumVerification {
+        int id = 0;
+        SftpJob job;
+        QSsh::SshRemoteProcess::Ptr process;
+        bool started = false;           ///< Servern accepterade exec
+        QByteArray output;              ///< Fjärrkommandots stdout
+        bool remoteDone = false;
+        FileHasher::Algorithm remoteAlgorithm = FileHasher::Crc32;
+        QByteArray remoteDigest;        ///< Tom om servern inte kunde räkna summan
+        bool localDone = false;
+        FileHasher::Algorithm localAlgorithm = FileHasher::Crc32;
+        QByteArray localDigest;
+        bool remoteOnly = false;        ///< remoteChecksum(); ingen lokal summa räknas
+    };
+    
+    // Delas med bakgrundsuppgifter så att de inte skickar resultat till
+    // en SftpManager som redan har raderats
+    struct WorkerGuard {
+        QMutex mutex;
+        SftpManager *owner = nullptr;
+    };
     
     /**
-     * @brief Hantera när filuppladdning är klar
-     * @param job Uppladdningsjobbet
-     * @param error Eventuellt fel
+     * @brief Registrera ett nytt jobb i jobbtabellen
+     * @param channel Kanalen jobbet skapades på
+     * @param jobId Id från SftpChannel, eller SftpInvalidJob om jobbet inte kunde skapas
+     * @param job Jobbets sammanhang
+     * @return true om jobbet registrerades
      */
-    void onFileUploadJobFinished(QSsh::SftpJobId job, const QString &error);
+    bool addJob(QSsh::SftpChannel *channel, QSsh::SftpJobId jobId, SftpJob job);
+    
+    /**
+     * @brief Koppla jobbsignalerna från en kanal till jobbtabellen
+     * @param channel Kanalen
+     */
+    void connectJobSignals(QSsh::SftpChannel *channel);
     
     /**
-     * @brief Hantera när filnedladdning är klar
-     * @param job Nedladdningsjobbet
-     * @param error Eventuellt fel
+     * @brief Öppna överföringskanaler på en SSH-anslutning
+     * @param connection Anslutningen
+     * @param count Antal kanaler
      */
-    void onFileDownloadJobFinished(QSsh::SftpJobId job, const QString &error);
+    void openTransferChannels(QSsh::SshConnection *connection, int count);
+    
+    /**
+     * @brief Öppna de extra SSH-anslutningarna i poolen
+     */
+    void openExtraConnections();
+    
+    /**
+     * @brief Välj den minst belastade överföringskanalen
+     * @return Index i m_transferChannels, -1 om metadatakanalen ska användas,
+     *         eller -2 om poolens kanaler fortfarande öppnas
+     */
+    int pickTransferChannel() const;
+    
+    /**
+     * @brief Hantera poster från en pågående kataloglistning
+     *
+     * Servern skickar en SSH_FXP_NAME-grupp per READDIR-svar, så posterna
+     * kan visas medan resten av katalogen fortfarande läses.
+     */
+    void onListDirFileInfoAvailable(QSsh::SftpChannel *channel, QSsh::SftpJobId job,
+                                    const QList<QSsh::SftpFileInfo> &dirContent);
+    
+    /**
+     * @brief Hantera när ett jobb på en kanal är klart
+     */
+    void onJobFinished(QSsh::SftpChannel *channel, QSsh::SftpJobId job, const QString &error);
     
     /**
      * @brief Hantera när filöverföring rapporterar framsteg
-     * @param job Filöverföringsjobbet
-     * @param bytesSent Antal byte skickade
-     * @param bytesTotal Totalt antal byte
      */
-    void onTransferProgress(QSsh::SftpJobId job, quint64 bytesSent, quint64 bytesTotal);
+    void onTransferProgress(QSsh::SftpChannel *channel, QSsh::SftpJobId job,
+                            quint64 bytesSent, quint64 bytesTotal);
     
     /**
-     * @brief Hantera när katalog har skapats
-     * @param job Jobbet för att skapa katalog
-     * @param error Eventuellt fel
+     * @brief Starta köade överföringar så länge fönstret har plats
      */
-    void onMkdirJobFinished(QSsh::SftpJobId job, const QString &error);
+    void startQueuedTransfers();
     
     /**
-     * @brief Hantera när fil har raderats
-     * @param job Jobbet för att radera fil
-     * @param error Eventuellt fel
+     * @brief Öppna den lokala filen och starta en överföring på en kanal
+     * @param job Överföringen
+     * @param index Index i m_transferChannels, eller -1 för metadatakanalen
      */
-    void onRemoveFileJobFinished(QSsh::SftpJobId job, const QString &error);
+    void startTransferJob(SftpJob job, int index);
     
     /**
-     * @brief Hantera när katalog har raderats
-     * @param job Jobbet för att radera katalog
-     * @param error Eventuellt fel
+     * @brief Packa väntande små filer i ett tar-arkiv och skicka det
      */
-    void onRemoveDirJobFinished(QSsh::SftpJobId job, const QString &error);
+    void flushArchiveBatch();
     
     /**
-     * @brief Hantera när fil eller katalog har bytt namn
-     * @param job Jobbet för att byta namn
-     * @param error Eventuellt fel
+     * @brief Hantera när tar på servern har avslutats
+     * @param upload Arkivet
+     * @param exitStatus QSsh::SshRemoteProcess::ExitStatus
      */
-    void onRenameJobFinished(QSsh::SftpJobId job, const QString &error);
-
-private:
+    void onArchiveFinished(ArchiveUpload *upload, int exitStatus);
+    
+    /**
+     * @brief Starta en deltaöverföring med en STAT av fjärrfilen
+     */
+    void startDeltaUpload(const SftpJob &job);
+    
+    /**
+     * @brief Hantera STAT-svaret och hämta fjärrfilens signatur
+     */
+    void onDeltaStat(const SftpJob &job, bool failed);
+    
+    /**
+     * @brief Starta fjärrhjälparen i läget "sig" eller "patch"
+     */
+    void runDeltaHelper(DeltaUpload *upload, DeltaUpload::Stage stage);
+    
+    /**
+     * @brief Hantera när fjärrhjälparen har avslutats
+     */
+    void onDeltaHelperFinished(DeltaUpload *upload, int exitStatus);
+    
+    /**
+     * @brief Räkna deltat mot fjärrsignaturen i en bakgrundstråd
+     */
+    void startDeltaComputation(DeltaUpload *upload, const DeltaSync::Signature &signature);
+    
+    /**
+     * @brief Ta emot resultatet från bakgrundstråden
+     */
+    void onDeltaComputed(const QString &remotePath, int id, bool worthwhile,
+                         const DeltaSync::Delta &delta, const DeltaSync::Signature &newSignature);
+    
+    /**
+     * @brief Ladda upp hela filen i stället, t.ex. om exec saknas
+     */
+    void fallBackToFullUpload(DeltaUpload *upload);
+    
+    /**
+     * @brief Ta bort en deltaöverföring ur tabellen och radera den
+     */
+    void finishDeltaUpload(DeltaUpload *upload);
+    
+    /**
+     * @brief Starta jämförelsen av kontrollsummor för en avslutad överföring
+     * @return false om överföringen inte ska verifieras
+     */
+    bool startChecksumVerification(const SftpJob &job);
+    
+    /**
+     * @brief Starta fjärrkommandot som räknar summan för en jämförelse
+     * @return false om servern inte kan köra kommandot
+     */
+    bool startRemoteChecksum(ChecksumVerification *verification);
+    
+    /**
+     * @brief Räkna den lokala filens summa i en bakgrundstråd
+     */
+    void hashLocalFile(ChecksumVerification *verification, FileHasher::Algorithm algorithm);
+    
+    /**
+     * @brief Ta emot den lokala summan från bakgrundstråden
+     */
+    void onLocalChecksumComputed(int id, FileHasher::Algorithm algorithm, const QByteArray &digest);
+    
+    /**
+     * @brief Tolka fjärrkommandots utdata när det har avslutats
+     */
+    void onRemoteChecksumFinished(ChecksumVerification *verification, int exitStatus);
+    
+    /**
+     * @brief Jämför summorna när båda är klara och rapportera överföringen
+     */
+    void checkChecksumVerification(ChecksumVerification *verification);
+    
+    // Signaturcachen för deltaöverföringar
+    QString signatureCachePath(const QString &remotePath) const;
+    DeltaSync::Signature loadCachedSignature(const QString &remotePath) const;
+    void saveCachedSignature(const QString &remotePath, const DeltaSync::Signature &signature) const;
+    
+    /**
+     * @brief Skicka en STAT för att mäta RTT om senaste mätningen är gammal
+     */
+    void probeRoundTripTime();
+    
+    /**
+     * @brief Räkna om fönstret från utjämnad RTT
+     */
+    void updateTransferWindow();
+    
+    /**
+     * @brief Rapportera ett överföringsfel med error() och transferFailed()
+     */
+    void failTransfer(const QString &remotePath, const QString &errorString);
+    
     /**
      * @brief Konvertera QSsh::SftpFileInfo till ServerFileItem
      * @param fileInfo QSsh::SftpFileInfo att konvertera
@@ -279,26 +737,58 @@ private:
     quint16 m_port;
     QString m_currentDirectory;
     bool m_connected;
-    
-    // Lagra information om pågående överföringar
-    QSsh::SftpJobId m_currentListJob;
-    QSsh::SftpJobId m_currentUploadJob;
-    QSsh::SftpJobId m_currentDownloadJob;
-    QSsh::SftpJobId m_currentMkdirJob;
-    QSsh::SftpJobId m_currentRemoveFileJob;
-    QSsh::SftpJobId m_currentRemoveDirJob;
-    QSsh::SftpJobId m_currentRenameJob;
-    
-    QString m_currentUploadPath;
-    QString m_currentDownloadPath;
-    QString m_currentLocalUploadPath;
-    QString m_currentLocalDownloadPath;
-    QString m_currentMkdirPath;
-    QString m_currentRemoveFilePath;
-    QString m_currentRemoveDirPath;
-    QString m_currentRenameSrcPath;
-    QString m_currentRenameDstPath;
-    QString m_currentListPath;
+    int m_listingId;                    ///< Senast startade listning
+    
+    // Alla pågående jobb, nycklade på kanal och jobb-id
+    QHash<JobKey, SftpJob> m_jobs;
+    
+    // Kanalpool för överföringar och extra SSH-anslutningar
+    QVector<TransferChannel> m_transferChannels;
+    QList<QSsh::SshConnection *> m_extraConnections;
+    int m_transferChannelCount;
+    int m_connectionCount;
+    
+    // Överföringar som väntar på plats i fönstret
+    QQueue<SftpJob> m_queuedTransfers;
+    int m_activeTransfers;
+    int m_transferWindow;
+    int m_maxTransferWindow;
+    bool m_autoTuneWindow;
+    
+    // Snabbväg för små filer: eget fönster, eller tar-arkiv över exec
+    QQueue<SftpJob> m_queuedSmallTransfers;
+    int m_activeSmallTransfers;
+    bool m_smallFileBatching;
+    bool m_useArchive;
+    bool m_archiveUnavailable;      ///< Servern har nekat exec eller saknar tar
+    bool m_archiveFlushScheduled;
+    QList<SftpJob> m_pendingArchiveFiles;
+    QList<ArchiveUpload*> m_archiveUploads;
+    
+    // Deltaöverföringar, nycklade på fjärrsökväg
+    QHash<QString, DeltaUpload*> m_deltaUploads;
+    bool m_deltaSync;
+    qint64 m_deltaMinimumSize;
+    bool m_deltaUnavailable;        ///< Servern har nekat exec eller saknar python3
+    int m_nextDeltaId;
+    QSharedPointer<WorkerGuard> m_workerGuard;
+    
+    // Verifiering med kontrollsummor, nycklade på id
+    QHash<int, ChecksumVerification*> m_checksumVerifications;
+    bool m_verifyChecksums;
+    qint64 m_checksumMinimumSize;
+    bool m_checksumUnavailable;     ///< Servern har nekat exec eller saknar verktygen
+    FileHasher::Algorithm m_remoteChecksumAlgorithm; ///< Vad servern svarade senast
+    int m_nextChecksumId;
+    
+    // Bandbreddsbegränsning; en ström per session
+    BandwidthLimiter *m_limiter;
+    int m_limiterStream;
+    
+    // RTT-mätning
+    qint64 m_roundTripTime;
+    bool m_probePending;
+    QElapsedTimer m_lastProbe;
 };
 
 #endif // SFTPMANAGER_H 
\ No newline at end of file
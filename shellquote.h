@@ -0,0 +1,22 @@
+#ifndef SHELLQUOTE_H
+#define SHELLQUOTE_H
+
+#include <QByteArray>
+#include <QString>
+
+/**
+ * @brief Citera text som ett argument till ett POSIX-skal
+ *
+ * Texten omges av enkla citattecken och varje enkelt citattecken i den
+ * skrivs som '\''. Används för fjärrkommandon över exec-kanaler.
+ * @param text Argumentet, t.ex. en fjärrsökväg
+ * @return Argumentet i UTF-8, färdigt att klistras in i en kommandorad
+ */
+inline QByteArray shellQuote(const QString &text)
+{
+    QByteArray quoted = text.toUtf8();
+    quoted.replace('\'', "'\\''");
+    return '\'' + quoted + '\'';
+}
+
+#endif // SHELLQUOTE_H
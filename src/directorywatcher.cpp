@@ -0,0 +1,253 @@
+#include "directorywatcher.h"
+#include <QDebug>
+#include <QFile>
+#include <QFileSystemWatcher>
+#include <QSocketNotifier>
+
+#ifdef Q_OS_LINUX
+#include <sys/inotify.h>
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+#endif
+
+// Standardtak för bevakningar; inotify-gränsen delas av alla program
+// för samma användare, så bara en liten del av den används
+const int DEFAULT_MAX_WATCHES = 256;
+
+// Händelser samlas så här länge innan de skickas
+const int FLUSH_INTERVAL_MS = 50;
+
+// Fler ändrade namn än så i en omgång: lista om katalogen i stället
+const int MAX_CHANGES_PER_FLUSH = 1000;
+
+DirectoryWatcher::DirectoryWatcher(QObject *parent)
+    : QObject(parent)
+    , m_maxWatches(DEFAULT_MAX_WATCHES)
+    , m_useCounter(0)
+#ifdef Q_OS_LINUX
+    , m_fd(-1)
+    , m_notifier(nullptr)
+#else
+    , m_fallback(new QFileSystemWatcher(this))
+#endif
+{
+    m_flushTimer.setSingleShot(true);
+    m_flushTimer.setInterval(FLUSH_INTERVAL_MS);
+    connect(&m_flushTimer, &QTimer::timeout, this, &DirectoryWatcher::flushChanges);
+
+#ifdef Q_OS_LINUX
+    m_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (m_fd < 0) {
+        qDebug() << "Kunde inte starta inotify:" << strerror(errno);
+    } else {
+        m_notifier = new QSocketNotifier(m_fd, QSocketNotifier::Read, this);
+        connect(m_notifier, &QSocketNotifier::activated, this, &DirectoryWatcher::readEvents);
+    }
+
+    // Lämna gott om plats åt andra program under användarens gräns
+    QFile limitFile("/proc/sys/fs/inotify/max_user_watches");
+    if (limitFile.open(QIODevice::ReadOnly)) {
+        const int userLimit = limitFile.readAll().trimmed().toInt();
+        if (userLimit > 0) {
+            m_maxWatches = qMax(1, qMin(m_maxWatches, userLimit / 4));
+        }
+    }
+#else
+    connect(m_fallback, &QFileSystemWatcher::directoryChanged, this, [this](const QString &path) {
+        emit directoryInvalidated(path);
+    });
+#endif
+}
+
+DirectoryWatcher::~DirectoryWatcher()
+{
+#ifdef Q_OS_LINUX
+    if (m_fd >= 0) {
+        ::close(m_fd);
+    }
+#endif
+}
+
+bool DirectoryWatcher::watch(const QString &path)
+{
+    auto it = m_lastUsed.find(path);
+    if (it != m_lastUsed.end()) {
+        it.value() = ++m_useCounter;
+        return true;
+    }
+
+    if (m_maxWatches <= 0) {
+        return false;
+    }
+    while (m_lastUsed.size() >= m_maxWatches) {
+        evictLeastRecent();
+    }
+
+#ifdef Q_OS_LINUX
+    if (m_fd < 0) {
+        return false;
+    }
+    const quint32 mask = IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ATTRIB
+                         | IN_CLOSE_WRITE | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR;
+    const QByteArray encoded = QFile::encodeName(path);
+    int wd = inotify_add_watch(m_fd, encoded.constData(), mask);
+    if (wd < 0 && errno == ENOSPC && !m_lastUsed.isEmpty()) {
+        // Användarens gräns är nådd av andra program; ge upp en egen bevakning
+        evictLeastRecent();
+        wd = inotify_add_watch(m_fd, encoded.constData(), mask);
+    }
+    if (wd < 0) {
+        qDebug() << "Kunde inte bevaka" << path << ":" << strerror(errno);
+        return false;
+    }
+    // Samma katalog under ett annat namn ger samma id
+    const QString previous = m_paths.value(wd);
+    if (!previous.isEmpty() && previous != path) {
+        m_lastUsed.remove(previous);
+        m_descriptors.remove(previous);
+    }
+    m_paths.insert(wd, path);
+    m_descriptors.insert(path, wd);
+#else
+    if (!m_fallback->addPath(path)) {
+        return false;
+    }
+#endif
+
+    m_lastUsed.insert(path, ++m_useCounter);
+    return true;
+}
+
+void DirectoryWatcher::unwatch(const QString &path)
+{
+    if (!m_lastUsed.contains(path)) {
+        return;
+    }
+#ifdef Q_OS_LINUX
+    const int wd = m_descriptors.value(path, -1);
+    if (wd >= 0) {
+        inotify_rm_watch(m_fd, wd);
+    }
+#else
+    m_fallback->removePath(path);
+#endif
+    removeWatch(path);
+}
+
+bool DirectoryWatcher::isWatching(const QString &path) const
+{
+    return m_lastUsed.contains(path);
+}
+
+int DirectoryWatcher::maxWatches() const
+{
+    return m_maxWatches;
+}
+
+void DirectoryWatcher::setMaxWatches(int limit)
+{
+    m_maxWatches = qMax(0, limit);
+    while (m_lastUsed.size() > m_maxWatches) {
+        evictLeastRecent();
+    }
+}
+
+void DirectoryWatcher::readEvents()
+{
+#ifdef Q_OS_LINUX
+    // Bufferten måste vara justerad som inotify_event
+    alignas(struct inotify_event) char buffer[64 * 1024];
+
+    for (;;) {
+        const ssize_t length = ::read(m_fd, buffer, sizeof(buffer));
+        if (length <= 0) {
+            break; // EAGAIN: allt är läst
+        }
+
+        for (const char *p = buffer; p < buffer + length;) {
+            const struct inotify_event *event = reinterpret_cast<const struct inotify_event *>(p);
+            p += sizeof(struct inotify_event) + event->len;
+
+            if (event->mask & IN_Q_OVERFLOW) {
+                // Händelser har gått förlorade; alla kataloger måste listas om
+                const QStringList paths = m_lastUsed.keys();
+                for (const QString &path : paths) {
+                    m_changes.remove(path);
+                    emit directoryInvalidated(path);
+                }
+                continue;
+            }
+
+            const QString path = m_paths.value(event->wd);
+            if (path.isEmpty()) {
+                continue;
+            }
+            if (event->mask & IN_IGNORED) {
+                // Bevakningen är borta, t.ex. efter inotify_rm_watch
+                if (m_descriptors.value(path, -1) == event->wd) {
+                    removeWatch(path);
+                }
+                continue;
+            }
+            if (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_UNMOUNT)) {
+                m_changes.remove(path);
+                unwatch(path);
+                emit directoryInvalidated(path);
+                continue;
+            }
+            if (event->len > 0) {
+                m_changes[path].insert(QFile::decodeName(event->name));
+            }
+        }
+    }
+
+    if (!m_changes.isEmpty() && !m_flushTimer.isActive()) {
+        m_flushTimer.start();
+    }
+#endif
+}
+
+void DirectoryWatcher::flushChanges()
+{
+    const QHash<QString, QSet<QString>> changes = m_changes;
+    m_changes.clear();
+
+    for (auto it = changes.constBegin(); it != changes.constEnd(); ++it) {
+        if (!m_lastUsed.contains(it.key())) {
+            continue;
+        }
+        if (it.value().size() > MAX_CHANGES_PER_FLUSH) {
+            emit directoryInvalidated(it.key());
+        } else {
+            emit entriesChanged(it.key(), it.value().values());
+        }
+    }
+}
+
+void DirectoryWatcher::evictLeastRecent()
+{
+    QString oldest;
+    quint64 oldestUse = 0;
+    for (auto it = m_lastUsed.constBegin(); it != m_lastUsed.constEnd(); ++it) {
+        if (oldest.isEmpty() || it.value() < oldestUse) {
+            oldest = it.key();
+            oldestUse = it.value();
+        }
+    }
+    if (!oldest.isEmpty()) {
+        unwatch(oldest);
+    }
+}
+
+void DirectoryWatcher::removeWatch(const QString &path)
+{
+    m_lastUsed.remove(path);
+    m_changes.remove(path);
+#ifdef Q_OS_LINUX
+    const int wd = m_descriptors.take(path);
+    if (m_paths.value(wd) == path) {
+        m_paths.remove(wd);
+    }
+#endif
+}
@@ -0,0 +1,83 @@
+#ifndef DIRECTORYWATCHER_H
+#define DIRECTORYWATCHER_H
+
+#include <QObject>
+#include <QHash>
+#include <QSet>
+#include <QString>
+#include <QStringList>
+#include <QTimer>
+
+class QFileSystemWatcher;
+class QSocketNotifier;
+
+/**
+ * @brief Bevakar ett begränsat antal kataloger och rapporterar ändrade namn
+ *
+ * På Linux används inotify direkt, så att ändringar kan rapporteras per
+ * namn: FileModel stat:ar bara de namnen och uppdaterar enskilda rader i
+ * stället för att lista om hela katalogen. Händelser samlas en kort stund
+ * och skickas som en signal per katalog.
+ *
+ * Antalet bevakningar är begränsat. När taket nås släpps den katalog som
+ * varit orörd längst; dess cachade listning valideras då med katalogens
+ * ändringstid i stället. På andra plattformar används QFileSystemWatcher,
+ * som bara säger att något har ändrats, och katalogen listas om.
+ */
+class DirectoryWatcher : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit DirectoryWatcher(QObject *parent = nullptr);
+    ~DirectoryWatcher();
+
+    /**
+     * @brief Bevaka en katalog, eller markera en bevakad som nyss använd
+     * @return false om katalogen inte kunde bevakas
+     */
+    bool watch(const QString &path);
+    void unwatch(const QString &path);
+    bool isWatching(const QString &path) const;
+
+    // Högsta antal samtidiga bevakningar
+    int maxWatches() const;
+    void setMaxWatches(int limit);
+
+signals:
+    /**
+     * @brief Poster med de här namnen har lagts till, tagits bort eller ändrats
+     */
+    void entriesChanged(const QString &path, const QStringList &names);
+
+    /**
+     * @brief Katalogen måste listas om; händelser har gått förlorade,
+     * katalogen har tagits bort eller plattformen säger inte vad som ändrats
+     */
+    void directoryInvalidated(const QString &path);
+
+private:
+    void readEvents();
+    void flushChanges();
+    void evictLeastRecent();
+    void removeWatch(const QString &path);
+
+    int m_maxWatches;
+    quint64 m_useCounter;
+    QHash<QString, quint64> m_lastUsed;         // Bevakade kataloger -> senaste användning
+
+    // Namn som ändrats sedan förra signalen, per katalog
+    QHash<QString, QSet<QString>> m_changes;
+    QTimer m_flushTimer;
+
+#ifdef Q_OS_LINUX
+    int m_fd;
+    QSocketNotifier *m_notifier;
+    QHash<int, QString> m_paths;                // inotify-id -> katalog
+    QHash<QString, int> m_descriptors;
+#else
+    QFileSystemWatcher *m_fallback;
+#endif
+};
+
+#endif // DIRECTORYWATCHER_H
@@ -0,0 +1,341 @@
+#include "fileentrystore.h"
+#include <algorithm>
+#include <limits>
+
+// Ändringstid för poster där den inte gick att läsa
+const qint64 INVALID_TIME = std::numeric_limits<qint64>::min();
+
+// Namnbufferten packas om när mer än hälften är oanvänd
+const int MIN_GARBAGE_TO_COMPACT = 4096;
+
+namespace {
+
+// QString::append(QStringView) finns först i Qt6
+void appendView(QString &target, QStringView view)
+{
+    target.append(view.data(), int(view.size()));
+}
+
+} // namespace
+
+FileEntryStore::FileEntryStore()
+    : m_garbage(0)
+{
+}
+
+void FileEntryStore::clear(const QString &directory)
+{
+    m_directory = directory;
+    m_prefix = directory.endsWith('/') ? directory : directory + '/';
+    m_names.clear();
+    m_nameOffsets.clear();
+    m_nameLengths.clear();
+    m_sizes.clear();
+    m_modified.clear();
+    m_directories.clear();
+    m_garbage = 0;
+}
+
+QString FileEntryStore::directory() const
+{
+    return m_directory;
+}
+
+int FileEntryStore::size() const
+{
+    return m_sizes.size();
+}
+
+bool FileEntryStore::isEmpty() const
+{
+    return m_sizes.isEmpty();
+}
+
+int FileEntryStore::directoryCount() const
+{
+    return m_directories.count(true);
+}
+
+void FileEntryStore::append(const FileInfo &info)
+{
+    insert(size(), info);
+}
+
+void FileEntryStore::insert(int row, const FileInfo &info)
+{
+    quint32 offset = 0;
+    quint32 length = 0;
+    appendName(info.fileName, offset, length);
+    m_nameOffsets.insert(row, offset);
+    m_nameLengths.insert(row, length);
+    m_sizes.insert(row, info.fileSize);
+    m_modified.insert(row, info.fileDate.isValid() ? info.fileDate.toMSecsSinceEpoch() : INVALID_TIME);
+    insertBits(row, 1);
+    setDirectoryBit(row, info.isDirectory);
+}
+
+void FileEntryStore::insert(int row, const QVector<FileInfo> &infos)
+{
+    const int count = infos.size();
+    if (count == 0) {
+        return;
+    }
+
+    // Gör plats för hela blocket först, så att raderna efter flyttas en gång
+    m_nameOffsets.insert(row, count, 0);
+    m_nameLengths.insert(row, count, 0);
+    m_sizes.insert(row, count, 0);
+    m_modified.insert(row, count, 0);
+    insertBits(row, count);
+    for (int i = 0; i < count; ++i) {
+        const FileInfo &info = infos.at(i);
+        appendName(info.fileName, m_nameOffsets[row + i], m_nameLengths[row + i]);
+        m_sizes[row + i] = info.fileSize;
+        m_modified[row + i] = info.fileDate.isValid() ? info.fileDate.toMSecsSinceEpoch() : INVALID_TIME;
+        setDirectoryBit(row + i, info.isDirectory);
+    }
+}
+
+void FileEntryStore::removeAt(int row)
+{
+    remove(row, 1);
+}
+
+void FileEntryStore::remove(int row, int count)
+{
+    if (count <= 0) {
+        return;
+    }
+
+    for (int i = row; i < row + count; ++i) {
+        m_garbage += int(m_nameLengths.at(i));
+    }
+    m_nameOffsets.remove(row, count);
+    m_nameLengths.remove(row, count);
+    m_sizes.remove(row, count);
+    m_modified.remove(row, count);
+
+    const int bits = m_directories.size();
+    for (int i = row; i + count < bits; ++i) {
+        setDirectoryBit(i, m_directories.testBit(i + count));
+    }
+    m_directories.resize(bits - count);
+    compactNamesIfSparse();
+}
+
+void FileEntryStore::removeIf(const std::function<bool(int row)> &predicate)
+{
+    const int count = size();
+    int kept = 0;
+    for (int row = 0; row < count; ++row) {
+        if (predicate(row)) {
+            m_garbage += int(m_nameLengths.at(row));
+            continue;
+        }
+        if (kept != row) {
+            m_nameOffsets[kept] = m_nameOffsets.at(row);
+            m_nameLengths[kept] = m_nameLengths.at(row);
+            m_sizes[kept] = m_sizes.at(row);
+            m_modified[kept] = m_modified.at(row);
+            setDirectoryBit(kept, m_directories.testBit(row));
+        }
+        ++kept;
+    }
+    if (kept == count) {
+        return;
+    }
+
+    m_nameOffsets.resize(kept);
+    m_nameLengths.resize(kept);
+    m_sizes.resize(kept);
+    m_modified.resize(kept);
+    m_directories.resize(kept);
+    compactNamesIfSparse();
+}
+
+void FileEntryStore::replace(int row, const FileInfo &info)
+{
+    if (nameView(row) != QStringView(info.fileName)) {
+        m_garbage += int(m_nameLengths.at(row));
+        appendName(info.fileName, m_nameOffsets[row], m_nameLengths[row]);
+    }
+    m_sizes[row] = info.fileSize;
+    m_modified[row] = info.fileDate.isValid() ? info.fileDate.toMSecsSinceEpoch() : INVALID_TIME;
+    setDirectoryBit(row, info.isDirectory);
+}
+
+QStringView FileEntryStore::nameView(int row) const
+{
+    return QStringView(m_names.constData() + m_nameOffsets.at(row), qsizetype(m_nameLengths.at(row)));
+}
+
+QString FileEntryStore::fileName(int row) const
+{
+    return nameView(row).toString();
+}
+
+QString FileEntryStore::filePath(int row) const
+{
+    QString path;
+    path.reserve(m_prefix.size() + int(m_nameLengths.at(row)));
+    path += m_prefix;
+    appendView(path, nameView(row));
+    return path;
+}
+
+qint64 FileEntryStore::fileSize(int row) const
+{
+    return m_sizes.at(row);
+}
+
+QDateTime FileEntryStore::fileDate(int row) const
+{
+    const qint64 modified = m_modified.at(row);
+    return modified == INVALID_TIME ? QDateTime() : QDateTime::fromMSecsSinceEpoch(modified);
+}
+
+bool FileEntryStore::isDirectory(int row) const
+{
+    return m_directories.testBit(row);
+}
+
+FileInfo FileEntryStore::at(int row) const
+{
+    FileInfo info;
+    info.fileName = fileName(row);
+    info.filePath = filePath(row);
+    info.fileSize = fileSize(row);
+    info.fileDate = fileDate(row);
+    info.isDirectory = isDirectory(row);
+    return info;
+}
+
+void FileEntryStore::sort(int first)
+{
+    const int count = size();
+    if (count - first < 2) {
+        return;
+    }
+
+    // Sortera en permutation och flytta sedan alla kolumner en gång
+    QVector<int> order(count);
+    for (int row = 0; row < count; ++row) {
+        order[row] = row;
+    }
+    std::stable_sort(order.begin() + first, order.end(), [this](int a, int b) {
+        return lessThan(isDirectory(a), nameView(a), isDirectory(b), nameView(b));
+    });
+
+    // Namnen skrivs om i radordning, så bufferten blir också tät
+    QString names;
+    names.reserve(m_names.size() - m_garbage);
+    QVector<quint32> offsets(count);
+    QVector<quint32> lengths(count);
+    QVector<qint64> sizes(count);
+    QVector<qint64> modified(count);
+    QBitArray directories(count);
+    for (int row = 0; row < count; ++row) {
+        const int from = order.at(row);
+        offsets[row] = quint32(names.size());
+        lengths[row] = m_nameLengths.at(from);
+        appendView(names, nameView(from));
+        sizes[row] = m_sizes.at(from);
+        modified[row] = m_modified.at(from);
+        directories.setBit(row, m_directories.testBit(from));
+    }
+
+    m_names = names;
+    m_nameOffsets = offsets;
+    m_nameLengths = lengths;
+    m_sizes = sizes;
+    m_modified = modified;
+    m_directories = directories;
+    m_garbage = 0;
+}
+
+bool FileEntryStore::isSorted(int first) const
+{
+    for (int row = first + 1; row < size(); ++row) {
+        if (lessThan(isDirectory(row), nameView(row), isDirectory(row - 1), nameView(row - 1))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int FileEntryStore::lowerBound(int first, const FileInfo &info) const
+{
+    int low = first;
+    int high = size();
+    while (low < high) {
+        const int middle = low + (high - low) / 2;
+        if (lessThan(isDirectory(middle), nameView(middle), info.isDirectory, QStringView(info.fileName))) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+qint64 FileEntryStore::memoryUsage() const
+{
+    return qint64(sizeof(FileEntryStore))
+           + qint64(m_names.capacity()) * qint64(sizeof(QChar))
+           + qint64(m_nameOffsets.capacity() + m_nameLengths.capacity()) * qint64(sizeof(quint32))
+           + qint64(m_sizes.capacity() + m_modified.capacity()) * qint64(sizeof(qint64))
+           + m_directories.size() / 8
+           + qint64(m_prefix.size() + m_directory.size()) * qint64(sizeof(QChar));
+}
+
+bool FileEntryStore::lessThan(bool aDirectory, QStringView a, bool bDirectory, QStringView b)
+{
+    // Kataloger före filer, sedan namn utan hänsyn till skiftläge som QDir::Name | QDir::IgnoreCase
+    if (aDirectory != bDirectory) {
+        return aDirectory;
+    }
+    const int result = a.compare(b, Qt::CaseInsensitive);
+    return result != 0 ? result < 0 : a < b;
+}
+
+void FileEntryStore::setDirectoryBit(int row, bool directory)
+{
+    m_directories.setBit(row, directory);
+}
+
+void FileEntryStore::insertBits(int row, int count)
+{
+    // QBitArray kan inte sätta in mitt i; flytta bitarna efter raden count steg
+    const int bits = m_directories.size();
+    m_directories.resize(bits + count);
+    for (int i = bits + count - 1; i >= row + count; --i) {
+        m_directories.setBit(i, m_directories.testBit(i - count));
+    }
+}
+
+void FileEntryStore::appendName(const QString &name, quint32 &offset, quint32 &length)
+{
+    offset = quint32(m_names.size());
+    length = quint32(name.size());
+    m_names += name;
+}
+
+void FileEntryStore::compactNamesIfSparse()
+{
+    if (m_garbage > MIN_GARBAGE_TO_COMPACT && m_garbage > m_names.size() / 2) {
+        compactNames();
+    }
+}
+
+void FileEntryStore::compactNames()
+{
+    QString names;
+    names.reserve(m_names.size() - m_garbage);
+    for (int row = 0; row < size(); ++row) {
+        const quint32 offset = quint32(names.size());
+        appendView(names, nameView(row));
+        m_nameOffsets[row] = offset;
+    }
+    m_names = names;
+    m_garbage = 0;
+}
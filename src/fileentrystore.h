@@ -0,0 +1,103 @@
+#ifndef FILEENTRYSTORE_H
+#define FILEENTRYSTORE_H
+
+#include <QBitArray>
+#include <QDateTime>
+#include <QString>
+#include <QStringView>
+#include <QVector>
+#include <functional>
+
+// Struktur för att hålla filinformation
+struct FileInfo {
+    QString fileName;
+    QString filePath;
+    qint64 fileSize;
+    QDateTime fileDate;
+    bool isDirectory;
+    // Lägg till fler attribut senare (t.ex. permissions)
+};
+
+/**
+ * @brief Kompakt lagring av poster i en katalog, en kolumn per fält
+ *
+ * Katalogens sökväg sparas en gång och filePath() byggs vid behov. Namnen
+ * ligger efter varandra i en gemensam UTF-16-buffert, storlekar och
+ * ändringstider i packade int64-fält och katalogflaggan i en bitmängd.
+ * En post kostar då runt 25 byte plus namnet, mot flera hundra för en
+ * FileInfo med två QString och en QDateTime i en QList.
+ *
+ * Alla kolumner delas implicit, så en kopia (t.ex. till katalogcachen)
+ * kostar inget förrän någon av dem ändras. Efter sort() ligger namnen i
+ * radordning i bufferten, så att jämförelser och ritning läser minnet i
+ * följd.
+ */
+class FileEntryStore
+{
+public:
+    FileEntryStore();
+
+    // Töm och byt katalog
+    void clear(const QString &directory = QString());
+    QString directory() const;
+
+    int size() const;
+    bool isEmpty() const;
+    int directoryCount() const;
+
+    void append(const FileInfo &info);
+    void insert(int row, const FileInfo &info);
+    // Sätt in flera rader efter varandra; kolumnerna flyttas en gång
+    void insert(int row, const QVector<FileInfo> &infos);
+    void removeAt(int row);
+    // Ta bort count rader från row; kolumnerna flyttas en gång
+    void remove(int row, int count);
+    // Ta bort alla rader där predicate är sant, i ett svep
+    void removeIf(const std::function<bool(int row)> &predicate);
+    // Ersätt en rad; namnet behöver inte vara detsamma
+    void replace(int row, const FileInfo &info);
+
+    QStringView nameView(int row) const;
+    QString fileName(int row) const;
+    QString filePath(int row) const;
+    qint64 fileSize(int row) const;
+    QDateTime fileDate(int row) const;
+    bool isDirectory(int row) const;
+    FileInfo at(int row) const;
+
+    /**
+     * @brief Sortera raderna från och med first: kataloger först, sedan
+     * namn utan hänsyn till skiftläge
+     */
+    void sort(int first = 0);
+    bool isSorted(int first = 0) const;
+
+    // Raden där info ska sättas in för att sorteringen ska hålla
+    int lowerBound(int first, const FileInfo &info) const;
+
+    // Ungefärligt minne i byte, för katalogcachen
+    qint64 memoryUsage() const;
+
+    // Samma ordning som sort(); används också för FileInfo-listor
+    static bool lessThan(bool aDirectory, QStringView a, bool bDirectory, QStringView b);
+
+private:
+    void setDirectoryBit(int row, bool directory);
+    void insertBits(int row, int count);
+    void appendName(const QString &name, quint32 &offset, quint32 &length);
+    void compactNamesIfSparse();
+    void compactNames();
+
+    QString m_directory;
+    QString m_prefix;                   // m_directory med avslutande snedstreck
+
+    QString m_names;                    // Alla namn efter varandra
+    QVector<quint32> m_nameOffsets;
+    QVector<quint32> m_nameLengths;
+    QVector<qint64> m_sizes;
+    QVector<qint64> m_modified;         // Ms sedan epoch, INVALID_TIME om okänd
+    QBitArray m_directories;
+    int m_garbage;                      // Tecken i m_names som inte används längre
+};
+
+#endif // FILEENTRYSTORE_H
@@ -1,6 +1,7 @@
 #include "filemodel.h"
-#include <QDebug>
+#include "directorywatcher.h"
 #include <QDirIterator>
+#include <QElapsedTimer>
 #include <QFile>
 #include <QDir>
 #include <QMessageBox> // För framtida bekräftelsedialoger kanske
@@ -8,10 +9,39 @@
 #include <QMutexLocker>
 #include <QThreadPool>
 #include <QRunnable>
+#include <algorithm>
+#include <climits>
 
-// Konstanter för inkrementell laddning
-const int BATCH_SIZE = 100;
-const int MAX_CACHE_DIRS = 10;
+// Konstanter för inkrementell laddning: den första omgången är liten så
+// att något syns direkt, sedan växer de så att stora kataloger inte ger
+// tusentals anrop till huvudtråden
+const int FIRST_LIST_BATCH = 64;
+const int MAX_LIST_BATCH = 4096;
+// En omgång skickas även om den inte är full, t.ex. på en långsam nätverksdisk
+const int LIST_BATCH_INTERVAL_MS = 50;
+// Katalogcachen: standardbudget i byte
+const int DEFAULT_CACHE_SIZE = 32 * 1024 * 1024;
+// Ändringstider så här nära listningen kan ha ändrats igen inom samma
+// tidsupplösning utan att tiden ändras; sådana listningar valideras inte
+const qint64 MODIFIED_GRANULARITY_MS = 2000;
+
+// Insättning i modellen: så mycket tid per bildruta får det ta, så att
+// vyn hinner rita mellan omgångarna. Antalet rader anpassas efter utfallet
+const qint64 FRAME_BUDGET_NS = 8 * 1000 * 1000;
+const int FRAME_INTERVAL_MS = 16;
+const int INITIAL_ROWS_PER_FRAME = 512;
+const int MIN_ROWS_PER_FRAME = 64;
+const int MAX_ROWS_PER_FRAME = 64 * 1024;
+
+namespace {
+
+// Samma ordning som FileEntryStore::sort()
+bool entryLessThan(const FileInfo &a, const FileInfo &b)
+{
+    return FileEntryStore::lessThan(a.isDirectory, QStringView(a.fileName), b.isDirectory, QStringView(b.fileName));
+}
+
+} // namespace
 
 // Hjälpklass för att utföra filsystemsoperationer i bakgrunden
 class FileSystemTask : public QRunnable
@@ -24,8 +54,9 @@ public:
         RenameFile
     };
     
-    FileSystemTask(FileModel* model, TaskType type, const QString& arg1, const QString& arg2 = QString())
-        : m_model(model), m_type(type), m_arg1(arg1), m_arg2(arg2)
+    FileSystemTask(FileModel* model, TaskType type, const QString& arg1, const QString& arg2 = QString(),
+                   int generation = 0)
+        : m_model(model), m_type(type), m_arg1(arg1), m_arg2(arg2), m_generation(generation)
     {
         setAutoDelete(true);
     }
@@ -34,7 +65,7 @@ public:
     {
         switch (m_type) {
             case ListDirectory:
-                m_model->listDirectoryTask(m_arg1);
+                m_model->listDirectoryTask(m_arg1, m_generation);
                 break;
             case DeleteFile:
                 m_model->deletePathTask(m_arg1);
@@ -53,6 +84,7 @@ private:
     TaskType m_type;
     QString m_arg1;
     QString m_arg2;
+    int m_generation;
 };
 
 FileModel::FileModel(bool remote, QObject *parent)
@@ -60,7 +92,19 @@ FileModel::FileModel(bool remote, QObject *parent)
     , m_isRemote(remote)
     , m_isLoading(false)
     , m_hasMoreItems(false)
+    , m_listGeneration(0)
+    , m_directoryRows(0)
+    , m_pendingOffset(0)
+    , m_rowsPerFrame(INITIAL_ROWS_PER_FRAME)
+    , m_listingDone(false)
+    , m_cacheHits(0)
+    , m_cacheMisses(0)
+    , m_listingModified(-1)
+    , m_watcher(nullptr)
 {
+    m_insertTimer.setSingleShot(true);
+    connect(&m_insertTimer, &QTimer::timeout, this, &FileModel::insertPending);
+    
     // Definiera rollnamn för mappning till QML
     m_roleNames[FileNameRole] = "fileName";
     m_roleNames[FilePathRole] = "filePath";
@@ -69,7 +113,13 @@ FileModel::FileModel(bool remote, QObject *parent)
     m_roleNames[IsDirectoryRole] = "isDirectory";
     
     // Initiera cache-strukturer
-    m_dirCache.setMaxCost(MAX_CACHE_DIRS);
+    m_dirCache.setMaxCost(DEFAULT_CACHE_SIZE);
+    
+    if (!m_isRemote) {
+        m_watcher = new DirectoryWatcher(this);
+        connect(m_watcher, &DirectoryWatcher::entriesChanged, this, &FileModel::onEntriesChanged);
+        connect(m_watcher, &DirectoryWatcher::directoryInvalidated, this, &FileModel::onDirectoryInvalidated);
+    }
 }
 
 int FileModel::rowCount(const QModelIndex &parent) const
@@ -83,19 +133,19 @@ QVariant FileModel::data(const QModelIndex &index, int role) const
     if (!index.isValid() || index.row() < 0 || index.row() >= m_files.size())
         return QVariant();
     
-    const FileInfo &fileInfo = m_files.at(index.row());
+    const int row = index.row();
     
     switch (role) {
         case FileNameRole:
-            return fileInfo.fileName;
+            return m_files.fileName(row);
         case FilePathRole:
-            return fileInfo.filePath;
+            return m_files.filePath(row);
         case FileSizeRole:
-            return fileInfo.isDirectory ? "" : formatFileSize(fileInfo.fileSize);
+            return m_files.isDirectory(row) ? "" : formatFileSize(m_files.fileSize(row));
         case FileDateRole:
-            return fileInfo.fileDate.toString("yyyy-MM-dd hh:mm");
+            return m_files.fileDate(row).toString("yyyy-MM-dd hh:mm");
         case IsDirectoryRole:
-            return fileInfo.isDirectory;
+            return m_files.isDirectory(row);
         default:
             return QVariant();
     }
@@ -113,31 +163,42 @@ void FileModel::navigate(const QString &path)
     // Säkerställ konsekvent hantering av snedstreck
     cleanedPath.replace('\\', '/');
     
+    // En listning som fortfarande pågår gäller den gamla katalogen
+    const int generation = m_listGeneration.fetchAndAddOrdered(1) + 1;
+    m_insertTimer.stop();
+    m_pendingEntries.clear();
+    m_pendingOffset = 0;
+    m_listingDone = false;
+    m_deferredChanges.clear();
+    
     // Om vi redan har denna katalog i cachen, använd den direkt
-    if (m_dirCache.contains(cleanedPath)) {
+    if (const CachedDirectory *cached = cachedDirectory(cleanedPath)) {
         QMutexLocker locker(&m_mutex);
         beginResetModel();
-        m_files.clear();
-        QVector<FileInfo>* cachedFiles = m_dirCache.object(cleanedPath);
-        if (cachedFiles) {
-            for (const FileInfo &info : *cachedFiles) {
-                m_files.append(info);
-            }
-        }
+        // Kolumnerna delas med cachen tills någon av dem ändras
+        m_files = cached->files;
+        m_directoryRows = m_files.directoryCount();
         m_currentPath = cleanedPath;
         endResetModel();
+        if (m_isLoading || m_hasMoreItems) {
+            m_isLoading = false;
+            m_hasMoreItems = false;
+            emit loadingChanged();
+        }
         emit currentPathChanged(m_currentPath);
         return;
     }
     
     // Annars, ladda asynkront
     m_isLoading = true;
+    m_hasMoreItems = true;
     emit loadingChanged();
     
     QFileInfo pathInfo(cleanedPath);
     if (!pathInfo.exists() || !pathInfo.isDir()) {
         emit error(tr("Katalogen finns inte: %1").arg(cleanedPath));
         m_isLoading = false;
+        m_hasMoreItems = false;
         emit loadingChanged();
         return;
     }
@@ -146,122 +207,447 @@ void FileModel::navigate(const QString &path)
     m_currentPath = cleanedPath;
     emit currentPathChanged(m_currentPath);
     
-    // Rensa modellen och visa "laddar"-indikation
+    // Rensa modellen; ".." visas direkt om vi inte är i roten
     beginResetModel();
-    m_files.clear();
+    m_files.clear(cleanedPath);
+    m_directoryRows = 0;
+    if (!isRoot(cleanedPath)) {
+        FileInfo parentInfo;
+        parentInfo.fileName = "..";
+        parentInfo.filePath = pathInfo.absoluteFilePath() + "/..";
+        parentInfo.fileSize = 0;
+        parentInfo.fileDate = QDateTime::currentDateTime();
+        parentInfo.isDirectory = true;
+        m_files.append(parentInfo);
+        m_directoryRows = 1;
+    }
     endResetModel();
     
-    // Kör listning av katalog i en bakgrundstråd
+    // Kör listning av katalog i en bakgrundstråd. Ändringstiden tas före
+    // listningen, så att ändringar under tiden syns vid nästa träff
+    const QDateTime modified = pathInfo.lastModified();
+    m_listingModified = modified.isValid() ? modified.toMSecsSinceEpoch() : -1;
+    m_listingPath = cleanedPath;
+    if (m_watcher) {
+        // Bevakningen startar före listningen så att inget faller mellan stolarna
+        m_watcher->watch(cleanedPath);
+    }
     FileSystemTask* task = new FileSystemTask(this, 
                                             FileSystemTask::ListDirectory, 
-                                            cleanedPath);
+                                            cleanedPath, QString(), generation);
     QThreadPool::globalInstance()->start(task);
 }
 
-void FileModel::listDirectoryTask(const QString &path)
+QVector<FileInfo> FileModel::readDirectory(const QString &path, QDir::Filters filters)
 {
-    QMutexLocker locker(&m_mutex);
-    
-    // Läs kataloginnehåll
-    QDir dir(path);
-    dir.setFilter(QDir::AllEntries | QDir::NoDot);
-    QFileInfoList entries = dir.entryInfoList();
-    
     QVector<FileInfo> files;
+    streamDirectory(path, filters, [&files](const QVector<FileInfo> &batch) {
+        files += batch;
+        return true;
+    });
     
     // Sortera först kataloger, sen filer
-    for (const QFileInfo &entry : entries) {
-        if (entry.isDir()) {
-            FileInfo info;
-            info.fileName = entry.fileName();
-            info.filePath = entry.filePath();
-            info.fileSize = 0; // Kataloger har ingen storlek
-            info.fileDate = entry.lastModified();
-            info.isDirectory = true;
-            files.append(info);
+    std::sort(files.begin(), files.end(), entryLessThan);
+    return files;
+}
+
+bool FileModel::streamDirectory(const QString &path, QDir::Filters filters,
+                                const std::function<bool(const QVector<FileInfo> &)> &sink)
+{
+    // QDirIterator läser katalogen post för post i stället för att först
+    // bygga en QFileInfoList med allt, som QDir::entryInfoList() gör
+    QDirIterator it(path, filters);
+    
+    int batchSize = FIRST_LIST_BATCH;
+    QVector<FileInfo> batch;
+    batch.reserve(batchSize);
+    QElapsedTimer timer;
+    timer.start();
+    
+    while (it.hasNext()) {
+        it.next();
+        const QFileInfo entry = it.fileInfo();
+        
+        FileInfo info;
+        info.fileName = entry.fileName();
+        info.filePath = entry.filePath();
+        info.isDirectory = entry.isDir();
+        info.fileSize = info.isDirectory ? 0 : entry.size(); // Kataloger har ingen storlek
+        info.fileDate = entry.lastModified();
+        batch.append(info);
+        
+        if (batch.size() >= batchSize || timer.elapsed() >= LIST_BATCH_INTERVAL_MS) {
+            if (!sink(batch)) {
+                return false;
+            }
+            batchSize = qMin(batchSize * 2, MAX_LIST_BATCH);
+            batch.clear();
+            batch.reserve(batchSize);
+            timer.restart();
         }
     }
     
-    for (const QFileInfo &entry : entries) {
-        if (!entry.isDir()) {
-            FileInfo info;
-            info.fileName = entry.fileName();
-            info.filePath = entry.filePath();
-            info.fileSize = entry.size();
-            info.fileDate = entry.lastModified();
-            info.isDirectory = false;
-            files.append(info);
+    return batch.isEmpty() || sink(batch);
+}
+
+void FileModel::listDirectoryTask(const QString &path, int generation)
+{
+    // Varje omgång skickas till huvudtråden så fort den är läst. Listningen
+    // avbryts om användaren hunnit navigera vidare
+    const bool completed = streamDirectory(path, QDir::AllEntries | QDir::NoDotAndDotDot,
+                                           [this, generation](const QVector<FileInfo> &batch) {
+        if (m_listGeneration.loadAcquire() != generation) {
+            return false;
         }
+        QMetaObject::invokeMethod(this, [this, generation, batch]() {
+            enqueueBatch(generation, batch);
+        }, Qt::QueuedConnection);
+        return true;
+    });
+    
+    if (completed) {
+        QMetaObject::invokeMethod(this, [this, generation, path]() {
+            finishListing(generation, path);
+        }, Qt::QueuedConnection);
+    }
+}
+
+void FileModel::enqueueBatch(int generation, const QVector<FileInfo> &batch)
+{
+    if (generation != m_listGeneration.loadAcquire()) {
+        return;
     }
     
-    // Lägg till i cache
-    m_dirCache.insert(path, new QVector<FileInfo>(files), files.size());
+    m_pendingEntries += batch;
+    if (!m_insertTimer.isActive()) {
+        m_insertTimer.start(0);
+    }
+}
+
+void FileModel::finishListing(int generation, const QString &path)
+{
+    if (generation != m_listGeneration.loadAcquire() || path != m_listingPath) {
+        return;
+    }
     
-    // Lägg till först den speciella ".." uppkatalogen om vi inte är i root
-    QDir currentDir(m_currentPath);
-    if (currentDir.exists() && !isRoot(m_currentPath)) {
-        FileInfo parentInfo;
-        parentInfo.fileName = "..";
-        parentInfo.filePath = currentDir.absolutePath() + "/..";
-        parentInfo.fileSize = 0;
-        parentInfo.fileDate = QDateTime::currentDateTime();
-        parentInfo.isDirectory = true;
+    m_listingDone = true;
+    if (!m_insertTimer.isActive()) {
+        m_insertTimer.start(0);
+    }
+}
+
+void FileModel::insertPending()
+{
+    const int available = m_pendingEntries.size() - m_pendingOffset;
+    if (available > 0) {
+        const int count = qMin(available, m_rowsPerFrame);
+        
+        QElapsedTimer timer;
+        timer.start();
+        appendEntries(m_pendingEntries.mid(m_pendingOffset, count));
+        const qint64 elapsed = timer.nsecsElapsed();
+        
+        m_pendingOffset += count;
+        if (m_pendingOffset == m_pendingEntries.size()) {
+            m_pendingEntries.clear();
+            m_pendingOffset = 0;
+        }
         
-        QMetaObject::invokeMethod(this, "addItem", Qt::QueuedConnection,
-                                 Q_ARG(FileInfo, parentInfo), Q_ARG(bool, true));
+        // Sikta på budgeten nästa gång; bara hela omgångar säger något om takten
+        if (count == m_rowsPerFrame && elapsed > 0) {
+            const qint64 target = qint64(count) * FRAME_BUDGET_NS / elapsed;
+            m_rowsPerFrame = int(qBound<qint64>(MIN_ROWS_PER_FRAME, (m_rowsPerFrame + target) / 2,
+                                                MAX_ROWS_PER_FRAME));
+        }
     }
     
-    // Ladda första batchen
-    loadNextBatch(files, 0);
+    if (m_pendingOffset < m_pendingEntries.size()) {
+        m_insertTimer.start(FRAME_INTERVAL_MS);
+    } else if (m_listingDone) {
+        completeListing();
+    }
 }
 
-void FileModel::loadNextBatch(const QVector<FileInfo> &allFiles, int startIndex)
+void FileModel::appendEntries(const QVector<FileInfo> &entries)
 {
-    if (startIndex >= allFiles.size()) {
-        // Alla filer är inlästa
-        m_hasMoreItems = false;
-        m_isLoading = false;
-        emit loadingChanged();
-        return;
+    QVector<FileInfo> directories;
+    QVector<FileInfo> files;
+    files.reserve(entries.size());
+    for (const FileInfo &info : entries) {
+        if (info.isDirectory) {
+            directories.append(info);
+        } else {
+            files.append(info);
+        }
     }
     
-    // Bestäm slutindex för denna batch
-    int endIndex = qMin(startIndex + BATCH_SIZE, allFiles.size());
+    // Kataloger läggs sist i katalogblocket och filer sist i listan, så att
+    // ordningen kataloger-filer håller medan listningen pågår
+    if (!directories.isEmpty()) {
+        beginInsertRows(QModelIndex(), m_directoryRows, m_directoryRows + directories.size() - 1);
+        m_files.insert(m_directoryRows, directories);
+        m_directoryRows += directories.size();
+        endInsertRows();
+    }
     
-    // Lägg till filerna inkrementellt
-    for (int i = startIndex; i < endIndex; ++i) {
-        QMetaObject::invokeMethod(this, "addItem", Qt::QueuedConnection,
-                                 Q_ARG(FileInfo, allFiles[i]));
+    if (!files.isEmpty()) {
+        beginInsertRows(QModelIndex(), m_files.size(), m_files.size() + files.size() - 1);
+        m_files.insert(m_files.size(), files);
+        endInsertRows();
+    }
+}
+
+void FileModel::completeListing()
+{
+    m_listingDone = false;
+    
+    // Posterna kommer i filsystemets ordning; sortera en gång när allt är
+    // inläst. ".." ligger kvar först
+    const int first = firstSortedRow();
+    if (!m_files.isSorted(first)) {
+        emit layoutAboutToBeChanged();
+        m_files.sort(first);
+        emit layoutChanged();
     }
     
-    // Om det finns fler filer, ladda nästa batch efter kort fördröjning
-    if (endIndex < allFiles.size()) {
-        m_hasMoreItems = true;
-        QTimer::singleShot(10, this, [this, allFiles, endIndex]() {
-            loadNextBatch(allFiles, endIndex);
-        });
-    } else {
-        // Alla filer är nu inlästa
-        m_hasMoreItems = false;
-        m_isLoading = false;
-        emit loadingChanged();
+    // Ändringar som kom medan listningen pågick; de kan redan vara med
+    if (!m_deferredChanges.isEmpty()) {
+        const QStringList names = m_deferredChanges.values();
+        m_deferredChanges.clear();
+        applyChangesToModel(names, statEntries(m_listingPath, names));
     }
+    
+    // Lägg till i cache
+    CachedDirectory *cached = new CachedDirectory;
+    cached->files = m_files;
+    cached->modified = trustedModified(m_listingModified);
+    insertIntoCache(m_listingPath, cached);
+    
+    m_hasMoreItems = false;
+    m_isLoading = false;
+    emit loadingChanged();
 }
 
-void FileModel::addItem(const FileInfo &item, bool prepend)
+const FileModel::CachedDirectory *FileModel::cachedDirectory(const QString &path)
 {
-    // Lägg till en ny post i modellen
-    if (prepend) {
-        beginInsertRows(QModelIndex(), 0, 0);
-        m_files.prepend(item);
-        endInsertRows();
+    CachedDirectory *cached = m_dirCache.object(path);
+    if (cached) {
+        // En bevakad katalog hålls aktuell av händelserna
+        if (m_watcher && m_watcher->isWatching(path)) {
+            m_watcher->watch(path);
+            ++m_cacheHits;
+            return cached;
+        }
+        const QDateTime modified = QFileInfo(path).lastModified();
+        if (cached->modified >= 0 && modified.isValid()
+            && modified.toMSecsSinceEpoch() == cached->modified) {
+            ++m_cacheHits;
+            return cached;
+        }
+        m_dirCache.remove(path);
+    }
+    ++m_cacheMisses;
+    return nullptr;
+}
+
+void FileModel::insertIntoCache(const QString &path, CachedDirectory *cached)
+{
+    // En katalog större än hela budgeten sparas inte
+    const qint64 cost = cached->files.memoryUsage();
+    if (m_dirCache.insert(path, cached, int(qMin<qint64>(cost, INT_MAX)))) {
+        if (m_watcher) {
+            m_watcher->watch(path);
+        }
+    } else if (m_watcher && path != m_currentPath) {
+        m_watcher->unwatch(path);
+    }
+}
+
+qint64 FileModel::trustedModified(qint64 modified)
+{
+    if (modified < 0 || QDateTime::currentMSecsSinceEpoch() - modified <= MODIFIED_GRANULARITY_MS) {
+        return -1;
+    }
+    return modified;
+}
+
+void FileModel::onEntriesChanged(const QString &path, const QStringList &names)
+{
+    const bool current = path == m_currentPath;
+    
+    // Listningen tar med eller missar posterna; de kontrolleras när den är klar
+    if (current && m_isLoading) {
+        for (const QString &name : names) {
+            m_deferredChanges.insert(name);
+        }
+        return;
+    }
+    
+    CachedDirectory *cached = m_dirCache.take(path);
+    if (!current && !cached) {
+        m_watcher->unwatch(path);
+        return;
+    }
+    
+    // Bara de ändrade namnen stat:as
+    const QHash<QString, FileInfo> present = statEntries(path, names);
+    
+    if (current) {
+        applyChangesToModel(names, present);
+        if (!cached) {
+            cached = new CachedDirectory;
+        }
+        cached->files = m_files;
     } else {
-        beginInsertRows(QModelIndex(), m_files.size(), m_files.size());
-        m_files.append(item);
+        // Ta bort de ändrade namnen och sätt in dem som finns kvar på sin plats
+        const QSet<QString> changed(names.begin(), names.end());
+        FileEntryStore &files = cached->files;
+        files.removeIf([&files, &changed](int row) {
+            const QStringView name = files.nameView(row);
+            return name != QLatin1String("..") && changed.contains(name.toString());
+        });
+        const int first = (!files.isEmpty() && files.nameView(0) == QLatin1String("..")) ? 1 : 0;
+        for (const FileInfo &info : qAsConst(present)) {
+            files.insert(files.lowerBound(first, info), info);
+        }
+    }
+    
+    const QDateTime modified = QFileInfo(path).lastModified();
+    cached->modified = trustedModified(modified.isValid() ? modified.toMSecsSinceEpoch() : -1);
+    insertIntoCache(path, cached);
+}
+
+void FileModel::onDirectoryInvalidated(const QString &path)
+{
+    m_dirCache.remove(path);
+    if (path == m_currentPath) {
+        refresh();
+    } else if (m_watcher) {
+        m_watcher->unwatch(path);
+    }
+}
+
+void FileModel::applyChangesToModel(const QStringList &names, const QHash<QString, FileInfo> &present)
+{
+    const int first = firstSortedRow();
+    QHash<QString, int> rows;
+    rows.reserve(m_files.size());
+    for (int row = first; row < m_files.size(); ++row) {
+        rows.insert(m_files.fileName(row), row);
+    }
+    
+    // Poster som finns kvar som samma typ uppdateras på plats; övriga tas
+    // bort och sätts in på nytt så att sorteringen håller
+    QVector<int> removed;
+    QVector<FileInfo> inserted;
+    for (const QString &name : names) {
+        const int row = rows.value(name, -1);
+        auto info = present.constFind(name);
+        if (row >= 0 && info != present.constEnd() && info->isDirectory == m_files.isDirectory(row)) {
+            m_files.replace(row, info.value());
+            emit dataChanged(index(row), index(row));
+            continue;
+        }
+        if (row >= 0) {
+            removed.append(row);
+        }
+        if (info != present.constEnd()) {
+            inserted.append(info.value());
+        }
+    }
+    
+    // Vyn måste få varje sammanhängande intervall för sig; bakifrån så att
+    // radnumren håller, och varje intervall flyttar kolumnerna en gång
+    std::sort(removed.begin(), removed.end(), std::greater<int>());
+    for (int i = 0; i < removed.size();) {
+        const int last = removed.at(i);
+        int row = last;
+        while (++i < removed.size() && removed.at(i) == row - 1) {
+            --row;
+        }
+        beginRemoveRows(QModelIndex(), row, last);
+        for (int r = row; r <= last; ++r) {
+            if (m_files.isDirectory(r)) {
+                --m_directoryRows;
+            }
+        }
+        m_files.remove(row, last - row + 1);
+        endRemoveRows();
+    }
+    
+    // Sorterade poster som hamnar i samma lucka sätts in som ett block
+    std::sort(inserted.begin(), inserted.end(), [](const FileInfo &a, const FileInfo &b) {
+        return FileEntryStore::lessThan(a.isDirectory, QStringView(a.fileName),
+                                        b.isDirectory, QStringView(b.fileName));
+    });
+    for (int i = 0; i < inserted.size();) {
+        const int row = m_files.lowerBound(first, inserted.at(i));
+        QVector<FileInfo> block;
+        do {
+            block.append(inserted.at(i));
+        } while (++i < inserted.size() && m_files.lowerBound(row, inserted.at(i)) == row);
+        
+        beginInsertRows(QModelIndex(), row, row + block.size() - 1);
+        for (const FileInfo &info : qAsConst(block)) {
+            if (info.isDirectory) {
+                ++m_directoryRows;
+            }
+        }
+        m_files.insert(row, block);
         endInsertRows();
     }
 }
 
+int FileModel::firstSortedRow() const
+{
+    return (!m_files.isEmpty() && m_files.nameView(0) == QLatin1String("..")) ? 1 : 0;
+}
+
+QHash<QString, FileInfo> FileModel::statEntries(const QString &path, const QStringList &names)
+{
+    // Namn som inte finns längre saknas i resultatet
+    QHash<QString, FileInfo> present;
+    const QDir dir(path);
+    for (const QString &name : names) {
+        const QFileInfo entry(dir.filePath(name));
+        if (entry.exists() || entry.isSymLink()) {
+            FileInfo info;
+            info.fileName = name;
+            info.filePath = entry.filePath();
+            info.isDirectory = entry.isDir();
+            info.fileSize = info.isDirectory ? 0 : entry.size(); // Kataloger har ingen storlek
+            info.fileDate = entry.lastModified();
+            present.insert(name, info);
+        }
+    }
+    return present;
+}
+
+int FileModel::cacheSize() const
+{
+    return m_dirCache.maxCost();
+}
+
+void FileModel::setCacheSize(int bytes)
+{
+    m_dirCache.setMaxCost(qMax(0, bytes));
+}
+
+int FileModel::cacheUsage() const
+{
+    return m_dirCache.totalCost();
+}
+
+int FileModel::cacheHits() const
+{
+    return m_cacheHits;
+}
+
+int FileModel::cacheMisses() const
+{
+    return m_cacheMisses;
+}
+
 void FileModel::refresh()
 {
     if (m_currentPath.isEmpty())
@@ -424,13 +810,11 @@ QVariantMap FileModel::get(int index) const
     if (index < 0 || index >= m_files.size())
         return result;
     
-    const FileInfo &info = m_files[index];
-    
-    result["fileName"] = info.fileName;
-    result["filePath"] = info.filePath;
-    result["fileSize"] = formatFileSize(info.fileSize);
-    result["fileDate"] = info.fileDate.toString("yyyy-MM-dd hh:mm");
-    result["isDirectory"] = info.isDirectory;
+    result["fileName"] = m_files.fileName(index);
+    result["filePath"] = m_files.filePath(index);
+    result["fileSize"] = formatFileSize(m_files.fileSize(index));
+    result["fileDate"] = m_files.fileDate(index).toString("yyyy-MM-dd hh:mm");
+    result["isDirectory"] = m_files.isDirectory(index);
     
     return result;
 }
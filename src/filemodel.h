@@ -11,17 +11,14 @@
 #include <QCache>
 #include <QVector>
 #include <QMutex>
+#include <QSet>
+#include <QStringList>
+#include <QAtomicInt>
 #include <QTimer>
+#include <functional>
+#include "fileentrystore.h"
 
-// Struktur för att hålla filinformation
-struct FileInfo {
-    QString fileName;
-    QString filePath;
-    qint64 fileSize;
-    QDateTime fileDate;
-    bool isDirectory;
-    // Lägg till fler attribut senare (t.ex. permissions)
-};
+class DirectoryWatcher;
 
 class FileModel : public QAbstractListModel
 {
@@ -58,6 +55,18 @@ public:
     Q_INVOKABLE bool renamePath(const QString &oldPath, const QString &newName);
     Q_INVOKABLE QVariantMap get(int index) const;
 
+    // Lägg till poster med en radinsättning för katalogerna och en för
+    // filerna; kataloger hamnar sist bland katalogerna, filer sist
+    void appendEntries(const QVector<FileInfo> &entries);
+
+    // Katalogcachen, budgeterad i byte; äldst använda kataloger tas bort
+    // först när budgeten är slut
+    int cacheSize() const;
+    void setCacheSize(int bytes);
+    int cacheUsage() const;
+    int cacheHits() const;
+    int cacheMisses() const;
+
     // Egenskapsmetoder
     QString currentPath() const;
     void setCurrentPath(const QString &path);
@@ -65,8 +74,19 @@ public:
     bool isLoading() const;
     bool hasMoreItems() const;
 
+    // Läs en katalog: först kataloger, sen filer, var för sig i namnordning.
+    // Trådsäker; används av SyncEngine
+    static QVector<FileInfo> readDirectory(const QString &path,
+                                           QDir::Filters filters = QDir::AllEntries | QDir::NoDotAndDotDot);
+
+    // Läs en katalog i omgångar utan att först bygga hela listan. sink får
+    // varje omgång i den ordning filsystemet ger posterna och returnerar
+    // false för att avbryta. Trådsäker
+    static bool streamDirectory(const QString &path, QDir::Filters filters,
+                                const std::function<bool(const QVector<FileInfo> &)> &sink);
+
     // Metoder som används av FileSystemTask
-    void listDirectoryTask(const QString &path);
+    void listDirectoryTask(const QString &path, int generation);
     void deletePathTask(const QString &path);
     void createDirectoryTask(const QString &basePath, const QString &name);
     void renamePathTask(const QString &oldPath, const QString &newPath);
@@ -81,24 +101,62 @@ private slots:
     void createDirectoryResult(bool success, const QString &errorMsg);
     void deletePathResult(bool success, const QString &errorMsg);
     void renamePathResult(bool success, const QString &errorMsg);
-    void addItem(const FileInfo &item, bool prepend = false);
 
 private:
     // Interna hjälpmetoder
     bool isRoot(const QString &path) const;
     QString formatFileSize(qint64 size) const;
-    void loadNextBatch(const QVector<FileInfo> &allFiles, int startIndex);
+    void enqueueBatch(int generation, const QVector<FileInfo> &batch);
+    void finishListing(int generation, const QString &path);
+    void insertPending();
+    void completeListing();
+    
+    // Ändringar från DirectoryWatcher
+    void onEntriesChanged(const QString &path, const QStringList &names);
+    void onDirectoryInvalidated(const QString &path);
+    void applyChangesToModel(const QStringList &names, const QHash<QString, FileInfo> &present);
+    int firstSortedRow() const;
+    static QHash<QString, FileInfo> statEntries(const QString &path, const QStringList &names);
 
     // Medlemsvariabler
-    QList<FileInfo> m_files;
+    FileEntryStore m_files;
     QString m_currentPath;
     bool m_isRemote;
     bool m_isLoading;
     bool m_hasMoreItems;
     QHash<int, QByteArray> m_roleNames;
     
-    // Cache för kataloglistningar
-    QCache<QString, QVector<FileInfo>> m_dirCache;
+    // Pågående listning; en ny navigering gör äldre listningar inaktuella
+    QAtomicInt m_listGeneration;
+    int m_directoryRows;    // Kataloger (och "..") ligger först i m_files
+    
+    // Lästa poster som väntar på att läggas in; en del per bildruta
+    QVector<FileInfo> m_pendingEntries;
+    int m_pendingOffset;
+    QTimer m_insertTimer;
+    int m_rowsPerFrame;     // Anpassas efter hur lång tid insättningarna tar
+    bool m_listingDone;     // Listningen är läst, bara m_pendingEntries återstår
+    QString m_listingPath;
+    
+    // Cache för kataloglistningar. Kostnaden är ungefärligt minne i byte.
+    // Katalogens ändringstid kontrolleras vid varje träff, så en katalog
+    // som fått eller tappat poster listas om
+    struct CachedDirectory {
+        FileEntryStore files;
+        qint64 modified = -1;   // Ms sedan epoch, -1 om tiden inte går att lita på
+    };
+    const CachedDirectory *cachedDirectory(const QString &path);
+    void insertIntoCache(const QString &path, CachedDirectory *cached);
+    static qint64 trustedModified(qint64 modified);
+    QCache<QString, CachedDirectory> m_dirCache;
+    int m_cacheHits;
+    int m_cacheMisses;
+    qint64 m_listingModified;   // Katalogens ändringstid när listningen började
+    
+    // Lokala kataloger i m_dirCache och den aktuella bevakas, så att
+    // ändringar blir enskilda rader i stället för en ny listning
+    DirectoryWatcher *m_watcher;
+    QSet<QString> m_deferredChanges;    // Namn som ändrats medan listningen pågår
     
     // Mutex för trådsäkerhet
     QMutex m_mutex;
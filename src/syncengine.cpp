@@ -0,0 +1,680 @@
+#include "syncengine.h"
+#include "filemodel.h"
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutexLocker>
+#include <QRunnable>
+#include <QThreadPool>
+#include <algorithm>
+#include <functional>
+
+// Standardantal samtidiga fjärrlistningar, samma som för TreeTransfer
+const int DEFAULT_MAX_LISTINGS = 4;
+
+// Ändringstider inom så många sekunder räknas som lika
+const int DEFAULT_TIME_TOLERANCE = 2;
+
+namespace {
+
+// QRunnable som kör en funktion; QRunnable::create() finns inte i äldre Qt5
+class FunctionTask : public QRunnable
+{
+public:
+    explicit FunctionTask(std::function<void()> function)
+        : m_function(std::move(function))
+    {
+    }
+
+    void run() override
+    {
+        m_function();
+    }
+
+private:
+    std::function<void()> m_function;
+};
+
+qint64 secondsSinceEpoch(const QDateTime &time)
+{
+    return time.isValid() ? time.toMSecsSinceEpoch() / 1000 : 0;
+}
+
+int pathDepth(const QString &path)
+{
+    return path.count('/');
+}
+
+} // namespace
+
+SyncEngine::SyncEngine(TransferQueue *queue, const QString &host, QObject *parent)
+    : QObject(parent)
+    , m_queue(queue)
+    , m_host(host)
+    , m_direction(MirrorToRemote)
+    , m_deleteExtraneous(false)
+    , m_dryRun(false)
+    , m_timeTolerance(DEFAULT_TIME_TOLERANCE)
+    , m_compareChecksums(false)
+    , m_cancelled(false)
+    , m_planning(false)
+    , m_finished(false)
+    , m_pool(QThreadPool::globalInstance())
+    , m_state(new WalkState)
+    , m_maxListings(DEFAULT_MAX_LISTINGS)
+{
+    m_state->owner = this;
+}
+
+SyncEngine::~SyncEngine()
+{
+    // Uppgifter som fortfarande körs får inte skicka resultat hit
+    QMutexLocker locker(&m_state->mutex);
+    m_state->owner = nullptr;
+}
+
+void SyncEngine::setDirection(Direction direction)
+{
+    m_direction = direction;
+}
+
+void SyncEngine::setDeleteExtraneous(bool enabled)
+{
+    m_deleteExtraneous = enabled;
+}
+
+void SyncEngine::setDryRun(bool enabled)
+{
+    m_dryRun = enabled;
+}
+
+void SyncEngine::setTimeTolerance(int seconds)
+{
+    m_timeTolerance = qMax(0, seconds);
+}
+
+void SyncEngine::setCompareChecksums(bool enabled)
+{
+    m_compareChecksums = enabled;
+}
+
+void SyncEngine::setMaxConcurrentListings(int count)
+{
+    m_maxListings = qMax(1, count);
+    startListings();
+}
+
+void SyncEngine::start(const QString &localRoot, const QString &remoteRoot)
+{
+    m_localRoot = QDir::cleanPath(localRoot);
+    m_remoteRoot = normalizePath(remoteRoot);
+    m_plan.clear();
+    m_planning = true;
+
+    visit(QString(), true, true);
+}
+
+void SyncEngine::cancel()
+{
+    if (m_finished) {
+        return;
+    }
+
+    m_cancelled = true;
+    {
+        QMutexLocker locker(&m_state->mutex);
+        m_state->owner = nullptr;
+    }
+
+    m_pending.clear();
+    m_activeListings.clear();
+    m_queuedListings.clear();
+    m_pendingChecksums.clear();
+    m_directoryLevels.clear();
+    m_requestedDirs.clear();
+    finish(0, 0);
+}
+
+bool SyncEngine::isFinished() const
+{
+    return m_finished;
+}
+
+const QList<SyncAction> &SyncEngine::plan() const
+{
+    return m_plan;
+}
+
+QString SyncEngine::describe(const SyncAction &action)
+{
+    QString text;
+    switch (action.type) {
+    case SyncAction::Upload:
+        text = tr("Ladda upp   %1 -> %2").arg(action.localPath, action.remotePath);
+        break;
+    case SyncAction::Download:
+        text = tr("Ladda ner   %1 -> %2").arg(action.remotePath, action.localPath);
+        break;
+    case SyncAction::CreateRemoteDir:
+        text = tr("Skapa       %1").arg(action.remotePath);
+        break;
+    case SyncAction::CreateLocalDir:
+        text = tr("Skapa       %1").arg(action.localPath);
+        break;
+    case SyncAction::DeleteRemote:
+        text = tr("Ta bort     %1").arg(action.remotePath);
+        break;
+    case SyncAction::DeleteLocal:
+        text = tr("Ta bort     %1").arg(action.localPath);
+        break;
+    }
+
+    if (!action.reason.isEmpty()) {
+        text += QString(" (%1)").arg(action.reason);
+    }
+    return text;
+}
+
+void SyncEngine::visit(const QString &relative, bool hasLocal, bool hasRemote)
+{
+    PendingDirectory &directory = m_pending[relative];
+    directory.localDone = !hasLocal;
+    directory.remoteDone = !hasRemote;
+
+    if (hasLocal) {
+        scanLocalDirectory(relative);
+    }
+    if (hasRemote) {
+        m_queuedListings.enqueue(relative);
+        startListings();
+    }
+}
+
+void SyncEngine::scanLocalDirectory(const QString &relative)
+{
+    const QString localDir = localPath(relative);
+
+    QSharedPointer<WalkState> state = m_state;
+    m_pool->start(new FunctionTask([state, relative, localDir]() {
+        QVector<Entry> entries;
+        QString errorString;
+
+        // En tom lista från en oläslig katalog får inte se ut som en tom katalog,
+        // då skulle allt på andra sidan tas bort eller kopieras
+        if (!QFileInfo(localDir).isReadable()) {
+            errorString = QObject::tr("Kunde inte läsa katalog: %1").arg(localDir);
+        } else {
+            const QVector<FileInfo> files = FileModel::readDirectory(
+                localDir, QDir::AllEntries | QDir::NoDotAndDotDot | QDir::Hidden | QDir::System);
+            entries.reserve(files.size());
+            for (const FileInfo &file : files) {
+                // Symboliska länkar till kataloger följs inte, de kan bilda slingor
+                if (file.isDirectory && QFileInfo(file.filePath).isSymLink()) {
+                    continue;
+                }
+                Entry entry;
+                entry.name = file.fileName;
+                entry.size = file.fileSize;
+                entry.modified = secondsSinceEpoch(file.fileDate);
+                entry.isDirectory = file.isDirectory;
+                entries.append(entry);
+            }
+            std::sort(entries.begin(), entries.end(), [](const Entry &a, const Entry &b) {
+                return a.name < b.name;
+            });
+        }
+
+        // Resultatet hanteras i huvudtråden
+        QMutexLocker locker(&state->mutex);
+        SyncEngine *owner = state->owner;
+        if (owner) {
+            QMetaObject::invokeMethod(owner, [owner, relative, entries, errorString]() {
+                owner->onLocalDirectoryScanned(relative, entries, errorString);
+            }, Qt::QueuedConnection);
+        }
+    }));
+}
+
+void SyncEngine::onLocalDirectoryScanned(const QString &relative, const QVector<Entry> &entries,
+                                         const QString &errorString)
+{
+    auto it = m_pending.find(relative);
+    if (m_cancelled || it == m_pending.end()) {
+        return;
+    }
+
+    if (!errorString.isEmpty()) {
+        it->failed = true;
+        emit walkError(localPath(relative), errorString);
+    }
+    it->local = entries;
+    it->localDone = true;
+
+    if (it->remoteDone) {
+        compareDirectory(relative);
+    }
+}
+
+void SyncEngine::startListings()
+{
+    while (!m_cancelled && m_activeListings.size() < m_maxListings && !m_queuedListings.isEmpty()) {
+        const QString relative = m_queuedListings.dequeue();
+        const QString remoteDir = remotePath(relative);
+        m_activeListings.insert(remoteDir, relative);
+        emit listRemoteDirectory(remoteDir);
+    }
+}
+
+void SyncEngine::onRemoteListingChunk(const QString &path, const QList<ServerFileItem> &items)
+{
+    if (m_cancelled) {
+        return;
+    }
+
+    auto listing = m_activeListings.constFind(normalizePath(path));
+    if (listing == m_activeListings.constEnd()) {
+        return;
+    }
+
+    PendingDirectory &directory = m_pending[listing.value()];
+    directory.remote.reserve(directory.remote.size() + items.size());
+    for (const ServerFileItem &item : items) {
+        if (item.name() == "." || item.name() == "..") {
+            continue;
+        }
+        Entry entry;
+        entry.name = item.name();
+        entry.size = item.isDirectory() ? 0 : item.size();
+        entry.modified = secondsSinceEpoch(item.lastModified());
+        entry.isDirectory = item.isDirectory();
+        directory.remote.append(entry);
+    }
+}
+
+void SyncEngine::onRemoteListingFinished(const QString &path, bool error, const QString &errorString)
+{
+    if (m_cancelled) {
+        return;
+    }
+
+    const QString remoteDir = normalizePath(path);
+    auto listing = m_activeListings.find(remoteDir);
+    if (listing == m_activeListings.end()) {
+        return;
+    }
+    const QString relative = listing.value();
+    m_activeListings.erase(listing);
+
+    auto it = m_pending.find(relative);
+    if (it == m_pending.end()) {
+        return;
+    }
+
+    if (error) {
+        it->failed = true;
+        emit walkError(remoteDir, errorString);
+    }
+
+    // Blocken kommer i serverns ordning; sorteringen görs en gång här
+    std::sort(it->remote.begin(), it->remote.end(), [](const Entry &a, const Entry &b) {
+        return a.name < b.name;
+    });
+    it->remoteDone = true;
+
+    startListings();
+    if (it->localDone) {
+        compareDirectory(relative);
+    }
+}
+
+void SyncEngine::compareDirectory(const QString &relative)
+{
+    const PendingDirectory directory = m_pending.take(relative);
+
+    if (!directory.failed) {
+        // Båda listorna är sorterade på namn, så en genomgång räcker
+        const QVector<Entry> &local = directory.local;
+        const QVector<Entry> &remote = directory.remote;
+        int i = 0;
+        int j = 0;
+        while (i < local.size() || j < remote.size()) {
+            if (j >= remote.size() || (i < local.size() && local[i].name < remote[j].name)) {
+                compareOnlyLocal(relative, local[i++]);
+            } else if (i >= local.size() || remote[j].name < local[i].name) {
+                compareOnlyRemote(relative, remote[j++]);
+            } else {
+                compareBoth(relative, local[i++], remote[j++]);
+            }
+        }
+    }
+
+    checkPlanned();
+}
+
+void SyncEngine::compareOnlyLocal(const QString &relative, const Entry &entry)
+{
+    if (m_direction == MirrorToLocal) {
+        if (m_deleteExtraneous) {
+            addAction(makeAction(SyncAction::DeleteLocal, relative, entry, tr("finns inte på servern")));
+        }
+        return;
+    }
+
+    if (entry.isDirectory) {
+        addAction(makeAction(SyncAction::CreateRemoteDir, relative, entry, tr("saknas på servern")));
+        visit(joinRelative(relative, entry.name), true, false);
+    } else {
+        addAction(makeAction(SyncAction::Upload, relative, entry, tr("saknas på servern")));
+    }
+}
+
+void SyncEngine::compareOnlyRemote(const QString &relative, const Entry &entry)
+{
+    if (m_direction == MirrorToRemote) {
+        if (m_deleteExtraneous) {
+            // En fjärrkatalog måste tömmas innan den kan tas bort, så den läses först
+            if (entry.isDirectory) {
+                visit(joinRelative(relative, entry.name), false, true);
+            }
+            addAction(makeAction(SyncAction::DeleteRemote, relative, entry, tr("finns inte lokalt")));
+        }
+        return;
+    }
+
+    if (entry.isDirectory) {
+        addAction(makeAction(SyncAction::CreateLocalDir, relative, entry, tr("saknas lokalt")));
+        visit(joinRelative(relative, entry.name), false, true);
+    } else {
+        addAction(makeAction(SyncAction::Download, relative, entry, tr("saknas lokalt")));
+    }
+}
+
+void SyncEngine::compareBoth(const QString &relative, const Entry &local, const Entry &remote)
+{
+    if (local.isDirectory && remote.isDirectory) {
+        visit(joinRelative(relative, local.name), true, true);
+        return;
+    }
+
+    if (local.isDirectory != remote.isDirectory) {
+        emit conflict(remotePath(joinRelative(relative, local.name)),
+                      tr("fil på ena sidan, katalog på den andra"));
+        return;
+    }
+
+    // Okänd tid på någon sida ger ingen vinnare; då avgör storleken ensam
+    const bool timesKnown = local.modified > 0 && remote.modified > 0;
+    const qint64 difference = timesKnown ? local.modified - remote.modified : 0;
+    const bool localNewer = difference > m_timeTolerance;
+    const bool remoteNewer = difference < -m_timeTolerance;
+    const bool sameSize = local.size == remote.size;
+
+    // Efter en överföring är målet alltid nyare än källan, eftersom tiden inte
+    // följer med. Speglingen kopierar därför bara när källan är nyare, och
+    // TwoWay litar på storleken så att en fil inte studsar fram och tillbaka.
+    SyncAction::Type type = SyncAction::Upload;
+    bool differs = false;
+    bool winner = true;
+    switch (m_direction) {
+    case MirrorToRemote:
+        type = SyncAction::Upload;
+        differs = !sameSize || localNewer;
+        break;
+    case MirrorToLocal:
+        type = SyncAction::Download;
+        differs = !sameSize || remoteNewer;
+        break;
+    case TwoWay:
+        type = remoteNewer ? SyncAction::Download : SyncAction::Upload;
+        winner = localNewer || remoteNewer;
+        differs = !sameSize;
+        break;
+    }
+
+    const QString reason = !sameSize ? tr("olika storlek")
+                         : (localNewer ? tr("nyare lokalt") : tr("nyare på servern"));
+
+    if (differs) {
+        if (winner) {
+            addAction(makeAction(type, relative, local, reason));
+        } else {
+            emit conflict(remotePath(joinRelative(relative, local.name)),
+                          tr("olika innehåll men ingen sida är nyare"));
+        }
+        return;
+    }
+
+    if (m_compareChecksums && sameSize) {
+        PendingChecksum pending;
+        pending.action = makeAction(type, relative, local, tr("olika kontrollsumma"));
+        pending.conflict = !winner;
+        m_pendingChecksums.insert(pending.action.remotePath, pending);
+        emit requestRemoteChecksum(pending.action.remotePath);
+    }
+}
+
+void SyncEngine::onRemoteChecksum(const QString &remotePath, FileHasher::Algorithm algorithm,
+                                  const QByteArray &digest)
+{
+    auto it = m_pendingChecksums.constFind(remotePath);
+    if (m_cancelled || it == m_pendingChecksums.constEnd()) {
+        return;
+    }
+
+    // Storlek och tid stämmer redan, så en summa som inte går att få räknas som lika
+    if (digest.isEmpty()) {
+        onChecksumCompared(remotePath, true);
+        return;
+    }
+
+    const QString localFile = it->action.localPath;
+    QSharedPointer<WalkState> state = m_state;
+    m_pool->start(new FunctionTask([state, remotePath, localFile, algorithm, digest]() {
+        const QByteArray localDigest = FileHasher::hashFile(localFile, algorithm);
+        const bool equal = localDigest.isEmpty() || localDigest == digest;
+
+        QMutexLocker locker(&state->mutex);
+        SyncEngine *owner = state->owner;
+        if (owner) {
+            QMetaObject::invokeMethod(owner, [owner, remotePath, equal]() {
+                owner->onChecksumCompared(remotePath, equal);
+            }, Qt::QueuedConnection);
+        }
+    }));
+}
+
+void SyncEngine::onChecksumCompared(const QString &remotePath, bool equal)
+{
+    auto it = m_pendingChecksums.find(remotePath);
+    if (m_cancelled || it == m_pendingChecksums.end()) {
+        return;
+    }
+
+    const PendingChecksum pending = *it;
+    m_pendingChecksums.erase(it);
+
+    if (!equal) {
+        if (pending.conflict) {
+            emit conflict(remotePath, tr("olika kontrollsumma men ingen sida är nyare"));
+        } else {
+            addAction(pending.action);
+        }
+    }
+
+    checkPlanned();
+}
+
+SyncAction SyncEngine::makeAction(SyncAction::Type type, const QString &relative, const Entry &entry,
+                                  const QString &reason) const
+{
+    const QString path = joinRelative(relative, entry.name);
+
+    SyncAction action;
+    action.type = type;
+    action.localPath = localPath(path);
+    action.remotePath = remotePath(path);
+    action.size = entry.size;
+    action.isDirectory = entry.isDirectory;
+    action.reason = reason;
+    return action;
+}
+
+void SyncEngine::addAction(const SyncAction &action)
+{
+    m_plan.append(action);
+}
+
+void SyncEngine::checkPlanned()
+{
+    if (!m_planning || m_cancelled || !m_pending.isEmpty() || !m_pendingChecksums.isEmpty()) {
+        return;
+    }
+
+    m_planning = false;
+    emit planReady(m_plan);
+
+    if (m_dryRun) {
+        finish(0, 0);
+    } else {
+        execute();
+    }
+}
+
+void SyncEngine::execute()
+{
+    // Lokala kataloger skapas direkt; fjärrkataloger en nivå i taget så att
+    // föräldern alltid finns när ett barn begärs
+    for (const SyncAction &action : qAsConst(m_plan)) {
+        if (action.type == SyncAction::CreateLocalDir) {
+            QDir().mkpath(action.localPath);
+        } else if (action.type == SyncAction::CreateRemoteDir) {
+            m_directoryLevels[pathDepth(action.remotePath)].append(action.remotePath);
+        }
+    }
+
+    createNextDirectoryLevel();
+}
+
+void SyncEngine::createNextDirectoryLevel()
+{
+    if (m_directoryLevels.isEmpty()) {
+        startTransfers();
+        return;
+    }
+
+    const QStringList dirs = m_directoryLevels.take(m_directoryLevels.firstKey());
+    for (const QString &dir : dirs) {
+        m_requestedDirs.insert(dir);
+    }
+    for (const QString &dir : dirs) {
+        emit createRemoteDirectory(dir);
+    }
+}
+
+void SyncEngine::onRemoteDirectoryReady(const QString &path)
+{
+    if (m_cancelled || !m_requestedDirs.remove(normalizePath(path))) {
+        return;
+    }
+
+    if (m_requestedDirs.isEmpty()) {
+        createNextDirectoryLevel();
+    }
+}
+
+void SyncEngine::startTransfers()
+{
+    QList<TransferRequest> requests;
+    QList<SyncAction> remoteDirDeletes;
+    int deletes = 0;
+
+    for (const SyncAction &action : qAsConst(m_plan)) {
+        switch (action.type) {
+        case SyncAction::Upload:
+        case SyncAction::Download: {
+            const bool upload = action.type == SyncAction::Upload;
+            TransferRequest request;
+            request.host = m_host;
+            request.isUpload = upload;
+            request.sourcePath = upload ? action.localPath : action.remotePath;
+            request.targetPath = upload ? action.remotePath : action.localPath;
+            request.size = action.size;
+            requests.append(request);
+            break;
+        }
+        case SyncAction::DeleteLocal:
+            if (action.isDirectory) {
+                QDir(action.localPath).removeRecursively();
+            } else {
+                QFile::remove(action.localPath);
+            }
+            ++deletes;
+            break;
+        case SyncAction::DeleteRemote:
+            // Filerna först; katalogerna när de är tomma
+            if (action.isDirectory) {
+                remoteDirDeletes.append(action);
+            } else {
+                emit deleteRemotePath(action.remotePath, false);
+                ++deletes;
+            }
+            break;
+        default:
+            break;
+        }
+    }
+
+    if (!requests.isEmpty()) {
+        m_queue->enqueueBatch(requests);
+    }
+
+    // Djupaste katalogerna först. Servern utför kommandona i den ordning
+    // de skickas, så filerna i en katalog är borta när den tas bort.
+    std::stable_sort(remoteDirDeletes.begin(), remoteDirDeletes.end(),
+                     [](const SyncAction &a, const SyncAction &b) {
+        return pathDepth(a.remotePath) > pathDepth(b.remotePath);
+    });
+    for (const SyncAction &action : qAsConst(remoteDirDeletes)) {
+        emit deleteRemotePath(action.remotePath, true);
+        ++deletes;
+    }
+
+    finish(requests.size(), deletes);
+}
+
+void SyncEngine::finish(int transfers, int deletes)
+{
+    if (m_finished) {
+        return;
+    }
+
+    m_finished = true;
+    emit finished(transfers, deletes);
+}
+
+QString SyncEngine::localPath(const QString &relative) const
+{
+    return relative.isEmpty() ? m_localRoot : QDir(m_localRoot).filePath(relative);
+}
+
+QString SyncEngine::remotePath(const QString &relative) const
+{
+    if (relative.isEmpty()) {
+        return m_remoteRoot;
+    }
+    return m_remoteRoot.endsWith('/') ? m_remoteRoot + relative : m_remoteRoot + '/' + relative;
+}
+
+QString SyncEngine::joinRelative(const QString &relative, const QString &name)
+{
+    return relative.isEmpty() ? name : relative + '/' + name;
+}
+
+QString SyncEngine::normalizePath(const QString &path)
+{
+    QString normalized = QDir::cleanPath(path);
+    if (normalized.isEmpty()) {
+        normalized = "/";
+    }
+    return normalized;
+}
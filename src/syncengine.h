@@ -0,0 +1,275 @@
+#ifndef SYNCENGINE_H
+#define SYNCENGINE_H
+
+#include <QObject>
+#include <QHash>
+#include <QList>
+#include <QMap>
+#include <QMutex>
+#include <QQueue>
+#include <QSet>
+#include <QSharedPointer>
+#include <QString>
+#include <QVector>
+#include "transferqueue.h"
+#include "../filehasher.h"
+#include "../serverfileitem.h"
+
+class QThreadPool;
+
+/**
+ * @brief En åtgärd i en synkroniseringsplan
+ */
+struct SyncAction {
+    enum Type {
+        Upload,
+        Download,
+        CreateRemoteDir,
+        CreateLocalDir,
+        DeleteRemote,
+        DeleteLocal
+    };
+
+    Type type = Upload;
+    QString localPath;
+    QString remotePath;
+    qint64 size = 0;
+    bool isDirectory = false;
+    QString reason;     ///< Varför åtgärden behövs, visas i torrkörningar
+};
+
+/**
+ * @brief Jämför en lokal katalog med en fjärrkatalog och gör dem lika
+ *
+ * Träden gås igenom katalog för katalog. Den lokala sidan läses med
+ * FileModel::readDirectory() på en QThreadPool, fjärrsidan med samma
+ * listningar som TreeTransfer använder. När båda sidorna av en katalog
+ * är lästa sorteras de på namn och slås ihop i ett svep (sorted merge
+ * join), så varje katalog kostar O(n log n) och bara de kataloger som
+ * håller på att jämföras ligger i minnet. Det räcker för träd med
+ * miljontals poster.
+ *
+ * Filer jämförs på storlek och ändringstid, och med setCompareChecksums()
+ * även på kontrollsumma när storleken är lika. Resultatet är en plan med
+ * så få åtgärder som möjligt. I torrkörning skickas bara planen ut; annars
+ * skapas kataloger först, sedan läggs alla överföringar i TransferQueue i
+ * ett svep och sist tas överflödiga filer bort.
+ *
+ * Precis som TreeTransfer pratar klassen inte själv med servern utan begär
+ * åtgärder med signaler och får svar via slotsen.
+ */
+class SyncEngine : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum Direction {
+        MirrorToRemote, ///< Fjärrkatalogen ska bli som den lokala
+        MirrorToLocal,  ///< Den lokala katalogen ska bli som fjärrkatalogen
+        TwoWay          ///< Det som saknas kopieras åt båda hållen, nyast vinner
+    };
+    Q_ENUM(Direction)
+
+    /**
+     * @brief Skapa en synkronisering
+     * @param queue Kön som överföringarna läggs i
+     * @param host Sessionsnyckel för kön, se TransferRequest::host
+     * @param parent Förälderobjekt
+     */
+    SyncEngine(TransferQueue *queue, const QString &host, QObject *parent = nullptr);
+    ~SyncEngine();
+
+    void setDirection(Direction direction);
+
+    /**
+     * @brief Ta bort filer som bara finns på målsidan
+     *
+     * Gäller bara speglingslägena; i TwoWay tas ingenting bort.
+     */
+    void setDeleteExtraneous(bool enabled);
+
+    /**
+     * @brief Bara räkna fram planen, utför ingenting
+     */
+    void setDryRun(bool enabled);
+
+    /**
+     * @brief Hur många sekunder ändringstiderna får skilja innan filerna räknas som olika
+     *
+     * FTP-listningar har ofta bara minutupplösning.
+     */
+    void setTimeTolerance(int seconds);
+
+    /**
+     * @brief Jämför kontrollsummor för filer med samma storlek
+     *
+     * Ägaren räknar fjärrfilens summa när requestRemoteChecksum() skickas och
+     * svarar med onRemoteChecksum(); den lokala filen räknas sedan med samma
+     * algoritm i en bakgrundstråd.
+     */
+    void setCompareChecksums(bool enabled);
+
+    /**
+     * @brief Ställ in hur många fjärrlistningar som får pågå samtidigt
+     * @param count Antal listningar (minst 1)
+     */
+    void setMaxConcurrentListings(int count);
+
+    /**
+     * @brief Börja jämföra två kataloger; båda måste finnas
+     * @param localRoot Lokal katalog
+     * @param remoteRoot Fjärrkatalog
+     */
+    void start(const QString &localRoot, const QString &remoteRoot);
+
+    /**
+     * @brief Avbryt jämförelsen eller utförandet
+     *
+     * Överföringar som redan ligger i kön påverkas inte.
+     */
+    void cancel();
+
+    bool isFinished() const;
+    const QList<SyncAction> &plan() const;
+
+    /**
+     * @brief En rad text som beskriver en åtgärd, för loggen
+     */
+    static QString describe(const SyncAction &action);
+
+public slots:
+    void onRemoteListingChunk(const QString &path, const QList<ServerFileItem> &items);
+    void onRemoteListingFinished(const QString &path, bool error, const QString &errorString);
+    void onRemoteDirectoryReady(const QString &path);
+
+    /**
+     * @brief Svar på requestRemoteChecksum()
+     * @param remotePath Fjärrfilen
+     * @param algorithm Algoritmen servern använde
+     * @param digest Summan, tom om servern inte kunde räkna den
+     */
+    void onRemoteChecksum(const QString &remotePath, FileHasher::Algorithm algorithm,
+                          const QByteArray &digest);
+
+signals:
+    void listRemoteDirectory(const QString &path);
+    void createRemoteDirectory(const QString &path);
+
+    /**
+     * @brief Ägaren ska ta bort en fjärrfil eller en tom fjärrkatalog
+     */
+    void deleteRemotePath(const QString &path, bool isDirectory);
+
+    /**
+     * @brief Ägaren ska räkna kontrollsumman för en fjärrfil med samma storlek som den lokala
+     */
+    void requestRemoteChecksum(const QString &remotePath);
+
+    /**
+     * @brief En katalog kunde inte läsas; den och allt under den hoppas över
+     */
+    void walkError(const QString &path, const QString &errorString);
+
+    /**
+     * @brief Två poster kunde inte jämkas ihop och hoppas över
+     */
+    void conflict(const QString &path, const QString &reason);
+
+    /**
+     * @brief Hela planen är framräknad
+     */
+    void planReady(const QList<SyncAction> &plan);
+
+    /**
+     * @brief Planen är utförd (eller bara framräknad vid torrkörning)
+     * @param transfers Antal överföringar som lades i kön
+     * @param deletes Antal borttagningar
+     */
+    void finished(int transfers, int deletes);
+
+private:
+    // En post på någon av sidorna, med tiden i sekunder sedan epoken (0 = okänd)
+    struct Entry {
+        QString name;
+        qint64 size = 0;
+        qint64 modified = 0;
+        bool isDirectory = false;
+    };
+
+    // En katalog vars sidor håller på att läsas
+    struct PendingDirectory {
+        bool localDone = false;
+        bool remoteDone = false;
+        bool failed = false;
+        QVector<Entry> local;
+        QVector<Entry> remote;
+    };
+
+    // En fil som väntar på svar från requestRemoteChecksum()
+    struct PendingChecksum {
+        SyncAction action;      // Utförs om summorna skiljer
+        bool conflict = false;  // Ingen sida är nyare; skiljer summorna är det en konflikt
+    };
+
+    // Delas med arbetsuppgifterna, se TreeTransfer::WalkState
+    struct WalkState {
+        QMutex mutex;
+        SyncEngine *owner = nullptr;
+    };
+
+    void visit(const QString &relative, bool hasLocal, bool hasRemote);
+    void scanLocalDirectory(const QString &relative);
+    void onLocalDirectoryScanned(const QString &relative, const QVector<Entry> &entries,
+                                 const QString &errorString);
+    void startListings();
+    void compareDirectory(const QString &relative);
+    void compareOnlyLocal(const QString &relative, const Entry &entry);
+    void compareOnlyRemote(const QString &relative, const Entry &entry);
+    void compareBoth(const QString &relative, const Entry &local, const Entry &remote);
+    void onChecksumCompared(const QString &remotePath, bool equal);
+    SyncAction makeAction(SyncAction::Type type, const QString &relative, const Entry &entry,
+                          const QString &reason) const;
+    void addAction(const SyncAction &action);
+    void checkPlanned();
+
+    void execute();
+    void createNextDirectoryLevel();
+    void startTransfers();
+    void finish(int transfers, int deletes);
+
+    QString localPath(const QString &relative) const;
+    QString remotePath(const QString &relative) const;
+    static QString joinRelative(const QString &relative, const QString &name);
+    static QString normalizePath(const QString &path);
+
+    TransferQueue *m_queue;
+    QString m_host;
+    Direction m_direction;
+    bool m_deleteExtraneous;
+    bool m_dryRun;
+    int m_timeTolerance;
+    bool m_compareChecksums;
+    bool m_cancelled;
+    bool m_planning;
+    bool m_finished;
+
+    QString m_localRoot;
+    QString m_remoteRoot;
+    QList<SyncAction> m_plan;
+
+    // Jämförelse: kataloger som läses (relativ sökväg -> status),
+    // fjärrlistningar som pågår eller väntar och kontrollsummor som väntar
+    QThreadPool *m_pool;
+    QSharedPointer<WalkState> m_state;
+    QHash<QString, PendingDirectory> m_pending;
+    QHash<QString, QString> m_activeListings;   // fjärrkatalog -> relativ sökväg
+    QQueue<QString> m_queuedListings;
+    int m_maxListings;
+    QHash<QString, PendingChecksum> m_pendingChecksums;  // fjärrfil -> väntande jämförelse
+
+    // Utförande: fjärrkataloger som skapas, en nivå i taget
+    QMap<int, QStringList> m_directoryLevels;
+    QSet<QString> m_requestedDirs;
+};
+
+#endif // SYNCENGINE_H
@@ -0,0 +1,311 @@
+#include "transferjournal.h"
+#include "../filehasher.h"
+#include <QDataStream>
+#include <QDebug>
+#include <QMap>
+#include <QSaveFile>
+#include <QVector>
+#include <QtEndian>
+
+#ifdef Q_OS_WIN
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+// Filen börjar med en magisk sträng och ett versionsnummer
+const char JOURNAL_MAGIC[] = "DFTJ";
+const char JOURNAL_VERSION = 1;
+const int JOURNAL_HEADER_SIZE = 5;
+
+// Postram: längd och CRC-32 för innehållet, båda little endian
+const int RECORD_HEADER_SIZE = 8;
+
+// Hur länge poster samlas innan de skrivs och synkas, och hur mycket som
+// får samlas innan de skrivs direkt
+const int FLUSH_INTERVAL_MS = 500;
+const int MAX_BUFFER_SIZE = 1024 * 1024;
+
+namespace {
+
+// Postinnehållet kodas med en fast version så att Qt5 och Qt6 läser samma fil
+void prepareStream(QDataStream &stream)
+{
+    stream.setVersion(QDataStream::Qt_5_0);
+}
+
+bool syncToDisk(QFile &file)
+{
+    if (!file.flush()) {
+        return false;
+    }
+#ifdef Q_OS_WIN
+    return _commit(file.handle()) == 0;
+#else
+    return ::fsync(file.handle()) == 0;
+#endif
+}
+
+} // namespace
+
+TransferJournal::TransferJournal(const QString &path, QObject *parent)
+    : QObject(parent)
+    , m_path(path)
+    , m_file(path)
+{
+    m_flushTimer.setSingleShot(true);
+    m_flushTimer.setInterval(FLUSH_INTERVAL_MS);
+    connect(&m_flushTimer, &QTimer::timeout, this, &TransferJournal::flush);
+}
+
+TransferJournal::~TransferJournal()
+{
+    flush();
+}
+
+QString TransferJournal::path() const
+{
+    return m_path;
+}
+
+QList<TransferJournal::Entry> TransferJournal::recover()
+{
+    QList<Entry> result;
+
+    QFile file(m_path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return result;
+    }
+    const QByteArray data = file.readAll();
+    if (data.size() < JOURNAL_HEADER_SIZE || !data.startsWith(JOURNAL_MAGIC)
+        || data.at(JOURNAL_HEADER_SIZE - 1) != JOURNAL_VERSION) {
+        qDebug() << "Okänd journalfil, ignoreras:" << m_path;
+        return result;
+    }
+
+    // Jobb-id ökar i den ordning jobben köades
+    QVector<QString> hosts;
+    QMap<int, Entry> entries;
+
+    int position = JOURNAL_HEADER_SIZE;
+    while (position + RECORD_HEADER_SIZE <= data.size()) {
+        const uchar *header = reinterpret_cast<const uchar *>(data.constData() + position);
+        const quint32 length = qFromLittleEndian<quint32>(header);
+        const quint32 crc = qFromLittleEndian<quint32>(header + 4);
+        if (length > quint32(data.size() - position - RECORD_HEADER_SIZE)) {
+            break; // Halvskriven post sist i filen
+        }
+        const uchar *payload = header + RECORD_HEADER_SIZE;
+        if (FileHasher::crc32(0, payload, length) != crc) {
+            break;
+        }
+        position += RECORD_HEADER_SIZE + int(length);
+
+        QDataStream stream(QByteArray::fromRawData(reinterpret_cast<const char *>(payload), int(length)));
+        prepareStream(stream);
+        quint8 type = 0;
+        qint32 jobId = 0;
+        stream >> type;
+
+        switch (type) {
+        case HostRecord: {
+            quint32 index = 0;
+            QString host;
+            stream >> index >> host;
+            if (index == quint32(hosts.size())) {
+                hosts.append(host);
+            }
+            break;
+        }
+        case EnqueueRecord: {
+            Entry entry;
+            quint32 host = 0;
+            qint32 priority = 0;
+            stream >> jobId >> host >> entry.request.isUpload >> entry.request.sourcePath
+                   >> entry.request.targetPath >> entry.request.size >> priority;
+            if (stream.status() == QDataStream::Ok && host < quint32(hosts.size())) {
+                entry.jobId = jobId;
+                entry.request.host = hosts.at(int(host));
+                entry.request.priority = priority;
+                entries.insert(jobId, entry);
+            }
+            break;
+        }
+        case ProgressRecord: {
+            qint64 transferred = 0;
+            stream >> jobId >> transferred;
+            auto it = entries.find(jobId);
+            if (it != entries.end()) {
+                it->transferred = transferred;
+            }
+            break;
+        }
+        case FinishedRecord:
+            stream >> jobId;
+            entries.remove(jobId);
+            break;
+        default:
+            break;
+        }
+    }
+
+    if (position < data.size()) {
+        qDebug() << "Journalen slutar med en skadad post efter" << position << "byte:" << m_path;
+    }
+
+    // Nya värdposter får index efter dem som redan finns i filen
+    m_hosts.clear();
+    for (int i = 0; i < hosts.size(); ++i) {
+        m_hosts.insert(hosts.at(i), quint32(i));
+    }
+
+    return entries.values();
+}
+
+void TransferJournal::recordEnqueued(int jobId, const TransferRequest &request)
+{
+    m_dirtyProgress.remove(jobId);
+    appendEnqueue(m_buffer, jobId, request);
+    scheduleFlush();
+}
+
+void TransferJournal::recordProgress(int jobId, qint64 bytesDone)
+{
+    // Skrivs först vid nästa flush, så bara det senaste värdet blir en post
+    m_dirtyProgress.insert(jobId, bytesDone);
+    if (!m_flushTimer.isActive()) {
+        m_flushTimer.start();
+    }
+}
+
+void TransferJournal::recordFinished(int jobId)
+{
+    m_dirtyProgress.remove(jobId);
+
+    QByteArray payload;
+    QDataStream stream(&payload, QIODevice::WriteOnly);
+    prepareStream(stream);
+    stream << quint8(FinishedRecord) << qint32(jobId);
+    appendRecord(m_buffer, payload);
+    scheduleFlush();
+}
+
+void TransferJournal::flush()
+{
+    m_flushTimer.stop();
+
+    for (auto it = m_dirtyProgress.constBegin(); it != m_dirtyProgress.constEnd(); ++it) {
+        appendProgress(m_buffer, it.key(), it.value());
+    }
+    m_dirtyProgress.clear();
+
+    if (m_buffer.isEmpty()) {
+        return;
+    }
+
+    if (!m_file.isOpen()) {
+        if (!m_file.open(QIODevice::WriteOnly | QIODevice::Append)) {
+            qDebug() << "Kunde inte öppna journalen:" << m_file.errorString();
+            m_buffer.clear();
+            return;
+        }
+        if (m_file.size() == 0) {
+            m_file.write(JOURNAL_MAGIC, JOURNAL_HEADER_SIZE - 1);
+            m_file.write(&JOURNAL_VERSION, 1);
+        }
+    }
+
+    if (m_file.write(m_buffer) != m_buffer.size() || !syncToDisk(m_file)) {
+        qDebug() << "Kunde inte skriva journalen:" << m_file.errorString();
+    }
+    m_buffer.clear();
+}
+
+bool TransferJournal::compact(const QList<Entry> &pending)
+{
+    // Det som samlats skrivs till den gamla filen först, så att inget går
+    // förlorat om den nya inte kan skrivas
+    flush();
+    m_file.close();
+
+    // Värdtabellen för den gamla filen behövs om den nya inte kan skrivas
+    const QHash<QString, quint32> previousHosts = m_hosts;
+    m_hosts.clear();
+
+    if (pending.isEmpty()) {
+        if (!QFile::exists(m_path) || QFile::remove(m_path)) {
+            return true;
+        }
+        m_hosts = previousHosts;
+        return false;
+    }
+
+    QByteArray data(JOURNAL_MAGIC, JOURNAL_HEADER_SIZE - 1);
+    data.append(JOURNAL_VERSION);
+    for (const Entry &entry : pending) {
+        appendEnqueue(data, entry.jobId, entry.request);
+        if (entry.transferred > 0) {
+            appendProgress(data, entry.jobId, entry.transferred);
+        }
+    }
+
+    QSaveFile file(m_path);
+    if (!file.open(QIODevice::WriteOnly) || file.write(data) != data.size() || !file.commit()) {
+        qWarning() << "Kunde inte komprimera journalen:" << file.errorString();
+        // Den gamla filen är orörd och fortsätter användas
+        m_hosts = previousHosts;
+        return false;
+    }
+    return true;
+}
+
+void TransferJournal::appendRecord(QByteArray &target, const QByteArray &payload)
+{
+    uchar header[RECORD_HEADER_SIZE];
+    qToLittleEndian(quint32(payload.size()), header);
+    qToLittleEndian(FileHasher::crc32(0, reinterpret_cast<const uchar *>(payload.constData()),
+                                      payload.size()), header + 4);
+    target.append(reinterpret_cast<const char *>(header), RECORD_HEADER_SIZE);
+    target.append(payload);
+}
+
+void TransferJournal::appendEnqueue(QByteArray &target, int jobId, const TransferRequest &request)
+{
+    // Alla jobb i en batch har samma värd, så den skrivs bara en gång
+    auto host = m_hosts.constFind(request.host);
+    if (host == m_hosts.constEnd()) {
+        const quint32 index = quint32(m_hosts.size());
+        host = m_hosts.insert(request.host, index);
+
+        QByteArray payload;
+        QDataStream stream(&payload, QIODevice::WriteOnly);
+        prepareStream(stream);
+        stream << quint8(HostRecord) << index << request.host;
+        appendRecord(target, payload);
+    }
+
+    QByteArray payload;
+    QDataStream stream(&payload, QIODevice::WriteOnly);
+    prepareStream(stream);
+    stream << quint8(EnqueueRecord) << qint32(jobId) << host.value() << request.isUpload
+           << request.sourcePath << request.targetPath << request.size << qint32(request.priority);
+    appendRecord(target, payload);
+}
+
+void TransferJournal::appendProgress(QByteArray &target, int jobId, qint64 bytesDone)
+{
+    QByteArray payload;
+    QDataStream stream(&payload, QIODevice::WriteOnly);
+    prepareStream(stream);
+    stream << quint8(ProgressRecord) << qint32(jobId) << bytesDone;
+    appendRecord(target, payload);
+}
+
+void TransferJournal::scheduleFlush()
+{
+    if (m_buffer.size() >= MAX_BUFFER_SIZE) {
+        flush();
+    } else if (!m_flushTimer.isActive()) {
+        m_flushTimer.start();
+    }
+}
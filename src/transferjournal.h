@@ -0,0 +1,99 @@
+#ifndef TRANSFERJOURNAL_H
+#define TRANSFERJOURNAL_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QFile>
+#include <QHash>
+#include <QList>
+#include <QString>
+#include <QTimer>
+#include "transferqueue.h"
+
+/**
+ * @brief Journal på disk över köade överföringar
+ *
+ * Varje ändring i TransferQueue läggs till sist i filen som en post: ett
+ * jobb köas, ett jobb har kommit en bit, ett jobb är klart. Efter en krasch
+ * eller ett strömavbrott spelas posterna upp vid nästa start och de jobb
+ * som inte blev klara läggs tillbaka i kön.
+ *
+ * Posterna buffras och skrivs med en enda fsync per intervall, så att
+ * tiotusentals filer i en batch inte väntar på disken en i taget. Framsteg
+ * slås ihop till en post per jobb och intervall. Varje post har längd och
+ * CRC-32, så en halvskriven post sist i filen upptäcks och hoppas över.
+ * Vid normal avslutning skrivs filen om med bara de jobb som återstår.
+ */
+class TransferJournal : public QObject
+{
+    Q_OBJECT
+
+public:
+    // Ett jobb som inte var klart när journalen skrevs
+    struct Entry {
+        int jobId = 0;
+        TransferRequest request;
+        qint64 transferred = 0;     // Senast sparade framsteg
+    };
+
+    /**
+     * @brief Skapa en journal
+     * @param path Journalfilen; katalogen måste finnas
+     * @param parent Förälderobjekt
+     */
+    explicit TransferJournal(const QString &path, QObject *parent = nullptr);
+    ~TransferJournal();
+
+    QString path() const;
+
+    /**
+     * @brief Läs journalen och hämta jobben som inte blev klara
+     *
+     * Läsningen slutar vid första skadade posten. Värdtabellen i filen
+     * sparas, så att nya poster kan läggas till efter de gamla.
+     * @return Jobben i den ordning de köades
+     */
+    QList<Entry> recover();
+
+    void recordEnqueued(int jobId, const TransferRequest &request);
+    void recordProgress(int jobId, qint64 bytesDone);
+    void recordFinished(int jobId);
+
+    /**
+     * @brief Skriv buffrade poster och vänta tills de ligger på disken
+     */
+    void flush();
+
+    /**
+     * @brief Ersätt journalen med en som bara innehåller de givna jobben
+     *
+     * Den nya filen skrivs bredvid och byter plats med den gamla i ett
+     * steg, så journalen är hel även om programmet dör under tiden.
+     * @return false om filen inte kunde skrivas; den gamla finns då kvar
+     *         och nya poster läggs till sist i den som vanligt
+     */
+    bool compact(const QList<Entry> &pending);
+
+private:
+    enum RecordType {
+        HostRecord = 1,     // Värdnyckel som senare poster hänvisar till med index
+        EnqueueRecord,
+        ProgressRecord,
+        FinishedRecord
+    };
+
+    // Posterna läggs i target, som är bufferten eller en ny fil vid komprimering
+    static void appendRecord(QByteArray &target, const QByteArray &payload);
+    void appendEnqueue(QByteArray &target, int jobId, const TransferRequest &request);
+    static void appendProgress(QByteArray &target, int jobId, qint64 bytesDone);
+    void scheduleFlush();
+
+    QString m_path;
+    QFile m_file;
+    QByteArray m_buffer;
+    QHash<int, qint64> m_dirtyProgress;     // Framsteg som ännu inte skrivits
+    QHash<QString, quint32> m_hosts;        // Värdnycklar som redan finns i filen
+    QTimer m_flushTimer;
+};
+
+#endif // TRANSFERJOURNAL_H
@@ -0,0 +1,1059 @@
+#include "transferqueue.h"
+#include "transferjournal.h"
+#include <QFileInfo>
+#include <QMutexLocker>
+#include <QRunnable>
+#include <QThreadPool>
+#include <QTimer>
+#include <QVariantList>
+#include <algorithm>
+#include <functional>
+
+// Standardtak: totalt och per värd
+const int DEFAULT_MAX_CONCURRENT = 4;
+const int DEFAULT_MAX_PER_HOST = 2;
+
+// Små filer: hur många som får pågå per värd och var gränsen går
+const int DEFAULT_MAX_SMALL_PER_HOST = 32;
+const qint64 DEFAULT_SMALL_FILE_SIZE = 64 * 1024;
+
+// Hur många väntande jobb per värd startTransfers() letar förbi efter jobb
+// som får starta, så att en lång kö inte gås igenom vid varje start
+const int SMALL_LANE_LOOKAHEAD = 256;
+
+// Vyn uppdateras med 10 Hz
+const int DEFAULT_PROGRESS_INTERVAL_MS = 100;
+
+namespace {
+
+// QRunnable som kör en funktion; QRunnable::create() finns inte i äldre Qt5
+class FunctionTask : public QRunnable
+{
+public:
+    explicit FunctionTask(std::function<void()> function)
+        : m_function(std::move(function))
+    {
+    }
+
+    void run() override
+    {
+        m_function();
+    }
+
+private:
+    std::function<void()> m_function;
+};
+
+QString formatFileSize(qint64 size)
+{
+    const qint64 KB = 1024;
+    const qint64 MB = KB * 1024;
+    const qint64 GB = MB * 1024;
+
+    if (size < KB) {
+        return QString("%1 B").arg(size);
+    } else if (size < MB) {
+        return QString("%1 KB").arg(size / (double)KB, 0, 'f', 1);
+    } else if (size < GB) {
+        return QString("%1 MB").arg(size / (double)MB, 0, 'f', 1);
+    } else {
+        return QString("%1 GB").arg(size / (double)GB, 0, 'f', 1);
+    }
+}
+
+QString formatDuration(qint64 seconds)
+{
+    if (seconds < 60) {
+        return QString("%1s").arg(seconds);
+    } else if (seconds < 3600) {
+        return QString("%1m %2s").arg(seconds / 60).arg(seconds % 60);
+    } else {
+        return QString("%1h %2m").arg(seconds / 3600).arg((seconds % 3600) / 60);
+    }
+}
+
+} // namespace
+
+TransferQueue::TransferQueue(QObject *parent)
+    : QAbstractListModel(parent)
+    , m_running(0)
+    , m_runningSmall(0)
+    , m_maxConcurrent(DEFAULT_MAX_CONCURRENT)
+    , m_maxPerHost(DEFAULT_MAX_PER_HOST)
+    , m_maxSmallPerHost(DEFAULT_MAX_SMALL_PER_HOST)
+    , m_smallFileSize(DEFAULT_SMALL_FILE_SIZE)
+    , m_paused(false)
+    , m_startScheduled(false)
+    , m_idle(true)
+    , m_nextId(0)
+    , m_journal(nullptr)
+    , m_statisticsPool(new QThreadPool(this))
+    , m_statistics(new StatisticsState)
+    , m_statisticsPending(false)
+    , m_overallProgress(0.0)
+    , m_totalBytesPerSecond(0)
+    , m_remainingBytes(0)
+{
+    // En egen tråd, så att uträkningen inte köar bakom träd- och synkgenomgångar
+    // på den globala poolen; omgångarna körs ändå en i taget
+    m_statisticsPool->setMaxThreadCount(1);
+    m_statistics->owner = this;
+    m_progressTimer.setInterval(DEFAULT_PROGRESS_INTERVAL_MS);
+    connect(&m_progressTimer, &QTimer::timeout, this, &TransferQueue::publishProgress);
+    m_progressClock.start();
+
+    // Samma rollnamn som exempelmodellen i TransferPanel.qml
+    m_roleNames[JobIdRole] = "jobId";
+    m_roleNames[FileNameRole] = "fileName";
+    m_roleNames[SourceFileRole] = "sourceFile";
+    m_roleNames[TargetFileRole] = "targetFile";
+    m_roleNames[FileSizeRole] = "fileSize";
+    m_roleNames[TransferProgressRole] = "transferProgress";
+    m_roleNames[TransferSpeedRole] = "transferSpeed";
+    m_roleNames[TimeRemainingRole] = "timeRemaining";
+    m_roleNames[IsUploadRole] = "isUpload";
+    m_roleNames[StatusRole] = "status";
+    m_roleNames[StatusCodeRole] = "statusCode";
+    m_roleNames[PriorityRole] = "priority";
+    m_roleNames[HostRole] = "host";
+    m_roleNames[ErrorStringRole] = "errorString";
+    m_roleNames[CurrentSpeedRole] = "currentSpeed";
+    m_roleNames[AverageSpeedRole] = "averageSpeed";
+    m_roleNames[SecondsRemainingRole] = "secondsRemaining";
+    m_roleNames[StalledRole] = "stalled";
+    m_roleNames[SpeedHistoryRole] = "speedHistory";
+}
+
+TransferQueue::~TransferQueue()
+{
+    // En uträkning som pågår får inte skicka tillbaka sitt resultat
+    QMutexLocker locker(&m_statistics->mutex);
+    m_statistics->owner = nullptr;
+}
+
+int TransferQueue::rowCount(const QModelIndex &parent) const
+{
+    if (parent.isValid()) {
+        return 0;
+    }
+    return m_jobs.size();
+}
+
+QVariant TransferQueue::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid() || index.row() < 0 || index.row() >= m_jobs.size())
+        return QVariant();
+
+    const TransferJob &job = m_jobs.at(index.row());
+
+    switch (role) {
+        case JobIdRole:
+            return job.id;
+        case FileNameRole:
+            return QFileInfo(job.sourcePath).fileName();
+        case SourceFileRole:
+            return job.sourcePath;
+        case TargetFileRole:
+            return job.targetPath;
+        case FileSizeRole:
+            return job.size < 0 ? QString() : formatFileSize(job.size);
+        case TransferProgressRole:
+            if (job.status == Completed) {
+                return 1.0;
+            }
+            return job.size > 0 ? qBound(0.0, double(job.transferred) / double(job.size), 1.0) : 0.0;
+        case TransferSpeedRole:
+            return formatFileSize(job.bytesPerSecond) + "/s";
+        case TimeRemainingRole:
+            if (job.status == Queued) {
+                return tr("Väntar");
+            }
+            if (job.status == Running && job.stalled) {
+                return tr("Står still");
+            }
+            if (job.status == Running && job.secondsRemaining >= 0) {
+                return formatDuration(job.secondsRemaining);
+            }
+            return QString();
+        case IsUploadRole:
+            return job.isUpload;
+        case StatusRole:
+            switch (job.status) {
+                case Queued: return tr("I kö");
+                case Running: return tr("Pågår");
+                case Paused: return tr("Pausad");
+                case Completed: return tr("Klar");
+                case Failed: return tr("Misslyckad");
+                case Cancelled: return tr("Avbruten");
+            }
+            return QVariant();
+        case StatusCodeRole:
+            return int(job.status);
+        case PriorityRole:
+            return job.priority;
+        case HostRole:
+            return job.host;
+        case ErrorStringRole:
+            return job.errorString;
+        case CurrentSpeedRole:
+            return job.bytesPerSecond;
+        case AverageSpeedRole:
+            return job.averageSpeed;
+        case SecondsRemainingRole:
+            return job.secondsRemaining;
+        case StalledRole:
+            return job.stalled;
+        case SpeedHistoryRole: {
+            QVariantList history;
+            history.reserve(job.speedHistory.size());
+            for (qint64 speed : job.speedHistory) {
+                history.append(speed);
+            }
+            return history;
+        }
+        default:
+            return QVariant();
+    }
+}
+
+QHash<int, QByteArray> TransferQueue::roleNames() const
+{
+    return m_roleNames;
+}
+
+int TransferQueue::enqueue(const QString &host, bool isUpload, const QString &sourcePath,
+                           const QString &targetPath, qint64 size, int priority)
+{
+    TransferRequest request;
+    request.host = host;
+    request.isUpload = isUpload;
+    request.sourcePath = sourcePath;
+    request.targetPath = targetPath;
+    request.size = size;
+    request.priority = priority;
+    return enqueueBatch({ request }).value(0);
+}
+
+QList<int> TransferQueue::enqueueBatch(const QList<TransferRequest> &requests)
+{
+    QList<int> ids;
+    if (requests.isEmpty()) {
+        return ids;
+    }
+
+    const int first = m_jobs.size();
+    beginInsertRows(QModelIndex(), first, first + requests.size() - 1);
+    m_jobs.reserve(first + requests.size());
+    for (const TransferRequest &request : requests) {
+        TransferJob job;
+        job.id = ++m_nextId;
+        job.host = request.host;
+        job.isUpload = request.isUpload;
+        job.sourcePath = request.sourcePath;
+        job.targetPath = request.targetPath;
+        job.size = request.size;
+        job.priority = qBound(int(LowPriority), request.priority, int(HighPriority));
+
+        m_rowById.insert(job.id, m_jobs.size());
+        m_waiting[job.priority][job.host].enqueue(job.id);
+        journalEnqueued(job);
+        m_jobs.append(job);
+        ids.append(job.id);
+    }
+    endInsertRows();
+
+    emit countChanged();
+    scheduleStart();
+    return ids;
+}
+
+void TransferQueue::pause(int jobId)
+{
+    int row = rowForId(jobId);
+    if (row < 0) {
+        return;
+    }
+
+    Status status = m_jobs.at(row).status;
+    if (status == Running) {
+        m_jobs[row].aborting = true;
+        setStatus(row, Paused);
+        emit abortTransfer(jobId);
+    } else if (status == Queued) {
+        setStatus(row, Paused);
+    }
+}
+
+void TransferQueue::resume(int jobId)
+{
+    int row = rowForId(jobId);
+    if (row < 0 || m_jobs.at(row).status != Paused) {
+        return;
+    }
+
+    TransferJob &job = m_jobs[row];
+    m_waiting[job.priority][job.host].enqueue(job.id);
+    setStatus(row, Queued);
+    scheduleStart();
+}
+
+void TransferQueue::cancel(int jobId)
+{
+    int row = rowForId(jobId);
+    if (row < 0) {
+        return;
+    }
+
+    Status status = m_jobs.at(row).status;
+    if (status == Running) {
+        m_jobs[row].aborting = true;
+        setStatus(row, Cancelled);
+        emit abortTransfer(jobId);
+    } else if (status == Queued || status == Paused) {
+        setStatus(row, Cancelled);
+    }
+}
+
+void TransferQueue::retry(int jobId)
+{
+    int row = rowForId(jobId);
+    if (row < 0) {
+        return;
+    }
+
+    TransferJob &job = m_jobs[row];
+    if (job.status != Failed && job.status != Cancelled) {
+        return;
+    }
+
+    job.transferred = 0;
+    job.errorString.clear();
+    journalEnqueued(job);
+    m_waiting[job.priority][job.host].enqueue(job.id);
+    setStatus(row, Queued);
+    scheduleStart();
+}
+
+void TransferQueue::setPriority(int jobId, int priority)
+{
+    int row = rowForId(jobId);
+    if (row < 0) {
+        return;
+    }
+
+    TransferJob &job = m_jobs[row];
+    priority = qBound(int(LowPriority), priority, int(HighPriority));
+    if (job.priority == priority) {
+        return;
+    }
+
+    job.priority = priority;
+    if (job.status == Queued || job.status == Running || job.status == Paused) {
+        journalEnqueued(job);
+    }
+    // Det gamla köentryt blir kvar och hoppas över i startTransfers()
+    if (job.status == Queued) {
+        m_waiting[priority][job.host].enqueue(job.id);
+        scheduleStart();
+    }
+    emitRowChanged(row);
+}
+
+void TransferQueue::pauseAll()
+{
+    setPaused(true);
+    for (int row = 0; row < m_jobs.size(); ++row) {
+        if (m_jobs.at(row).status == Running || m_jobs.at(row).status == Queued) {
+            pause(m_jobs.at(row).id);
+        }
+    }
+}
+
+void TransferQueue::resumeAll()
+{
+    for (int row = 0; row < m_jobs.size(); ++row) {
+        if (m_jobs.at(row).status == Paused) {
+            resume(m_jobs.at(row).id);
+        }
+    }
+    setPaused(false);
+}
+
+void TransferQueue::cancelAll()
+{
+    for (int row = 0; row < m_jobs.size(); ++row) {
+        cancel(m_jobs.at(row).id);
+    }
+    m_waiting.clear();
+}
+
+void TransferQueue::clearFinished()
+{
+    // Ta bort sammanhängande intervall bakifrån så att radnumren håller
+    int row = m_jobs.size() - 1;
+    bool removed = false;
+    while (row >= 0) {
+        // Avbrutna jobb som fortfarande håller en plats får ligga kvar
+        auto finished = [this](int row) {
+            const TransferJob &job = m_jobs.at(row);
+            return job.status == Completed || (job.status == Cancelled && !job.aborting);
+        };
+        if (!finished(row)) {
+            --row;
+            continue;
+        }
+
+        int last = row;
+        while (row >= 0 && finished(row)) {
+            --row;
+        }
+        beginRemoveRows(QModelIndex(), row + 1, last);
+        m_jobs.remove(row + 1, last - row);
+        endRemoveRows();
+        removed = true;
+    }
+
+    if (removed) {
+        rebuildIndex();
+        emit countChanged();
+    }
+}
+
+int TransferQueue::progressInterval() const
+{
+    return m_progressTimer.interval();
+}
+
+void TransferQueue::setProgressInterval(int msecs)
+{
+    msecs = qMax(1, msecs);
+    if (msecs == m_progressTimer.interval()) {
+        return;
+    }
+    m_progressTimer.setInterval(msecs);
+    emit limitsChanged();
+}
+
+double TransferQueue::overallProgress() const
+{
+    return m_overallProgress;
+}
+
+qint64 TransferQueue::totalBytesPerSecond() const
+{
+    return m_totalBytesPerSecond;
+}
+
+QString TransferQueue::totalSpeed() const
+{
+    return formatFileSize(m_totalBytesPerSecond) + "/s";
+}
+
+QString TransferQueue::totalTimeRemaining() const
+{
+    if (m_totalBytesPerSecond <= 0 || m_remainingBytes <= 0) {
+        return QString();
+    }
+    return formatDuration(m_remainingBytes / m_totalBytesPerSecond);
+}
+
+int TransferQueue::activeCount() const
+{
+    return m_running;
+}
+
+bool TransferQueue::isPaused() const
+{
+    return m_paused;
+}
+
+void TransferQueue::setPaused(bool paused)
+{
+    if (m_paused == paused) {
+        return;
+    }
+
+    m_paused = paused;
+    emit pausedChanged();
+    if (!paused) {
+        scheduleStart();
+    }
+}
+
+int TransferQueue::maxConcurrent() const
+{
+    return m_maxConcurrent;
+}
+
+void TransferQueue::setMaxConcurrent(int limit)
+{
+    limit = qMax(0, limit);
+    if (m_maxConcurrent == limit) {
+        return;
+    }
+
+    m_maxConcurrent = limit;
+    emit limitsChanged();
+    scheduleStart();
+}
+
+int TransferQueue::maxPerHost() const
+{
+    return m_maxPerHost;
+}
+
+void TransferQueue::setMaxPerHost(int limit)
+{
+    limit = qMax(0, limit);
+    if (m_maxPerHost == limit) {
+        return;
+    }
+
+    m_maxPerHost = limit;
+    emit limitsChanged();
+    scheduleStart();
+}
+
+void TransferQueue::setHostLimit(const QString &host, int limit)
+{
+    if (limit < 0) {
+        m_hostLimits.remove(host);
+    } else {
+        m_hostLimits.insert(host, limit);
+    }
+    scheduleStart();
+}
+
+void TransferQueue::holdHost(const QString &host)
+{
+    m_heldHosts.insert(host);
+}
+
+void TransferQueue::releaseHost(const QString &host)
+{
+    if (m_heldHosts.remove(host)) {
+        scheduleStart();
+    }
+}
+
+int TransferQueue::maxSmallPerHost() const
+{
+    return m_maxSmallPerHost;
+}
+
+void TransferQueue::setMaxSmallPerHost(int limit)
+{
+    limit = qMax(0, limit);
+    if (m_maxSmallPerHost == limit) {
+        return;
+    }
+
+    m_maxSmallPerHost = limit;
+    emit limitsChanged();
+    scheduleStart();
+}
+
+qint64 TransferQueue::smallFileSize() const
+{
+    return m_smallFileSize;
+}
+
+void TransferQueue::setSmallFileSize(qint64 size)
+{
+    size = qMax<qint64>(0, size);
+    if (m_smallFileSize == size) {
+        return;
+    }
+
+    m_smallFileSize = size;
+    scheduleStart();
+}
+
+TransferQueue::Status TransferQueue::status(int jobId) const
+{
+    int row = rowForId(jobId);
+    return row < 0 ? Cancelled : m_jobs.at(row).status;
+}
+
+int TransferQueue::setJournal(TransferJournal *journal)
+{
+    m_journal = journal;
+    if (!journal) {
+        return 0;
+    }
+
+    const QList<TransferJournal::Entry> entries = journal->recover();
+
+    // Jobb som redan finns i journalen med rätt id behöver inte skrivas igen
+    QSet<int> journaled;
+    for (const TransferJournal::Entry &entry : entries) {
+        m_nextId = qMax(m_nextId, entry.jobId);
+    }
+    if (!entries.isEmpty()) {
+        const int first = m_jobs.size();
+        beginInsertRows(QModelIndex(), first, first + entries.size() - 1);
+        m_jobs.reserve(first + entries.size());
+        for (const TransferJournal::Entry &entry : entries) {
+            TransferJob job;
+            job.id = m_rowById.contains(entry.jobId) ? ++m_nextId : entry.jobId;
+            if (job.id == entry.jobId) {
+                journaled.insert(job.id);
+            }
+            job.host = entry.request.host;
+            job.isUpload = entry.request.isUpload;
+            job.sourcePath = entry.request.sourcePath;
+            job.targetPath = entry.request.targetPath;
+            job.size = entry.request.size;
+            job.transferred = entry.transferred;
+            job.priority = qBound(int(LowPriority), entry.request.priority, int(HighPriority));
+            job.status = Paused;
+            job.restored = true;
+
+            m_rowById.insert(job.id, m_jobs.size());
+            m_jobs.append(job);
+        }
+        endInsertRows();
+        emit countChanged();
+    }
+
+    // Går journalen inte att skriva om fortsätter den gamla att gälla; jobb
+    // som inte finns där under sitt id läggs då till sist i den
+    if (!compactJournal()) {
+        for (const TransferJob &job : qAsConst(m_jobs)) {
+            if (!journaled.contains(job.id)
+                && (job.status == Queued || job.status == Running || job.status == Paused)) {
+                journalEnqueued(job);
+                if (job.transferred > 0) {
+                    m_journal->recordProgress(job.id, job.transferred);
+                }
+            }
+        }
+    }
+    return entries.size();
+}
+
+void TransferQueue::resumeRestored(const QString &host)
+{
+    for (int row = 0; row < m_jobs.size(); ++row) {
+        TransferJob &job = m_jobs[row];
+        if (job.restored && job.host == host) {
+            job.restored = false;
+            resume(job.id);
+        }
+    }
+}
+
+bool TransferQueue::compactJournal()
+{
+    if (!m_journal) {
+        return true;
+    }
+
+    QList<TransferJournal::Entry> pending;
+    for (const TransferJob &job : qAsConst(m_jobs)) {
+        if (job.status != Queued && job.status != Running && job.status != Paused) {
+            continue;
+        }
+        TransferJournal::Entry entry;
+        entry.jobId = job.id;
+        entry.request = requestFor(job);
+        entry.transferred = job.transferred;
+        pending.append(entry);
+    }
+    return m_journal->compact(pending);
+}
+
+void TransferQueue::reportProgress(int jobId, qint64 bytesDone, qint64 bytesTotal)
+{
+    int row = rowForId(jobId);
+    if (row < 0 || m_jobs.at(row).status != Running) {
+        return;
+    }
+
+    TransferJob &job = m_jobs[row];
+    job.transferred = bytesDone;
+    if (bytesTotal > 0) {
+        job.size = bytesTotal;
+    }
+    job.progressDirty = true;
+    if (m_journal) {
+        m_journal->recordProgress(jobId, bytesDone);
+    }
+}
+
+void TransferQueue::reportFinished(int jobId, bool error, const QString &errorString)
+{
+    int row = rowForId(jobId);
+    if (row < 0) {
+        return;
+    }
+
+    // Ett avbrutet jobb har redan fått sin status; nu är platsen ledig
+    if (m_jobs.at(row).aborting) {
+        releaseSlot(m_jobs[row]);
+        scheduleStart();
+        return;
+    }
+    if (m_jobs.at(row).status != Running) {
+        return;
+    }
+
+    TransferJob &job = m_jobs[row];
+    job.errorString = errorString;
+    if (!error && job.size >= 0) {
+        job.transferred = job.size;
+    }
+    setStatus(row, error ? Failed : Completed);
+
+    emit transferFinished(jobId, error, errorString);
+    scheduleStart();
+}
+
+void TransferQueue::requeue(int jobId)
+{
+    int row = rowForId(jobId);
+    if (row < 0) {
+        return;
+    }
+
+    // Pausat eller avbrutet medan det körde; bara platsen släpps
+    TransferJob &job = m_jobs[row];
+    if (job.aborting) {
+        releaseSlot(job);
+        scheduleStart();
+        return;
+    }
+    if (job.status != Running) {
+        return;
+    }
+
+    // Först i värdens kö, så att jobbet fortsätter före dem som köades efter
+    m_waiting[job.priority][job.host].prepend(job.id);
+    setStatus(row, Queued);
+    scheduleStart();
+}
+
+void TransferQueue::scheduleStart()
+{
+    // Samla ihop ändringar från samma händelse till en schemaläggning
+    if (m_startScheduled) {
+        return;
+    }
+
+    m_startScheduled = true;
+    QTimer::singleShot(0, this, &TransferQueue::startTransfers);
+}
+
+void TransferQueue::startTransfers()
+{
+    m_startScheduled = false;
+
+    QList<int> started;
+    if (!m_paused) {
+        // Högsta prioritet först; inom en prioritet turas värdarna om
+        for (auto priority = m_waiting.end(); priority != m_waiting.begin();) {
+            --priority;
+            QMap<QString, QQueue<int>> &hosts = priority.value();
+
+            for (auto host = hosts.begin(); host != hosts.end();) {
+                QQueue<int> &queue = host.value();
+                // Ett jobb som inte får starta hindrar bara jobb av samma
+                // slag bakom sig; små filer har egna platser och letas upp
+                // förbi en stor fil som väntar, men bara en bit in i kön
+                bool largeBlocked = false;
+                bool smallBlocked = false;
+                int skipped = 0;
+                for (int i = 0; i < queue.size() && skipped < SMALL_LANE_LOOKAHEAD;) {
+                    // Jobbet kan ha pausats, avbrutits eller fått en annan prioritet
+                    int row = rowForId(queue.at(i));
+                    if (row < 0 || m_jobs.at(row).status != Queued
+                        || m_jobs.at(row).priority != priority.key()) {
+                        queue.removeAt(i);
+                        continue;
+                    }
+
+                    const TransferJob &job = m_jobs.at(row);
+                    bool &blocked = isSmall(job) ? smallBlocked : largeBlocked;
+                    if (!blocked && !job.aborting && !canStart(job)) {
+                        blocked = true;
+                    }
+                    // Ett aborting-jobb väntar på att den förra överföringen
+                    // ska sluta och hoppas bara över
+                    if (blocked || job.aborting) {
+                        if (largeBlocked && smallBlocked) {
+                            break;
+                        }
+                        ++i;
+                        ++skipped;
+                        continue;
+                    }
+
+                    queue.removeAt(i);
+                    started.append(job.id);
+                    setStatus(row, Running);
+                }
+
+                if (queue.isEmpty()) {
+                    host = hosts.erase(host);
+                } else {
+                    ++host;
+                }
+            }
+        }
+
+        for (auto priority = m_waiting.begin(); priority != m_waiting.end();) {
+            if (priority.value().isEmpty()) {
+                priority = m_waiting.erase(priority);
+            } else {
+                ++priority;
+            }
+        }
+    }
+
+    // Signalerna skickas först när köstrukturerna är klara, eftersom
+    // mottagaren kan rapportera tillbaka direkt
+    for (int jobId : started) {
+        int row = rowForId(jobId);
+        if (row < 0 || m_jobs.at(row).status != Running) {
+            continue;
+        }
+        const TransferJob &job = m_jobs.at(row);
+        emit startTransfer(job.id, job.host, job.isUpload, job.sourcePath, job.targetPath);
+    }
+
+    if (m_running == 0 && m_waiting.isEmpty()) {
+        if (!m_idle) {
+            m_idle = true;
+            emit allFinished();
+        }
+    } else {
+        m_idle = false;
+    }
+}
+
+bool TransferQueue::canStart(const TransferJob &job) const
+{
+    if (m_heldHosts.contains(job.host)) {
+        return false;
+    }
+
+    if (isSmall(job)) {
+        return m_maxSmallPerHost <= 0 || m_runningSmallPerHost.value(job.host) < m_maxSmallPerHost;
+    }
+
+    if (m_maxConcurrent > 0 && m_running - m_runningSmall >= m_maxConcurrent) {
+        return false;
+    }
+    int limit = m_hostLimits.value(job.host, m_maxPerHost);
+    return limit <= 0 || m_runningPerHost.value(job.host) < limit;
+}
+
+bool TransferQueue::isSmall(const TransferJob &job) const
+{
+    return job.size >= 0 && job.size <= m_smallFileSize;
+}
+
+void TransferQueue::setStatus(int row, Status status)
+{
+    TransferJob &job = m_jobs[row];
+    if (job.status == status) {
+        return;
+    }
+
+    // Håll räknarna för pågående överföringar i takt med statusen; ett
+    // avbrutet jobb släpper sin plats först i reportFinished(). Små filer
+    // låses vid start, eftersom reportProgress() kan ändra storleken
+    if (status == Running && job.status != Running) {
+        job.small = isSmall(job);
+    }
+    if (job.status == Running) {
+        if (!job.aborting) {
+            releaseSlot(job);
+        }
+    } else if (status == Running) {
+        QHash<QString, int> &perHost = job.small ? m_runningSmallPerHost : m_runningPerHost;
+        ++m_running;
+        if (job.small) {
+            ++m_runningSmall;
+        }
+        ++perHost[job.host];
+        emit activeCountChanged();
+
+        job.bytesPerSecond = 0;
+        job.averageSpeed = 0;
+        job.secondsRemaining = -1;
+        job.stalled = false;
+        job.progressDirty = false;
+        job.speedHistory.clear();
+        m_sampling.insert(job.id);
+        if (!m_progressTimer.isActive()) {
+            m_progressTimer.start();
+        }
+    }
+
+    job.status = status;
+    if (m_journal && (status == Completed || status == Failed || status == Cancelled)) {
+        m_journal->recordFinished(job.id);
+    }
+    emitRowChanged(row);
+}
+
+void TransferQueue::releaseSlot(TransferJob &job)
+{
+    job.aborting = false;
+
+    QHash<QString, int> &perHost = job.small ? m_runningSmallPerHost : m_runningPerHost;
+    --m_running;
+    if (job.small) {
+        --m_runningSmall;
+    }
+    if (--perHost[job.host] <= 0) {
+        perHost.remove(job.host);
+    }
+    emit activeCountChanged();
+}
+
+void TransferQueue::emitRowChanged(int row)
+{
+    QModelIndex modelIndex = index(row);
+    emit dataChanged(modelIndex, modelIndex);
+}
+
+void TransferQueue::publishProgress()
+{
+    // Hinner inte arbetstråden med hoppas ställningen över; nästa tar igen den
+    if (m_statisticsPending) {
+        return;
+    }
+
+    QVector<TransferStatistics::Sample> samples;
+    samples.reserve(m_sampling.size());
+    for (auto it = m_sampling.begin(); it != m_sampling.end();) {
+        const int row = rowForId(*it);
+        if (row < 0 || m_jobs.at(row).status != Running) {
+            it = m_sampling.erase(it);
+            continue;
+        }
+        ++it;
+
+        const TransferJob &job = m_jobs.at(row);
+        TransferStatistics::Sample sample;
+        sample.jobId = job.id;
+        sample.bytesDone = job.transferred;
+        sample.bytesTotal = job.size;
+        samples.append(sample);
+    }
+
+    // En sista omgång utan jobb nollställer summorna
+    if (m_sampling.isEmpty()) {
+        m_progressTimer.stop();
+    }
+
+    m_statisticsPending = true;
+    const qint64 now = m_progressClock.elapsed();
+    QSharedPointer<StatisticsState> state = m_statistics;
+    m_statisticsPool->start(new FunctionTask([state, now, samples]() {
+        QMutexLocker locker(&state->mutex);
+        TransferQueue *owner = state->owner;
+        if (!owner) {
+            return;
+        }
+        const QVector<TransferStatistics::Result> results = state->statistics.update(now, samples);
+        QMetaObject::invokeMethod(owner, [owner, results]() {
+            owner->applyStatistics(results);
+        }, Qt::QueuedConnection);
+    }));
+}
+
+void TransferQueue::applyStatistics(const QVector<TransferStatistics::Result> &results)
+{
+    m_statisticsPending = false;
+
+    QVector<int> rows;
+    qint64 totalSpeed = 0;
+    qint64 totalDone = 0;
+    qint64 totalSize = 0;
+
+    for (const TransferStatistics::Result &result : results) {
+        const int row = rowForId(result.jobId);
+        // Jobbet kan ha blivit klart medan uträkningen pågick
+        if (row < 0 || m_jobs.at(row).status != Running) {
+            continue;
+        }
+
+        TransferJob &job = m_jobs[row];
+        if (job.progressDirty || result.historyChanged
+            || job.bytesPerSecond != result.currentSpeed
+            || job.secondsRemaining != result.secondsRemaining
+            || job.stalled != result.stalled) {
+            rows.append(row);
+        }
+        job.bytesPerSecond = result.currentSpeed;
+        job.averageSpeed = result.averageSpeed;
+        job.secondsRemaining = result.secondsRemaining;
+        job.stalled = result.stalled;
+        job.progressDirty = false;
+        if (result.historyChanged) {
+            job.speedHistory = result.history;
+        }
+
+        totalSpeed += job.bytesPerSecond;
+        if (job.size > 0) {
+            totalDone += qMin(job.transferred, job.size);
+            totalSize += job.size;
+        }
+    }
+
+    // En signal per sammanhängande intervall i stället för en per rad
+    static const QVector<int> roles = {
+        FileSizeRole, TransferProgressRole, TransferSpeedRole, TimeRemainingRole,
+        CurrentSpeedRole, AverageSpeedRole, SecondsRemainingRole, StalledRole, SpeedHistoryRole
+    };
+    std::sort(rows.begin(), rows.end());
+    for (int first = 0; first < rows.size();) {
+        int last = first;
+        while (last + 1 < rows.size() && rows.at(last + 1) == rows.at(last) + 1) {
+            ++last;
+        }
+        emit dataChanged(index(rows.at(first)), index(rows.at(last)), roles);
+        first = last + 1;
+    }
+
+    m_totalBytesPerSecond = totalSpeed;
+    m_remainingBytes = totalSize - totalDone;
+    m_overallProgress = totalSize > 0 ? double(totalDone) / double(totalSize) : 0.0;
+    emit progressUpdated();
+}
+
+void TransferQueue::rebuildIndex()
+{
+    m_rowById.clear();
+    m_rowById.reserve(m_jobs.size());
+    for (int row = 0; row < m_jobs.size(); ++row) {
+        m_rowById.insert(m_jobs.at(row).id, row);
+    }
+}
+
+int TransferQueue::rowForId(int jobId) const
+{
+    return m_rowById.value(jobId, -1);
+}
+
+void TransferQueue::journalEnqueued(const TransferJob &job)
+{
+    if (m_journal) {
+        m_journal->recordEnqueued(job.id, requestFor(job));
+    }
+}
+
+TransferRequest TransferQueue::requestFor(const TransferJob &job)
+{
+    TransferRequest request;
+    request.host = job.host;
+    request.isUpload = job.isUpload;
+    request.sourcePath = job.sourcePath;
+    request.targetPath = job.targetPath;
+    request.size = job.size;
+    request.priority = job.priority;
+    return request;
+}
@@ -0,0 +1,361 @@
+#ifndef TRANSFERQUEUE_H
+#define TRANSFERQUEUE_H
+
+#include <QAbstractListModel>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QList>
+#include <QMap>
+#include <QMutex>
+#include <QQueue>
+#include <QSet>
+#include <QSharedPointer>
+#include <QString>
+#include <QTimer>
+#include <QVector>
+#include "transferstatistics.h"
+
+class QThreadPool;
+class TransferJournal;
+
+// En överföring som ska läggas i kön
+struct TransferRequest {
+    QString host;           // Sessionen överföringen körs i, t.ex. "sftp://user@host:22"
+    bool isUpload = false;
+    QString sourcePath;
+    QString targetPath;
+    qint64 size = -1;       // -1 om storleken är okänd
+    int priority = 1;       // TransferQueue::Priority
+};
+
+/**
+ * @brief Central kö för alla filöverföringar
+ *
+ * Kön tar emot godtyckligt många jobb och startar dem i prioritetsordning
+ * med hänsyn till ett globalt tak och ett tak per värd. Själva överföringen
+ * görs av ägaren (FtpManager/SftpManager via MainWindow eller QML-sidan):
+ * kön skickar startTransfer() och ägaren rapporterar tillbaka med
+ * reportProgress() och reportFinished().
+ *
+ * Modellen exponerar samma roller som TransferPanel.qml använde i sin
+ * exempelmodell, så vyn kan binda direkt mot kön.
+ *
+ * Med setJournal() sparas kön på disk medan den ändras, så att jobb som
+ * inte hann bli klara före en krasch finns kvar vid nästa start.
+ *
+ * reportProgress() sparar bara räknarna. Vyn uppdateras i takt med
+ * progressInterval(), med en dataChanged() per sammanhängande radintervall
+ * och en progressUpdated() för hela kön, hur ofta överföringarna än
+ * rapporterar. Hastigheter, tid kvar och historik räknas ut av
+ * TransferStatistics i en arbetstråd.
+ */
+class TransferQueue : public QAbstractListModel
+{
+    Q_OBJECT
+    Q_PROPERTY(int count READ rowCount NOTIFY countChanged)
+    Q_PROPERTY(int activeCount READ activeCount NOTIFY activeCountChanged)
+    Q_PROPERTY(bool paused READ isPaused WRITE setPaused NOTIFY pausedChanged)
+    Q_PROPERTY(int maxConcurrent READ maxConcurrent WRITE setMaxConcurrent NOTIFY limitsChanged)
+    Q_PROPERTY(int maxPerHost READ maxPerHost WRITE setMaxPerHost NOTIFY limitsChanged)
+    Q_PROPERTY(int maxSmallPerHost READ maxSmallPerHost WRITE setMaxSmallPerHost NOTIFY limitsChanged)
+    Q_PROPERTY(int progressInterval READ progressInterval WRITE setProgressInterval NOTIFY limitsChanged)
+    Q_PROPERTY(double overallProgress READ overallProgress NOTIFY progressUpdated)
+    Q_PROPERTY(QString totalSpeed READ totalSpeed NOTIFY progressUpdated)
+    Q_PROPERTY(QString totalTimeRemaining READ totalTimeRemaining NOTIFY progressUpdated)
+
+public:
+    enum Status {
+        Queued,
+        Running,
+        Paused,
+        Completed,
+        Failed,
+        Cancelled
+    };
+    Q_ENUM(Status)
+
+    enum Priority {
+        LowPriority = 0,
+        NormalPriority = 1,
+        HighPriority = 2
+    };
+    Q_ENUM(Priority)
+
+    // Roller för att exponera data till QML
+    enum TransferRoles {
+        JobIdRole = Qt::UserRole + 1,
+        FileNameRole,
+        SourceFileRole,
+        TargetFileRole,
+        FileSizeRole,
+        TransferProgressRole,
+        TransferSpeedRole,
+        TimeRemainingRole,
+        IsUploadRole,
+        StatusRole,
+        StatusCodeRole,
+        PriorityRole,
+        HostRole,
+        ErrorStringRole,
+        CurrentSpeedRole,       // Byte per sekund, utjämnad
+        AverageSpeedRole,       // Byte per sekund sedan start
+        SecondsRemainingRole,   // -1 om okänt
+        StalledRole,
+        SpeedHistoryRole        // Hastighet per sekund, äldst först
+    };
+
+    explicit TransferQueue(QObject *parent = nullptr);
+    ~TransferQueue();
+
+    // === QAbstractListModel Overrides ===
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+    QHash<int, QByteArray> roleNames() const override;
+
+    /**
+     * @brief Lägg en överföring i kön
+     * @return Jobbets id
+     */
+    Q_INVOKABLE int enqueue(const QString &host, bool isUpload, const QString &sourcePath,
+                            const QString &targetPath, qint64 size = -1,
+                            int priority = NormalPriority);
+
+    /**
+     * @brief Lägg många överföringar i kön på en gång
+     *
+     * Modellen uppdateras med en enda radinsättning, vilket gör det billigt
+     * att köa tusentals filer från en markering eller drag och släpp.
+     * @return Jobbens id i samma ordning som requests
+     */
+    QList<int> enqueueBatch(const QList<TransferRequest> &requests);
+
+    // Styrning av enskilda jobb
+    Q_INVOKABLE void pause(int jobId);
+    Q_INVOKABLE void resume(int jobId);
+    Q_INVOKABLE void cancel(int jobId);
+    Q_INVOKABLE void retry(int jobId);
+    Q_INVOKABLE void setPriority(int jobId, int priority);
+
+    // Styrning av hela kön
+    Q_INVOKABLE void pauseAll();
+    Q_INVOKABLE void resumeAll();
+    Q_INVOKABLE void cancelAll();
+    Q_INVOKABLE void clearFinished();
+
+    int activeCount() const;
+    bool isPaused() const;
+    void setPaused(bool paused);
+
+    // Samtidighetstak för vanliga överföringar; 0 betyder obegränsat. Små
+    // filer räknas inte här, se maxSmallPerHost()
+    int maxConcurrent() const;
+    void setMaxConcurrent(int limit);
+    int maxPerHost() const;
+    void setMaxPerHost(int limit);
+    void setHostLimit(const QString &host, int limit);
+
+    /**
+     * @brief Håll inne jobben för en värd
+     *
+     * Köade jobb för värden startas inte förrän releaseHost() anropas, t.ex.
+     * medan sessionen är nedkopplad eller en annan session är aktiv. Jobben
+     * ligger kvar som köade, så journalen behåller dem.
+     */
+    void holdHost(const QString &host);
+    void releaseHost(const QString &host);
+
+    /**
+     * @brief Tak för små filer per värd
+     *
+     * Filer med känd storlek upp till smallFileSize() begränsas av rundresor
+     * snarare än bandbredd. De räknas därför mot ett eget, högre tak och
+     * tar inte plats från de vanliga överföringarna. maxConcurrent() och
+     * setHostLimit() gäller inte för dem; hanterarna kör dem över sessionens
+     * befintliga kanaler, så taket begränsar bara hur många förfrågningar
+     * som är ute samtidigt, inte antalet anslutningar. Små filer som köats
+     * efter en stor fil som väntar på en plats startas ändå.
+     */
+    int maxSmallPerHost() const;
+    void setMaxSmallPerHost(int limit);
+    qint64 smallFileSize() const;
+    void setSmallFileSize(qint64 size);
+
+    Status status(int jobId) const;
+
+    /**
+     * @brief Hur ofta framsteg publiceras till vyn, i millisekunder
+     */
+    int progressInterval() const;
+    void setProgressInterval(int msecs);
+
+    // Summor över pågående jobb, uppdaterade vid varje progressUpdated()
+    double overallProgress() const;         // 0-1 för jobb med känd storlek
+    qint64 totalBytesPerSecond() const;
+    QString totalSpeed() const;
+    QString totalTimeRemaining() const;
+
+    /**
+     * @brief Spara kön i en journal och återställ jobben som fanns där
+     *
+     * Jobb som inte blev klara förra gången läggs tillbaka som pausade,
+     * eftersom ingen session finns ännu; starta dem med resumeRestored()
+     * när värden är ansluten. De får samma id som i journalen, och nya jobb
+     * får id efter det högsta därifrån, så journalen går att fortsätta
+     * skriva i även om den inte kan skrivas om.
+     * @param journal Journalen; ägs av anroparen. nullptr kopplar loss den
+     * @return Antal återställda jobb
+     */
+    int setJournal(TransferJournal *journal);
+
+    /**
+     * @brief Starta återställda jobb för en värd
+     * @param host Sessionsnyckel, se TransferRequest::host
+     */
+    Q_INVOKABLE void resumeRestored(const QString &host);
+
+    /**
+     * @brief Skriv om journalen med bara de jobb som återstår
+     *
+     * Anropas vid normal avslutning så att journalen inte växer mellan körningar.
+     * @return false om journalen inte kunde skrivas om; den gamla gäller då
+     */
+    bool compactJournal();
+
+public slots:
+    /**
+     * @brief Rapportera framsteg för ett jobb som körs
+     * @param jobId Jobbets id
+     * @param bytesDone Antal överförda byte
+     * @param bytesTotal Totalt antal byte (-1 om okänt)
+     */
+    void reportProgress(int jobId, qint64 bytesDone, qint64 bytesTotal);
+
+    /**
+     * @brief Rapportera att ett jobb är klart
+     * @param jobId Jobbets id
+     * @param error true om överföringen misslyckades
+     * @param errorString Felbeskrivning
+     */
+    void reportFinished(int jobId, bool error, const QString &errorString = QString());
+
+    /**
+     * @brief Lägg tillbaka ett jobb som inte kunde köras klart
+     *
+     * För överföringar som bröts för att sessionen försvann, inte för att
+     * de misslyckades. Jobbet köas först för sin värd och behåller sina
+     * överförda byte; kombinera med holdHost() tills sessionen är tillbaka.
+     * @param jobId Jobbets id
+     */
+    void requeue(int jobId);
+
+signals:
+    /**
+     * @brief Ett jobb ska startas av ägaren
+     */
+    void startTransfer(int jobId, const QString &host, bool isUpload,
+                       const QString &sourcePath, const QString &targetPath);
+
+    /**
+     * @brief Ett jobb som körs ska avbrytas (paus eller avbryt)
+     *
+     * Jobbet behåller sin plats tills ägaren anropar reportFinished() för
+     * det, så att nya jobb inte startas medan överföringen tar slut.
+     */
+    void abortTransfer(int jobId);
+
+    void transferFinished(int jobId, bool error, const QString &errorString);
+    void allFinished();
+
+    /**
+     * @brief Framsteg och hastigheter har publicerats för alla pågående jobb
+     */
+    void progressUpdated();
+
+    void countChanged();
+    void activeCountChanged();
+    void pausedChanged();
+    void limitsChanged();
+
+private:
+    struct TransferJob {
+        int id = 0;
+        QString host;
+        bool isUpload = false;
+        QString sourcePath;
+        QString targetPath;
+        qint64 size = -1;
+        qint64 transferred = 0;
+        qint64 bytesPerSecond = 0;  // Utjämnad hastighet
+        qint64 averageSpeed = 0;
+        qint64 secondsRemaining = -1;
+        bool stalled = false;
+        bool progressDirty = false; // Har rapporterat sedan förra publiceringen
+        QVector<qint64> speedHistory;
+        int priority = NormalPriority;
+        Status status = Queued;
+        bool small = false;     // Räknas mot maxSmallPerHost() medan jobbet körs
+        bool restored = false;  // Återställt från journalen och ännu inte startat
+        bool aborting = false;  // Avbrutet men ägaren har inte rapporterat slutet
+        QString errorString;
+    };
+
+    void scheduleStart();
+    void startTransfers();
+    bool canStart(const TransferJob &job) const;
+    bool isSmall(const TransferJob &job) const;
+    void setStatus(int row, Status status);
+    void releaseSlot(TransferJob &job);
+    void emitRowChanged(int row);
+    void publishProgress();
+    void applyStatistics(const QVector<TransferStatistics::Result> &results);
+    void rebuildIndex();
+    int rowForId(int jobId) const;
+    void journalEnqueued(const TransferJob &job);
+    static TransferRequest requestFor(const TransferJob &job);
+
+    QVector<TransferJob> m_jobs;
+    QHash<int, int> m_rowById;
+
+    // Köade jobb-id per prioritet och värd; inaktuella id (pausade,
+    // avbrutna, flyttade till en annan prioritet) plockas bort först när
+    // de når köns början
+    QMap<int, QMap<QString, QQueue<int>>> m_waiting;
+
+    // Pågående jobb; små filer räknas separat, se maxSmallPerHost()
+    QHash<QString, int> m_runningPerHost;
+    QHash<QString, int> m_runningSmallPerHost;
+    QHash<QString, int> m_hostLimits;
+    QSet<QString> m_heldHosts;      // Se holdHost()
+    int m_running;
+    int m_runningSmall;
+    int m_maxConcurrent;
+    int m_maxPerHost;
+    int m_maxSmallPerHost;
+    qint64 m_smallFileSize;
+    bool m_paused;
+    bool m_startScheduled;
+    bool m_idle;
+    int m_nextId;
+    TransferJournal *m_journal;
+    QHash<int, QByteArray> m_roleNames;
+
+    // Delas med arbetsuppgiften, se TreeTransfer::WalkState
+    struct StatisticsState {
+        QMutex mutex;
+        TransferQueue *owner = nullptr;
+        TransferStatistics statistics;
+    };
+
+    // Pågående jobb vars framsteg publiceras av m_progressTimer
+    QSet<int> m_sampling;
+    QTimer m_progressTimer;
+    QElapsedTimer m_progressClock;
+    QThreadPool *m_statisticsPool;  // Egen tråd för publishProgress()
+    QSharedPointer<StatisticsState> m_statistics;
+    bool m_statisticsPending;   // Förra ställningen räknas fortfarande på
+    double m_overallProgress;
+    qint64 m_totalBytesPerSecond;
+    qint64 m_remainingBytes;
+};
+
+#endif // TRANSFERQUEUE_H
@@ -0,0 +1,141 @@
+#include "transferstatistics.h"
+#include <QtMath>
+
+// Hastigheten mäts över de senaste sekunderna och jämnas sedan ut
+const qint64 WINDOW_MS = 3000;
+const int WINDOW_CAPACITY = 64;
+const double SPEED_TIME_CONSTANT_MS = 1500.0;
+
+// Så länge utan nya byte innan ett jobb räknas som stillastående
+const qint64 STALL_MS = 5000;
+
+// En minut historik, ett värde per sekund
+const int HISTORY_SIZE = 60;
+const qint64 HISTORY_INTERVAL_MS = 1000;
+
+TransferStatistics::TransferStatistics()
+{
+}
+
+QVector<TransferStatistics::Result> TransferStatistics::update(qint64 now, const QVector<Sample> &samples)
+{
+    QVector<Result> results;
+    results.reserve(samples.size());
+
+    // Bara jobben i samples följer med till nästa gång
+    QHash<int, Track> tracks;
+    tracks.reserve(samples.size());
+
+    for (const Sample &sample : samples) {
+        Track track = m_tracks.take(sample.jobId);
+        Result result;
+        result.jobId = sample.jobId;
+
+        // Nytt jobb, eller ett som börjat om från början
+        if (track.windowTimes.isEmpty() || sample.bytesDone < track.lastBytes) {
+            track = Track();
+            track.startTime = now;
+            track.startBytes = sample.bytesDone;
+            track.lastBytes = sample.bytesDone;
+            track.lastProgress = now;
+            track.lastUpdate = now;
+            track.windowTimes.resize(WINDOW_CAPACITY);
+            track.windowBytes.resize(WINDOW_CAPACITY);
+            track.history.resize(HISTORY_SIZE);
+            track.nextHistory = now + HISTORY_INTERVAL_MS;
+        }
+
+        if (sample.bytesDone > track.lastBytes) {
+            track.lastProgress = now;
+        }
+        track.lastBytes = sample.bytesDone;
+        push(track, now, sample.bytesDone);
+
+        // Äldsta ställningen i fönstret är basen för hastigheten
+        const int base = track.windowHead;
+        const qint64 windowTime = now - track.windowTimes.at(base);
+        if (windowTime > 0) {
+            const double rate = double(sample.bytesDone - track.windowBytes.at(base)) * 1000.0 / windowTime;
+            if (!track.measured) {
+                track.speed = rate;
+                track.measured = true;
+            } else {
+                const double weight = 1.0 - qExp(-(now - track.lastUpdate) / SPEED_TIME_CONSTANT_MS);
+                track.speed += weight * (rate - track.speed);
+            }
+        }
+        track.lastUpdate = now;
+
+        result.stalled = now - track.lastProgress >= STALL_MS;
+        if (result.stalled) {
+            track.speed = 0.0;
+        }
+        result.currentSpeed = qRound64(track.speed);
+        if (now > track.startTime) {
+            result.averageSpeed = (sample.bytesDone - track.startBytes) * 1000 / (now - track.startTime);
+        }
+        if (sample.bytesTotal > 0 && result.currentSpeed > 0) {
+            const qint64 remaining = qMax<qint64>(0, sample.bytesTotal - sample.bytesDone);
+            result.secondsRemaining = (remaining + result.currentSpeed - 1) / result.currentSpeed;
+        }
+
+        // Efter ett långt uppehåll räcker det att fylla bufferten en gång
+        for (int i = 0; i < HISTORY_SIZE && now >= track.nextHistory; ++i) {
+            track.history[track.historyHead] = result.currentSpeed;
+            track.historyHead = (track.historyHead + 1) % HISTORY_SIZE;
+            track.historyCount = qMin(track.historyCount + 1, HISTORY_SIZE);
+            track.nextHistory += HISTORY_INTERVAL_MS;
+            result.historyChanged = true;
+        }
+        if (now >= track.nextHistory) {
+            track.nextHistory = now + HISTORY_INTERVAL_MS;
+        }
+        if (result.historyChanged) {
+            result.history = orderedHistory(track);
+        }
+
+        tracks.insert(sample.jobId, track);
+        results.append(result);
+    }
+
+    m_tracks.swap(tracks);
+    return results;
+}
+
+void TransferStatistics::clear()
+{
+    m_tracks.clear();
+}
+
+void TransferStatistics::push(Track &track, qint64 now, qint64 bytes)
+{
+    if (track.windowCount == WINDOW_CAPACITY) {
+        track.windowHead = (track.windowHead + 1) % WINDOW_CAPACITY;
+        --track.windowCount;
+    }
+    const int tail = (track.windowHead + track.windowCount) % WINDOW_CAPACITY;
+    track.windowTimes[tail] = now;
+    track.windowBytes[tail] = bytes;
+    ++track.windowCount;
+
+    // Behåll den nyaste ställningen som är minst ett fönster gammal som bas
+    while (track.windowCount > 1) {
+        const int next = (track.windowHead + 1) % WINDOW_CAPACITY;
+        if (now - track.windowTimes.at(next) < WINDOW_MS) {
+            break;
+        }
+        track.windowHead = next;
+        --track.windowCount;
+    }
+}
+
+QVector<qint64> TransferStatistics::orderedHistory(const Track &track)
+{
+    QVector<qint64> history;
+    history.reserve(track.historyCount);
+    const int first = (track.historyHead - track.historyCount + HISTORY_SIZE) % HISTORY_SIZE;
+    for (int i = 0; i < track.historyCount; ++i) {
+        history.append(track.history.at((first + i) % HISTORY_SIZE));
+    }
+    return history;
+}
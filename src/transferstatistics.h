@@ -0,0 +1,81 @@
+#ifndef TRANSFERSTATISTICS_H
+#define TRANSFERSTATISTICS_H
+
+#include <QHash>
+#include <QVector>
+
+/**
+ * @brief Hastighet, tid kvar och historik för pågående överföringar
+ *
+ * Matas med räknarställningar i jämn takt och räknar för varje jobb ut
+ * hastigheten över ett glidande fönster, utjämnad med ett exponentiellt
+ * medelvärde, medelhastigheten sedan start och tiden kvar. Ett jobb som
+ * inte kommit framåt på en stund markeras som stillastående. Hastigheten
+ * sparas också en gång per sekund i en ringbuffert, för ett litet diagram
+ * i vyn.
+ *
+ * Klassen har inget QObject och används av en tråd åt gången, se
+ * TransferQueue, som kör den utanför huvudtråden.
+ */
+class TransferStatistics
+{
+public:
+    // Räknarställning för ett jobb
+    struct Sample {
+        int jobId = 0;
+        qint64 bytesDone = 0;
+        qint64 bytesTotal = -1;     // -1 om storleken är okänd
+    };
+
+    struct Result {
+        int jobId = 0;
+        qint64 currentSpeed = 0;    // Utjämnad, byte per sekund
+        qint64 averageSpeed = 0;    // Sedan jobbet började mätas
+        qint64 secondsRemaining = -1;
+        bool stalled = false;
+        bool historyChanged = false;
+        QVector<qint64> history;    // Äldst först; bara satt när historyChanged
+    };
+
+    TransferStatistics();
+
+    /**
+     * @brief Uppdatera med nya räknarställningar
+     *
+     * Jobb som inte finns med i samples glöms bort.
+     * @param now Tidpunkt i millisekunder från en monoton klocka
+     * @return Ett resultat per sample, i samma ordning
+     */
+    QVector<Result> update(qint64 now, const QVector<Sample> &samples);
+
+    void clear();
+
+private:
+    // Ringbuffert med ställningar inom fönstret och hastigheter per sekund
+    struct Track {
+        qint64 startTime = 0;
+        qint64 startBytes = 0;
+        qint64 lastBytes = 0;
+        qint64 lastProgress = 0;    // När byte senast tillkom
+        qint64 lastUpdate = 0;
+        double speed = 0.0;
+        bool measured = false;
+
+        QVector<qint64> windowTimes;
+        QVector<qint64> windowBytes;
+        int windowHead = 0;         // Äldsta ställningen
+        int windowCount = 0;
+
+        QVector<qint64> history;
+        int historyHead = 0;        // Nästa plats att skriva
+        int historyCount = 0;
+        qint64 nextHistory = 0;     // När nästa värde ska sparas
+    };
+
+    static void push(Track &track, qint64 now, qint64 bytes);
+    static QVector<qint64> orderedHistory(const Track &track);
+
+    QHash<int, Track> m_tracks;
+};
+
+#endif // TRANSFERSTATISTICS_H
@@ -0,0 +1,351 @@
+#include "treetransfer.h"
+#include <QDir>
+#include <QDirIterator>
+#include <QMutexLocker>
+#include <QRunnable>
+#include <QThreadPool>
+#include <functional>
+
+// Standardantal samtidiga fjärrlistningar per träd
+const int DEFAULT_MAX_LISTINGS = 4;
+
+namespace {
+
+// QRunnable som kör en funktion; QRunnable::create() finns inte i äldre Qt5
+class FunctionTask : public QRunnable
+{
+public:
+    explicit FunctionTask(std::function<void()> function)
+        : m_function(std::move(function))
+    {
+    }
+
+    void run() override
+    {
+        m_function();
+    }
+
+private:
+    std::function<void()> m_function;
+};
+
+} // namespace
+
+TreeTransfer::TreeTransfer(TransferQueue *queue, const QString &host, QObject *parent)
+    : QObject(parent)
+    , m_queue(queue)
+    , m_host(host)
+    , m_upload(false)
+    , m_cancelled(false)
+    , m_finished(false)
+    , m_fileCount(0)
+    , m_directoryCount(0)
+    , m_pool(QThreadPool::globalInstance())
+    , m_state(new WalkState)
+    , m_pendingScans(0)
+    , m_maxListings(DEFAULT_MAX_LISTINGS)
+{
+    m_state->owner = this;
+}
+
+TreeTransfer::~TreeTransfer()
+{
+    // Uppgifter som fortfarande körs får inte skicka resultat hit
+    QMutexLocker locker(&m_state->mutex);
+    m_state->owner = nullptr;
+}
+
+void TreeTransfer::startUpload(const QString &localRoot, const QString &remoteRoot)
+{
+    m_upload = true;
+
+    // Fjärrroten skapas först; dess förälder antas redan finnas
+    const QString root = normalizePath(remoteRoot);
+    m_requestedDirs.insert(root);
+    emit createRemoteDirectory(root);
+
+    scanLocalDirectory(QDir::cleanPath(localRoot), root);
+}
+
+void TreeTransfer::startDownload(const QString &remoteRoot, const QString &localRoot)
+{
+    m_upload = false;
+
+    const QString local = QDir::cleanPath(localRoot);
+    QDir().mkpath(local);
+
+    ++m_directoryCount;
+    m_queuedListings.enqueue(qMakePair(normalizePath(remoteRoot), local));
+    startListings();
+}
+
+void TreeTransfer::cancel()
+{
+    if (m_finished) {
+        return;
+    }
+
+    m_cancelled = true;
+    {
+        QMutexLocker locker(&m_state->mutex);
+        m_state->owner = nullptr;
+    }
+
+    m_waitingFiles.clear();
+    m_waitingDirs.clear();
+    m_requestedDirs.clear();
+    m_queuedListings.clear();
+    m_activeListings.clear();
+    m_pendingScans = 0;
+    finish();
+}
+
+void TreeTransfer::setMaxConcurrentListings(int count)
+{
+    m_maxListings = qMax(1, count);
+    startListings();
+}
+
+bool TreeTransfer::isUpload() const
+{
+    return m_upload;
+}
+
+bool TreeTransfer::isFinished() const
+{
+    return m_finished;
+}
+
+int TreeTransfer::fileCount() const
+{
+    return m_fileCount;
+}
+
+int TreeTransfer::directoryCount() const
+{
+    return m_directoryCount;
+}
+
+void TreeTransfer::scanLocalDirectory(const QString &localDir, const QString &remoteDir)
+{
+    ++m_pendingScans;
+    ++m_directoryCount;
+
+    QSharedPointer<WalkState> state = m_state;
+    m_pool->start(new FunctionTask([state, localDir, remoteDir]() {
+        QList<QFileInfo> entries;
+        QString errorString;
+
+        if (!QFileInfo(localDir).isReadable()) {
+            errorString = QObject::tr("Kunde inte läsa katalog: %1").arg(localDir);
+        } else {
+            QDirIterator it(localDir, QDir::AllEntries | QDir::NoDotAndDotDot
+                                      | QDir::Hidden | QDir::System);
+            while (it.hasNext()) {
+                it.next();
+                entries.append(it.fileInfo());
+            }
+        }
+
+        // Resultatet hanteras i huvudtråden, där kön och signalerna finns
+        QMutexLocker locker(&state->mutex);
+        TreeTransfer *owner = state->owner;
+        if (owner) {
+            QMetaObject::invokeMethod(owner, [owner, localDir, remoteDir, entries, errorString]() {
+                owner->onLocalDirectoryScanned(localDir, remoteDir, entries, errorString);
+            }, Qt::QueuedConnection);
+        }
+    }));
+}
+
+void TreeTransfer::onLocalDirectoryScanned(const QString &localDir, const QString &remoteDir,
+                                           const QList<QFileInfo> &entries, const QString &errorString)
+{
+    if (m_cancelled) {
+        return;
+    }
+    --m_pendingScans;
+
+    if (!errorString.isEmpty()) {
+        emit walkError(localDir, errorString);
+    }
+
+    QList<TransferRequest> files;
+    for (const QFileInfo &entry : entries) {
+        const QString remotePath = joinPath(remoteDir, entry.fileName());
+
+        if (entry.isDir()) {
+            // Symboliska länkar till kataloger följs inte, de kan bilda slingor
+            if (entry.isSymLink()) {
+                continue;
+            }
+            requestRemoteDirectory(remotePath);
+            scanLocalDirectory(entry.filePath(), remotePath);
+        } else if (entry.isFile()) {
+            TransferRequest request;
+            request.host = m_host;
+            request.isUpload = true;
+            request.sourcePath = entry.filePath();
+            request.targetPath = remotePath;
+            request.size = entry.size();
+            files.append(request);
+        }
+    }
+
+    if (!files.isEmpty()) {
+        if (m_readyDirs.contains(remoteDir)) {
+            m_fileCount += files.size();
+            m_queue->enqueueBatch(files);
+        } else {
+            m_waitingFiles[remoteDir] += files;
+        }
+    }
+
+    checkFinished();
+}
+
+void TreeTransfer::requestRemoteDirectory(const QString &remoteDir)
+{
+    // En katalog skapas först när dess förälder finns på servern
+    int slash = remoteDir.lastIndexOf('/');
+    const QString parentDir = slash > 0 ? remoteDir.left(slash) : QString("/");
+
+    if (m_readyDirs.contains(parentDir)) {
+        m_requestedDirs.insert(remoteDir);
+        emit createRemoteDirectory(remoteDir);
+    } else {
+        m_waitingDirs[parentDir].append(remoteDir);
+    }
+}
+
+void TreeTransfer::onRemoteDirectoryReady(const QString &path)
+{
+    const QString dir = normalizePath(path);
+    if (!m_upload || m_cancelled || !m_requestedDirs.remove(dir)) {
+        return;
+    }
+
+    m_readyDirs.insert(dir);
+
+    const QList<TransferRequest> files = m_waitingFiles.take(dir);
+    if (!files.isEmpty()) {
+        m_fileCount += files.size();
+        m_queue->enqueueBatch(files);
+    }
+
+    const QStringList children = m_waitingDirs.take(dir);
+    for (const QString &child : children) {
+        m_requestedDirs.insert(child);
+        emit createRemoteDirectory(child);
+    }
+
+    checkFinished();
+}
+
+void TreeTransfer::startListings()
+{
+    while (!m_cancelled && m_activeListings.size() < m_maxListings && !m_queuedListings.isEmpty()) {
+        const QPair<QString, QString> listing = m_queuedListings.dequeue();
+        m_activeListings.insert(listing.first, listing.second);
+        emit listRemoteDirectory(listing.first);
+    }
+}
+
+void TreeTransfer::onRemoteListingChunk(const QString &path, const QList<ServerFileItem> &items)
+{
+    if (m_upload || m_cancelled) {
+        return;
+    }
+
+    const QString remoteDir = normalizePath(path);
+    auto it = m_activeListings.constFind(remoteDir);
+    if (it == m_activeListings.constEnd()) {
+        return;
+    }
+    const QString localDir = it.value();
+
+    // Filerna i blocket läggs i kön direkt, underkatalogerna listas efter hand
+    QList<TransferRequest> files;
+    for (const ServerFileItem &item : items) {
+        if (item.name() == "." || item.name() == "..") {
+            continue;
+        }
+
+        const QString remotePath = joinPath(remoteDir, item.name());
+        const QString localPath = QDir(localDir).filePath(item.name());
+
+        if (item.isDirectory()) {
+            QDir().mkpath(localPath);
+            ++m_directoryCount;
+            m_queuedListings.enqueue(qMakePair(remotePath, localPath));
+        } else {
+            TransferRequest request;
+            request.host = m_host;
+            request.isUpload = false;
+            request.sourcePath = remotePath;
+            request.targetPath = localPath;
+            request.size = item.size();
+            files.append(request);
+        }
+    }
+
+    if (!files.isEmpty()) {
+        m_fileCount += files.size();
+        m_queue->enqueueBatch(files);
+    }
+}
+
+void TreeTransfer::onRemoteListingFinished(const QString &path, bool error, const QString &errorString)
+{
+    if (m_upload || m_cancelled) {
+        return;
+    }
+
+    const QString remoteDir = normalizePath(path);
+    if (!m_activeListings.remove(remoteDir)) {
+        return;
+    }
+
+    if (error) {
+        emit walkError(remoteDir, errorString);
+    }
+
+    startListings();
+    checkFinished();
+}
+
+void TreeTransfer::checkFinished()
+{
+    const bool done = m_upload
+        ? m_pendingScans == 0 && m_requestedDirs.isEmpty()
+        : m_activeListings.isEmpty() && m_queuedListings.isEmpty();
+
+    if (done) {
+        finish();
+    }
+}
+
+void TreeTransfer::finish()
+{
+    if (m_finished) {
+        return;
+    }
+
+    m_finished = true;
+    emit finished(m_fileCount, m_directoryCount);
+}
+
+QString TreeTransfer::joinPath(const QString &dir, const QString &name)
+{
+    return dir.endsWith('/') ? dir + name : dir + '/' + name;
+}
+
+QString TreeTransfer::normalizePath(const QString &path)
+{
+    // Samma katalog ska alltid ge samma nyckel, oavsett avslutande snedstreck
+    QString normalized = QDir::cleanPath(path);
+    if (normalized.isEmpty()) {
+        normalized = "/";
+    }
+    return normalized;
+}
@@ -0,0 +1,167 @@
+#ifndef TREETRANSFER_H
+#define TREETRANSFER_H
+
+#include <QObject>
+#include <QFileInfo>
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QPair>
+#include <QQueue>
+#include <QSet>
+#include <QSharedPointer>
+#include <QString>
+#include "transferqueue.h"
+#include "../serverfileitem.h"
+
+class QThreadPool;
+
+/**
+ * @brief Rekursiv överföring av ett helt katalogträd
+ *
+ * Lokala träd gås igenom parallellt på en QThreadPool med en uppgift per
+ * katalog. Fjärrträd listas med flera samtidiga listningar. Filerna läggs i
+ * TransferQueue så fort de hittas, så överföringen kommer igång direkt i
+ * stället för att vänta på att hela trädet har lästs.
+ *
+ * Klassen pratar inte själv med FtpManager/SftpManager. Precis som
+ * TransferQueue begär den åtgärder med signaler (listRemoteDirectory(),
+ * createRemoteDirectory()) och ägaren rapporterar tillbaka med slotsen.
+ */
+class TreeTransfer : public QObject
+{
+    Q_OBJECT
+
+public:
+    /**
+     * @brief Skapa en trädöverföring
+     * @param queue Kön som filerna läggs i
+     * @param host Sessionsnyckel för kön, se TransferRequest::host
+     * @param parent Förälderobjekt
+     */
+    TreeTransfer(TransferQueue *queue, const QString &host, QObject *parent = nullptr);
+    ~TreeTransfer();
+
+    /**
+     * @brief Ladda upp en lokal katalog rekursivt
+     *
+     * Varje fjärrkatalog skapas innan filerna i den läggs i kön.
+     * @param localRoot Lokal katalog att ladda upp
+     * @param remoteRoot Fjärrkatalogen som motsvarar localRoot
+     */
+    void startUpload(const QString &localRoot, const QString &remoteRoot);
+
+    /**
+     * @brief Ladda ner en fjärrkatalog rekursivt
+     * @param remoteRoot Fjärrkatalog att ladda ner
+     * @param localRoot Lokal katalog som motsvarar remoteRoot
+     */
+    void startDownload(const QString &remoteRoot, const QString &localRoot);
+
+    /**
+     * @brief Sluta gå igenom trädet
+     *
+     * Filer som redan ligger i kön påverkas inte.
+     */
+    void cancel();
+
+    /**
+     * @brief Ställ in hur många fjärrlistningar som får pågå samtidigt
+     * @param count Antal listningar (minst 1)
+     */
+    void setMaxConcurrentListings(int count);
+
+    bool isUpload() const;
+    bool isFinished() const;
+    int fileCount() const;
+    int directoryCount() const;
+
+public slots:
+    /**
+     * @brief Poster från en pågående fjärrlistning
+     * @param path Katalogen som listas
+     * @param items Nya poster
+     */
+    void onRemoteListingChunk(const QString &path, const QList<ServerFileItem> &items);
+
+    /**
+     * @brief En fjärrlistning är klar
+     * @param path Katalogen som listades
+     * @param error true om listningen misslyckades
+     * @param errorString Felbeskrivning
+     */
+    void onRemoteListingFinished(const QString &path, bool error, const QString &errorString);
+
+    /**
+     * @brief En fjärrkatalog som begärts med createRemoteDirectory() finns nu
+     * @param path Fjärrkatalogen
+     */
+    void onRemoteDirectoryReady(const QString &path);
+
+signals:
+    /**
+     * @brief Ägaren ska lista en fjärrkatalog och rapportera tillbaka
+     */
+    void listRemoteDirectory(const QString &path);
+
+    /**
+     * @brief Ägaren ska skapa en fjärrkatalog (om den saknas) och rapportera tillbaka
+     */
+    void createRemoteDirectory(const QString &path);
+
+    /**
+     * @brief En katalog i trädet kunde inte läsas
+     */
+    void walkError(const QString &path, const QString &errorString);
+
+    /**
+     * @brief Hela trädet är genomgånget och alla filer ligger i kön
+     * @param files Antal filer som lades i kön
+     * @param directories Antal kataloger som hittades
+     */
+    void finished(int files, int directories);
+
+private:
+    // Delas med arbetsuppgifterna så att de kan se om överföringen har
+    // avbrutits eller raderats innan de skickar tillbaka sitt resultat
+    struct WalkState {
+        QMutex mutex;
+        TreeTransfer *owner = nullptr;
+    };
+
+    void scanLocalDirectory(const QString &localDir, const QString &remoteDir);
+    void onLocalDirectoryScanned(const QString &localDir, const QString &remoteDir,
+                                 const QList<QFileInfo> &entries, const QString &errorString);
+    void requestRemoteDirectory(const QString &remoteDir);
+    void startListings();
+    void checkFinished();
+    void finish();
+
+    static QString joinPath(const QString &dir, const QString &name);
+    static QString normalizePath(const QString &path);
+
+    TransferQueue *m_queue;
+    QString m_host;
+    bool m_upload;
+    bool m_cancelled;
+    bool m_finished;
+    int m_fileCount;
+    int m_directoryCount;
+
+    // Uppladdning: lokala kataloger som skannas just nu, fjärrkataloger
+    // som finns och filer/underkataloger som väntar på sin fjärrkatalog
+    QThreadPool *m_pool;
+    QSharedPointer<WalkState> m_state;
+    int m_pendingScans;
+    QSet<QString> m_readyDirs;
+    QSet<QString> m_requestedDirs;
+    QHash<QString, QList<TransferRequest>> m_waitingFiles;
+    QHash<QString, QStringList> m_waitingDirs;
+
+    // Nedladdning: fjärrkataloger som listas, och de som väntar på en plats
+    QHash<QString, QString> m_activeListings;   // fjärrkatalog -> lokal katalog
+    QQueue<QPair<QString, QString>> m_queuedListings;
+    int m_maxListings;
+};
+
+#endif // TREETRANSFER_H